@@ -0,0 +1,603 @@
+#include "actor_refs.hpp"
+
+#include "save_layout.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <sstream>
+
+namespace actor_refs {
+
+namespace {
+
+constexpr std::size_t kHeaderNameSize = 64;
+constexpr std::size_t kHeaderModelOff = 64;
+constexpr std::size_t kHeaderTypeOff = 128;
+constexpr std::size_t kHeaderPayloadSizeOff = 132;
+constexpr std::size_t kHeaderIdxOff = 136;
+constexpr std::size_t kAiNameSize = 32;
+constexpr std::uint32_t kMaxAiCount = 4096u;
+constexpr std::size_t kMaxChunkNameLen = 1024u;
+constexpr const char* kNoTarget = "<NONE>";
+
+// Accepts only NUL-terminated printable names so stray program-layout matches do not record garbage refs.
+bool ReadChunkName(const std::vector<std::uint8_t>& p, const save_layout::ActorRefChunk& chunk, std::string* out) {
+    if (chunk.nameLen < 2u) {
+        return false;
+    }
+    const std::size_t nameOff = chunk.offset + 8;
+    if (p[nameOff + chunk.nameLen - 1] != 0u) {
+        return false;
+    }
+    for (std::size_t i = 0; i + 1 < chunk.nameLen; ++i) {
+        const std::uint8_t b = p[nameOff + i];
+        if (b < 32u || b == 127u) {
+            return false;
+        }
+    }
+    out->assign(reinterpret_cast<const char*>(p.data() + nameOff), chunk.nameLen - 1);
+    return true;
+}
+
+bool IsActorHeader(const mafia_save::SaveData& save, std::size_t segIdx) {
+    return segIdx + 1 < save.segments.size() && save.segments[segIdx].name.rfind("actor_header_", 0) == 0 &&
+           save.segments[segIdx + 1].name.rfind("actor_payload_", 0) == 0 &&
+           save.segments[segIdx].plain.size() >= mafia_save::kActorHeaderSize;
+}
+
+struct Cursor {
+    const std::vector<std::uint8_t>& p;
+    std::size_t off = 0;
+    bool ok = true;
+
+    bool Need(std::size_t n) {
+        if (ok && off + n > p.size()) {
+            ok = false;
+        }
+        return ok;
+    }
+
+    std::uint32_t U32() {
+        if (!Need(4)) {
+            return 0;
+        }
+        const std::uint32_t v = mafia_save::ReadU32LE(p, off);
+        off += 4;
+        return v;
+    }
+
+    void Skip(std::size_t n) {
+        if (Need(n)) {
+            off += n;
+        }
+    }
+};
+
+ActorRef MakeFixedRef(RefKind kind, const std::vector<std::uint8_t>& p, std::size_t segIdx, std::size_t nameOff) {
+    ActorRef ref;
+    ref.kind = kind;
+    ref.segIdx = segIdx;
+    ref.offset = nameOff;
+    ref.fieldSize = kAiNameSize;
+    ref.name = mafia_save::ReadCStr(p, nameOff, kAiNameSize);
+    return ref;
+}
+
+// Reads one u32-counted list of ai_groups entries; namePos is the name offset inside each entry.
+bool ReadAiGroupList(Cursor* c,
+                     std::size_t segIdx,
+                     std::size_t entrySize,
+                     std::size_t namePos,
+                     std::vector<ActorRef>* out) {
+    const std::size_t countOff = c->off;
+    const std::uint32_t n = c->U32();
+    if (!c->ok || n > kMaxAiCount) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < n; ++i) {
+        const std::size_t entryOff = c->off;
+        c->Skip(entrySize);
+        if (!c->ok) {
+            return false;
+        }
+        ActorRef ref = MakeFixedRef(RefKind::kAiGroupEntry, c->p, segIdx, entryOff + namePos);
+        ref.entryOffset = entryOff;
+        ref.entrySize = entrySize;
+        ref.countOffset = countOff;
+        ref.tableIndex = i;
+        out->push_back(std::move(ref));
+    }
+    return true;
+}
+
+// ai_groups::Save: u32, u32 groups, per group {4 x u32, [u32 + name], [name], [name + u32]}, then [name].
+bool CollectAiGroups(const mafia_save::SaveData& save, std::vector<ActorRef>* out) {
+    const std::size_t segIdx = save.idxAiGroups;
+    Cursor c{save.segments[segIdx].plain};
+    c.U32();
+    const std::uint32_t groupCount = c.U32();
+    if (!c.ok || groupCount > kMaxAiCount) {
+        return false;
+    }
+    for (std::uint32_t g = 0; g < groupCount; ++g) {
+        c.Skip(16);
+        if (!ReadAiGroupList(&c, segIdx, 4 + kAiNameSize, 4, out) ||
+            !ReadAiGroupList(&c, segIdx, kAiNameSize, 0, out) ||
+            !ReadAiGroupList(&c, segIdx, kAiNameSize + 4, 0, out)) {
+            return false;
+        }
+    }
+    if (!ReadAiGroupList(&c, segIdx, kAiNameSize, 0, out)) {
+        return false;
+    }
+    return c.off == c.p.size();
+}
+
+// ai_follow_manager::Save: u32, u32 count, per entry {[name], 12 bytes, 5 x u32, leader name, target name}.
+bool CollectAiFollow(const mafia_save::SaveData& save, std::vector<ActorRef>* out) {
+    const std::size_t segIdx = save.idxAiFollow;
+    Cursor c{save.segments[segIdx].plain};
+    c.U32();
+    const std::uint32_t count = c.U32();
+    if (!c.ok || count > kMaxAiCount) {
+        return false;
+    }
+    for (std::uint32_t e = 0; e < count; ++e) {
+        const std::size_t countOff = c.off;
+        const std::uint32_t members = c.U32();
+        if (!c.ok || members > kMaxAiCount) {
+            return false;
+        }
+        for (std::uint32_t i = 0; i < members; ++i) {
+            const std::size_t nameOff = c.off;
+            c.Skip(kAiNameSize);
+            if (!c.ok) {
+                return false;
+            }
+            ActorRef ref = MakeFixedRef(RefKind::kAiFollowMember, c.p, segIdx, nameOff);
+            ref.entryOffset = nameOff;
+            ref.entrySize = kAiNameSize;
+            ref.countOffset = countOff;
+            ref.tableIndex = i;
+            out->push_back(std::move(ref));
+        }
+        c.Skip(12 + 5 * 4);
+        const std::size_t leaderOff = c.off;
+        c.Skip(kAiNameSize);
+        const std::size_t targetOff = c.off;
+        c.Skip(kAiNameSize);
+        if (!c.ok) {
+            return false;
+        }
+        ActorRef leader = MakeFixedRef(RefKind::kAiFollowLeader, c.p, segIdx, leaderOff);
+        leader.tableIndex = e;
+        out->push_back(std::move(leader));
+        ActorRef target = MakeFixedRef(RefKind::kAiFollowTarget, c.p, segIdx, targetOff);
+        target.tableIndex = e;
+        if (target.name != kNoTarget) {
+            out->push_back(std::move(target));
+        }
+    }
+    return c.off == c.p.size();
+}
+
+void CollectChunkRef(const mafia_save::SaveData& save,
+                     RefKind kind,
+                     std::size_t segIdx,
+                     const save_layout::ActorRefChunk& chunk,
+                     std::uint32_t tableIndex,
+                     std::vector<ActorRef>* out) {
+    ActorRef ref;
+    if (!ReadChunkName(save.segments[segIdx].plain, chunk, &ref.name)) {
+        return;
+    }
+    ref.kind = kind;
+    ref.segIdx = segIdx;
+    ref.offset = chunk.offset;
+    ref.tableIndex = tableIndex;
+    out->push_back(std::move(ref));
+}
+
+struct Edit {
+    std::size_t offset = 0;
+    std::size_t removeLen = 0;
+    std::vector<std::uint8_t> bytes;
+};
+
+std::vector<std::uint8_t> FixedNameBytes(const std::string& name, std::size_t fieldSize) {
+    std::vector<std::uint8_t> out(fieldSize, 0u);
+    std::copy(name.begin(), name.end(), out.begin());
+    return out;
+}
+
+std::vector<std::uint8_t> ChunkBytes(const std::string& name, std::uint32_t actorType) {
+    const std::uint32_t nameLen = name.empty() ? 0u : static_cast<std::uint32_t>(name.size() + 1);
+    std::vector<std::uint8_t> out(8 + nameLen, 0u);
+    mafia_save::WriteU32LE(&out, 0, nameLen);
+    mafia_save::WriteU32LE(&out, 4, actorType);
+    std::copy(name.begin(), name.end(), out.begin() + 8);
+    return out;
+}
+
+std::size_t ChunkSize(const std::vector<std::uint8_t>& p, std::size_t off) {
+    return 8 + static_cast<std::size_t>(mafia_save::ReadU32LE(p, off));
+}
+
+// Writes the new size of a resized segment into the field the loader reads it from.
+void UpdateSizeField(mafia_save::SaveData* save, std::size_t segIdx) {
+    const auto size = static_cast<std::uint32_t>(save->segments[segIdx].plain.size());
+    if (segIdx == save->idxGamePayload || segIdx == save->idxAiGroups || segIdx == save->idxAiFollow) {
+        const std::size_t off = segIdx == save->idxGamePayload ? 32 : (segIdx == save->idxAiGroups ? 240 : 244);
+        mafia_save::WriteU32LE(&save->segments[save->idxInfo].plain, off, size);
+        return;
+    }
+    if (segIdx > 0 && IsActorHeader(*save, segIdx - 1)) {
+        mafia_save::WriteU32LE(&save->segments[segIdx - 1].plain, kHeaderPayloadSizeOff, size);
+    }
+}
+
+// Applies all edits with one forward copy per touched segment; edits must not overlap.
+bool ApplyEdits(mafia_save::SaveData* save, std::map<std::size_t, std::vector<Edit>>* edits, std::string* error) {
+    for (auto& [segIdx, list] : *edits) {
+        std::sort(list.begin(), list.end(), [](const Edit& a, const Edit& b) { return a.offset < b.offset; });
+        const auto& src = save->segments[segIdx].plain;
+        std::size_t prevEnd = 0;
+        for (const auto& e : list) {
+            if (e.offset < prevEnd || e.offset + e.removeLen > src.size()) {
+                if (error != nullptr) {
+                    std::ostringstream oss;
+                    oss << "overlapping reference edits in segment " << save->segments[segIdx].name << " at offset "
+                        << e.offset;
+                    *error = oss.str();
+                }
+                return false;
+            }
+            prevEnd = e.offset + e.removeLen;
+        }
+    }
+
+    for (auto& [segIdx, list] : *edits) {
+        auto& src = save->segments[segIdx].plain;
+        std::vector<std::uint8_t> dst;
+        std::size_t newSize = src.size();
+        for (const auto& e : list) {
+            newSize = newSize - e.removeLen + e.bytes.size();
+        }
+        dst.reserve(newSize);
+        std::size_t cur = 0;
+        for (const auto& e : list) {
+            dst.insert(dst.end(), src.begin() + static_cast<std::ptrdiff_t>(cur),
+                       src.begin() + static_cast<std::ptrdiff_t>(e.offset));
+            dst.insert(dst.end(), e.bytes.begin(), e.bytes.end());
+            cur = e.offset + e.removeLen;
+        }
+        dst.insert(dst.end(), src.begin() + static_cast<std::ptrdiff_t>(cur), src.end());
+        const bool resized = dst.size() != src.size();
+        src = std::move(dst);
+        if (resized) {
+            UpdateSizeField(save, segIdx);
+        }
+    }
+    return true;
+}
+
+void RecomputeRawSize(mafia_save::SaveData* save) {
+    std::size_t total = mafia_save::kFileHeaderSize;
+    for (const auto& seg : save->segments) {
+        total += seg.plain.size();
+    }
+    save->rawSize = total;
+}
+
+const std::vector<std::size_t>* FindRefs(const ActorGraph& graph, const std::string& name) {
+    const auto it = graph.byName.find(name);
+    return it == graph.byName.end() ? nullptr : &it->second;
+}
+
+void SetNoActor(std::string* error, const std::string& name) {
+    if (error != nullptr) {
+        *error = "no references to actor '" + name + "'";
+    }
+}
+
+}  // namespace
+
+const char* RefKindName(RefKind kind) {
+    switch (kind) {
+        case RefKind::kHeaderName:
+            return "header";
+        case RefKind::kUsedActor:
+            return "used_actor";
+        case RefKind::kProgramActor:
+            return "program_actor";
+        case RefKind::kAiGroupEntry:
+            return "ai_group";
+        case RefKind::kAiFollowMember:
+            return "ai_follow_member";
+        case RefKind::kAiFollowLeader:
+            return "ai_follow_leader";
+        case RefKind::kAiFollowTarget:
+            return "ai_follow_target";
+    }
+    return "unknown";
+}
+
+bool BuildActorGraph(const mafia_save::SaveData& save, ActorGraph* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output actor graph";
+        }
+        return false;
+    }
+
+    ActorGraph graph;
+    std::vector<ActorRef> refs;
+    for (std::size_t segIdx = 0; segIdx < save.segments.size(); ++segIdx) {
+        if (!IsActorHeader(save, segIdx)) {
+            continue;
+        }
+        const auto& h = save.segments[segIdx].plain;
+        ActorNode node;
+        node.name = mafia_save::ReadCStr(h, 0, kHeaderNameSize);
+        node.model = mafia_save::ReadCStr(h, kHeaderModelOff, kHeaderNameSize);
+        node.type = mafia_save::ReadU32LE(h, kHeaderTypeOff);
+        node.slotIdx = mafia_save::ReadU32LE(h, kHeaderIdxOff);
+        node.headerSegIdx = segIdx;
+        node.payloadSegIdx = segIdx + 1;
+
+        ActorRef ref;
+        ref.kind = RefKind::kHeaderName;
+        ref.name = node.name;
+        ref.segIdx = segIdx;
+        ref.offset = 0;
+        ref.fieldSize = kHeaderNameSize;
+        ref.tableIndex = static_cast<std::uint32_t>(graph.actors.size());
+        refs.push_back(std::move(ref));
+
+        const auto& p = save.segments[node.payloadSegIdx].plain;
+        save_layout::ActorRefChunk used[2];
+        if (save_layout::IsHumanPayload(p) && save_layout::ReadHumanUsedActorChunks(p, &used[0], &used[1])) {
+            for (std::uint32_t i = 0; i < 2; ++i) {
+                CollectChunkRef(save, RefKind::kUsedActor, node.payloadSegIdx, used[i], i, &refs);
+            }
+        }
+        graph.actors.push_back(std::move(node));
+    }
+
+    for (std::size_t segIdx = 0; segIdx < save.segments.size(); ++segIdx) {
+        if (!save_layout::IsProgramCandidateSegment(save, segIdx)) {
+            continue;
+        }
+        const auto& p = save.segments[segIdx].plain;
+        const auto layout = save_layout::DetectProgramLayout(p);
+        save_layout::ProgramTables tables;
+        if (!layout.has_value() || !save_layout::ReadProgramTables(p, *layout, &tables)) {
+            continue;
+        }
+        for (std::size_t i = 0; i < tables.actors.size(); ++i) {
+            CollectChunkRef(save, RefKind::kProgramActor, segIdx, tables.actors[i], static_cast<std::uint32_t>(i), &refs);
+        }
+    }
+
+    if (save.idxAiGroups != mafia_save::kNoIndex) {
+        std::vector<ActorRef> aiRefs;
+        if (CollectAiGroups(save, &aiRefs)) {
+            refs.insert(refs.end(), aiRefs.begin(), aiRefs.end());
+        } else {
+            graph.warnings.push_back("ai_groups_payload layout not recognized; its names are not tracked");
+        }
+    }
+    if (save.idxAiFollow != mafia_save::kNoIndex) {
+        std::vector<ActorRef> aiRefs;
+        if (CollectAiFollow(save, &aiRefs)) {
+            refs.insert(refs.end(), aiRefs.begin(), aiRefs.end());
+        } else {
+            graph.warnings.push_back("ai_follow_payload layout not recognized; its names are not tracked");
+        }
+    }
+
+    refs.erase(std::remove_if(refs.begin(), refs.end(), [](const ActorRef& r) { return r.name.empty(); }),
+               refs.end());
+    // A program-table match may coincide with a human used-actor chunk; keep the first record per position.
+    std::sort(refs.begin(), refs.end(), [](const ActorRef& a, const ActorRef& b) {
+        return a.segIdx != b.segIdx ? a.segIdx < b.segIdx : a.offset < b.offset;
+    });
+    refs.erase(std::unique(refs.begin(), refs.end(),
+                           [](const ActorRef& a, const ActorRef& b) {
+                               return a.segIdx == b.segIdx && a.offset == b.offset;
+                           }),
+               refs.end());
+
+    graph.refs = std::move(refs);
+    for (std::size_t i = 0; i < graph.refs.size(); ++i) {
+        graph.byName[graph.refs[i].name].push_back(i);
+    }
+
+    *out = std::move(graph);
+    return true;
+}
+
+bool RenameActor(mafia_save::SaveData* save,
+                 const ActorGraph& graph,
+                 const std::string& oldName,
+                 const std::string& newName,
+                 std::size_t* outChanged,
+                 std::string* error) {
+    if (save == nullptr) {
+        if (error != nullptr) {
+            *error = "null save";
+        }
+        return false;
+    }
+    const auto* list = FindRefs(graph, oldName);
+    if (list == nullptr) {
+        SetNoActor(error, oldName);
+        return false;
+    }
+    if (newName.empty() || newName == oldName) {
+        if (error != nullptr) {
+            *error = "new actor name must be non-empty and differ from the old one";
+        }
+        return false;
+    }
+    if (FindRefs(graph, newName) != nullptr) {
+        if (error != nullptr) {
+            *error = "actor name '" + newName + "' is already in use";
+        }
+        return false;
+    }
+
+    std::map<std::size_t, std::vector<Edit>> edits;
+    for (std::size_t refIdx : *list) {
+        const ActorRef& ref = graph.refs[refIdx];
+        const auto& p = save->segments[ref.segIdx].plain;
+        Edit e;
+        e.offset = ref.offset;
+        if (ref.fieldSize != 0) {
+            if (newName.size() + 1 > ref.fieldSize) {
+                if (error != nullptr) {
+                    std::ostringstream oss;
+                    oss << "new name does not fit the " << ref.fieldSize << "-byte " << RefKindName(ref.kind)
+                        << " field";
+                    *error = oss.str();
+                }
+                return false;
+            }
+            e.removeLen = ref.fieldSize;
+            e.bytes = FixedNameBytes(newName, ref.fieldSize);
+        } else {
+            if (newName.size() + 1 > kMaxChunkNameLen) {
+                if (error != nullptr) {
+                    *error = "new name is too long for an actor reference chunk";
+                }
+                return false;
+            }
+            e.removeLen = ChunkSize(p, ref.offset);
+            e.bytes = ChunkBytes(newName, mafia_save::ReadU32LE(p, ref.offset + 4));
+        }
+        edits[ref.segIdx].push_back(std::move(e));
+    }
+
+    if (!ApplyEdits(save, &edits, error)) {
+        return false;
+    }
+    RecomputeRawSize(save);
+    if (outChanged != nullptr) {
+        *outChanged = list->size();
+    }
+    return true;
+}
+
+bool RemoveActor(mafia_save::SaveData* save,
+                 const ActorGraph& graph,
+                 const std::string& name,
+                 std::size_t* outChanged,
+                 std::string* error) {
+    if (save == nullptr) {
+        if (error != nullptr) {
+            *error = "null save";
+        }
+        return false;
+    }
+    const auto* list = FindRefs(graph, name);
+    if (list == nullptr) {
+        SetNoActor(error, name);
+        return false;
+    }
+
+    std::size_t headerSegIdx = mafia_save::kNoIndex;
+    for (std::size_t refIdx : *list) {
+        const ActorRef& ref = graph.refs[refIdx];
+        if (ref.kind == RefKind::kAiFollowLeader) {
+            if (error != nullptr) {
+                std::ostringstream oss;
+                oss << "actor '" << name << "' leads ai_follow entry " << ref.tableIndex
+                    << "; remove or rename it instead";
+                *error = oss.str();
+            }
+            return false;
+        }
+        if (ref.kind == RefKind::kHeaderName) {
+            if (headerSegIdx != mafia_save::kNoIndex) {
+                if (error != nullptr) {
+                    *error = "actor name '" + name + "' is not unique";
+                }
+                return false;
+            }
+            headerSegIdx = ref.segIdx;
+        }
+    }
+
+    std::map<std::size_t, std::vector<Edit>> edits;
+    std::map<std::pair<std::size_t, std::size_t>, std::uint32_t> droppedPerList;
+    for (std::size_t refIdx : *list) {
+        const ActorRef& ref = graph.refs[refIdx];
+        if (ref.kind == RefKind::kHeaderName ||
+            (headerSegIdx != mafia_save::kNoIndex && ref.segIdx == headerSegIdx + 1)) {
+            continue;
+        }
+        const auto& p = save->segments[ref.segIdx].plain;
+        Edit e;
+        if (ref.entrySize != 0) {
+            e.offset = ref.entryOffset;
+            e.removeLen = ref.entrySize;
+            ++droppedPerList[{ref.segIdx, ref.countOffset}];
+        } else if (ref.fieldSize != 0) {
+            e.offset = ref.offset;
+            e.removeLen = ref.fieldSize;
+            e.bytes = FixedNameBytes(kNoTarget, ref.fieldSize);
+        } else {
+            e.offset = ref.offset;
+            e.removeLen = ChunkSize(p, ref.offset);
+            e.bytes = ChunkBytes(std::string(), 0u);
+        }
+        edits[ref.segIdx].push_back(std::move(e));
+    }
+    for (const auto& [where, dropped] : droppedPerList) {
+        const auto& p = save->segments[where.first].plain;
+        Edit e;
+        e.offset = where.second;
+        e.removeLen = 4;
+        e.bytes.resize(4);
+        mafia_save::WriteU32LE(&e.bytes, 0, mafia_save::ReadU32LE(p, where.second) - dropped);
+        edits[where.first].push_back(std::move(e));
+    }
+
+    if (!ApplyEdits(save, &edits, error)) {
+        return false;
+    }
+
+    if (headerSegIdx != mafia_save::kNoIndex) {
+        auto first = save->segments.begin() + static_cast<std::ptrdiff_t>(headerSegIdx);
+        save->segments.erase(first, first + 2);
+        if (save->actorCount > 0) {
+            --save->actorCount;
+        }
+        // Renumber the loader-assigned actor_header_N / actor_payload_N names; clones keep theirs.
+        std::size_t actorIndex = 0;
+        for (std::size_t i = 0; i < save->segments.size(); ++i) {
+            auto& seg = save->segments[i];
+            if (!IsActorHeader(*save, i)) {
+                continue;
+            }
+            const std::string suffix = seg.name.substr(std::string("actor_header_").size());
+            const bool numbered = !suffix.empty() && std::all_of(suffix.begin(), suffix.end(), [](char ch) {
+                return std::isdigit(static_cast<unsigned char>(ch)) != 0;
+            });
+            if (numbered) {
+                seg.name = "actor_header_" + std::to_string(actorIndex);
+                save->segments[i + 1].name = "actor_payload_" + std::to_string(actorIndex);
+            }
+            ++actorIndex;
+        }
+    }
+
+    RecomputeRawSize(save);
+    if (outChanged != nullptr) {
+        *outChanged = list->size();
+    }
+    return true;
+}
+
+}  // namespace actor_refs
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace actor_refs {
+
+enum class RefKind {
+    kHeaderName,     // actor_header_N name field (64 bytes)
+    kUsedActor,      // C_human m_pUsedActor / m_pUsedActor2 chunk (length-prefixed)
+    kProgramActor,   // C_program actor table chunk (length-prefixed, scripts address it by index)
+    kAiGroupEntry,   // ai_groups list entry name (32 bytes)
+    kAiFollowMember, // ai_follow member list name (32 bytes)
+    kAiFollowLeader, // ai_follow leader name (32 bytes, entry cannot exist without it)
+    kAiFollowTarget, // ai_follow target name (32 bytes, "<NONE>" when empty)
+};
+
+const char* RefKindName(RefKind kind);
+
+struct ActorRef {
+    RefKind kind = RefKind::kHeaderName;
+    std::string name;
+    std::size_t segIdx = mafia_save::kNoIndex;
+    std::size_t offset = 0;           // fixed name field, or chunk start for length-prefixed refs
+    std::size_t fieldSize = 0;        // fixed field width incl. NUL; 0 for length-prefixed chunks
+    std::size_t entryOffset = 0;      // enclosing list entry (droppable refs only)
+    std::size_t entrySize = 0;        // 0 when the entry cannot be dropped
+    std::size_t countOffset = 0;      // u32 element count of the enclosing list
+    std::uint32_t tableIndex = 0;     // position inside the owning table/list
+};
+
+struct ActorNode {
+    std::string name;
+    std::string model;
+    std::uint32_t type = 0;
+    std::uint32_t slotIdx = 0xFFFFFFFFu;
+    std::size_t headerSegIdx = mafia_save::kNoIndex;
+    std::size_t payloadSegIdx = mafia_save::kNoIndex;
+};
+
+struct ActorGraph {
+    std::vector<ActorNode> actors;
+    std::vector<ActorRef> refs;
+    // name -> indices into refs, in save order.
+    std::unordered_map<std::string, std::vector<std::size_t>> byName;
+    std::vector<std::string> warnings;
+};
+
+bool BuildActorGraph(const mafia_save::SaveData& save, ActorGraph* out, std::string* error = nullptr);
+
+// Both edits walk the recorded positions once, rebuild only the touched segments and fix
+// the dependent size fields (actor header +132, info +32/+240/+244) and rawSize.
+bool RenameActor(mafia_save::SaveData* save,
+                 const ActorGraph& graph,
+                 const std::string& oldName,
+                 const std::string& newName,
+                 std::size_t* outChanged = nullptr,
+                 std::string* error = nullptr);
+
+// Drops the actor segments, nulls length-prefixed refs (keeping table indices stable),
+// removes AI list entries and resets AI follow targets to "<NONE>".
+bool RemoveActor(mafia_save::SaveData* save,
+                 const ActorGraph& graph,
+                 const std::string& name,
+                 std::size_t* outChanged = nullptr,
+                 std::string* error = nullptr);
+
+}  // namespace actor_refs
@@ -0,0 +1,26 @@
+# Compact batch 005: XOR single plaintext bytes and re-encrypt the whole stream (no stream desync).
+base = savegame/mafia004.230
+output = out/batch005
+name = {base}_{n}
+start = 22
+notes = RESULTS_SERIES_005_plan.txt
+title = Compact batch 005 (3 tests, encrypted stream-aware edits)
+intro = Generation method: decrypt -> edit plaintext -> re-encrypt full stream
+outro = What to report:
+outro = 1) menu title/image/stats
+outro = 2) load progress stage (percent)
+outro = 3) whether mission starts, and if yes, where/with what behavior
+
+[variant]
+label = control roundtrip, no plaintext edits
+detail = Purpose: verify parser/encrypter stability (should behave exactly like base save).
+
+[variant]
+label = XOR plaintext byte at absolute file offset {off} with {val}
+detail = Purpose: compare with old _20 result, but now without stream desync.
+xor file+0x400 = 0x01
+
+[variant]
+label = XOR plaintext byte at absolute file offset {off} with {val}
+detail = Purpose: compare with old _21 result, but now without stream desync.
+xor file+0x800 = 0x01
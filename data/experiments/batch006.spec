@@ -0,0 +1,25 @@
+# Compact batch 006: actor matching by name (SaveProc/SaveGameLoad).
+base = savegame/mafia004.230
+output = out/batch006
+name = {base}_{n}
+start = 25
+notes = RESULTS_SERIES_006_plan.txt
+title = Compact batch 006 (actor-header mapping tests)
+intro = Based on recovered SaveProc/SaveGameLoad actor mapping by actor name.
+outro = What to report:
+outro = 1) menu title/image/stats
+outro = 2) load progress stage
+outro = 3) whether mission starts, and if yes, any broken scripts/softlock/fail state
+
+[variant]
+label = control copy of base
+
+[variant]
+label = actor_header_0 name first byte set to {val}
+detail = Absolute offset: {off}
+set actor_header_0+0 = 0x00
+
+[variant]
+label = actor_header_1 name first byte set to {val}
+detail = Absolute offset: {off}
+set actor_header_1+0 = 0x00
@@ -0,0 +1,30 @@
+# Compact batch 007: Tommy (actor_header_1) header field isolation.
+base = savegame/mafia004.230
+output = out/batch007
+name = {base}_{n}
+start = 28
+notes = RESULTS_SERIES_007_plan.txt
+title = Compact batch 007 (Tommy header field isolation)
+intro = actor_header_1 base offset: {@actor_header_1+0}
+outro = What to report:
+outro = 1) menu title/image/stats
+outro = 2) load progress stage
+outro = 3) mission start/fail/softlock details
+
+[variant]
+label = actor_header_1 model first byte -> {val}
+detail = Offset: {off}
+detail = Hypothesis: model name is less critical than actor name for matching.
+set actor_header_1+64 = 0x00
+
+[variant]
+label = actor_header_1 type 2 -> {val}
+detail = Offset: {off}
+detail = Hypothesis: wrong actor type should change load/apply path strongly.
+set actor_header_1+128:u32 = 4
+
+[variant]
+label = actor_header_1 idx 0xFFFFFFFF -> {val}
+detail = Offset: {off}
+detail = Hypothesis: Tommy may be written into car slot table, causing script/state anomalies.
+set actor_header_1+136:u32 = 0
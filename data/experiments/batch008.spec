@@ -0,0 +1,30 @@
+# Compact batch 008: Tommy strict-field tests (name, type, model).
+base = savegame/mafia004.230
+output = out/batch008
+name = {base}_{n}
+start = 31
+notes = RESULTS_SERIES_008_plan.txt
+title = Compact batch 008 (Tommy strict-field tests)
+intro = actor_header_1 base offset: {@actor_header_1+0}
+outro = What to report:
+outro = 1) menu title/image/stats
+outro = 2) mission behavior on start
+outro = 3) player body visibility, controls, fail/restart behavior
+
+[variant]
+label = Tommy name -> {val}
+detail = Offset: {off}
+detail = Hypothesis: even one-char mismatch should break actor matching like _27.
+set actor_header_1+0:str64 = "Jommy"
+
+[variant]
+label = Tommy type 2 -> {val}
+detail = Offset: {off}
+detail = Hypothesis: type 27 may behave closer to human/player than type 4.
+set actor_header_1+128:u32 = 27
+
+[variant]
+label = Tommy model -> {val}
+detail = Offset: {off}
+detail = Hypothesis: valid non-empty model should avoid invisibility from _28.
+set actor_header_1+64:str64 = "Tommy.i3d"
@@ -203,37 +203,49 @@ std::map<std::uint16_t, MissionWord34> BuildMissionWord34Table(const fs::path& d
         if (!ParseSaveFileMeta(entry.path(), &meta)) {
             continue;
         }
+        AddMissionWord34Source(entry.path(), ReadFileBytes(entry.path()), &table);
+    }
+    return table;
+}
 
-        const auto bytes = ReadFileBytes(entry.path());
-        Header h;
-        if (!ReadHeader(bytes, &h)) {
-            continue;
-        }
+void AddMissionWord34Source(const fs::path& path,
+                            const std::vector<std::uint8_t>& headerBytes,
+                            std::map<std::uint16_t, MissionWord34>* table) {
+    if (table == nullptr) {
+        return;
+    }
+    SaveFileMeta meta;
+    if (!ParseSaveFileMeta(path, &meta)) {
+        return;
+    }
 
-        std::string checkError;
-        if (!ValidateMissionChecks(h, &checkError)) {
-            continue;
-        }
+    Header h;
+    if (!ReadHeader(headerBytes, &h)) {
+        return;
+    }
 
-        const std::uint16_t mission = DecodeMission(h);
-        if (meta.slot != static_cast<int>(mission)) {
-            continue;
-        }
+    std::string checkError;
+    if (!ValidateMissionChecks(h, &checkError)) {
+        return;
+    }
 
-        auto& rec = table[mission];
-        if (rec.sourceCount == 0) {
-            rec.d3 = h.d3;
-            rec.d4 = h.d4;
-            rec.sourceCount = 1;
-            continue;
-        }
+    const std::uint16_t mission = DecodeMission(h);
+    if (meta.slot != static_cast<int>(mission)) {
+        return;
+    }
 
-        if (rec.d3 != h.d3 || rec.d4 != h.d4) {
-            rec.conflict = true;
-        }
-        ++rec.sourceCount;
+    auto& rec = (*table)[mission];
+    if (rec.sourceCount == 0) {
+        rec.d3 = h.d3;
+        rec.d4 = h.d4;
+        rec.sourceCount = 1;
+        return;
     }
-    return table;
+
+    if (rec.d3 != h.d3 || rec.d4 != h.d4) {
+        rec.conflict = true;
+    }
+    ++rec.sourceCount;
 }
 
 bool TryApplyMissionWord34(Header* header,
@@ -62,6 +62,10 @@ bool ValidateMissionChecks(const Header& header, std::string* error = nullptr);
 void EncodeMissionCore(Header* header, std::uint16_t mission);
 
 std::map<std::uint16_t, MissionWord34> BuildMissionWord34Table(const fs::path& directory);
+// Adds one save (file name + first kHeaderSize bytes) to a table; skips files that do not validate.
+void AddMissionWord34Source(const fs::path& path,
+                            const std::vector<std::uint8_t>& headerBytes,
+                            std::map<std::uint16_t, MissionWord34>* table);
 bool TryApplyMissionWord34(Header* header,
                            std::uint16_t mission,
                            const std::map<std::uint16_t, MissionWord34>& table,
@@ -0,0 +1,478 @@
+#include "gvas_formula.hpp"
+
+#include "gvas.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace gvas_formula {
+
+namespace {
+
+constexpr std::uint32_t kKey1Init = 0x23101976u;
+constexpr std::uint32_t kKey2Init = 0x10072002u;
+constexpr std::uint64_t kChunk = 1ull << 20;
+
+struct CrcPoly {
+    std::uint32_t poly;
+    bool msbFirst;
+};
+
+constexpr CrcPoly kCrcPolys[] = {
+    {0xEDB88320u, false},  // CRC-32
+    {0x82F63B78u, false},  // CRC-32C
+    {0xEB31D82Eu, false},  // CRC-32K
+    {0xD5828281u, false},  // CRC-32Q
+    {0x04C11DB7u, true},   // CRC-32/BZIP2
+    {0x1EDC6F41u, true},
+    {0x741B8CD7u, true},
+    {0x814141ABu, true},
+};
+constexpr std::size_t kCrcPolyCount = sizeof(kCrcPolys) / sizeof(kCrcPolys[0]);
+
+std::uint32_t Rotl(std::uint32_t v, std::uint32_t r) {
+    r &= 31u;
+    return r == 0 ? v : ((v << r) | (v >> (32u - r)));
+}
+
+std::uint32_t Bswap16(std::uint32_t m) {
+    return ((m & 0xFFu) << 8) | ((m >> 8) & 0xFFu);
+}
+
+std::uint32_t Crc(std::uint32_t poly, bool msbFirst, std::uint32_t m, std::uint32_t bytes) {
+    std::uint32_t crc = 0;
+    for (std::uint32_t i = 0; i < bytes; ++i) {
+        const std::uint32_t byte = (m >> (8u * i)) & 0xFFu;
+        if (msbFirst) {
+            crc ^= byte << 24;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc & 0x80000000u) != 0u ? (crc << 1) ^ poly : (crc << 1);
+            }
+        } else {
+            crc ^= byte;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc & 1u) != 0u ? (crc >> 1) ^ poly : (crc >> 1);
+            }
+        }
+    }
+    return crc;
+}
+
+// Each family maps an enumeration index to its free parameters; the constant b is solved
+// from the first observation so only the remaining observations need to be checked.
+struct AffineFamily {
+    static constexpr Family kFamily = Family::kAffine;
+    static Formula Fit(std::uint64_t idx, std::uint32_t m0, std::uint32_t w0) {
+        const auto a = static_cast<std::uint32_t>(idx);
+        return Formula{kFamily, a, w0 - a * m0, 0};
+    }
+    static std::uint32_t Eval(const Formula& f, std::uint32_t m) { return f.a * m + f.b; }
+};
+
+struct XorAffineFamily {
+    static constexpr Family kFamily = Family::kXorAffine;
+    static Formula Fit(std::uint64_t idx, std::uint32_t m0, std::uint32_t w0) {
+        const auto a = static_cast<std::uint32_t>(idx);
+        return Formula{kFamily, a, w0 ^ (a * m0), 0};
+    }
+    static std::uint32_t Eval(const Formula& f, std::uint32_t m) { return (f.a * m) ^ f.b; }
+};
+
+struct RotMulFamily {
+    static constexpr Family kFamily = Family::kRotMul;
+    static Formula Fit(std::uint64_t idx, std::uint32_t m0, std::uint32_t w0) {
+        const auto r = static_cast<std::uint32_t>(idx & 31u);
+        const auto a = static_cast<std::uint32_t>(idx >> 5);
+        return Formula{kFamily, a, w0 ^ Rotl(a * m0, r), r};
+    }
+    static std::uint32_t Eval(const Formula& f, std::uint32_t m) { return Rotl(f.a * m, f.c) ^ f.b; }
+};
+
+struct CrcFamily {
+    static constexpr Family kFamily = Family::kCrc;
+    static Formula Fit(std::uint64_t idx, std::uint32_t m0, std::uint32_t w0) {
+        const CrcPoly& p = kCrcPolys[idx % kCrcPolyCount];
+        const std::uint32_t c = (idx / kCrcPolyCount == 0 ? 2u : 4u) | (p.msbFirst ? 0x100u : 0u);
+        Formula f{kFamily, p.poly, 0, c};
+        f.b = w0 ^ Eval(f, m0);
+        return f;
+    }
+    static std::uint32_t Eval(const Formula& f, std::uint32_t m) {
+        return Crc(f.a, (f.c & 0x100u) != 0u, m, f.c & 0xFFu) ^ f.b;
+    }
+};
+
+struct ByteMixFamily {
+    static constexpr Family kFamily = Family::kByteMix;
+    static std::uint32_t Mix(std::uint32_t c, std::uint32_t m) {
+        return Rotl((c & 0x100u) != 0u ? Bswap16(m) : m, c & 31u);
+    }
+    static Formula Fit(std::uint64_t idx, std::uint32_t m0, std::uint32_t w0) {
+        const auto c = static_cast<std::uint32_t>((idx & 31u) | (((idx >> 5) & 1u) << 8) | (((idx >> 6) & 1u) << 16));
+        const std::uint32_t mix = Mix(c, m0);
+        return Formula{kFamily, 0, (c & 0x10000u) != 0u ? w0 - mix : w0 ^ mix, c};
+    }
+    static std::uint32_t Eval(const Formula& f, std::uint32_t m) {
+        const std::uint32_t mix = Mix(f.c, m);
+        return (f.c & 0x10000u) != 0u ? mix + f.b : mix ^ f.b;
+    }
+};
+
+struct Targets {
+    std::vector<std::uint32_t> missions;
+    std::vector<std::uint32_t> words;
+};
+
+template <typename F>
+FamilyResult RunFamily(std::uint64_t count, const Targets& t, const SearchOptions& options, unsigned threads) {
+    struct Local {
+        std::uint64_t matches = 0;
+        std::vector<Formula> shown;
+    };
+    // One slot per chunk: a chunk is scanned in increasing order, so its first hits are its lowest
+    // indices, and merging the chunks in order keeps the overall lowest whatever worker ran them.
+    const std::size_t chunks = static_cast<std::size_t>((count + kChunk - 1) / kChunk);
+    std::vector<Local> locals(chunks);
+    const std::uint32_t m0 = t.missions[0];
+    const std::uint32_t w0 = t.words[0];
+    const std::size_t n = t.missions.size();
+
+    work_pool::ParallelFor(chunks, threads, [&](unsigned, std::size_t chunk) {
+        Local& local = locals[chunk];
+        const std::uint64_t begin = chunk * kChunk;
+        const std::uint64_t end = std::min(count, begin + kChunk);
+        for (std::uint64_t idx = begin; idx < end; ++idx) {
+            const Formula f = F::Fit(idx, m0, w0);
+            std::size_t j = 1;
+            while (j < n && F::Eval(f, t.missions[j]) == t.words[j]) {
+                ++j;
+            }
+            if (j != n) {
+                continue;
+            }
+            ++local.matches;
+            if (local.shown.size() < options.maxShown) {
+                local.shown.push_back(f);
+            }
+        }
+    });
+
+    FamilyResult out;
+    out.family = F::kFamily;
+    out.tested = count;
+    for (const auto& local : locals) {
+        out.matches += local.matches;
+        for (std::size_t i = 0; i < local.shown.size() && out.shown.size() < options.maxShown; ++i) {
+            out.shown.push_back(local.shown[i]);
+        }
+    }
+    return out;
+}
+
+std::array<std::uint32_t, kStreamWords> DecryptStream(const std::array<std::uint32_t, kStreamWords>& cipher) {
+    std::array<std::uint32_t, kStreamWords> plain{};
+    std::uint32_t key1 = kKey1Init;
+    std::uint32_t key2 = kKey2Init;
+    for (std::size_t i = 0; i < kStreamWords; ++i) {
+        plain[i] = key1 ^ cipher[i];
+        key2 += plain[i];
+        key1 += key2;
+    }
+    return plain;
+}
+
+std::uint32_t ApplyRule(const WordRule& rule, std::uint16_t mission) {
+    switch (rule.op) {
+        case WordOp::kAddMission:
+            return rule.constant + mission;
+        case WordOp::kXorMission:
+            return rule.constant ^ mission;
+        case WordOp::kConst:
+            break;
+    }
+    return rule.constant;
+}
+
+// All rules consistent with word i of every observation, in kConst, kAddMission, kXorMission order.
+std::vector<WordRule> FitWordRules(const std::vector<Observation>& observations,
+                                   const std::vector<std::array<std::uint32_t, kStreamWords>>& plains,
+                                   std::size_t i) {
+    std::vector<WordRule> out;
+    for (WordOp op : {WordOp::kConst, WordOp::kAddMission, WordOp::kXorMission}) {
+        WordRule rule;
+        rule.op = op;
+        const std::uint32_t m0 = observations[0].mission;
+        rule.constant = op == WordOp::kAddMission ? plains[0][i] - m0
+                                                  : (op == WordOp::kXorMission ? plains[0][i] ^ m0 : plains[0][i]);
+        bool ok = true;
+        for (std::size_t j = 1; j < observations.size() && ok; ++j) {
+            ok = ApplyRule(rule, observations[j].mission) == plains[j][i];
+        }
+        if (ok) {
+            out.push_back(rule);
+        }
+    }
+    return out;
+}
+
+FamilyResult StreamResult(const std::vector<Observation>& observations,
+                          const std::vector<std::array<std::uint32_t, kStreamWords>>& plains,
+                          bool prefixValid,
+                          std::size_t word) {
+    FamilyResult out;
+    out.family = Family::kStream;
+    out.tested = 3;
+    if (!prefixValid) {
+        return out;
+    }
+    for (const WordRule& rule : FitWordRules(observations, plains, word)) {
+        out.shown.push_back(Formula{Family::kStream, static_cast<std::uint32_t>(word), rule.constant,
+                                    static_cast<std::uint32_t>(rule.op)});
+        ++out.matches;
+    }
+    return out;
+}
+
+}  // namespace
+
+const char* FamilyName(Family family) {
+    switch (family) {
+        case Family::kAffine:
+            return "affine";
+        case Family::kXorAffine:
+            return "xor-affine";
+        case Family::kRotMul:
+            return "rot-mul";
+        case Family::kCrc:
+            return "crc";
+        case Family::kByteMix:
+            return "byte-mix";
+        case Family::kStream:
+            return "g-stream";
+    }
+    return "unknown";
+}
+
+bool CollectObservations(const fs::path& directory, std::vector<Observation>* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output observation list";
+        }
+        return false;
+    }
+    if (!fs::exists(directory) || !fs::is_directory(directory)) {
+        if (error != nullptr) {
+            *error = "not a directory: " + directory.string();
+        }
+        return false;
+    }
+
+    std::vector<Observation> list;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        gvas::SaveFileMeta meta;
+        if (!gvas::ParseSaveFileMeta(entry.path(), &meta)) {
+            continue;
+        }
+        const auto bytes = gvas::ReadFileBytes(entry.path());
+        gvas::Header h;
+        if (!gvas::ReadHeader(bytes, &h) || !gvas::ValidateMissionChecks(h)) {
+            continue;
+        }
+        const std::uint16_t mission = gvas::DecodeMission(h);
+        if (meta.slot != static_cast<int>(mission)) {
+            continue;
+        }
+        Observation obs;
+        obs.mission = mission;
+        obs.words = {h.w18, h.w1c, h.d0, h.d1, h.d2, h.d3, h.d4, h.d5};
+        obs.source = entry.path();
+        list.push_back(std::move(obs));
+    }
+    // directory_iterator order is unspecified; keep reports stable.
+    std::sort(list.begin(), list.end(), [](const Observation& x, const Observation& y) {
+        return x.mission != y.mission ? x.mission < y.mission : x.source < y.source;
+    });
+    *out = std::move(list);
+    return true;
+}
+
+StreamTemplate DefaultStreamTemplate() {
+    StreamTemplate t;
+    t.plain[0] = {WordOp::kConst, 0x47766153u};  // "SavG"
+    t.plain[1] = {WordOp::kConst, 0x10u};
+    t.plain[2] = {WordOp::kAddMission, 0u};
+    t.plain[3] = {WordOp::kConst, 0u};
+    t.plain[4] = {WordOp::kConst, 0u};
+    t.plain[5] = {WordOp::kAddMission, 5000u};
+    t.plain[6] = {WordOp::kAddMission, 0u};  // meta32 slot
+    t.plain[7] = {WordOp::kConst, 0u};
+    return t;
+}
+
+bool InferStreamTemplate(const std::vector<Observation>& observations, StreamTemplate* out) {
+    if (out == nullptr || observations.empty()) {
+        return false;
+    }
+    std::vector<std::array<std::uint32_t, kStreamWords>> plains;
+    plains.reserve(observations.size());
+    for (const auto& obs : observations) {
+        plains.push_back(DecryptStream(obs.words));
+    }
+    StreamTemplate t;
+    for (std::size_t i = 0; i < kStreamWords; ++i) {
+        const auto rules = FitWordRules(observations, plains, i);
+        if (rules.empty()) {
+            return false;
+        }
+        t.plain[i] = rules.front();
+    }
+    *out = t;
+    return true;
+}
+
+std::array<std::uint32_t, kStreamWords> EncryptStream(const StreamTemplate& stream, std::uint16_t mission) {
+    std::array<std::uint32_t, kStreamWords> cipher{};
+    std::uint32_t key1 = kKey1Init;
+    std::uint32_t key2 = kKey2Init;
+    for (std::size_t i = 0; i < kStreamWords; ++i) {
+        const std::uint32_t plain = ApplyRule(stream.plain[i], mission);
+        key2 += plain;
+        cipher[i] = plain ^ key1;
+        key1 += key2;
+    }
+    return cipher;
+}
+
+std::uint32_t Evaluate(const Formula& formula, std::uint16_t mission, const StreamTemplate& stream) {
+    switch (formula.family) {
+        case Family::kAffine:
+            return AffineFamily::Eval(formula, mission);
+        case Family::kXorAffine:
+            return XorAffineFamily::Eval(formula, mission);
+        case Family::kRotMul:
+            return RotMulFamily::Eval(formula, mission);
+        case Family::kCrc:
+            return CrcFamily::Eval(formula, mission);
+        case Family::kByteMix:
+            return ByteMixFamily::Eval(formula, mission);
+        case Family::kStream: {
+            if (formula.a >= kStreamWords) {
+                return 0;
+            }
+            StreamTemplate t = stream;
+            t.plain[formula.a] = {static_cast<WordOp>(formula.c), formula.b};
+            return EncryptStream(t, mission)[formula.a];
+        }
+    }
+    return 0;
+}
+
+std::string Describe(const Formula& f) {
+    std::ostringstream oss;
+    oss << std::hex << std::uppercase << std::setfill('0');
+    switch (f.family) {
+        case Family::kAffine:
+            oss << "0x" << std::setw(8) << f.a << " * m + 0x" << std::setw(8) << f.b;
+            break;
+        case Family::kXorAffine:
+            oss << "(0x" << std::setw(8) << f.a << " * m) ^ 0x" << std::setw(8) << f.b;
+            break;
+        case Family::kRotMul:
+            oss << "rotl(0x" << std::setw(8) << f.a << " * m, " << std::dec << f.c << std::hex << ") ^ 0x"
+                << std::setw(8) << f.b;
+            break;
+        case Family::kCrc:
+            oss << "crc32(poly=0x" << std::setw(8) << f.a << (f.c & 0x100u ? " msb" : " lsb") << ", " << std::dec
+                << (f.c & 0xFFu) << " bytes of m" << std::hex << ") ^ 0x" << std::setw(8) << f.b;
+            break;
+        case Family::kByteMix:
+            oss << "rotl(" << ((f.c & 0x100u) != 0u ? "bswap16(m)" : "m") << ", " << std::dec << (f.c & 31u) << std::hex
+                << ") " << ((f.c & 0x10000u) != 0u ? "+" : "^") << " 0x" << std::setw(8) << f.b;
+            break;
+        case Family::kStream: {
+            const auto op = static_cast<WordOp>(f.c);
+            oss << "G_Stream word " << std::dec << f.a << std::hex << ", plain = ";
+            if (op == WordOp::kConst) {
+                oss << "0x" << std::setw(8) << f.b;
+            } else {
+                oss << "m " << (op == WordOp::kAddMission ? "+" : "^") << " 0x" << std::setw(8) << f.b;
+            }
+            break;
+        }
+    }
+    return oss.str();
+}
+
+bool SearchWord34(const std::vector<Observation>& observations,
+                  const SearchOptions& options,
+                  SearchReport* out,
+                  std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output search report";
+        }
+        return false;
+    }
+    if (observations.empty()) {
+        if (error != nullptr) {
+            *error = "no (mission, d3, d4) observations";
+        }
+        return false;
+    }
+    if (options.bits == 0 || options.bits > 32) {
+        if (error != nullptr) {
+            *error = "parameter width must be 1..32 bits";
+        }
+        return false;
+    }
+
+    SearchReport report;
+    const std::uint64_t wide = 1ull << options.bits;
+    report.threads = work_pool::ResolveThreads(options.threads, static_cast<std::size_t>((wide + kChunk - 1) / kChunk));
+
+    std::vector<std::array<std::uint32_t, kStreamWords>> plains;
+    for (const auto& obs : observations) {
+        plains.push_back(DecryptStream(obs.words));
+    }
+    bool prefixValid = true;
+    for (std::size_t i = 0; i < kWordD3 && prefixValid; ++i) {
+        prefixValid = !FitWordRules(observations, plains, i).empty();
+    }
+    report.streamValid = InferStreamTemplate(observations, &report.stream);
+
+    for (std::size_t word : {kWordD3, kWordD4}) {
+        Targets t;
+        for (const auto& obs : observations) {
+            t.missions.push_back(obs.mission);
+            t.words.push_back(obs.words[word]);
+        }
+        std::vector<FamilyResult> results;
+        results.push_back(RunFamily<AffineFamily>(wide, t, options, report.threads));
+        results.push_back(RunFamily<XorAffineFamily>(wide, t, options, report.threads));
+        results.push_back(RunFamily<RotMulFamily>(wide, t, options, report.threads));
+        results.push_back(RunFamily<CrcFamily>(2 * kCrcPolyCount, t, options, 1));
+        results.push_back(RunFamily<ByteMixFamily>(128, t, options, 1));
+        results.push_back(StreamResult(observations, plains, prefixValid, word));
+        (word == kWordD3 ? report.d3 : report.d4) = std::move(results);
+    }
+
+    *out = std::move(report);
+    return true;
+}
+
+void PredictWord34(std::uint16_t mission, std::uint32_t* d3, std::uint32_t* d4) {
+    const auto words = EncryptStream(DefaultStreamTemplate(), mission);
+    if (d3 != nullptr) {
+        *d3 = words[kWordD3];
+    }
+    if (d4 != nullptr) {
+        *d4 = words[kWordD4];
+    }
+}
+
+}  // namespace gvas_formula
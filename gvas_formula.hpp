@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace gvas_formula {
+
+namespace fs = std::filesystem;
+
+// Header words 0x18..0x37 (w18, w1c, d0..d5) are the first eight G_Stream cipher words:
+// head24 words 0..5 followed by meta32 words 0..1.
+constexpr std::size_t kStreamWords = 8;
+constexpr std::size_t kWordD0 = 2;
+constexpr std::size_t kWordD3 = 5;
+constexpr std::size_t kWordD4 = 6;
+
+enum class Family {
+    kAffine,     // a * m + b
+    kXorAffine,  // (a * m) ^ b
+    kRotMul,     // rotl(a * m, r) ^ b
+    kCrc,        // crc_poly(m) ^ b
+    kByteMix,    // rotl(m or bswap16(m), s) ^/+ b (d0 style)
+    kStream,     // G_Stream encryption of a per-word plaintext rule
+};
+
+const char* FamilyName(Family family);
+
+struct Formula {
+    Family family = Family::kAffine;
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
+    std::uint32_t c = 0;
+};
+
+enum class WordOp { kConst, kAddMission, kXorMission };
+
+struct WordRule {
+    WordOp op = WordOp::kConst;
+    std::uint32_t constant = 0;
+};
+
+// Plaintext of the eight stream words as a function of the mission id.
+struct StreamTemplate {
+    std::array<WordRule, kStreamWords> plain{};
+};
+
+struct Observation {
+    std::uint16_t mission = 0;
+    std::array<std::uint32_t, kStreamWords> words{};
+    fs::path source;
+};
+
+struct FamilyResult {
+    Family family = Family::kAffine;
+    std::uint64_t tested = 0;
+    std::uint64_t matches = 0;
+    std::vector<Formula> shown;  // lowest-parameter matches, capped by SearchOptions::maxShown
+};
+
+struct SearchOptions {
+    unsigned threads = 0;    // 0 = hardware concurrency
+    unsigned bits = 32;      // enumerated parameter width for the brute-force families
+    std::size_t maxShown = 4;
+};
+
+struct SearchReport {
+    std::vector<FamilyResult> d3;
+    std::vector<FamilyResult> d4;
+    bool streamValid = false;
+    StreamTemplate stream;
+    unsigned threads = 0;
+};
+
+bool CollectObservations(const fs::path& directory, std::vector<Observation>* out, std::string* error = nullptr);
+
+// Built-in plaintext: "SavG", 0x10, mission, 0, 0, 5000 + mission | slot = mission, 0.
+StreamTemplate DefaultStreamTemplate();
+bool InferStreamTemplate(const std::vector<Observation>& observations, StreamTemplate* out);
+std::array<std::uint32_t, kStreamWords> EncryptStream(const StreamTemplate& stream, std::uint16_t mission);
+
+std::uint32_t Evaluate(const Formula& formula, std::uint16_t mission, const StreamTemplate& stream);
+std::string Describe(const Formula& formula);
+
+// Tests every family against all observed (mission, d3) and (mission, d4) pairs; candidates are
+// rejected on the first mismatching observation.
+bool SearchWord34(const std::vector<Observation>& observations,
+                  const SearchOptions& options,
+                  SearchReport* out,
+                  std::string* error = nullptr);
+
+void PredictWord34(std::uint16_t mission, std::uint32_t* d3, std::uint32_t* d4);
+
+}  // namespace gvas_formula
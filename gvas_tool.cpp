@@ -1,10 +1,14 @@
 #include "gvas.hpp"
+#include "gvas_formula.hpp"
+#include "save_index.hpp"
 
+#include <chrono>
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <optional>
+#include <set>
 #include <string>
 
 namespace fs = std::filesystem;
@@ -15,7 +19,17 @@ void PrintUsage() {
     std::cout << "Usage:\n"
               << "  gvas_tool inspect <save_file>\n"
               << "  gvas_tool set-mission <input_file> <output_file> <mission_id> [--table-dir <save_dir>] "
-                 "[--preserve-word34]\n";
+                 "[--preserve-word34]\n"
+              << "  gvas_tool search-word34 <save_dir> [--threads <n>] [--bits <n>] [--show <n>]\n";
+}
+
+std::optional<std::uint32_t> ParseCount(const std::string& s) {
+    char* end = nullptr;
+    const unsigned long v = std::strtoul(s.c_str(), &end, 10);
+    if (end == nullptr || *end != '\0' || v > 0xFFFFFFFFul) {
+        return std::nullopt;
+    }
+    return static_cast<std::uint32_t>(v);
 }
 
 std::optional<std::uint16_t> ParseMissionId(const std::string& s) {
@@ -27,6 +41,23 @@ std::optional<std::uint16_t> ParseMissionId(const std::string& s) {
     return static_cast<std::uint16_t>(v);
 }
 
+// Prefers <dir>/.mafia_index (see `mafia_stream_tool index`): headers come from the index and only
+// files changed since the last run are read.
+std::map<std::uint16_t, gvas::MissionWord34> LoadMissionWord34Table(const fs::path& dir) {
+    save_index::Index index;
+    if (!save_index::OpenIndex(dir, &index)) {
+        return gvas::BuildMissionWord34Table(dir);
+    }
+    std::map<std::uint16_t, gvas::MissionWord34> table;
+    for (const auto& e : index.entries) {
+        if (e.isSave && e.path.parent_path().empty()) {
+            gvas::AddMissionWord34Source(dir / e.path, std::vector<std::uint8_t>(e.gvasHeader.begin(), e.gvasHeader.end()),
+                                         &table);
+        }
+    }
+    return table;
+}
+
 int CmdInspect(const fs::path& filePath) {
     const auto bytes = gvas::ReadFileBytes(filePath);
     if (bytes.empty()) {
@@ -62,6 +93,10 @@ int CmdInspect(const fs::path& filePath) {
     if (!okChecks) {
         std::cout << "check_error=" << checkErr << "\n";
     }
+    std::uint32_t d3 = 0;
+    std::uint32_t d4 = 0;
+    gvas_formula::PredictWord34(mission0, &d3, &d4);
+    std::cout << "d3d4_formula=" << ((d3 == h.d3 && d4 == h.d4) ? "OK" : "MISMATCH") << "\n";
     return 0;
 }
 
@@ -117,16 +152,13 @@ int CmdSetMission(int argc, char** argv) {
     gvas::EncodeMissionCore(&h, mission);
 
     std::string wordMessage;
-    const auto table = gvas::BuildMissionWord34Table(tableDir);
-    bool wordApplied = gvas::TryApplyMissionWord34(&h, mission, table, &wordMessage);
-    if (!wordApplied && !preserveWord34) {
-        std::cerr << "Cannot set mission safely: " << wordMessage
-                  << ". Use --preserve-word34 to keep previous d3/d4.\n";
-        return 1;
-    }
-
+    const auto table = LoadMissionWord34Table(tableDir);
+    const bool wordApplied = gvas::TryApplyMissionWord34(&h, mission, table, &wordMessage);
     if (!wordApplied && preserveWord34) {
         wordMessage = "kept existing d3/d4 from input file";
+    } else if (!wordApplied) {
+        gvas_formula::PredictWord34(mission, &h.d3, &h.d4);
+        wordMessage = "derived d3/d4 from G_Stream header formula (" + wordMessage + ")";
     }
 
     if (!gvas::WriteHeader(h, &bytes, &err)) {
@@ -148,6 +180,97 @@ int CmdSetMission(int argc, char** argv) {
     return 0;
 }
 
+void PrintFamilyResults(const char* word,
+                        const std::vector<gvas_formula::FamilyResult>& results,
+                        const std::vector<gvas_formula::Observation>& observations,
+                        const gvas_formula::StreamTemplate& stream) {
+    for (const auto& r : results) {
+        std::cout << word << " family=" << gvas_formula::FamilyName(r.family) << " tested=" << r.tested
+                  << " matches=" << r.matches << "\n";
+        for (const auto& f : r.shown) {
+            std::cout << "  " << word << " = " << gvas_formula::Describe(f);
+            // Predictions for ids outside the samples show whether matches of one family agree.
+            std::cout << std::hex << std::uppercase << std::setfill('0');
+            for (std::uint16_t m : {std::uint16_t{0}, std::uint16_t{555}, observations.front().mission}) {
+                std::cout << " m" << std::dec << m << std::hex << "=0x" << std::setw(8)
+                          << gvas_formula::Evaluate(f, m, stream);
+            }
+            std::cout << std::dec << std::setfill(' ') << "\n";
+        }
+    }
+}
+
+int CmdSearchWord34(int argc, char** argv) {
+    if (argc < 3) {
+        PrintUsage();
+        return 1;
+    }
+    gvas_formula::SearchOptions options;
+    for (int i = 3; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << arg << " requires a value\n";
+            return 1;
+        }
+        const auto v = ParseCount(argv[++i]);
+        if (!v.has_value()) {
+            std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+            return 1;
+        }
+        if (arg == "--threads") {
+            options.threads = *v;
+        } else if (arg == "--bits") {
+            options.bits = *v;
+        } else if (arg == "--show") {
+            options.maxShown = *v;
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<gvas_formula::Observation> observations;
+    std::string err;
+    if (!gvas_formula::CollectObservations(argv[2], &observations, &err)) {
+        std::cerr << "CollectObservations failed: " << err << "\n";
+        return 1;
+    }
+    std::set<std::uint16_t> missions;
+    for (const auto& obs : observations) {
+        missions.insert(obs.mission);
+        std::cout << "observation mission=" << obs.mission << std::hex << std::uppercase << std::setfill('0')
+                  << " d3=0x" << std::setw(8) << obs.words[gvas_formula::kWordD3] << " d4=0x" << std::setw(8)
+                  << obs.words[gvas_formula::kWordD4] << std::dec << std::setfill(' ') << " file=" << obs.source.string()
+                  << "\n";
+    }
+
+    gvas_formula::SearchReport report;
+    const auto t0 = std::chrono::steady_clock::now();
+    if (!gvas_formula::SearchWord34(observations, options, &report, &err)) {
+        std::cerr << "SearchWord34 failed: " << err << "\n";
+        return 1;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    PrintFamilyResults("d3", report.d3, observations, report.stream);
+    PrintFamilyResults("d4", report.d4, observations, report.stream);
+
+    std::size_t formulaOk = 0;
+    for (const auto& obs : observations) {
+        std::uint32_t d3 = 0;
+        std::uint32_t d4 = 0;
+        gvas_formula::PredictWord34(obs.mission, &d3, &d4);
+        formulaOk += (d3 == obs.words[gvas_formula::kWordD3] && d4 == obs.words[gvas_formula::kWordD4]) ? 1 : 0;
+    }
+    std::cout << "stream_template=" << (report.streamValid ? "inferred" : "inconsistent") << "\n";
+    std::cout << "builtin_formula_matches=" << formulaOk << "/" << observations.size() << "\n";
+    std::cout << "observations=" << observations.size() << " distinct_missions=" << missions.size()
+              << (missions.size() < 3 ? " (underdetermined: two-parameter families fit any two points)" : "") << "\n";
+    std::cout << "threads=" << report.threads << " bits=" << options.bits
+              << " search_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "\n";
+    return 0;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -167,6 +290,9 @@ int main(int argc, char** argv) {
     if (cmd == "set-mission") {
         return CmdSetMission(argc, argv);
     }
+    if (cmd == "search-word34") {
+        return CmdSearchWord34(argc, argv);
+    }
 
     PrintUsage();
     return 1;
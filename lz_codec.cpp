@@ -0,0 +1,173 @@
+#include "lz_codec.hpp"
+
+#include <cstring>
+
+namespace lz_codec {
+
+namespace {
+
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kMaxOffset = 65535;
+constexpr unsigned kHashBits = 14;
+constexpr std::size_t kLastLiterals = 5;  // keep the tail as literals so matches never run to the end
+
+std::uint32_t Read32(const std::uint8_t* p) {
+    std::uint32_t v = 0;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+std::uint32_t HashOf(std::uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+void PutLength(std::vector<std::uint8_t>* out, std::size_t len) {
+    while (len >= 255) {
+        out->push_back(255);
+        len -= 255;
+    }
+    out->push_back(static_cast<std::uint8_t>(len));
+}
+
+void EmitSequence(std::vector<std::uint8_t>* out,
+                  const std::uint8_t* literals,
+                  std::size_t literalLen,
+                  std::size_t offset,
+                  std::size_t matchLen) {
+    const std::size_t litNibble = literalLen < 15 ? literalLen : 15;
+    std::size_t matchNibble = 0;
+    if (matchLen != 0) {
+        matchNibble = matchLen - kMinMatch < 15 ? matchLen - kMinMatch : 15;
+    }
+    out->push_back(static_cast<std::uint8_t>((litNibble << 4) | matchNibble));
+    if (litNibble == 15) {
+        PutLength(out, literalLen - 15);
+    }
+    out->insert(out->end(), literals, literals + literalLen);
+    if (matchLen == 0) {
+        return;
+    }
+    out->push_back(static_cast<std::uint8_t>(offset & 0xFFu));
+    out->push_back(static_cast<std::uint8_t>(offset >> 8));
+    if (matchNibble == 15) {
+        PutLength(out, matchLen - kMinMatch - 15);
+    }
+}
+
+bool ReadLength(const std::uint8_t* src, std::size_t srcSize, std::size_t* pos, std::size_t* len) {
+    for (;;) {
+        if (*pos >= srcSize) {
+            return false;
+        }
+        const std::uint8_t b = src[(*pos)++];
+        *len += b;
+        if (b != 255) {
+            return true;
+        }
+    }
+}
+
+}  // namespace
+
+std::vector<std::uint8_t> Compress(const std::uint8_t* data, std::size_t size) {
+    std::vector<std::uint8_t> out;
+    out.reserve(size / 2 + 16);
+    std::vector<std::uint32_t> table(std::size_t{1} << kHashBits, 0);  // position + 1; 0 = empty
+
+    std::size_t anchor = 0;
+    std::size_t pos = 0;
+    const std::size_t limit = size > kLastLiterals + kMinMatch ? size - kLastLiterals - kMinMatch : 0;
+    while (pos < limit) {
+        const std::uint32_t seq = Read32(data + pos);
+        const std::uint32_t h = HashOf(seq);
+        const std::size_t cand = table[h];
+        table[h] = static_cast<std::uint32_t>(pos + 1);
+        if (cand == 0 || pos - (cand - 1) > kMaxOffset || Read32(data + cand - 1) != seq) {
+            ++pos;
+            continue;
+        }
+
+        std::size_t ref = cand - 1;
+        while (pos > anchor && ref > 0 && data[pos - 1] == data[ref - 1]) {
+            --pos;
+            --ref;
+        }
+        std::size_t len = kMinMatch;
+        const std::size_t maxLen = size - kLastLiterals - pos;
+        while (len < maxLen && data[pos + len] == data[ref + len]) {
+            ++len;
+        }
+        EmitSequence(&out, data + anchor, pos - anchor, pos - ref, len);
+        pos += len;
+        anchor = pos;
+        if (pos >= 2 && pos - 2 < limit) {
+            table[HashOf(Read32(data + pos - 2))] = static_cast<std::uint32_t>(pos - 2 + 1);
+        }
+    }
+    EmitSequence(&out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool Decompress(const std::uint8_t* src,
+                std::size_t srcSize,
+                std::size_t rawSize,
+                std::vector<std::uint8_t>* out,
+                std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output buffer";
+        }
+        return false;
+    }
+    out->resize(rawSize);
+    std::uint8_t* dst = out->data();
+    std::size_t d = 0;
+    std::size_t s = 0;
+    while (s < srcSize) {
+        const std::uint8_t token = src[s++];
+        std::size_t literalLen = token >> 4;
+        if (literalLen == 15 && !ReadLength(src, srcSize, &s, &literalLen)) {
+            break;
+        }
+        if (literalLen > srcSize - s || literalLen > rawSize - d) {
+            break;
+        }
+        if (literalLen != 0) {
+            std::memcpy(dst + d, src + s, literalLen);
+        }
+        s += literalLen;
+        d += literalLen;
+        if (s == srcSize) {
+            if (d == rawSize) {
+                return true;
+            }
+            break;
+        }
+
+        if (srcSize - s < 2) {
+            break;
+        }
+        const std::size_t offset = static_cast<std::size_t>(src[s]) | (static_cast<std::size_t>(src[s + 1]) << 8);
+        s += 2;
+        std::size_t matchLen = token & 0x0Fu;
+        if (matchLen == 15 && !ReadLength(src, srcSize, &s, &matchLen)) {
+            break;
+        }
+        matchLen += kMinMatch;
+        if (offset == 0 || offset > d || matchLen > rawSize - d) {
+            break;
+        }
+        // Byte copy: overlapping matches (offset < length) repeat the pattern.
+        const std::uint8_t* ref = dst + d - offset;
+        for (std::size_t i = 0; i < matchLen; ++i) {
+            dst[d + i] = ref[i];
+        }
+        d += matchLen;
+    }
+    if (error != nullptr) {
+        *error = "corrupt compressed block";
+    }
+    return false;
+}
+
+}  // namespace lz_codec
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lz_codec {
+
+// LZ4-style block format: sequences of [token][literal length ext][literals][u16 offset][match length ext].
+// Token high nibble = literal count, low nibble = match length - 4 (15 = continued in 255-bytes).
+// The last sequence carries literals only. No framing: the caller stores the raw size.
+std::vector<std::uint8_t> Compress(const std::uint8_t* data, std::size_t size);
+
+// Fails on any out-of-range offset or length instead of reading/writing past the buffers.
+bool Decompress(const std::uint8_t* src,
+                std::size_t srcSize,
+                std::size_t rawSize,
+                std::vector<std::uint8_t>* out,
+                std::string* error = nullptr);
+
+}  // namespace lz_codec
@@ -0,0 +1,354 @@
+#include "gvas.hpp"
+#include "mafia_save.hpp"
+#include "profile_sav.hpp"
+#include "save_layout.hpp"
+#include "save_synth.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Keeps results observable so the optimizer cannot drop the measured calls.
+volatile std::uint64_t g_sink = 0;
+
+// A timed sample runs the case `batch` times; batch is picked so one sample takes at least this long.
+constexpr std::chrono::nanoseconds kMinSampleTime = std::chrono::microseconds(200);
+constexpr std::size_t kMaxBatch = 1u << 20;
+
+void PrintUsage() {
+    std::cout << "Usage:\n"
+              << "  mafia_bench [--samples <dir>]... [--no-synth] [--reps <n>] [--warmup <n>] [--filter <text>] "
+                 "[--json <file>]\n";
+}
+
+std::optional<std::uint32_t> ParseCount(const std::string& s) {
+    char* end = nullptr;
+    const unsigned long v = std::strtoul(s.c_str(), &end, 10);
+    if (end == nullptr || *end != '\0' || v > 0xFFFFFFFFul) {
+        return std::nullopt;
+    }
+    return static_cast<std::uint32_t>(v);
+}
+
+struct Input {
+    std::string name;
+    std::vector<std::uint8_t> raw;
+    mafia_save::SaveData save;
+};
+
+struct Case {
+    std::string name;
+    std::string input;
+    std::uint64_t bytes = 0;  // processed per call; 0 = no throughput column
+    std::function<void()> fn;
+};
+
+struct Result {
+    std::string name;
+    std::string input;
+    std::uint64_t bytes = 0;
+    std::size_t reps = 0;
+    std::size_t batch = 0;
+    double minNs = 0.0;
+    double medianNs = 0.0;
+    double p99Ns = 0.0;
+    double mbPerSec = 0.0;  // at the median
+};
+
+double SampleNs(const Case& c, std::size_t batch) {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < batch; ++i) {
+        c.fn();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) /
+           static_cast<double>(batch);
+}
+
+Result Run(const Case& c, std::size_t warmup, std::size_t reps) {
+    std::size_t batch = 1;
+    while (batch < kMaxBatch && SampleNs(c, batch) * static_cast<double>(batch) < kMinSampleTime.count()) {
+        batch *= 2;
+    }
+    for (std::size_t i = 0; i < warmup; ++i) {
+        SampleNs(c, batch);
+    }
+    std::vector<double> samples(reps);
+    for (auto& s : samples) {
+        s = SampleNs(c, batch);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result r;
+    r.name = c.name;
+    r.input = c.input;
+    r.bytes = c.bytes;
+    r.reps = reps;
+    r.batch = batch;
+    r.minNs = samples.front();
+    r.medianNs = samples[samples.size() / 2];
+    r.p99Ns = samples[std::min(samples.size() - 1, (samples.size() * 99 + 99) / 100 - 1)];
+    r.mbPerSec = c.bytes != 0 && r.medianNs > 0.0 ? static_cast<double>(c.bytes) / r.medianNs * 1e9 / (1024.0 * 1024.0)
+                                                   : 0.0;
+    return r;
+}
+
+void CollectSamples(const fs::path& dir, std::vector<Input>* out) {
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file(ec)) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto& f : files) {
+        Input in;
+        in.name = f.filename().string();
+        in.raw = mafia_save::ReadFileBytes(f);
+        if (!in.raw.empty() && mafia_save::ParseSave(in.raw, &in.save)) {
+            out->push_back(std::move(in));
+        }
+    }
+}
+
+bool AddSynthetic(const std::string& name, const save_synth::Spec& spec, std::vector<Input>* out) {
+    Input in;
+    in.name = name;
+    std::string err;
+    if (!save_synth::GenerateRaw(spec, &in.raw, nullptr, &err) || !mafia_save::ParseSave(in.raw, &in.save, &err)) {
+        std::cerr << "Synthetic input " << name << " failed: " << err << "\n";
+        return false;
+    }
+    out->push_back(std::move(in));
+    return true;
+}
+
+std::vector<std::uint8_t> SyntheticProfile() {
+    profile_sav::ProfileSaveData p;
+    for (std::size_t b = 0; b < 4; ++b) {
+        p.fileHeader[b] = static_cast<std::uint8_t>(profile_sav::kMagicForP >> (8 * b));
+        p.fileHeader[8 + b] = static_cast<std::uint8_t>(profile_sav::kVersion1 >> (8 * b));
+    }
+    p.core84.assign(profile_sav::kCoreSize, 0u);
+    profile_sav::WriteU32LE(&p.core84, 0, profile_sav::kMagicForP);
+    profile_sav::WriteU32LE(&p.core84, 4, profile_sav::kVersion1);
+    p.block720.assign(profile_sav::kBlock720Size, 0x11u);
+    p.block92.assign(profile_sav::kBlock92Size, 0x22u);
+    p.block156.assign(profile_sav::kBlock156Size, 0x33u);
+    std::vector<std::uint8_t> raw;
+    profile_sav::BuildRaw(p, &raw);
+    return raw;
+}
+
+void AddSaveCases(Input* in, std::vector<Case>* cases) {
+    const std::string& name = in->name;
+    const std::uint64_t size = in->raw.size();
+    const std::uint64_t body = size - mafia_save::kFileHeaderSize;
+
+    // The cipher runs in place over a scratch copy of the body; repeated passes keep the buffer size
+    // fixed, and throughput does not depend on the bytes.
+    auto scratch = std::make_shared<std::vector<std::uint8_t>>(in->raw.begin() + mafia_save::kFileHeaderSize,
+                                                               in->raw.end());
+    cases->push_back({"decrypt", name, body, [scratch] {
+                          mafia_save::DecryptFromCheckpoint(scratch.get(), mafia_save::CipherCheckpoint{});
+                          g_sink = g_sink + (*scratch)[0];
+                      }});
+    cases->push_back({"encrypt", name, body, [scratch] {
+                          mafia_save::CipherCheckpoint state;
+                          mafia_save::EncryptRange(scratch->data(), scratch->size(), &state);
+                          g_sink = g_sink + state.key1;
+                      }});
+    cases->push_back({"parse_save", name, size, [in] {
+                          mafia_save::SaveData save;
+                          mafia_save::ParseSave(in->raw, &save);
+                          g_sink = g_sink + save.segments.size();
+                      }});
+    cases->push_back({"build_raw", name, size, [in] {
+                          std::vector<std::uint8_t> out;
+                          mafia_save::BuildRaw(in->save, &out);
+                          g_sink = g_sink + out.size();
+                      }});
+    // Last byte of the file: XorFileOffsetByte walks every segment to map it.
+    auto work = std::make_shared<mafia_save::SaveData>(in->save);
+    cases->push_back({"xor_file_offset_byte", name, 0, [work, size] {
+                          mafia_save::XorFileOffsetByte(work.get(), size - 1, 0x01);
+                          g_sink = g_sink + work->segments.back().plain.back();
+                      }});
+
+    std::size_t progSeg = in->save.idxGamePayload;
+    const auto loc = save_layout::DetectProgramInSave(in->save);
+    if (loc.has_value()) {
+        progSeg = loc->segIdx;
+    }
+    if (progSeg != mafia_save::kNoIndex) {
+        const auto* seg = &in->save.segments[progSeg].plain;
+        const std::string input = name + ":" + in->save.segments[progSeg].name;
+        cases->push_back({"detect_program_layout", input, seg->size(), [seg] {
+                              save_layout::ClearProgramLayoutCache();
+                              const auto layout = save_layout::DetectProgramLayout(*seg);
+                              g_sink = g_sink + (layout.has_value() ? layout->varCount : 0u);
+                          }});
+        cases->push_back({"detect_program_layout_cached", input, seg->size(), [seg] {
+                              const auto layout = save_layout::DetectProgramLayout(*seg);
+                              g_sink = g_sink + (layout.has_value() ? layout->varCount : 0u);
+                          }});
+    }
+
+    std::uint64_t humanBytes = 0;
+    for (const auto& seg : in->save.segments) {
+        if (seg.name.rfind("actor_payload_", 0) == 0 && save_layout::IsHumanPayload(seg.plain)) {
+            humanBytes += seg.plain.size();
+        }
+    }
+    if (humanBytes != 0) {
+        cases->push_back({"find_human_inventory_offset", name + ":all_humans", humanBytes, [in] {
+                              std::size_t sum = 0;
+                              for (const auto& seg : in->save.segments) {
+                                  std::size_t off = 0;
+                                  if (save_layout::IsHumanPayload(seg.plain) &&
+                                      save_layout::FindHumanInventoryOffset(seg.plain, &off)) {
+                                      sum += off;
+                                  }
+                              }
+                              g_sink = g_sink + sum;
+                          }});
+    }
+
+    if (in->raw.size() >= gvas::kHeaderSize) {
+        cases->push_back({"gvas_header", name, gvas::kHeaderSize, [in] {
+                              gvas::Header h;
+                              if (gvas::ReadHeader(in->raw, &h)) {
+                                  g_sink = g_sink + gvas::DecodeMission(h) + (gvas::ValidateMissionChecks(h) ? 1u : 0u);
+                              }
+                          }});
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<fs::path> sampleDirs;
+    bool synth = true;
+    std::size_t reps = 30;
+    std::size_t warmup = 3;
+    std::string filter;
+    fs::path jsonPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string opt = argv[i];
+        if (opt == "--samples" && i + 1 < argc) {
+            sampleDirs.emplace_back(argv[++i]);
+        } else if (opt == "--no-synth") {
+            synth = false;
+        } else if ((opt == "--reps" || opt == "--warmup") && i + 1 < argc) {
+            const auto numOpt = ParseCount(argv[++i]);
+            if (!numOpt.has_value() || (opt == "--reps" && *numOpt == 0)) {
+                std::cerr << "Invalid " << opt << " value: " << argv[i] << "\n";
+                return 1;
+            }
+            (opt == "--reps" ? reps : warmup) = *numOpt;
+        } else if (opt == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (opt == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (opt == "--help" || opt == "-h") {
+            PrintUsage();
+            return 0;
+        } else {
+            std::cerr << "Unknown option: " << opt << "\n";
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (sampleDirs.empty()) {
+        sampleDirs.emplace_back("data/samples");
+    }
+
+    std::vector<Input> inputs;
+    for (const auto& dir : sampleDirs) {
+        CollectSamples(dir, &inputs);
+    }
+    if (synth) {
+        save_synth::Spec many;
+        many.actors = 10000;
+        many.programRegs = 8;
+        many.programVars = 2000;
+        many.programActors = 200;
+        many.programFrames = 100;
+        many.aiGroups = 40;
+        many.aiFollow = 20;
+        save_synth::Spec big;
+        big.actors = 200;
+        big.programVars = 64;
+        big.targetBytes = 8u * 1024u * 1024u;
+        if (!AddSynthetic("synth_10k_actors", many, &inputs) || !AddSynthetic("synth_8mb", big, &inputs)) {
+            return 1;
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "No inputs: no parseable saves in the sample directories and --no-synth given\n";
+        return 1;
+    }
+
+    // Input addresses are captured by the cases, so the vector must not grow from here on.
+    std::vector<Case> cases;
+    for (auto& in : inputs) {
+        AddSaveCases(&in, &cases);
+    }
+    const auto profile = std::make_shared<std::vector<std::uint8_t>>(SyntheticProfile());
+    cases.push_back({"parse_profile_save", "synthetic_profile", profile->size(), [profile] {
+                         profile_sav::ProfileSaveData p;
+                         g_sink = g_sink + (profile_sav::ParseProfileSave(*profile, &p) ? p.rawSize : 0u);
+                     }});
+
+    std::vector<Result> results;
+    for (const auto& c : cases) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos && c.input.find(filter) == std::string::npos) {
+            continue;
+        }
+        const Result r = Run(c, warmup, reps);
+        std::cout << "case=" << r.name << " input=" << r.input << " bytes=" << r.bytes << " reps=" << r.reps
+                  << " batch=" << r.batch << std::fixed << std::setprecision(3) << " min_us=" << r.minNs / 1000.0
+                  << " median_us=" << r.medianNs / 1000.0 << " p99_us=" << r.p99Ns / 1000.0 << std::setprecision(1)
+                  << " mb_per_s=" << r.mbPerSec << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+        results.push_back(r);
+    }
+
+    if (!jsonPath.empty()) {
+        std::ostringstream json;
+        json << "{\"tool\":\"mafia_bench\",\"reps\":" << reps << ",\"warmup\":" << warmup << ",\"results\":[";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            json << (i == 0 ? "" : ",") << "\n  {\"case\":\"" << mafia_save::JsonEscape(r.name) << "\",\"input\":\""
+                 << mafia_save::JsonEscape(r.input) << "\",\"bytes\":" << r.bytes << ",\"reps\":" << r.reps
+                 << ",\"batch\":" << r.batch << std::fixed << std::setprecision(1) << ",\"min_ns\":" << r.minNs
+                 << ",\"median_ns\":" << r.medianNs << ",\"p99_ns\":" << r.p99Ns << ",\"mb_per_s\":" << r.mbPerSec
+                 << "}";
+            json.unsetf(std::ios::floatfield);
+        }
+        json << "\n]}\n";
+        std::ofstream out(jsonPath, std::ios::binary | std::ios::trunc);
+        out << json.str();
+        if (!out) {
+            std::cerr << "Failed to write: " << jsonPath.string() << "\n";
+            return 1;
+        }
+    }
+    std::cout << "cases=" << results.size() << " inputs=" << inputs.size() << "\n";
+    return 0;
+}
@@ -7,6 +7,8 @@
 
 #include "mafia_save.hpp"
 #include "profile_sav.hpp"
+#include "save_layout.hpp"
+#include "save_strings.hpp"
 
 #include <windows.h>
 #include <commctrl.h>
@@ -1171,174 +1173,16 @@ bool ParseByteField(const std::string& s, std::uint8_t* out, std::string* err, c
     return true;
 }
 
-std::uint16_t ReadU16LE(const std::vector<std::uint8_t>& data, std::size_t off) {
-    return static_cast<std::uint16_t>(data[off]) | (static_cast<std::uint16_t>(data[off + 1]) << 8);
-}
-
-struct ProgramLayout {
-    bool valid = false;
-    std::size_t baseOff = 0;
-    std::size_t varsOff = 0;
-    std::uint16_t regCount = 0;
-    std::uint32_t varCount = 0;
-    std::uint32_t frameCount = 0;
-    std::uint32_t actorCount = 0;
-};
-
-constexpr std::size_t kGameHeaderSize = 67;
-struct ProgramLocation {
-    std::size_t segIdx = mafia_save::kNoIndex;
-    ProgramLayout layout;
-};
-
-std::optional<ProgramLayout> TryParseProgramLayoutAt(const std::vector<std::uint8_t>& p, std::size_t base) {
-    if (base + 39 > p.size() || p[base] != 2u) {
-        return std::nullopt;
-    }
-
-    ProgramLayout out;
-    out.baseOff = base;
-    out.regCount = ReadU16LE(p, base + 17);
-    out.varCount = mafia_save::ReadU32LE(p, base + 19);
-    out.frameCount = mafia_save::ReadU32LE(p, base + 23);
-    out.actorCount = mafia_save::ReadU32LE(p, base + 27);
-
-    if (out.regCount > 4096u || out.varCount > 8192u || out.frameCount > 2048u || out.actorCount > 2048u) {
-        return std::nullopt;
-    }
-
-    std::size_t cur = base + 39;
-    if (cur + (2u * static_cast<std::size_t>(out.regCount)) > p.size()) {
-        return std::nullopt;
-    }
-    cur += 2u * static_cast<std::size_t>(out.regCount);
-
-    out.varsOff = cur;
-    if (cur + (4u * static_cast<std::size_t>(out.varCount)) > p.size()) {
-        return std::nullopt;
-    }
-    cur += 4u * static_cast<std::size_t>(out.varCount);
-
-    for (std::uint32_t i = 0; i < out.actorCount; ++i) {
-        if (cur + 8 > p.size()) {
-            return std::nullopt;
-        }
-        const std::uint32_t nameLen = mafia_save::ReadU32LE(p, cur);
-        if (nameLen > 1024u) {
-            return std::nullopt;
-        }
-        cur += 8;
-        if (cur + static_cast<std::size_t>(nameLen) > p.size()) {
-            return std::nullopt;
-        }
-        cur += static_cast<std::size_t>(nameLen);
-    }
-
-    for (std::uint32_t i = 0; i < out.frameCount; ++i) {
-        if (cur + 2 > p.size()) {
-            return std::nullopt;
-        }
-        const std::uint16_t nameLen = ReadU16LE(p, cur);
-        cur += 2;
-        if (cur + static_cast<std::size_t>(nameLen) > p.size()) {
-            return std::nullopt;
-        }
-        cur += static_cast<std::size_t>(nameLen);
-    }
-
-    out.valid = true;
-    return out;
-}
-
-std::optional<ProgramLayout> DetectProgramLayout(const std::vector<std::uint8_t>& p) {
-    if (p.size() < 39) {
-        return std::nullopt;
-    }
-    std::optional<ProgramLayout> best;
-    for (std::size_t off = 0; off + 39 <= p.size(); ++off) {
-        if (p[off] != 2u) {
-            continue;
-        }
-        const auto cand = TryParseProgramLayoutAt(p, off);
-        if (!cand.has_value()) {
-            continue;
-        }
-        if (!best.has_value() || cand->varCount > best->varCount ||
-            (cand->varCount == best->varCount && cand->actorCount > best->actorCount)) {
-            best = cand;
-        }
-    }
-    return best;
-}
-
-bool IsProgramCandidateSegment(const mafia_save::SaveData& save, std::size_t segIdx) {
-    if (segIdx >= save.segments.size()) {
-        return false;
-    }
-    if (segIdx == save.idxGamePayload || segIdx == save.idxAiGroups || segIdx == save.idxAiFollow) {
-        return true;
-    }
-    const std::string& n = save.segments[segIdx].name;
-    return n.rfind("actor_payload_", 0) == 0 || n.rfind("actor_payload_clone", 0) == 0;
-}
-
-std::optional<ProgramLocation> DetectProgramInSave(const mafia_save::SaveData& save) {
-    std::optional<ProgramLocation> best;
-    for (std::size_t i = 0; i < save.segments.size(); ++i) {
-        if (!IsProgramCandidateSegment(save, i)) {
-            continue;
-        }
-        const auto prog = DetectProgramLayout(save.segments[i].plain);
-        if (!prog.has_value()) {
-            continue;
-        }
-
-        if (!best.has_value()) {
-            best = ProgramLocation{i, *prog};
-            continue;
-        }
-
-        const auto& b = best->layout;
-        const bool candHasVars = prog->varCount > 0u;
-        const bool bestHasVars = b.varCount > 0u;
-        if (candHasVars != bestHasVars) {
-            if (candHasVars) {
-                best = ProgramLocation{i, *prog};
-            }
-            continue;
-        }
-        if (prog->varCount != b.varCount) {
-            if (prog->varCount > b.varCount) {
-                best = ProgramLocation{i, *prog};
-            }
-            continue;
-        }
-        if (prog->actorCount != b.actorCount) {
-            if (prog->actorCount > b.actorCount) {
-                best = ProgramLocation{i, *prog};
-            }
-            continue;
-        }
-        if (prog->frameCount != b.frameCount) {
-            if (prog->frameCount > b.frameCount) {
-                best = ProgramLocation{i, *prog};
-            }
-            continue;
-        }
-        if (best->segIdx != save.idxGamePayload && i == save.idxGamePayload) {
-            best = ProgramLocation{i, *prog};
-        }
-    }
-    return best;
-}
-
-constexpr std::size_t kHumanBlobOff = 13;
-constexpr std::size_t kHumanBlobSize = 382;
-constexpr std::size_t kHumanPropsCurrentOff = kHumanBlobOff + 229;
-constexpr std::size_t kHumanPropsInitOff = kHumanBlobOff + 293;
-constexpr std::size_t kHumanCurrentHealthOff = kHumanPropsCurrentOff + 4;
-constexpr std::size_t kHumanMaxHealthOff = kHumanPropsInitOff + 4;
-constexpr std::size_t kInventoryBlobSize = 196;
+using save_layout::DetectProgramInSave;
+using save_layout::FindHumanInventoryOffset;
+using save_layout::kGameHeaderSize;
+using save_layout::kHumanCurrentHealthOff;
+using save_layout::kHumanMaxHealthOff;
+using save_layout::kHumanPropsCurrentOff;
+using save_layout::kHumanPropsInitOff;
+using save_layout::kInventoryBlobSize;
+using save_layout::ProgramLayout;
+using save_layout::ProgramLocation;
 
 constexpr const char* kHumanPropNames[16] = {
     "Strength",      "Health",      "Health Hand L", "Health Hand R",
@@ -1355,39 +1199,6 @@ void WriteInvDw(std::vector<std::uint8_t>* p, std::size_t invOff, std::size_t id
     mafia_save::WriteU32LE(p, invOff + (idx * 4), v);
 }
 
-bool FindHumanInventoryOffset(const std::vector<std::uint8_t>& p, std::size_t* outInvOff) {
-    if (outInvOff == nullptr) {
-        return false;
-    }
-    if (p.size() < kHumanBlobOff + kHumanBlobSize + 16 + kInventoryBlobSize) {
-        return false;
-    }
-    std::size_t cursor = kHumanBlobOff + kHumanBlobSize;
-    for (int i = 0; i < 2; ++i) {
-        if (cursor + 8 > p.size()) {
-            return false;
-        }
-        const std::uint32_t nameLen = mafia_save::ReadU32LE(p, cursor);
-        if (nameLen == 0) {
-            cursor += 8;
-            continue;
-        }
-        if (nameLen > 1024) {
-            return false;
-        }
-        const std::size_t chunk = static_cast<std::size_t>(nameLen) + 8;
-        if (cursor + chunk > p.size()) {
-            return false;
-        }
-        cursor += chunk;
-    }
-    if (cursor + kInventoryBlobSize > p.size()) {
-        return false;
-    }
-    *outInvOff = cursor;
-    return true;
-}
-
 void SetInventoryVisibility(bool visible) {
     SetFieldVisible(g_ui.invModeLabel, g_ui.invMode, visible);
     SetFieldVisible(g_ui.invFlagLabel, g_ui.invFlag, visible);
@@ -1525,61 +1336,7 @@ void FillInventoryEdits(const std::vector<std::uint8_t>& p, std::size_t invOff)
     SetText(g_ui.invS5Unk, std::to_string(ReadInvDw(p, invOff, 28)));
 }
 
-struct CoordLayout {
-    bool baseSupported = false;
-    bool coordsSupported = false;
-    bool dirSupported = false;
-    bool animSupported = false;
-    bool quatSupported = false;
-    bool carStateSupported = false;
-    bool carDriveSupported = false;
-    bool carEngineFlagsSupported = false;
-    bool carOdometerSupported = false;
-    bool humanStateSupported = false;
-    bool humanHealthSupported = false;
-    bool humanPropsSupported = false;
-    bool humanInventorySupported = false;
-    std::size_t stateOff = 1;
-    std::size_t idOff = 2;
-    std::size_t activeOff = 6;
-    std::size_t removeOff = 7;
-    std::size_t frameOff = 8;
-    std::size_t xOff = 0;
-    std::size_t yOff = 0;
-    std::size_t zOff = 0;
-    std::size_t dirXOff = 0;
-    std::size_t dirYOff = 0;
-    std::size_t dirZOff = 0;
-    std::size_t animIdOff = 0;
-    std::size_t quatWOff = 0;
-    std::size_t quatXOff = 0;
-    std::size_t quatYOff = 0;
-    std::size_t quatZOff = 0;
-    std::size_t carFuelOff = 0;
-    std::size_t carFlowOff = 0;
-    std::size_t carEngNormOff = 0;
-    std::size_t carEngCalcOff = 0;
-    std::size_t carSpeedLimitOff = 0;
-    std::size_t carLastGearOff = 0;
-    std::size_t carGearOff = 0;
-    std::size_t carGearboxFlagOff = 0;
-    std::size_t carDisableEngineOff = 0;
-    std::size_t carEngineOnOff = 0;
-    std::size_t carIsEngineOnOff = 0;
-    std::size_t carOdometerOff = 0;
-    std::size_t humanSeatOff = 0;
-    std::size_t humanCrouchOff = 0;
-    std::size_t humanAimOff = 0;
-    std::size_t humanShootXOff = 0;
-    std::size_t humanShootYOff = 0;
-    std::size_t humanShootZOff = 0;
-    std::size_t humanPropsCurrentOff = 0;
-    std::size_t humanPropsInitOff = 0;
-    std::size_t humanHpCurrentOff = 0;
-    std::size_t humanHpMaxOff = 0;
-    std::size_t humanInventoryOff = 0;
-    std::string hint;
-};
+using save_layout::CoordLayout;
 
 std::string FormatDate(std::uint32_t packed) {
     std::ostringstream oss;
@@ -1772,103 +1529,10 @@ bool IsActorPairAt(std::size_t headerIdx) {
 }
 
 CoordLayout DetectCoordLayout(std::size_t headerIdx) {
-    CoordLayout layout;
     if (!g_state.loaded || !IsActorPairAt(headerIdx)) {
-        return layout;
-    }
-
-    const auto& p = g_state.save.segments[headerIdx + 1].plain;
-    if (p.size() >= 13 && p[0] == 3u) {
-        layout.baseSupported = true;
-    }
-
-    if (p.size() >= 42 && p[0] == 3u && p[13] == 6u) {
-        layout.coordsSupported = true;
-        layout.dirSupported = true;
-        layout.animSupported = true;
-        layout.xOff = 14;
-        layout.yOff = 18;
-        layout.zOff = 22;
-        layout.dirXOff = 26;
-        layout.dirYOff = 30;
-        layout.dirZOff = 34;
-        layout.animIdOff = 38;
-        if (p.size() >= 66) {
-            layout.humanStateSupported = true;
-            layout.humanSeatOff = 46;
-            layout.humanCrouchOff = 50;
-            layout.humanAimOff = 51;
-            layout.humanShootXOff = 54;
-            layout.humanShootYOff = 58;
-            layout.humanShootZOff = 62;
-        }
-        if (p.size() >= (kHumanMaxHealthOff + 4)) {
-            layout.humanHealthSupported = true;
-            layout.humanHpCurrentOff = kHumanCurrentHealthOff;
-            layout.humanHpMaxOff = kHumanMaxHealthOff;
-        }
-        if (p.size() >= (kHumanPropsInitOff + 64)) {
-            layout.humanPropsSupported = true;
-            layout.humanPropsCurrentOff = kHumanPropsCurrentOff;
-            layout.humanPropsInitOff = kHumanPropsInitOff;
-        }
-        std::size_t invOff = 0;
-        if (FindHumanInventoryOffset(p, &invOff)) {
-            layout.humanInventorySupported = true;
-            layout.humanInventoryOff = invOff;
-        }
-        layout.hint = "Payload: marker=3, subtype=6 (human/player)";
-        return layout;
-    }
-
-    if (p.size() >= 18 && p[0] == 3u && p[13] == 9u) {
-        if (p.size() >= 49) {
-            layout.coordsSupported = true;
-            layout.quatSupported = true;
-            layout.xOff = 21;
-            layout.yOff = 25;
-            layout.zOff = 29;
-            layout.quatWOff = 33;
-            layout.quatXOff = 37;
-            layout.quatYOff = 41;
-            layout.quatZOff = 45;
-            if (p.size() > 308) {
-                layout.carStateSupported = true;
-                layout.carFuelOff = 304;
-                layout.carFlowOff = 211;
-                layout.carEngNormOff = 137;
-                layout.carEngCalcOff = 141;
-            }
-            if (p.size() >= 253) {
-                layout.carDriveSupported = true;
-                layout.carSpeedLimitOff = 215;
-                layout.carLastGearOff = 245;
-                layout.carGearOff = 249;
-            }
-            if (p.size() >= 304) {
-                layout.carEngineFlagsSupported = true;
-                layout.carGearboxFlagOff = 273;
-                layout.carDisableEngineOff = 277;
-                layout.carEngineOnOff = 298;
-                layout.carIsEngineOnOff = 303;
-            }
-            if (p.size() >= 349) {
-                layout.carOdometerSupported = true;
-                layout.carOdometerOff = 345;
-            }
-            layout.hint = "Payload: marker=3, subtype=9 (car mapped)";
-            return layout;
-        }
-        layout.hint = "Payload: marker=3, subtype=9 (car, partial mapping)";
-        return layout;
+        return CoordLayout{};
     }
-
-    if (layout.baseSupported) {
-        layout.hint = "Payload: marker=3 (base fields available)";
-        return layout;
-    }
-    layout.hint = "Payload: unknown format";
-    return layout;
+    return save_layout::DetectCoordLayout(g_state.save.segments[headerIdx + 1].plain);
 }
 
 std::optional<std::size_t> FindTommyHeaderSegIdx() {
@@ -4071,9 +3735,9 @@ void FillCarsList() {
     FillCarEditor();
 }
 
-constexpr std::size_t kGarageSlotCount = 25;
-constexpr std::size_t kGaragePrimaryOff = 40;
-constexpr std::size_t kGarageSecondaryOff = 140;
+using save_layout::kGaragePrimaryOff;
+using save_layout::kGarageSecondaryOff;
+using save_layout::kGarageSlotCount;
 constexpr const char* kEmbeddedGarageCarNames[] = {
     "Bolt Ace Tudor",
     "Bolt Ace Touring",
@@ -4351,20 +4015,12 @@ bool IsGarageDisplayNameToken(const std::string& s) {
 }
 
 std::vector<std::string> ExtractAsciiRuns(const std::vector<std::uint8_t>& bytes, std::size_t minLen) {
+    std::vector<save_strings::StringRun> runs;
+    save_strings::ExtractRuns(bytes.data(), bytes.size(), minLen, &runs);
     std::vector<std::string> out;
-    std::string cur;
-    for (std::uint8_t b : bytes) {
-        if (IsPrintableAnsiByte(b)) {
-            cur.push_back(static_cast<char>(b));
-        } else {
-            if (cur.size() >= minLen) {
-                out.push_back(cur);
-            }
-            cur.clear();
-        }
-    }
-    if (cur.size() >= minLen) {
-        out.push_back(cur);
+    out.reserve(runs.size());
+    for (const auto& run : runs) {
+        out.emplace_back(reinterpret_cast<const char*>(bytes.data() + run.offset), run.length);
     }
     return out;
 }
@@ -1,7 +1,10 @@
 #include "mafia_save.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 
 namespace mafia_save {
@@ -40,17 +43,16 @@ void DecryptInPlace(std::vector<std::uint8_t>* bytes, CipherState* state) {
     }
 }
 
-void EncryptInPlace(std::vector<std::uint8_t>* bytes, CipherState* state) {
-    if (bytes == nullptr || state == nullptr) {
+void EncryptInPlace(std::uint8_t* data, std::size_t size, CipherState* state) {
+    if (data == nullptr || state == nullptr) {
         return;
     }
-    const std::size_t fullWords = bytes->size() / 4;
+    const std::size_t fullWords = size / 4;
     for (std::size_t i = 0; i < fullWords; ++i) {
-        const std::size_t off = i * 4;
-        const std::uint32_t plain = ReadU32LERaw(bytes->data() + off);
+        std::uint8_t* word = data + i * 4;
+        const std::uint32_t plain = ReadU32LERaw(word);
         state->key2 += plain;
-        const std::uint32_t cipher = plain ^ state->key1;
-        WriteU32LERaw(bytes->data() + off, cipher);
+        WriteU32LERaw(word, plain ^ state->key1);
         state->key1 += state->key2;
     }
 }
@@ -61,7 +63,8 @@ bool ReadEncryptedSegment(const std::vector<std::uint8_t>& raw,
                           const std::string& name,
                           CipherState* state,
                           SaveData* out,
-                          std::string* error) {
+                          std::string* error,
+                          std::vector<CipherCheckpoint>* checkpoints = nullptr) {
     if (cursor == nullptr || state == nullptr || out == nullptr) {
         if (error != nullptr) {
             *error = "internal null pointer while reading segment";
@@ -77,6 +80,9 @@ bool ReadEncryptedSegment(const std::vector<std::uint8_t>& raw,
         return false;
     }
 
+    if (checkpoints != nullptr) {
+        checkpoints->push_back(CipherCheckpoint{state->key1, state->key2});
+    }
     Segment seg;
     seg.name = name;
     seg.plain.assign(raw.begin() + static_cast<std::ptrdiff_t>(*cursor),
@@ -87,6 +93,44 @@ bool ReadEncryptedSegment(const std::vector<std::uint8_t>& raw,
     return true;
 }
 
+constexpr std::size_t kStatCount = static_cast<std::size_t>(Stat::kCount);
+// In Stat order.
+constexpr std::uint64_t Stats::*kStatFields[kStatCount] = {
+    &Stats::filesRead,       &Stats::bytesRead,    &Stats::bytesDecrypted,    &Stats::bytesEncrypted,
+    &Stats::segmentsParsed,  &Stats::actorsParsed, &Stats::allocations,       &Stats::programCandidates,
+    &Stats::layoutCacheHits, &Stats::layoutCacheMisses,
+    &Stats::readNs,          &Stats::parseNs,      &Stats::buildNs,           &Stats::detectNs,
+};
+
+struct StatSlots;
+
+std::atomic<bool> g_statsEnabled{false};
+std::mutex g_statsMutex;
+std::vector<StatSlots*> g_statSlots;  // one per live thread that has counted
+Stats g_statsRetired;                 // folded in from exited threads
+
+// Only the owning thread writes its slots, so a relaxed load and store replace a locked add.
+struct StatSlots {
+    std::array<std::atomic<std::uint64_t>, kStatCount> values{};
+
+    StatSlots() {
+        std::lock_guard<std::mutex> lock(g_statsMutex);
+        g_statSlots.push_back(this);
+    }
+    ~StatSlots() {
+        std::lock_guard<std::mutex> lock(g_statsMutex);
+        for (std::size_t i = 0; i < kStatCount; ++i) {
+            g_statsRetired.*kStatFields[i] += values[i].load(std::memory_order_relaxed);
+        }
+        g_statSlots.erase(std::find(g_statSlots.begin(), g_statSlots.end(), this));
+    }
+};
+
+StatSlots& LocalStatSlots() {
+    thread_local StatSlots slots;
+    return slots;
+}
+
 const std::vector<std::uint8_t>* GetSegment(const SaveData& save, std::size_t idx, std::string* error) {
     if (idx == kNoIndex || idx >= save.segments.size()) {
         if (error != nullptr) {
@@ -114,6 +158,7 @@ std::uint32_t ReadInfoField(const SaveData& save, std::size_t offset, std::strin
 }  // namespace
 
 std::vector<std::uint8_t> ReadFileBytes(const fs::path& path) {
+    const StatTimer timer(Stat::kReadNs);
     std::ifstream in(path, std::ios::binary);
     if (!in) {
         return {};
@@ -126,6 +171,24 @@ std::vector<std::uint8_t> ReadFileBytes(const fs::path& path) {
     if (size > 0) {
         in.read(reinterpret_cast<char*>(bytes.data()), size);
     }
+    AddStat(Stat::kFilesRead, 1);
+    AddStat(Stat::kBytesRead, bytes.size());
+    AddStat(Stat::kAllocations, 1);
+    return bytes;
+}
+
+std::vector<std::uint8_t> ReadFilePrefix(const fs::path& path, std::size_t maxBytes) {
+    const StatTimer timer(Stat::kReadNs);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return {};
+    }
+    std::vector<std::uint8_t> bytes(maxBytes);
+    in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(maxBytes));
+    bytes.resize(static_cast<std::size_t>(in.gcount()));
+    AddStat(Stat::kFilesRead, 1);
+    AddStat(Stat::kBytesRead, bytes.size());
+    AddStat(Stat::kAllocations, 1);
     return bytes;
 }
 
@@ -140,7 +203,39 @@ bool WriteFileBytes(const fs::path& path, const std::vector<std::uint8_t>& bytes
     return static_cast<bool>(out);
 }
 
+bool WriteFileBytesAtomic(const fs::path& path, const std::vector<std::uint8_t>& bytes, std::string* error) {
+    std::error_code ec;
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path(), ec);
+    }
+    fs::path tmp = path;
+    tmp += ".tmp";
+    if (!WriteFileBytes(tmp, bytes)) {
+        if (error != nullptr) {
+            *error = "failed to write " + tmp.string();
+        }
+        return false;
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        if (error != nullptr) {
+            *error = "failed to replace " + path.string();
+        }
+        return false;
+    }
+    return true;
+}
+
 bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string* error) {
+    return ParseSaveWithCheckpoints(raw, out, nullptr, error);
+}
+
+bool ParseSaveWithCheckpoints(const std::vector<std::uint8_t>& raw,
+                              SaveData* out,
+                              std::vector<CipherCheckpoint>* checkpoints,
+                              std::string* error) {
+    const StatTimer timer(Stat::kParseNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output save struct";
@@ -160,19 +255,21 @@ bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string*
 
     std::size_t cursor = kFileHeaderSize;
     CipherState state;
+    std::vector<CipherCheckpoint> found;
+    std::vector<CipherCheckpoint>* record = checkpoints != nullptr ? &found : nullptr;
 
     parsed.idxHead = parsed.segments.size();
-    if (!ReadEncryptedSegment(raw, &cursor, kBlockHeadSize, "head24", &state, &parsed, error)) {
+    if (!ReadEncryptedSegment(raw, &cursor, kBlockHeadSize, "head24", &state, &parsed, error, record)) {
         return false;
     }
 
     parsed.idxMeta = parsed.segments.size();
-    if (!ReadEncryptedSegment(raw, &cursor, kBlockMetaSize, "meta32", &state, &parsed, error)) {
+    if (!ReadEncryptedSegment(raw, &cursor, kBlockMetaSize, "meta32", &state, &parsed, error, record)) {
         return false;
     }
 
     parsed.idxInfo = parsed.segments.size();
-    if (!ReadEncryptedSegment(raw, &cursor, kBlockInfoSize, "info264", &state, &parsed, error)) {
+    if (!ReadEncryptedSegment(raw, &cursor, kBlockInfoSize, "info264", &state, &parsed, error, record)) {
         return false;
     }
 
@@ -181,7 +278,8 @@ bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string*
     const auto aiFollowSize = ReadAiFollowSize(parsed, error);
 
     parsed.idxGamePayload = parsed.segments.size();
-    if (!ReadEncryptedSegment(raw, &cursor, static_cast<std::size_t>(mainSize), "game_payload", &state, &parsed, error)) {
+    if (!ReadEncryptedSegment(
+            raw, &cursor, static_cast<std::size_t>(mainSize), "game_payload", &state, &parsed, error, record)) {
         return false;
     }
 
@@ -193,7 +291,8 @@ bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string*
                                   "ai_groups_payload",
                                   &state,
                                   &parsed,
-                                  error)) {
+                                  error,
+                                  record)) {
             return false;
         }
     }
@@ -206,7 +305,8 @@ bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string*
                                   "ai_follow_payload",
                                   &state,
                                   &parsed,
-                                  error)) {
+                                  error,
+                                  record)) {
             return false;
         }
     }
@@ -222,7 +322,7 @@ bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string*
 
         const std::string headerName = "actor_header_" + std::to_string(actorIndex);
         const std::size_t hdrIdx = parsed.segments.size();
-        if (!ReadEncryptedSegment(raw, &cursor, kActorHeaderSize, headerName, &state, &parsed, error)) {
+        if (!ReadEncryptedSegment(raw, &cursor, kActorHeaderSize, headerName, &state, &parsed, error, record)) {
             return false;
         }
         const auto payloadSize = ReadU32LE(parsed.segments[hdrIdx].plain, 132);
@@ -236,13 +336,21 @@ bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string*
         }
 
         const std::string payloadName = "actor_payload_" + std::to_string(actorIndex);
-        if (!ReadEncryptedSegment(raw, &cursor, payloadSize, payloadName, &state, &parsed, error)) {
+        if (!ReadEncryptedSegment(raw, &cursor, payloadSize, payloadName, &state, &parsed, error, record)) {
             return false;
         }
         ++actorIndex;
     }
 
     parsed.actorCount = actorIndex;
+    AddStat(Stat::kSegmentsParsed, parsed.segments.size());
+    AddStat(Stat::kActorsParsed, actorIndex);
+    AddStat(Stat::kBytesDecrypted, raw.size() - kFileHeaderSize);
+    AddStat(Stat::kAllocations, parsed.segments.size());
+    if (checkpoints != nullptr) {
+        found.push_back(CipherCheckpoint{state.key1, state.key2});
+        *checkpoints = std::move(found);
+    }
     *out = std::move(parsed);
     return true;
 }
@@ -255,15 +363,24 @@ bool BuildRaw(const SaveData& save, std::vector<std::uint8_t>* out, std::string*
         return false;
     }
 
-    std::vector<std::uint8_t> raw;
-    raw.insert(raw.end(), save.fileHeader.begin(), save.fileHeader.end());
+    const StatTimer timer(Stat::kBuildNs);
+    // One allocation: every segment is copied into place and encrypted there.
+    std::size_t total = kFileHeaderSize;
+    for (const auto& seg : save.segments) {
+        total += seg.plain.size();
+    }
+    std::vector<std::uint8_t> raw(total);
+    std::copy(save.fileHeader.begin(), save.fileHeader.end(), raw.begin());
 
     CipherState state;
+    std::size_t cursor = kFileHeaderSize;
     for (const auto& seg : save.segments) {
-        std::vector<std::uint8_t> cipher = seg.plain;
-        EncryptInPlace(&cipher, &state);
-        raw.insert(raw.end(), cipher.begin(), cipher.end());
+        std::copy(seg.plain.begin(), seg.plain.end(), raw.begin() + static_cast<std::ptrdiff_t>(cursor));
+        EncryptInPlace(raw.data() + cursor, seg.plain.size(), &state);
+        cursor += seg.plain.size();
     }
+    AddStat(Stat::kBytesEncrypted, total - kFileHeaderSize);
+    AddStat(Stat::kAllocations, 1);
 
     *out = std::move(raw);
     return true;
@@ -282,6 +399,79 @@ void WriteU32LE(std::vector<std::uint8_t>* bytes, std::size_t offset, std::uint3
     (*bytes)[offset + 3] = static_cast<std::uint8_t>((value >> 24) & 0xFFu);
 }
 
+std::string ReadCStr(const std::vector<std::uint8_t>& bytes, std::size_t offset, std::size_t cap) {
+    std::size_t len = 0;
+    while (len < cap && offset + len < bytes.size() && bytes[offset + len] != 0u) {
+        ++len;
+    }
+    return len == 0 ? std::string() : std::string(reinterpret_cast<const char*>(bytes.data() + offset), len);
+}
+
+std::string Lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+    return s;
+}
+
+std::string JsonEscape(const std::string& s) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(s.size());
+    for (const char ch : s) {
+        const unsigned char c = static_cast<unsigned char>(ch);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(ch);
+        } else if (c < 0x20u || c >= 0x7Fu) {
+            out += "\\u00";
+            out.push_back(kHex[c >> 4]);
+            out.push_back(kHex[c & 0xFu]);
+        } else {
+            out.push_back(ch);
+        }
+    }
+    return out;
+}
+
+std::vector<CipherCheckpoint> SegmentCheckpoints(const SaveData& save) {
+    std::vector<CipherCheckpoint> out;
+    out.reserve(save.segments.size());
+    CipherState state;
+    for (const auto& seg : save.segments) {
+        out.push_back(CipherCheckpoint{state.key1, state.key2});
+        const std::size_t fullWords = seg.plain.size() / 4;
+        for (std::size_t i = 0; i < fullWords; ++i) {
+            state.key2 += ReadU32LERaw(seg.plain.data() + i * 4);
+            state.key1 += state.key2;
+        }
+    }
+    return out;
+}
+
+void DecryptFromCheckpoint(std::vector<std::uint8_t>* bytes, const CipherCheckpoint& checkpoint) {
+    CipherState state{checkpoint.key1, checkpoint.key2};
+    DecryptInPlace(bytes, &state);
+    if (bytes != nullptr) {
+        AddStat(Stat::kBytesDecrypted, bytes->size());
+    }
+}
+
+void EncryptWithCheckpoint(std::vector<std::uint8_t>* bytes, CipherCheckpoint* checkpoint) {
+    if (bytes == nullptr) {
+        return;
+    }
+    EncryptRange(bytes->data(), bytes->size(), checkpoint);
+}
+
+void EncryptRange(std::uint8_t* data, std::size_t size, CipherCheckpoint* checkpoint) {
+    if (checkpoint == nullptr) {
+        return;
+    }
+    CipherState state{checkpoint->key1, checkpoint->key2};
+    EncryptInPlace(data, size, &state);
+    *checkpoint = CipherCheckpoint{state.key1, state.key2};
+    AddStat(Stat::kBytesEncrypted, size);
+}
+
 bool ReadMetaFields(const SaveData& save, MetaFields* out, std::string* error) {
     if (out == nullptr) {
         if (error != nullptr) {
@@ -311,6 +501,68 @@ bool ReadMetaFields(const SaveData& save, MetaFields* out, std::string* error) {
     return true;
 }
 
+bool ParseSaveHeader(const std::vector<std::uint8_t>& prefix, SaveData* out, std::string* error) {
+    const StatTimer timer(Stat::kParseNs);
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output save struct";
+        }
+        return false;
+    }
+    if (prefix.size() < kHeaderPrefixSize) {
+        if (error != nullptr) {
+            *error = "file is too small for head24/meta32/info264 blocks";
+        }
+        return false;
+    }
+
+    SaveData parsed;
+    parsed.rawSize = prefix.size();
+    std::copy(prefix.begin(), prefix.begin() + static_cast<std::ptrdiff_t>(kFileHeaderSize), parsed.fileHeader.begin());
+
+    std::size_t cursor = kFileHeaderSize;
+    CipherState state;
+    parsed.idxHead = parsed.segments.size();
+    if (!ReadEncryptedSegment(prefix, &cursor, kBlockHeadSize, "head24", &state, &parsed, error)) {
+        return false;
+    }
+    parsed.idxMeta = parsed.segments.size();
+    if (!ReadEncryptedSegment(prefix, &cursor, kBlockMetaSize, "meta32", &state, &parsed, error)) {
+        return false;
+    }
+    parsed.idxInfo = parsed.segments.size();
+    if (!ReadEncryptedSegment(prefix, &cursor, kBlockInfoSize, "info264", &state, &parsed, error)) {
+        return false;
+    }
+    AddStat(Stat::kSegmentsParsed, parsed.segments.size());
+    AddStat(Stat::kBytesDecrypted, cursor - kFileHeaderSize);
+    AddStat(Stat::kAllocations, parsed.segments.size());
+    *out = std::move(parsed);
+    return true;
+}
+
+bool PeekMetaFields(const std::vector<std::uint8_t>& prefix, MetaFields* out, std::string* error) {
+    if (prefix.size() < kMetaPrefixSize) {
+        if (error != nullptr) {
+            *error = "file is too small for head24/meta32 blocks";
+        }
+        return false;
+    }
+
+    SaveData partial;
+    std::size_t cursor = kFileHeaderSize;
+    CipherState state;
+    partial.idxHead = partial.segments.size();
+    if (!ReadEncryptedSegment(prefix, &cursor, kBlockHeadSize, "head24", &state, &partial, error)) {
+        return false;
+    }
+    partial.idxMeta = partial.segments.size();
+    if (!ReadEncryptedSegment(prefix, &cursor, kBlockMetaSize, "meta32", &state, &partial, error)) {
+        return false;
+    }
+    return ReadMetaFields(partial, out, error);
+}
+
 bool WriteHpPercent(SaveData* save, std::uint32_t hpPercent, std::string* error) {
     if (save == nullptr) {
         if (error != nullptr) {
@@ -458,4 +710,61 @@ std::uint32_t ReadAiFollowSize(const SaveData& save, std::string* error) {
     return ReadInfoField(save, 244, error);
 }
 
+Stats& Stats::operator+=(const Stats& other) {
+    for (const auto field : kStatFields) {
+        this->*field += other.*field;
+    }
+    return *this;
+}
+
+void EnableStats(bool enabled) {
+    g_statsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool StatsEnabled() {
+    return g_statsEnabled.load(std::memory_order_relaxed);
+}
+
+void AddStat(Stat stat, std::uint64_t value) {
+    if (!g_statsEnabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto& slot = LocalStatSlots().values[static_cast<std::size_t>(stat)];
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+Stats CollectStats() {
+    std::lock_guard<std::mutex> lock(g_statsMutex);
+    Stats total = g_statsRetired;
+    for (const StatSlots* slots : g_statSlots) {
+        for (std::size_t i = 0; i < kStatCount; ++i) {
+            total.*kStatFields[i] += slots->values[i].load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+void ResetStats() {
+    std::lock_guard<std::mutex> lock(g_statsMutex);
+    g_statsRetired = Stats{};
+    for (StatSlots* slots : g_statSlots) {
+        for (auto& v : slots->values) {
+            v.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+StatTimer::StatTimer(Stat stat) : stat_(stat), on_(StatsEnabled()) {
+    if (on_) {
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+StatTimer::~StatTimer() {
+    if (on_) {
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+        AddStat(stat_, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+}
+
 }  // namespace mafia_save
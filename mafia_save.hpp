@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
@@ -17,6 +18,10 @@ constexpr std::size_t kBlockMetaSize = 32;
 constexpr std::size_t kBlockInfoSize = 264;
 constexpr std::size_t kActorHeaderSize = 140;
 constexpr std::size_t kNoIndex = static_cast<std::size_t>(-1);
+// File header + head24 + meta32: enough to read MetaFields without decrypting the rest.
+constexpr std::size_t kMetaPrefixSize = kFileHeaderSize + kBlockHeadSize + kBlockMetaSize;
+// ... + info264: adds the mission name and the payload size fields.
+constexpr std::size_t kHeaderPrefixSize = kMetaPrefixSize + kBlockInfoSize;
 
 struct Segment {
     std::string name;
@@ -49,16 +54,50 @@ struct MetaFields {
     std::uint32_t missionCode = 0;
 };
 
+// G_Stream key state at a segment boundary; decryption can resume from it without the preceding bytes.
+struct CipherCheckpoint {
+    std::uint32_t key1 = 0x23101976u;
+    std::uint32_t key2 = 0x10072002u;
+};
+
 std::vector<std::uint8_t> ReadFileBytes(const fs::path& path);
+std::vector<std::uint8_t> ReadFilePrefix(const fs::path& path, std::size_t maxBytes);
 bool WriteFileBytes(const fs::path& path, const std::vector<std::uint8_t>& bytes);
+// Writes `path`.tmp (creating missing parent directories) and renames it over `path`, so a reader
+// never sees a half-written file.
+bool WriteFileBytesAtomic(const fs::path& path, const std::vector<std::uint8_t>& bytes, std::string* error = nullptr);
 
 bool ParseSave(const std::vector<std::uint8_t>& raw, SaveData* out, std::string* error = nullptr);
+// ParseSave that also records the key state at the start of every segment and after the last one
+// (segments.size() + 1 entries) from the same decryption pass.
+bool ParseSaveWithCheckpoints(const std::vector<std::uint8_t>& raw,
+                              SaveData* out,
+                              std::vector<CipherCheckpoint>* checkpoints,
+                              std::string* error = nullptr);
 bool BuildRaw(const SaveData& save, std::vector<std::uint8_t>* out, std::string* error = nullptr);
 
 std::uint32_t ReadU32LE(const std::vector<std::uint8_t>& bytes, std::size_t offset);
 void WriteU32LE(std::vector<std::uint8_t>* bytes, std::size_t offset, std::uint32_t value);
+// At most `cap` bytes from `offset`, up to the first NUL or the end of `bytes`.
+std::string ReadCStr(const std::vector<std::uint8_t>& bytes, std::size_t offset, std::size_t cap);
+// ASCII lower case.
+std::string Lower(std::string s);
+// Body of a JSON string literal: quote and backslash escaped, control and non-ASCII bytes as \u00XX
+// (save text is a single-byte code page), so the output is plain ASCII.
+std::string JsonEscape(const std::string& s);
+
+// Key state at the start of every segment, in segment order.
+std::vector<CipherCheckpoint> SegmentCheckpoints(const SaveData& save);
+void DecryptFromCheckpoint(std::vector<std::uint8_t>* bytes, const CipherCheckpoint& checkpoint);
+// Encrypts one segment's plaintext and advances the checkpoint to the start of the next segment.
+void EncryptWithCheckpoint(std::vector<std::uint8_t>* bytes, CipherCheckpoint* checkpoint);
+// Same for one segment's plaintext already placed in an output buffer.
+void EncryptRange(std::uint8_t* data, std::size_t size, CipherCheckpoint* checkpoint);
 
 bool ReadMetaFields(const SaveData& save, MetaFields* out, std::string* error = nullptr);
+// Decrypts head24, meta32 and info264 from a kHeaderPrefixSize file prefix; payload segments are left out.
+bool ParseSaveHeader(const std::vector<std::uint8_t>& prefix, SaveData* out, std::string* error = nullptr);
+bool PeekMetaFields(const std::vector<std::uint8_t>& prefix, MetaFields* out, std::string* error = nullptr);
 bool WriteHpPercent(SaveData* save, std::uint32_t hpPercent, std::string* error = nullptr);
 bool XorGamePayloadByte(SaveData* save, std::size_t payloadOffset, std::uint8_t mask, std::string* error = nullptr);
 bool XorFileOffsetByte(SaveData* save, std::size_t fileOffset, std::uint8_t mask, std::string* error = nullptr);
@@ -69,4 +108,66 @@ std::uint32_t ReadMainPayloadSize(const SaveData& save, std::string* error = nul
 std::uint32_t ReadAiGroupsSize(const SaveData& save, std::string* error = nullptr);
 std::uint32_t ReadAiFollowSize(const SaveData& save, std::string* error = nullptr);
 
+// Performance counters of mafia_save, profile_sav and the save_layout program detection. Off by
+// default: while off, every counting site costs one relaxed load. Once enabled, each thread counts
+// into its own slots with plain relaxed stores, and CollectStats sums the slots of live and exited
+// threads. Phase times are summed over threads, so with several threads they can exceed wall time.
+struct Stats {
+    std::uint64_t filesRead = 0;
+    std::uint64_t bytesRead = 0;
+    std::uint64_t bytesDecrypted = 0;
+    std::uint64_t bytesEncrypted = 0;
+    std::uint64_t segmentsParsed = 0;  // profile .sav blocks included
+    std::uint64_t actorsParsed = 0;
+    std::uint64_t allocations = 0;        // byte buffers allocated for file contents, segments and builds
+    std::uint64_t programCandidates = 0;  // offsets handed to TryParseProgramLayoutAt by detection
+    std::uint64_t layoutCacheHits = 0;
+    std::uint64_t layoutCacheMisses = 0;
+    std::uint64_t readNs = 0;    // ReadFileBytes, ReadFilePrefix
+    std::uint64_t parseNs = 0;   // ParseSave*, ParseSaveHeader, profile_sav Parse*
+    std::uint64_t buildNs = 0;   // BuildRaw of both libraries
+    std::uint64_t detectNs = 0;  // DetectProgramLayout
+
+    Stats& operator+=(const Stats& other);
+};
+
+enum class Stat : std::uint8_t {
+    kFilesRead,
+    kBytesRead,
+    kBytesDecrypted,
+    kBytesEncrypted,
+    kSegmentsParsed,
+    kActorsParsed,
+    kAllocations,
+    kProgramCandidates,
+    kLayoutCacheHits,
+    kLayoutCacheMisses,
+    kReadNs,
+    kParseNs,
+    kBuildNs,
+    kDetectNs,
+    kCount
+};
+
+void EnableStats(bool enabled);
+bool StatsEnabled();
+void AddStat(Stat stat, std::uint64_t value);
+Stats CollectStats();
+// Zeroes every slot; call while no other thread is counting.
+void ResetStats();
+
+// Adds its lifetime in nanoseconds to `stat` when stats were enabled at construction.
+class StatTimer {
+public:
+    explicit StatTimer(Stat stat);
+    ~StatTimer();
+    StatTimer(const StatTimer&) = delete;
+    StatTimer& operator=(const StatTimer&) = delete;
+
+private:
+    Stat stat_;
+    bool on_;
+    std::chrono::steady_clock::time_point start_;
+};
+
 }  // namespace mafia_save
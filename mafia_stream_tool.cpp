@@ -1,10 +1,38 @@
+#include "actor_refs.hpp"
 #include "mafia_save.hpp"
-
+#include "program_diff.hpp"
+#include "save_archive.hpp"
+#include "save_bench.hpp"
+#include "save_edit.hpp"
+#include "save_experiment.hpp"
+#include "save_index.hpp"
+#include "save_json.hpp"
+#include "save_lint.hpp"
+#include "save_postings.hpp"
+#include "save_query.hpp"
+#include "save_scan.hpp"
+#include "save_search.hpp"
+#include "save_server.hpp"
+#include "save_similarity.hpp"
+#include "save_strings.hpp"
+#include "save_synth.hpp"
+#include "save_timeline.hpp"
+#include "save_transplant.hpp"
+#include "save_watch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <optional>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -17,10 +45,40 @@ void PrintUsage() {
     std::cout << "Usage:\n"
               << "  mafia_stream_tool inspect <save_file>\n"
               << "  mafia_stream_tool set-hp <input_file> <output_file> <hp_percent>\n"
-              << "  mafia_stream_tool batch005 <base_file> <output_dir>\n"
-              << "  mafia_stream_tool batch006 <base_file> <output_dir>\n"
-              << "  mafia_stream_tool batch007 <base_file> <output_dir>\n"
-              << "  mafia_stream_tool batch008 <base_file> <output_dir>\n";
+              << "  mafia_stream_tool find <save_file> <u8|u16|u32|f32|f64|bytes|ascii> <value|lo..hi> [--tol <t>] "
+                 "[--align <n>] [--limit <n>]\n"
+              << "  mafia_stream_tool strings <save_file> [min_len]\n"
+              << "  mafia_stream_tool xref <save_file> <text> [--contains]\n"
+              << "  mafia_stream_tool refs <save_file> [actor_name]\n"
+              << "  mafia_stream_tool rename-actor <input_file> <output_file> <old_name> <new_name>\n"
+              << "  mafia_stream_tool remove-actor <input_file> <output_file> <actor_name>\n"
+              << "  mafia_stream_tool timeline <save_dir> <output.csv|output.mstl> [--fields <list>] [--slot <lo..hi>] "
+                 "[--date <yyyymmdd..yyyymmdd>] [--threads <n>]\n"
+              << "  mafia_stream_tool vardiff <save_dir|save_file>... [--threads <n>]\n"
+              << "  mafia_stream_tool scan <dir> [--out <file>] [--format ndjson|csv] [--threads <n>] [--header-only]\n"
+              << "  mafia_stream_tool export <save_dir|save_file>... [--out <file>] [--format json|ndjson] [--threads <n>]\n"
+              << "  mafia_stream_tool import <json_file|-> <out_file|out_dir>\n"
+              << "  mafia_stream_tool lint <save_dir|save_file>... [--out <file>] [--threads <n>]\n"
+              << "  mafia_stream_tool index <dir> [--threads <n>] [--rebuild] [--list]\n"
+              << "  mafia_stream_tool archive add <archive> <save_dir|save_file>... [--threads <n>]\n"
+              << "  mafia_stream_tool archive list <archive>\n"
+              << "  mafia_stream_tool archive extract <archive> <id|name> <out_file>\n"
+              << "  mafia_stream_tool find-saves <dir> <query...> [--no-refresh]\n"
+              << "  mafia_stream_tool query <dir> <expression...> [--threads <n>]\n"
+              << "  mafia_stream_tool similar <save_dir|save_file|archive>... --to <save_file> [--top <n>] [--exhaustive] [--threads <n>]\n"
+              << "  mafia_stream_tool dedup-report <save_dir|save_file|archive>... [--threshold <0..1>] [--threads <n>]\n"
+              << "  mafia_stream_tool watch <dir> [--backup-dir <dir>] [--settle-ms <n>] [--poll] [--poll-ms <n>] [--no-sweep]\n"
+              << "  mafia_stream_tool apply <script_file> <save_dir|save_file>... [--write] [--out <dir>] [--threads <n>]\n"
+              << "  mafia_stream_tool transplant <source_file> <save_dir|save_file>... [--actor <name>]... [--type <n>] "
+                 "[--on-collision replace|rename|skip] [--write] [--out <dir>] [--threads <n>]\n"
+              << "  mafia_stream_tool serve <socket_path> [--cache-mb <n>] [--threads <n>]\n"
+              << "  mafia_stream_tool synth <out_file|out_dir> [--count <n>] [--seed <n>] [--actors <n>] [--humans <pct>] "
+                 "[--car-size <n>] [--mission <n>] [--program <regs,vars,actors,frames>] [--ai <groups,follow>] "
+                 "[--size-mb <n>] [--threads <n>]\n"
+              << "  mafia_stream_tool experiment <spec_file> [--base <file>] [--out <dir>] [--threads <n>] [--dry-run]\n"
+              << "  mafia_stream_tool bench <corpus_dir> [--reps <n>] [--threads <n>] [--work <dir>] [--baseline <csv>] "
+                 "[--threshold <pct>] [--write-baseline <csv>]\n"
+              << "Every command also takes --stats: I/O, cipher, parse and cache counters and phase times on stderr.\n";
 }
 
 std::optional<std::uint32_t> ParseU32(const std::string& s) {
@@ -32,6 +90,28 @@ std::optional<std::uint32_t> ParseU32(const std::string& s) {
     return static_cast<std::uint32_t>(v);
 }
 
+// "n" or "lo..hi".
+bool ParseU32Range(const std::string& s, std::uint32_t* lo, std::uint32_t* hi) {
+    const std::size_t sep = s.find("..");
+    const auto loOpt = ParseU32(s.substr(0, sep));
+    const auto hiOpt = sep == std::string::npos ? loOpt : ParseU32(s.substr(sep + 2));
+    if (!loOpt.has_value() || !hiOpt.has_value() || *loOpt > *hiOpt) {
+        return false;
+    }
+    *lo = *loOpt;
+    *hi = *hiOpt;
+    return true;
+}
+
+std::optional<double> ParseF64(const std::string& s) {
+    char* end = nullptr;
+    const double v = std::strtod(s.c_str(), &end);
+    if (s.empty() || end == nullptr || *end != '\0') {
+        return std::nullopt;
+    }
+    return v;
+}
+
 void DecodePackedTime(std::uint32_t packed, int* hour, int* minute, int* second) {
     if (hour != nullptr) {
         *hour = static_cast<int>((packed >> 16) & 0xFFu);
@@ -56,18 +136,6 @@ void DecodePackedDate(std::uint32_t packed, int* day, int* month, int* year) {
     }
 }
 
-std::size_t CountDiffBytes(const std::vector<std::uint8_t>& a, const std::vector<std::uint8_t>& b) {
-    const std::size_t n = std::min(a.size(), b.size());
-    std::size_t diff = 0;
-    for (std::size_t i = 0; i < n; ++i) {
-        if (a[i] != b[i]) {
-            ++diff;
-        }
-    }
-    diff += (a.size() > b.size()) ? (a.size() - b.size()) : (b.size() - a.size());
-    return diff;
-}
-
 int CmdInspect(const fs::path& savePath) {
     const auto raw = mafia_save::ReadFileBytes(savePath);
     if (raw.empty()) {
@@ -149,6 +217,109 @@ int CmdInspect(const fs::path& savePath) {
     return 0;
 }
 
+int CmdFind(const fs::path& savePath, const save_search::ValueQuery& query, std::size_t limit) {
+    const auto raw = mafia_save::ReadFileBytes(savePath);
+    if (raw.empty()) {
+        std::cerr << "Failed to read save file: " << savePath << "\n";
+        return 1;
+    }
+
+    mafia_save::SaveData save;
+    std::string err;
+    if (!mafia_save::ParseSave(raw, &save, &err)) {
+        std::cerr << "ParseSave failed: " << err << "\n";
+        return 1;
+    }
+
+    std::vector<save_search::Hit> hits;
+    const auto t0 = std::chrono::steady_clock::now();
+    if (!save_search::FindValues(save, query, &hits, &err)) {
+        std::cerr << "FindValues failed: " << err << "\n";
+        return 1;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const std::size_t shown = std::min(limit, hits.size());
+    for (std::size_t i = 0; i < shown; ++i) {
+        const auto& hit = hits[i];
+        std::cout << "hit segment[" << hit.segIdx << "] " << save.segments[hit.segIdx].name << " off=0x" << std::hex
+                  << hit.offset << " abs=0x" << hit.fileOffset << std::dec;
+        if (!hit.actorName.empty()) {
+            std::cout << " actor=\"" << hit.actorName << "\"";
+        }
+        std::cout << "\n";
+    }
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    std::cout << "hits=" << hits.size() << " shown=" << shown << " scanned_bytes=" << (raw.size() - mafia_save::kFileHeaderSize)
+              << " scan_us=" << us << "\n";
+    return 0;
+}
+
+bool LoadSave(const fs::path& savePath, mafia_save::SaveData* save) {
+    const auto raw = mafia_save::ReadFileBytes(savePath);
+    if (raw.empty()) {
+        std::cerr << "Failed to read save file: " << savePath << "\n";
+        return false;
+    }
+    std::string err;
+    if (!mafia_save::ParseSave(raw, save, &err)) {
+        std::cerr << "ParseSave failed: " << err << "\n";
+        return false;
+    }
+    return true;
+}
+
+void PrintOccurrence(const mafia_save::SaveData& save, const save_strings::Occurrence& occ) {
+    std::cout << "segment[" << occ.segIdx << "] " << save.segments[occ.segIdx].name << " off=0x" << std::hex << occ.offset
+              << std::dec << " len=" << occ.length << " hash=0x" << std::hex << std::setw(16) << std::setfill('0')
+              << occ.hash << std::dec << std::setfill(' ');
+    const std::string actorName = save_search::ActorNameForSegment(save, occ.segIdx);
+    if (!actorName.empty()) {
+        std::cout << " actor=\"" << actorName << "\"";
+    }
+    std::cout << " text=\"" << save_strings::OccurrenceText(save, occ) << "\"\n";
+}
+
+int CmdStrings(const fs::path& savePath, std::size_t minLen) {
+    mafia_save::SaveData save;
+    if (!LoadSave(savePath, &save)) {
+        return 1;
+    }
+    save_strings::StringIndex index;
+    std::string err;
+    const auto t0 = std::chrono::steady_clock::now();
+    if (!save_strings::BuildStringIndex(save, minLen, &index, &err)) {
+        std::cerr << "BuildStringIndex failed: " << err << "\n";
+        return 1;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    for (const auto& occ : index.occurrences) {
+        PrintOccurrence(save, occ);
+    }
+    std::cout << "strings=" << index.occurrences.size() << " distinct=" << index.byHash.size() << " index_us="
+              << std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() << "\n";
+    return 0;
+}
+
+int CmdXref(const fs::path& savePath, const std::string& text, bool contains) {
+    mafia_save::SaveData save;
+    if (!LoadSave(savePath, &save)) {
+        return 1;
+    }
+    save_strings::StringIndex index;
+    std::string err;
+    if (!save_strings::BuildStringIndex(save, std::min(text.size(), save_strings::kDefaultMinLen), &index, &err)) {
+        std::cerr << "BuildStringIndex failed: " << err << "\n";
+        return 1;
+    }
+    const auto refs = save_strings::FindReferences(save, index, text, !contains);
+    for (const auto& occ : refs) {
+        PrintOccurrence(save, occ);
+    }
+    std::cout << "references=" << refs.size() << "\n";
+    return 0;
+}
+
 bool WriteModified(const mafia_save::SaveData& save, const fs::path& outPath, std::string* errOut) {
     std::vector<std::uint8_t> raw;
     std::string err;
@@ -197,500 +368,1149 @@ int CmdSetHp(const fs::path& inPath, const fs::path& outPath, std::uint32_t hpPe
     return 0;
 }
 
-int CmdBatch005(const fs::path& basePath, const fs::path& outDir) {
-    const auto raw = mafia_save::ReadFileBytes(basePath);
-    if (raw.empty()) {
-        std::cerr << "Failed to read base save file: " << basePath << "\n";
-        return 1;
+void PrintActorRef(const mafia_save::SaveData& save, const actor_refs::ActorRef& ref) {
+    std::cout << "  ref kind=" << actor_refs::RefKindName(ref.kind) << " segment[" << ref.segIdx << "] "
+              << save.segments[ref.segIdx].name << " off=0x" << std::hex << ref.offset << std::dec
+              << " index=" << ref.tableIndex;
+    if (ref.fieldSize != 0) {
+        std::cout << " field=" << ref.fieldSize;
+    } else {
+        std::cout << " chunk=" << (8 + mafia_save::ReadU32LE(save.segments[ref.segIdx].plain, ref.offset));
     }
+    std::cout << "\n";
+}
 
-    mafia_save::SaveData base;
-    std::string err;
-    if (!mafia_save::ParseSave(raw, &base, &err)) {
-        std::cerr << "ParseSave failed: " << err << "\n";
-        return 1;
+// Name occurrences that no recorded reference covers, i.e. positions a rename would not touch.
+std::size_t PrintUnrecordedOccurrences(const mafia_save::SaveData& save,
+                                       const actor_refs::ActorGraph& graph,
+                                       const save_strings::StringIndex& index,
+                                       const std::string& name) {
+    std::set<std::pair<std::size_t, std::size_t>> recorded;
+    const auto it = graph.byName.find(name);
+    if (it != graph.byName.end()) {
+        for (std::size_t refIdx : it->second) {
+            const auto& ref = graph.refs[refIdx];
+            recorded.insert({ref.segIdx, ref.fieldSize != 0 ? ref.offset : ref.offset + 8});
+        }
     }
-
-    fs::create_directories(outDir);
-
-    auto writeVariant = [&](const std::string& fileName, const mafia_save::SaveData& variant) -> bool {
-        const fs::path outPath = outDir / fileName;
-        std::string localErr;
-        if (!WriteModified(variant, outPath, &localErr)) {
-            std::cerr << "Failed to write " << outPath << ": " << localErr << "\n";
-            return false;
+    std::size_t count = 0;
+    for (const auto& occ : save_strings::FindReferences(save, index, name)) {
+        if (recorded.count({occ.segIdx, occ.offset}) != 0) {
+            continue;
         }
-        return true;
-    };
+        std::cout << "  unrecorded ";
+        PrintOccurrence(save, occ);
+        ++count;
+    }
+    return count;
+}
 
-    mafia_save::SaveData v22 = base;
-    if (!writeVariant("mafia004.230_22", v22)) {
+int CmdRefs(const fs::path& savePath, const std::string& onlyName) {
+    mafia_save::SaveData save;
+    if (!LoadSave(savePath, &save)) {
         return 1;
     }
-
-    mafia_save::SaveData v23 = base;
-    if (!mafia_save::XorFileOffsetByte(&v23, 0x400u, 0x01u, &err)) {
-        std::cerr << "Failed to patch v23: " << err << "\n";
+    actor_refs::ActorGraph graph;
+    save_strings::StringIndex index;
+    std::string err;
+    const auto t0 = std::chrono::steady_clock::now();
+    if (!actor_refs::BuildActorGraph(save, &graph, &err)) {
+        std::cerr << "BuildActorGraph failed: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_23", v23)) {
+    const auto t1 = std::chrono::steady_clock::now();
+    if (!save_strings::BuildStringIndex(save, 1, &index, &err)) {
+        std::cerr << "BuildStringIndex failed: " << err << "\n";
         return 1;
     }
 
-    mafia_save::SaveData v24 = base;
-    if (!mafia_save::XorFileOffsetByte(&v24, 0x800u, 0x01u, &err)) {
-        std::cerr << "Failed to patch v24: " << err << "\n";
+    std::size_t shownActors = 0;
+    std::size_t unrecorded = 0;
+    for (const auto& actor : graph.actors) {
+        if (!onlyName.empty() && actor.name != onlyName) {
+            continue;
+        }
+        std::cout << "actor name=\"" << actor.name << "\" model=\"" << actor.model << "\" type=" << actor.type
+                  << " idx=0x" << std::hex << actor.slotIdx << std::dec << " header=segment[" << actor.headerSegIdx
+                  << "]\n";
+        const auto it = graph.byName.find(actor.name);
+        if (it != graph.byName.end()) {
+            for (std::size_t refIdx : it->second) {
+                PrintActorRef(save, graph.refs[refIdx]);
+            }
+        }
+        unrecorded += PrintUnrecordedOccurrences(save, graph, index, actor.name);
+        ++shownActors;
+    }
+    // Names that scripts/AI refer to but that have no header in this save (scene actors).
+    std::set<std::string> seen;
+    for (const auto& actor : graph.actors) {
+        seen.insert(actor.name);
+    }
+    for (const auto& ref : graph.refs) {
+        if ((!onlyName.empty() && ref.name != onlyName) || !seen.insert(ref.name).second) {
+            continue;
+        }
+        std::cout << "external name=\"" << ref.name << "\"\n";
+        for (std::size_t refIdx : graph.byName.at(ref.name)) {
+            PrintActorRef(save, graph.refs[refIdx]);
+        }
+    }
+    for (const auto& warning : graph.warnings) {
+        std::cout << "warning: " << warning << "\n";
+    }
+    std::cout << "actors=" << shownActors << " refs=" << graph.refs.size() << " unrecorded=" << unrecorded
+              << " graph_us=" << std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() << "\n";
+    return 0;
+}
+
+int CmdEditActor(const fs::path& inPath,
+                 const fs::path& outPath,
+                 const std::string& name,
+                 const std::optional<std::string>& newName) {
+    mafia_save::SaveData save;
+    if (!LoadSave(inPath, &save)) {
         return 1;
     }
-    if (!writeVariant("mafia004.230_24", v24)) {
+    actor_refs::ActorGraph graph;
+    std::string err;
+    if (!actor_refs::BuildActorGraph(save, &graph, &err)) {
+        std::cerr << "BuildActorGraph failed: " << err << "\n";
         return 1;
     }
+    for (const auto& warning : graph.warnings) {
+        std::cerr << "warning: " << warning << "\n";
+    }
 
-    std::vector<std::uint8_t> raw22;
-    std::vector<std::uint8_t> raw23;
-    std::vector<std::uint8_t> raw24;
-    if (!mafia_save::BuildRaw(v22, &raw22) || !mafia_save::BuildRaw(v23, &raw23) || !mafia_save::BuildRaw(v24, &raw24)) {
-        std::cerr << "Internal error while rebuilding variants" << "\n";
+    std::size_t changed = 0;
+    const bool ok = newName.has_value() ? actor_refs::RenameActor(&save, graph, name, *newName, &changed, &err)
+                                        : actor_refs::RemoveActor(&save, graph, name, &changed, &err);
+    if (!ok) {
+        std::cerr << (newName.has_value() ? "RenameActor" : "RemoveActor") << " failed: " << err << "\n";
+        return 1;
+    }
+    if (!WriteModified(save, outPath, &err)) {
+        std::cerr << "Write failed: " << err << "\n";
         return 1;
     }
 
-    const fs::path notePath = outDir / "RESULTS_SERIES_005_plan.txt";
-    std::vector<std::string> lines;
-    lines.push_back("Compact batch 005 (3 tests, encrypted stream-aware edits)");
-    lines.push_back("");
-    lines.push_back("Base file: " + basePath.string());
-    lines.push_back("Generation method: decrypt -> edit plaintext -> re-encrypt full stream");
-    lines.push_back("");
-    lines.push_back("- mafia004.230_22: control roundtrip, no plaintext edits");
-    lines.push_back("  Purpose: verify parser/encrypter stability (should behave exactly like base save).");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw22)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_23: XOR plaintext byte at absolute file offset 0x400 with 0x01");
-    lines.push_back("  Purpose: compare with old _20 result, but now without stream desync.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw23)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_24: XOR plaintext byte at absolute file offset 0x800 with 0x01");
-    lines.push_back("  Purpose: compare with old _21 result, but now without stream desync.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw24)));
-    lines.push_back("");
-    lines.push_back("What to report:");
-    lines.push_back("1) menu title/image/stats");
-    lines.push_back("2) load progress stage (percent)");
-    lines.push_back("3) whether mission starts, and if yes, where/with what behavior");
+    std::cout << "input=" << inPath.string() << "\n";
+    std::cout << "output=" << outPath.string() << "\n";
+    std::cout << "actor=" << name << "\n";
+    if (newName.has_value()) {
+        std::cout << "new_name=" << *newName << "\n";
+    }
+    std::cout << "refs_updated=" << changed << "\n";
+    std::cout << "actors=" << save.actorCount << "\n";
+    std::cout << "output_size=" << save.rawSize << "\n";
+    return 0;
+}
 
-    std::string content;
-    for (const auto& line : lines) {
-        content += line;
-        content += "\n";
+int CmdTimeline(const fs::path& saveDir,
+                const fs::path& outPath,
+                const std::vector<save_timeline::FieldSpec>& fields,
+                const save_timeline::HeaderFilter& filter,
+                unsigned threads) {
+    const auto t0 = std::chrono::steady_clock::now();
+    save_timeline::Timeline timeline;
+    std::string err;
+    if (!save_timeline::BuildTimeline(saveDir, fields, filter, threads, &timeline, &err)) {
+        std::cerr << "BuildTimeline failed: " << err << "\n";
+        return 1;
     }
-    if (!mafia_save::WriteFileBytes(notePath, std::vector<std::uint8_t>(content.begin(), content.end()))) {
-        std::cerr << "Failed to write note file: " << notePath << "\n";
+    const bool csv = outPath.extension() == ".csv";
+    const bool ok = csv ? save_timeline::WriteCsv(timeline, outPath, &err)
+                        : save_timeline::WriteColumnar(timeline, outPath, &err);
+    if (!ok) {
+        std::cerr << "Write failed: " << err << "\n";
         return 1;
     }
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
 
-    std::cout << "Generated: " << (outDir / "mafia004.230_22").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_23").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_24").string() << "\n";
-    std::cout << "Plan note: " << notePath.string() << "\n";
+    std::cout << "output=" << outPath.string() << "\n";
+    std::cout << "format=" << (csv ? "csv" : "mstl") << "\n";
+    std::cout << "columns=" << timeline.fields.size() << "\n";
+    std::cout << "rows=" << timeline.rows.size() << "\n";
+    std::cout << "filtered=" << timeline.filtered << "\n";
+    std::cout << "failed=" << timeline.failed << "\n";
+    std::cout << "elapsed_ms=" << ms << "\n";
     return 0;
 }
 
-int CmdBatch006(const fs::path& basePath, const fs::path& outDir) {
-    const auto raw = mafia_save::ReadFileBytes(basePath);
-    if (raw.empty()) {
-        std::cerr << "Failed to read base save file: " << basePath << "\n";
-        return 1;
+std::string FormatF32Bits(std::uint32_t bits) {
+    float v = 0.0f;
+    std::memcpy(&v, &bits, sizeof(v));
+    std::ostringstream oss;
+    oss << v;
+    return oss.str();
+}
+
+int CmdVarDiff(const std::vector<fs::path>& inputs, unsigned threads) {
+    std::vector<fs::path> files;
+    for (const auto& in : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(in, ec)) {
+            for (const auto& entry : fs::directory_iterator(in, ec)) {
+                if (entry.is_regular_file(ec)) {
+                    files.push_back(entry.path());
+                }
+            }
+        } else {
+            files.push_back(in);
+        }
     }
 
-    mafia_save::SaveData base;
+    const auto t0 = std::chrono::steady_clock::now();
+    program_diff::LoadReport report;
     std::string err;
-    if (!mafia_save::ParseSave(raw, &base, &err)) {
-        std::cerr << "ParseSave failed: " << err << "\n";
+    if (!program_diff::LoadSnapshots(files, threads, &report, &err)) {
+        std::cerr << "LoadSnapshots failed: " << err << "\n";
         return 1;
     }
+    const auto groups = program_diff::BuildVarDiff(report.snapshots);
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
 
-    std::size_t actorHeader0Abs = static_cast<std::size_t>(-1);
-    std::size_t actorHeader1Abs = static_cast<std::size_t>(-1);
-    std::size_t abs = mafia_save::kFileHeaderSize;
-    for (const auto& seg : base.segments) {
-        if (seg.name == "actor_header_0") {
-            actorHeader0Abs = abs;
-        } else if (seg.name == "actor_header_1") {
-            actorHeader1Abs = abs;
+    for (std::size_t gi = 0; gi < groups.size(); ++gi) {
+        const auto& g = groups[gi];
+        const auto& first = report.snapshots[g.members.front()];
+        std::size_t changedVars = 0;
+        for (std::uint32_t c : g.changeCount) {
+            changedVars += c != 0u ? 1u : 0u;
+        }
+        std::cout << "group=" << gi << " mission=" << g.mission << " signature=0x" << std::hex << std::setw(16)
+                  << std::setfill('0') << g.signature << std::dec << std::setfill(' ') << " saves=" << g.members.size()
+                  << " vars=" << g.varCount << " actors=" << first.actors.size() << " frames=" << first.frames.size()
+                  << " changed_vars=" << changedVars << "\n";
+        for (std::size_t k = 0; k < g.members.size(); ++k) {
+            const auto& snap = report.snapshots[g.members[k]];
+            int dd = 0;
+            int mo = 0;
+            int yy = 0;
+            int hh = 0;
+            int mm = 0;
+            int ss = 0;
+            DecodePackedDate(snap.meta.packedDate, &dd, &mo, &yy);
+            DecodePackedTime(snap.meta.packedTime, &hh, &mm, &ss);
+            std::cout << "  save[" << k << "]=" << snap.path.filename().string() << " date=" << dd << "." << mo << "."
+                      << yy << " time=" << hh << ":" << mm << ":" << ss << " slot=" << snap.meta.slot << " program="
+                      << snap.segment << "+" << snap.baseOff << "\n";
+        }
+        const std::size_t t = g.transitions();
+        for (std::size_t v = 0; v < g.varCount; ++v) {
+            if (g.changeCount[v] == 0u) {
+                continue;
+            }
+            std::string matrix(t, '.');
+            for (std::size_t k = 0; k < t; ++k) {
+                if (g.changed[v * t + k] != 0u) {
+                    matrix[k] = '*';
+                }
+            }
+            std::cout << "  var[" << v << "] changes=" << g.changeCount[v] << " matrix=" << matrix
+                      << " first=" << FormatF32Bits(first.vars[v])
+                      << " last=" << FormatF32Bits(report.snapshots[g.members.back()].vars[v]) << "\n";
         }
-        abs += seg.plain.size();
     }
-    if (actorHeader0Abs == static_cast<std::size_t>(-1) || actorHeader1Abs == static_cast<std::size_t>(-1)) {
-        std::cerr << "Expected actor_header_0 and actor_header_1 are missing in base file\n";
+    std::cout << "files=" << files.size() << " programs=" << report.snapshots.size() << " no_program=" << report.noProgram
+              << " failed=" << report.failed << " groups=" << groups.size() << " elapsed_ms=" << ms << "\n";
+    return 0;
+}
+
+int CmdScan(const fs::path& root,
+            const std::optional<fs::path>& outPath,
+            bool csv,
+            const save_scan::ScanOptions& options) {
+    const auto t0 = std::chrono::steady_clock::now();
+    save_scan::ScanReport report;
+    std::string err;
+    if (!save_scan::ScanDirectory(root, options, &report, &err)) {
+        std::cerr << "ScanDirectory failed: " << err << "\n";
         return 1;
     }
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
 
-    fs::create_directories(outDir);
-    auto writeVariant = [&](const std::string& fileName, const mafia_save::SaveData& variant) -> bool {
-        const fs::path outPath = outDir / fileName;
-        std::string localErr;
-        if (!WriteModified(variant, outPath, &localErr)) {
-            std::cerr << "Failed to write " << outPath << ": " << localErr << "\n";
-            return false;
+    std::ofstream file;
+    if (outPath.has_value()) {
+        file.open(*outPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to open output file: " << outPath->string() << "\n";
+            return 1;
         }
-        return true;
-    };
-
-    mafia_save::SaveData v25 = base;
-    if (!writeVariant("mafia004.230_25", v25)) {
+    }
+    std::ostream& out = outPath.has_value() ? static_cast<std::ostream&>(file) : std::cout;
+    if (csv) {
+        save_scan::WriteCsvHeader(out);
+    }
+    for (const auto& rec : report.records) {
+        if (csv) {
+            save_scan::WriteCsvRecord(out, rec);
+        } else {
+            save_scan::WriteNdjsonRecord(out, rec);
+        }
+    }
+    out.flush();
+    if (!out) {
+        std::cerr << "Failed to write scan records\n";
         return 1;
     }
 
-    mafia_save::SaveData v26 = base;
-    if (!mafia_save::SetFileOffsetByte(&v26, actorHeader0Abs, 0x00, &err)) {
-        std::cerr << "Failed to patch v26: " << err << "\n";
-        return 1;
+    // Records own stdout when no --out is given; keep the summary out of the data stream.
+    std::ostream& summary = outPath.has_value() ? std::cout : std::cerr;
+    if (outPath.has_value()) {
+        summary << "output=" << outPath->string() << "\n";
+    }
+    summary << "files=" << report.files << " parsed=" << report.parsed << " failed=" << report.failed
+            << " threads=" << report.threads << " elapsed_ms=" << ms << "\n";
+    return 0;
+}
+
+int CmdExport(const std::vector<fs::path>& inputs,
+              const std::optional<fs::path>& outPath,
+              save_json::Format format,
+              unsigned threads) {
+    std::ofstream file;
+    if (outPath.has_value()) {
+        file.open(*outPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to open output file: " << outPath->string() << "\n";
+            return 1;
+        }
     }
-    if (!writeVariant("mafia004.230_26", v26)) {
+    std::ostream& out = outPath.has_value() ? static_cast<std::ostream&>(file) : std::cout;
+    const auto t0 = std::chrono::steady_clock::now();
+    save_json::ExportStats stats;
+    std::string err;
+    if (!save_json::ExportFiles(inputs, format, threads, out, &stats, &err)) {
+        std::cerr << "Export failed: " << err << "\n";
         return 1;
     }
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    for (const auto& e : stats.errors) {
+        std::cerr << "failed " << e << "\n";
+    }
+
+    std::ostream& summary = outPath.has_value() ? std::cout : std::cerr;
+    if (outPath.has_value()) {
+        summary << "output=" << outPath->string() << "\n";
+    }
+    summary << "files=" << stats.files << " failed=" << stats.failed << " bytes_in=" << stats.bytesIn
+            << " bytes_out=" << stats.bytesOut << " threads=" << stats.threads << " elapsed_ms=" << us / 1000
+            << " out_mb_per_s=" << std::fixed << std::setprecision(1)
+            << (us > 0 ? static_cast<double>(stats.bytesOut) / static_cast<double>(us) : 0.0) << "\n";
+    return stats.failed == 0 ? 0 : 1;
+}
 
-    mafia_save::SaveData v27 = base;
-    if (!mafia_save::SetFileOffsetByte(&v27, actorHeader1Abs, 0x00, &err)) {
-        std::cerr << "Failed to patch v27: " << err << "\n";
+int CmdImport(const std::string& inPath, const fs::path& outPath) {
+    std::string text;
+    if (inPath == "-") {
+        std::ostringstream ss;
+        ss << std::cin.rdbuf();
+        text = ss.str();
+    } else {
+        const auto bytes = mafia_save::ReadFileBytes(inPath);
+        if (bytes.empty()) {
+            std::cerr << "Failed to read " << inPath << "\n";
+            return 1;
+        }
+        text.assign(bytes.begin(), bytes.end());
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    save_json::ImportStats stats;
+    std::string err;
+    if (!save_json::ImportText(text, outPath, &stats, &err)) {
+        std::cerr << "Import failed: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_27", v27)) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "saves=" << stats.saves << " bytes_in=" << stats.bytesIn << " bytes_out=" << stats.bytesOut
+              << " elapsed_ms=" << us / 1000 << " in_mb_per_s=" << std::fixed << std::setprecision(1)
+              << (us > 0 ? static_cast<double>(stats.bytesIn) / static_cast<double>(us) : 0.0) << "\n";
+    return 0;
+}
+
+int CmdLint(const std::vector<fs::path>& inputs,
+            const std::optional<fs::path>& outPath,
+            const save_lint::LintOptions& options) {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<save_lint::FileReport> reports;
+    save_lint::LintSummary summary;
+    std::string err;
+    if (!save_lint::Lint(inputs, options, &reports, &summary, &err)) {
+        std::cerr << "Lint failed: " << err << "\n";
         return 1;
     }
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
 
-    std::vector<std::uint8_t> raw25;
-    std::vector<std::uint8_t> raw26;
-    std::vector<std::uint8_t> raw27;
-    if (!mafia_save::BuildRaw(v25, &raw25) || !mafia_save::BuildRaw(v26, &raw26) || !mafia_save::BuildRaw(v27, &raw27)) {
-        std::cerr << "Internal error while rebuilding variants\n";
+    std::ofstream file;
+    if (outPath.has_value()) {
+        file.open(*outPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to open output file: " << outPath->string() << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = outPath.has_value() ? static_cast<std::ostream&>(file) : std::cout;
+    for (const auto& r : reports) {
+        save_lint::WriteNdjson(out, r);
+    }
+    out.flush();
+    if (!out) {
+        std::cerr << "Failed to write lint findings\n";
         return 1;
     }
 
-    const fs::path notePath = outDir / "RESULTS_SERIES_006_plan.txt";
-    std::vector<std::string> lines;
-    lines.push_back("Compact batch 006 (actor-header mapping tests)");
-    lines.push_back("");
-    lines.push_back("Base file: " + basePath.string());
-    lines.push_back("Based on recovered SaveProc/SaveGameLoad actor mapping by actor name.");
-    lines.push_back("");
-    lines.push_back("- mafia004.230_25: control copy of base");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw25)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_26: actor_header_0 name first byte set to 0x00");
-    lines.push_back("  Absolute offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << actorHeader0Abs; return oss.str(); }());
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw26)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_27: actor_header_1 name first byte set to 0x00");
-    lines.push_back("  Absolute offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << actorHeader1Abs; return oss.str(); }());
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw27)));
-    lines.push_back("");
-    lines.push_back("What to report:");
-    lines.push_back("1) menu title/image/stats");
-    lines.push_back("2) load progress stage");
-    lines.push_back("3) whether mission starts, and if yes, any broken scripts/softlock/fail state");
+    // Findings own stdout when no --out is given; keep the summary out of the data stream.
+    std::ostream& summaryOut = outPath.has_value() ? std::cout : std::cerr;
+    if (outPath.has_value()) {
+        summaryOut << "output=" << outPath->string() << "\n";
+    }
+    summaryOut << "files=" << summary.files << " clean=" << summary.clean << " with_errors=" << summary.withErrors
+               << " warnings_only=" << summary.withWarnings << " threads=" << summary.threads
+               << " elapsed_ms=" << us / 1000 << " mb_per_s=" << std::fixed << std::setprecision(1)
+               << (us > 0 ? static_cast<double>(summary.bytes) / static_cast<double>(us) : 0.0) << "\n";
+    return summary.withErrors == 0 ? 0 : 1;
+}
+
+int CmdIndex(const fs::path& root, unsigned threads, bool rebuild, bool list) {
+    const auto t0 = std::chrono::steady_clock::now();
+    const fs::path file = save_index::DefaultIndexPath(root);
+    save_index::Index index;
+    std::string err;
+    bool loaded = false;
+    if (!rebuild && fs::exists(file)) {
+        loaded = save_index::LoadIndex(file, &index, &err);
+        if (!loaded) {
+            std::cerr << "warning: ignoring index (" << err << ")\n";
+        }
+    }
+    const auto t1 = std::chrono::steady_clock::now();
 
-    std::string content;
-    for (const auto& line : lines) {
-        content += line;
-        content += "\n";
+    save_index::RefreshStats stats;
+    if (!save_index::RefreshIndex(root, &index, threads, &stats, &err)) {
+        std::cerr << "RefreshIndex failed: " << err << "\n";
+        return 1;
+    }
+    if ((stats.changed || !loaded) && !save_index::WriteIndex(index, file, &err)) {
+        std::cerr << "WriteIndex failed: " << err << "\n";
+        return 1;
     }
-    if (!mafia_save::WriteFileBytes(notePath, std::vector<std::uint8_t>(content.begin(), content.end()))) {
-        std::cerr << "Failed to write note file: " << notePath << "\n";
+    save_postings::PostingIndex postings;
+    bool postingsRebuilt = false;
+    if (!save_postings::OpenPostings(root, index, &postings, &postingsRebuilt, &err)) {
+        std::cerr << "OpenPostings failed: " << err << "\n";
         return 1;
     }
+    const auto t2 = std::chrono::steady_clock::now();
 
-    std::cout << "Generated: " << (outDir / "mafia004.230_25").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_26").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_27").string() << "\n";
-    std::cout << "Plan note: " << notePath.string() << "\n";
+    if (list) {
+        for (const auto& e : index.entries) {
+            if (!e.isSave) {
+                continue;
+            }
+            std::cout << e.path.generic_string() << " size=" << e.size << " parsed=" << (e.parsed ? 1 : 0)
+                      << " mission=" << e.mission << " slot=" << e.meta.slot << " segments=" << e.segments.size()
+                      << " actors=" << e.actors.size() << " hash=0x" << std::hex << std::setw(16) << std::setfill('0')
+                      << e.hash << std::dec << std::setfill(' ') << "\n";
+        }
+    }
+    std::size_t saves = 0;
+    for (const auto& e : index.entries) {
+        saves += e.isSave ? 1u : 0u;
+    }
+    std::cout << "index=" << file.string() << "\n";
+    std::cout << "files=" << stats.files << " saves=" << saves << " unchanged=" << stats.unchanged
+              << " touched=" << stats.touched << " parsed=" << stats.parsed << " removed=" << stats.removed << "\n";
+    std::cout << "postings_terms=" << postings.terms.size() << " postings_bytes=" << postings.postings.size()
+              << " postings_rebuilt=" << (postingsRebuilt ? 1 : 0) << "\n";
+    std::cout << "load_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+              << " refresh_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << "\n";
     return 0;
 }
 
-int CmdBatch007(const fs::path& basePath, const fs::path& outDir) {
-    const auto raw = mafia_save::ReadFileBytes(basePath);
-    if (raw.empty()) {
-        std::cerr << "Failed to read base save file: " << basePath << "\n";
+int CmdArchiveAdd(const fs::path& archivePath, const std::vector<fs::path>& inputs, unsigned threads) {
+    std::vector<save_archive::AddInput> files;
+    for (const auto& in : inputs) {
+        std::error_code ec;
+        if (!fs::is_directory(in, ec)) {
+            files.push_back({in, in.filename().generic_string()});
+            continue;
+        }
+        std::vector<fs::path> found;
+        save_index::CollectSaveFiles(in, &found);
+        for (const auto& f : found) {
+            files.push_back({f, f.lexically_relative(in).generic_string()});
+        }
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    save_archive::AddStats stats;
+    std::string err;
+    if (!save_archive::AddSaves(archivePath, files, threads, &stats, &err)) {
+        std::cerr << "AddSaves failed: " << err << "\n";
         return 1;
     }
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    for (const auto& f : stats.failures) {
+        std::cerr << "skipped " << f << "\n";
+    }
+    std::cout << "added=" << stats.added << " skipped=" << stats.skipped << " failed=" << stats.failed
+              << " segments=" << stats.segments << " new_blobs=" << stats.newBlobs << "\n";
+    std::cout << "raw_bytes=" << stats.rawBytes << " stored_bytes=" << stats.storedBytes << " elapsed_ms=" << ms
+              << "\n";
+    return 0;
+}
 
-    mafia_save::SaveData base;
+int CmdArchiveList(const fs::path& archivePath) {
+    save_archive::Archive archive;
     std::string err;
-    if (!mafia_save::ParseSave(raw, &base, &err)) {
-        std::cerr << "ParseSave failed: " << err << "\n";
+    if (!save_archive::OpenArchive(archivePath, &archive, &err)) {
+        std::cerr << "OpenArchive failed: " << err << "\n";
         return 1;
     }
+    if (archive.recovered) {
+        std::cerr << "warning: last add was not committed; listing the archive as it was before it\n";
+    }
+    std::uint64_t rawTotal = 0;
+    std::uint64_t segmentRefs = 0;
+    for (std::size_t i = 0; i < archive.saves.size(); ++i) {
+        const auto& s = archive.saves[i];
+        std::cout << "#" << i << " " << s.name << " size=" << s.rawSize << " segments=" << s.blobs.size()
+                  << " hash=0x" << std::hex << std::setw(16) << std::setfill('0') << s.hash << std::dec
+                  << std::setfill(' ') << "\n";
+        rawTotal += s.rawSize;
+        segmentRefs += s.blobs.size();
+    }
+    std::uint64_t blobRaw = 0;
+    std::uint64_t blobStored = 0;
+    for (const auto& b : archive.blobs) {
+        blobRaw += b.rawSize;
+        blobStored += b.storedSize;
+    }
+    std::error_code ec;
+    const auto fileSize = fs::exists(archivePath, ec) ? fs::file_size(archivePath, ec) : 0;
+    std::cout << "saves=" << archive.saves.size() << " segment_refs=" << segmentRefs << " blobs=" << archive.blobs.size()
+              << "\n";
+    std::cout << "raw_bytes=" << rawTotal << " unique_plain_bytes=" << blobRaw << " stored_bytes=" << blobStored
+              << " archive_bytes=" << fileSize << "\n";
+    if (rawTotal != 0) {
+        std::cout << "ratio=" << std::fixed << std::setprecision(4)
+                  << static_cast<double>(fileSize) / static_cast<double>(rawTotal) << "\n";
+    }
+    return 0;
+}
 
-    std::size_t actorHeader1Abs = static_cast<std::size_t>(-1);
-    std::size_t abs = mafia_save::kFileHeaderSize;
-    for (const auto& seg : base.segments) {
-        if (seg.name == "actor_header_1") {
-            actorHeader1Abs = abs;
+int CmdArchiveExtract(const fs::path& archivePath, const std::string& which, const fs::path& outPath) {
+    const auto t0 = std::chrono::steady_clock::now();
+    save_archive::Archive archive;
+    std::string err;
+    if (!save_archive::OpenArchive(archivePath, &archive, &err)) {
+        std::cerr << "OpenArchive failed: " << err << "\n";
+        return 1;
+    }
+    // Newest entry with that name wins; a plain number is an entry id from `archive list`.
+    std::size_t pick = archive.saves.size();
+    for (std::size_t i = archive.saves.size(); i-- > 0;) {
+        if (archive.saves[i].name == which) {
+            pick = i;
             break;
         }
-        abs += seg.plain.size();
     }
-    if (actorHeader1Abs == static_cast<std::size_t>(-1)) {
-        std::cerr << "actor_header_1 is missing in base file\n";
+    const auto idOpt = ParseU32(which);
+    if (pick == archive.saves.size() && idOpt.has_value() && *idOpt < archive.saves.size()) {
+        pick = *idOpt;
+    }
+    if (pick == archive.saves.size()) {
+        std::cerr << "No archived save named " << which << "\n";
         return 1;
     }
 
-    auto setU32AtFileOffset = [&](mafia_save::SaveData* s, std::size_t off, std::uint32_t v) -> bool {
-        for (int i = 0; i < 4; ++i) {
-            const std::uint8_t b = static_cast<std::uint8_t>((v >> (i * 8)) & 0xFFu);
-            if (!mafia_save::SetFileOffsetByte(s, off + static_cast<std::size_t>(i), b, &err)) {
-                return false;
-            }
-        }
-        return true;
-    };
-
-    fs::create_directories(outDir);
-    auto writeVariant = [&](const std::string& fileName, const mafia_save::SaveData& variant) -> bool {
-        const fs::path outPath = outDir / fileName;
-        std::string localErr;
-        if (!WriteModified(variant, outPath, &localErr)) {
-            std::cerr << "Failed to write " << outPath << ": " << localErr << "\n";
-            return false;
-        }
-        return true;
-    };
-
-    const std::size_t offModel = actorHeader1Abs + 64;
-    const std::size_t offType = actorHeader1Abs + 128;
-    const std::size_t offIdx = actorHeader1Abs + 136;
-
-    mafia_save::SaveData v28 = base;
-    if (!mafia_save::SetFileOffsetByte(&v28, offModel, 0x00, &err)) {
-        std::cerr << "Failed to patch v28: " << err << "\n";
+    std::vector<std::uint8_t> raw;
+    if (!save_archive::ExtractSave(archivePath, archive, pick, &raw, &err)) {
+        std::cerr << "ExtractSave failed: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_28", v28)) {
+    if (!mafia_save::WriteFileBytes(outPath, raw)) {
+        std::cerr << "Failed to write: " << outPath << "\n";
         return 1;
     }
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "extracted=#" << pick << " name=" << archive.saves[pick].name << " size=" << raw.size()
+              << " elapsed_us=" << us << "\n";
+    return 0;
+}
 
-    mafia_save::SaveData v29 = base;
-    if (!setU32AtFileOffset(&v29, offType, 4u)) {
-        std::cerr << "Failed to patch v29 type: " << err << "\n";
+int CmdFindSaves(const fs::path& root, const std::string& query, bool refresh) {
+    const auto t0 = std::chrono::steady_clock::now();
+    save_index::Index index;
+    std::string err;
+    save_postings::PostingIndex postings;
+    bool rebuilt = false;
+    if (refresh) {
+        save_index::RefreshStats stats;
+        if (!save_index::OpenIndex(root, &index, &stats, &err)) {
+            std::cerr << "No usable index in " << root.string() << (err.empty() ? "" : ": " + err)
+                      << " (run: mafia_stream_tool index " << root.string() << ")\n";
+            return 1;
+        }
+        if (!save_postings::OpenPostings(root, index, &postings, &rebuilt, &err)) {
+            std::cerr << "OpenPostings failed: " << err << "\n";
+            return 1;
+        }
+    } else if (!save_postings::LoadPostings(save_postings::DefaultPostingsPath(root), &postings, &err)) {
+        std::cerr << "LoadPostings failed: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_29", v29)) {
+    const auto t1 = std::chrono::steady_clock::now();
+
+    std::vector<std::uint32_t> docs;
+    save_postings::QueryStats qs;
+    if (!save_postings::Evaluate(postings, query, &docs, &qs, &err)) {
+        std::cerr << "Bad query: " << err << "\n";
         return 1;
     }
+    const auto t2 = std::chrono::steady_clock::now();
 
-    mafia_save::SaveData v30 = base;
-    if (!setU32AtFileOffset(&v30, offIdx, 0u)) {
-        std::cerr << "Failed to patch v30 idx: " << err << "\n";
+    for (const auto doc : docs) {
+        std::cout << postings.docs[doc] << "\n";
+    }
+    std::cout << "matches=" << docs.size() << " docs=" << postings.docs.size() << " terms=" << qs.terms
+              << " bloom_rejects=" << qs.bloomRejects << " postings_rebuilt=" << (rebuilt ? 1 : 0) << "\n";
+    std::cout << "open_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+              << " query_us=" << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << "\n";
+    return 0;
+}
+
+int CmdQuery(const fs::path& root, const std::string& expression, unsigned threads) {
+    save_query::Query query;
+    std::string err;
+    if (!save_query::Compile(expression, &query, &err)) {
+        std::cerr << "Bad query: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_30", v30)) {
+    const auto t0 = std::chrono::steady_clock::now();
+    save_query::QueryOptions options;
+    options.threads = threads;
+    std::vector<fs::path> matches;
+    save_query::QueryStats stats;
+    if (!save_query::Run(root, query, options, &matches, &stats, &err)) {
+        std::cerr << "Query failed: " << err << "\n";
         return 1;
     }
+    const auto t1 = std::chrono::steady_clock::now();
 
-    std::vector<std::uint8_t> raw28;
-    std::vector<std::uint8_t> raw29;
-    std::vector<std::uint8_t> raw30;
-    if (!mafia_save::BuildRaw(v28, &raw28) || !mafia_save::BuildRaw(v29, &raw29) || !mafia_save::BuildRaw(v30, &raw30)) {
-        std::cerr << "Internal error while rebuilding variants\n";
-        return 1;
+    for (const auto& path : matches) {
+        std::cout << path.lexically_relative(root).generic_string() << "\n";
     }
+    std::cout << "files=" << stats.files << " matched=" << stats.matched << " file_only=" << stats.decidedByFile
+              << " header_only=" << stats.decidedByHeader << " full_parsed=" << stats.fullParsed
+              << " failed=" << stats.failed << " threads=" << stats.threads
+              << " elapsed_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "\n";
+    return 0;
+}
 
-    const fs::path notePath = outDir / "RESULTS_SERIES_007_plan.txt";
-    std::vector<std::string> lines;
-    lines.push_back("Compact batch 007 (Tommy header field isolation)");
-    lines.push_back("");
-    lines.push_back("Base file: " + basePath.string());
-    lines.push_back("actor_header_1 base offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << actorHeader1Abs; return oss.str(); }());
-    lines.push_back("");
-    lines.push_back("- mafia004.230_28: actor_header_1 model first byte -> 0x00");
-    lines.push_back("  Offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << offModel; return oss.str(); }());
-    lines.push_back("  Hypothesis: model name is less critical than actor name for matching.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw28)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_29: actor_header_1 type 2 -> 4");
-    lines.push_back("  Offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << offType; return oss.str(); }());
-    lines.push_back("  Hypothesis: wrong actor type should change load/apply path strongly.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw29)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_30: actor_header_1 idx 0xFFFFFFFF -> 0");
-    lines.push_back("  Offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << offIdx; return oss.str(); }());
-    lines.push_back("  Hypothesis: Tommy may be written into car slot table, causing script/state anomalies.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw30)));
-    lines.push_back("");
-    lines.push_back("What to report:");
-    lines.push_back("1) menu title/image/stats");
-    lines.push_back("2) load progress stage");
-    lines.push_back("3) mission start/fail/softlock details");
+int CmdSimilar(const std::vector<fs::path>& inputs,
+               const fs::path& queryPath,
+               std::size_t top,
+               bool exhaustive,
+               unsigned threads) {
+    mafia_save::SaveData query;
+    std::string err;
+    if (!mafia_save::ParseSave(mafia_save::ReadFileBytes(queryPath), &query, &err)) {
+        std::cerr << "ParseSave failed for " << queryPath.string() << ": " << err << "\n";
+        return 1;
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    save_similarity::Corpus corpus;
+    if (!save_similarity::LoadCorpus(inputs, threads, &corpus, &err)) {
+        std::cerr << "LoadCorpus failed: " << err << "\n";
+        return 1;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    const auto sig = save_similarity::SaveSignature(query);
+    const std::size_t candidates = corpus.lsh.Candidates(sig).size();
+    const auto hits = save_similarity::Nearest(corpus, sig, top, exhaustive);
+    const auto t2 = std::chrono::steady_clock::now();
 
-    std::string content;
-    for (const auto& line : lines) {
-        content += line;
-        content += "\n";
+    for (const auto& h : hits) {
+        std::cout << std::fixed << std::setprecision(3) << "similarity=" << h.similarity
+                  << " save=" << corpus.names[h.id] << "\n";
     }
-    if (!mafia_save::WriteFileBytes(notePath, std::vector<std::uint8_t>(content.begin(), content.end()))) {
-        std::cerr << "Failed to write note file: " << notePath << "\n";
+    std::cout << "corpus=" << corpus.signatures.size() << " failed=" << corpus.failed
+              << " hashed_parts=" << corpus.hashedParts << " candidates=" << candidates << "\n";
+    std::cout << "load_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()
+              << " query_us=" << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << "\n";
+    return 0;
+}
+
+int CmdDedupReport(const std::vector<fs::path>& inputs, double threshold, unsigned threads) {
+    const auto t0 = std::chrono::steady_clock::now();
+    save_similarity::Corpus corpus;
+    std::string err;
+    if (!save_similarity::LoadCorpus(inputs, threads, &corpus, &err)) {
+        std::cerr << "LoadCorpus failed: " << err << "\n";
         return 1;
     }
+    const auto clusters = save_similarity::Clusters(corpus, threshold);
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
 
-    std::cout << "Generated: " << (outDir / "mafia004.230_28").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_29").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_30").string() << "\n";
-    std::cout << "Plan note: " << notePath.string() << "\n";
+    std::size_t clustered = 0;
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+        const auto& members = clusters[c];
+        clustered += members.size();
+        bool identical = true;
+        for (const auto id : members) {
+            identical = identical && corpus.signatures[id] == corpus.signatures[members.front()];
+        }
+        std::cout << "cluster=" << c << " size=" << members.size() << " identical=" << (identical ? 1 : 0) << "\n";
+        for (const auto id : members) {
+            std::cout << "  " << corpus.names[id] << "\n";
+        }
+    }
+    std::cout << "corpus=" << corpus.signatures.size() << " failed=" << corpus.failed << " clusters=" << clusters.size()
+              << " clustered_saves=" << clustered << " threshold=" << threshold << " elapsed_ms=" << ms << "\n";
     return 0;
 }
 
-int CmdBatch008(const fs::path& basePath, const fs::path& outDir) {
-    const auto raw = mafia_save::ReadFileBytes(basePath);
-    if (raw.empty()) {
-        std::cerr << "Failed to read base save file: " << basePath << "\n";
+std::atomic<bool> g_stopWatch{false};
+
+void OnStopSignal(int) {
+    g_stopWatch.store(true);
+}
+
+const char* WatchEventName(save_watch::WatchEvent::Kind kind) {
+    switch (kind) {
+        case save_watch::WatchEvent::Kind::kBackup:
+            return "backup";
+        case save_watch::WatchEvent::Kind::kDuplicate:
+            return "same";
+        case save_watch::WatchEvent::Kind::kPartial:
+            return "partial";
+        case save_watch::WatchEvent::Kind::kRemoved:
+            return "removed";
+    }
+    return "?";
+}
+
+int CmdWatch(const fs::path& root, save_watch::WatchOptions options) {
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+    options.stop = &g_stopWatch;
+    options.onEvent = [](const save_watch::WatchEvent& ev) {
+        std::cout << WatchEventName(ev.kind) << " path=" << ev.path.generic_string();
+        if (ev.kind != save_watch::WatchEvent::Kind::kRemoved) {
+            std::cout << " size=" << ev.size;
+        }
+        if (ev.kind == save_watch::WatchEvent::Kind::kBackup || ev.kind == save_watch::WatchEvent::Kind::kDuplicate) {
+            std::cout << " version=" << ev.version << " hash=0x" << std::hex << std::setw(16) << std::setfill('0')
+                      << ev.hash << std::dec << std::setfill(' ');
+        }
+        if (!ev.detail.empty()) {
+            std::cout << " detail=" << ev.detail;
+        }
+        std::cout << std::endl;
+    };
+
+    const fs::path backupDir = options.backupDir.empty() ? root / save_watch::kDefaultBackupDirName : options.backupDir;
+    std::cout << "watch=" << root.string() << " backend=" << save_watch::BackendName(options.forcePoll)
+              << " backups=" << backupDir.string() << " settle_ms=" << options.settleMs << std::endl;
+    std::string err;
+    if (!save_watch::Watch(root, options, &err)) {
+        std::cerr << "Watch failed: " << err << "\n";
         return 1;
     }
+    std::cout << "stopped" << std::endl;
+    return 0;
+}
 
-    mafia_save::SaveData base;
+int CmdServe(const fs::path& socketPath, save_server::ServeOptions options) {
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+    options.stop = &g_stopWatch;
+    std::cout << "serve=" << socketPath.string() << " cache_mb=" << options.cacheBytes / (1024u * 1024u) << std::endl;
     std::string err;
-    if (!mafia_save::ParseSave(raw, &base, &err)) {
-        std::cerr << "ParseSave failed: " << err << "\n";
+    if (!save_server::Serve(socketPath, options, &err)) {
+        std::cerr << "Serve failed: " << err << "\n";
         return 1;
     }
+    std::cout << "stopped" << std::endl;
+    return 0;
+}
 
-    std::size_t actorHeader1Abs = static_cast<std::size_t>(-1);
-    std::size_t abs = mafia_save::kFileHeaderSize;
-    for (const auto& seg : base.segments) {
-        if (seg.name == "actor_header_1") {
-            actorHeader1Abs = abs;
-            break;
+int CmdApply(const fs::path& scriptPath, const std::vector<fs::path>& inputs, const save_edit::ApplyOptions& options) {
+    save_edit::Script script;
+    std::string err;
+    if (!save_edit::LoadScript(scriptPath, &script, &err)) {
+        std::cerr << "Bad script " << scriptPath.string() << ": " << err << "\n";
+        return 1;
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<save_edit::FileResult> results;
+    if (!save_edit::Apply(script, inputs, options, &results, &err)) {
+        std::cerr << "Apply failed: " << err << "\n";
+        return 1;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    std::size_t counts[3] = {0, 0, 0};
+    std::vector<save_edit::StatementResult> totals(script.statements.size());
+    std::vector<std::size_t> filesMatched(script.statements.size(), 0);
+    for (const auto& r : results) {
+        ++counts[static_cast<std::size_t>(r.status)];
+        std::size_t matched = 0;
+        std::size_t changed = 0;
+        std::size_t skipped = 0;
+        for (std::size_t i = 0; i < r.statements.size(); ++i) {
+            const auto& st = r.statements[i];
+            matched += st.matched;
+            changed += st.changed;
+            skipped += st.skipped;
+            totals[i].matched += st.matched;
+            totals[i].changed += st.changed;
+            totals[i].skipped += st.skipped;
+            filesMatched[i] += st.matched != 0 ? 1u : 0u;
         }
-        abs += seg.plain.size();
+        std::cout << "file=" << r.path.generic_string() << " status=" << save_edit::StatusName(r.status);
+        if (r.status == save_edit::FileResult::Status::kFailed) {
+            std::cout << " error=" << r.error << "\n";
+            continue;
+        }
+        std::cout << " matched=" << matched << " changed=" << changed << " skipped=" << skipped
+                  << " bytes_changed=" << r.bytesChanged;
+        if (!r.written.empty()) {
+            std::cout << " written=" << r.written.generic_string();
+        }
+        std::cout << "\n";
+    }
+    for (std::size_t i = 0; i < script.statements.size(); ++i) {
+        std::cout << "statement line=" << script.statements[i].line << " files=" << filesMatched[i]
+                  << " matched=" << totals[i].matched << " changed=" << totals[i].changed
+                  << " skipped=" << totals[i].skipped << " text=" << script.statements[i].text << "\n";
+    }
+    std::cout << "files=" << results.size() << " changed=" << counts[1] << " unchanged=" << counts[0]
+              << " failed=" << counts[2] << " mode=" << (options.write ? "write" : "dry-run")
+              << " elapsed_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "\n";
+    return counts[2] == 0 ? 0 : 1;
+}
+
+int CmdTransplant(const fs::path& sourcePath,
+                  const save_transplant::Selection& selection,
+                  const std::vector<fs::path>& targets,
+                  const save_transplant::TransplantOptions& options) {
+    save_transplant::Source source;
+    std::string err;
+    if (!save_transplant::LoadSource(sourcePath, selection, &source, &err)) {
+        std::cerr << "Bad source: " << err << "\n";
+        return 1;
     }
-    if (actorHeader1Abs == static_cast<std::size_t>(-1)) {
-        std::cerr << "actor_header_1 is missing in base file\n";
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<save_transplant::FileResult> results;
+    if (!save_transplant::Transplant(source, targets, options, &results, &err)) {
+        std::cerr << "Transplant failed: " << err << "\n";
         return 1;
     }
+    const auto t1 = std::chrono::steady_clock::now();
 
-    auto setU32AtFileOffset = [&](mafia_save::SaveData* s, std::size_t off, std::uint32_t v) -> bool {
-        for (int i = 0; i < 4; ++i) {
-            const std::uint8_t b = static_cast<std::uint8_t>((v >> (i * 8)) & 0xFFu);
-            if (!mafia_save::SetFileOffsetByte(s, off + static_cast<std::size_t>(i), b, &err)) {
-                return false;
-            }
+    for (const auto& d : source.donors) {
+        std::cout << "donor name=\"" << d.name << "\" type=" << d.type << " payload=" << d.payload.size() << "\n";
+    }
+    std::size_t counts[3] = {0, 0, 0};
+    std::uint64_t copied = 0;
+    std::uint64_t encrypted = 0;
+    for (const auto& r : results) {
+        ++counts[static_cast<std::size_t>(r.status)];
+        std::cout << "file=" << r.path.generic_string() << " status=" << save_transplant::StatusName(r.status);
+        if (r.status == save_transplant::FileResult::Status::kFailed) {
+            std::cout << " error=" << r.error << "\n";
+            continue;
         }
-        return true;
-    };
-
-    auto setCStringAtFileOffset = [&](mafia_save::SaveData* s, std::size_t off, std::size_t cap, const std::string& str) -> bool {
-        if (str.size() + 1 > cap) {
-            err = "string is too long for fixed-size field";
-            return false;
+        copied += r.bytesCopied;
+        encrypted += r.bytesEncrypted;
+        std::cout << " replaced=" << r.replaced << " added=" << r.added << " renamed=" << r.renamed
+                  << " skipped=" << r.skipped << " bytes_copied=" << r.bytesCopied
+                  << " bytes_encrypted=" << r.bytesEncrypted;
+        if (!r.written.empty()) {
+            std::cout << " written=" << r.written.generic_string();
         }
-        for (std::size_t i = 0; i < cap; ++i) {
-            std::uint8_t b = 0;
-            if (i < str.size()) {
-                b = static_cast<std::uint8_t>(str[i]);
-            }
-            if (!mafia_save::SetFileOffsetByte(s, off + i, b, &err)) {
-                return false;
-            }
+        std::cout << "\n";
+        for (const auto& note : r.notes) {
+            std::cout << "  note " << note << "\n";
         }
-        return true;
-    };
+    }
+    std::cout << "files=" << results.size() << " changed=" << counts[1] << " unchanged=" << counts[0]
+              << " failed=" << counts[2] << " bytes_copied=" << copied << " bytes_encrypted=" << encrypted
+              << " mode=" << (options.write ? "write" : "dry-run")
+              << " elapsed_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "\n";
+    return counts[2] == 0 ? 0 : 1;
+}
 
-    fs::create_directories(outDir);
-    auto writeVariant = [&](const std::string& fileName, const mafia_save::SaveData& variant) -> bool {
-        const fs::path outPath = outDir / fileName;
-        std::string localErr;
-        if (!WriteModified(variant, outPath, &localErr)) {
-            std::cerr << "Failed to write " << outPath << ": " << localErr << "\n";
-            return false;
+int CmdSynth(const fs::path& out, const save_synth::Spec& spec, std::size_t count, unsigned threads) {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::string err;
+    if (count == 1 && !fs::is_directory(out)) {
+        std::vector<std::uint8_t> raw;
+        save_synth::SaveStats s;
+        if (!save_synth::GenerateRaw(spec, &raw, &s, &err)) {
+            std::cerr << "Synth failed: " << err << "\n";
+            return 1;
         }
-        return true;
-    };
-
-    const std::size_t offName = actorHeader1Abs + 0;
-    const std::size_t offModel = actorHeader1Abs + 64;
-    const std::size_t offType = actorHeader1Abs + 128;
+        if (!mafia_save::WriteFileBytes(out, raw)) {
+            std::cerr << "Failed to write: " << out.string() << "\n";
+            return 1;
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        std::cout << "file=" << out.generic_string() << " size=" << s.rawSize << " actors=" << spec.actors
+                  << " humans=" << s.humans << " cars=" << s.cars << " game_payload=" << s.gamePayloadSize
+                  << " program_off=" << s.programOffset << " seed=" << spec.seed
+                  << " elapsed_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "\n";
+        return 0;
+    }
+    save_synth::GenerateStats stats;
+    if (!save_synth::GenerateFiles(spec, count, out, threads, &stats, &err)) {
+        std::cerr << "Synth failed: " << err << "\n";
+        return 1;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+    std::cout << "dir=" << out.generic_string() << " files=" << stats.files << " bytes=" << stats.bytesWritten
+              << " seed=" << spec.seed << " threads=" << stats.threads << " elapsed_ms=" << ms << " mb_per_s="
+              << std::fixed << std::setprecision(1)
+              << (ms > 0 ? static_cast<double>(stats.bytesWritten) / (1024.0 * 1024.0) / (ms / 1000.0) : 0.0) << "\n";
+    return 0;
+}
 
-    mafia_save::SaveData v31 = base;
-    if (!setCStringAtFileOffset(&v31, offName, 64, "Jommy")) {
-        std::cerr << "Failed to patch v31 name: " << err << "\n";
+int CmdExperiment(const fs::path& specPath, const fs::path& baseOverride, const fs::path& outOverride, unsigned threads,
+                  bool dryRun) {
+    save_experiment::Spec spec;
+    std::string err;
+    if (!save_experiment::LoadSpec(specPath, &spec, &err)) {
+        std::cerr << "Bad spec " << specPath.string() << ": " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_31", v31)) {
+    if (!baseOverride.empty()) {
+        spec.base = baseOverride;
+    }
+    if (!outOverride.empty()) {
+        spec.output = outOverride;
+    }
+    if (spec.base.empty() || spec.output.empty()) {
+        std::cerr << "Spec needs base and output (or --base / --out)\n";
         return 1;
     }
 
-    mafia_save::SaveData v32 = base;
-    if (!setU32AtFileOffset(&v32, offType, 27u)) {
-        std::cerr << "Failed to patch v32 type: " << err << "\n";
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto raw = mafia_save::ReadFileBytes(spec.base);
+    if (raw.empty()) {
+        std::cerr << "Failed to read base save file: " << spec.base << "\n";
+        return 1;
+    }
+    mafia_save::SaveData base;
+    if (!mafia_save::ParseSave(raw, &base, &err)) {
+        std::cerr << "ParseSave failed: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_32", v32)) {
+    save_experiment::Plan plan;
+    if (!save_experiment::Expand(spec, base, &plan, &err)) {
+        std::cerr << "Bad spec " << specPath.string() << ": " << err << "\n";
         return 1;
     }
 
-    mafia_save::SaveData v33 = base;
-    if (!setCStringAtFileOffset(&v33, offModel, 64, "Tommy.i3d")) {
-        std::cerr << "Failed to patch v33 model: " << err << "\n";
+    if (dryRun) {
+        for (const auto& v : plan.variants) {
+            std::cout << v.name << ": " << v.label;
+            for (const auto& p : v.patches) {
+                std::cout << (p.op == save_experiment::EditOp::kXor ? " xor@0x" : " set@0x") << std::hex << p.fileOffset
+                          << "=";
+                for (const auto b : p.bytes) {
+                    std::cout << std::setw(2) << std::setfill('0') << static_cast<unsigned>(b);
+                }
+                std::cout << std::dec << std::setfill(' ');
+            }
+            std::cout << "\n";
+        }
+        std::cout << "variants=" << plan.variants.size() << "\n";
+        return 0;
+    }
+
+    save_experiment::GenerateStats stats;
+    if (!save_experiment::Generate(spec, raw, base, plan, threads, &stats, &err)) {
+        std::cerr << "Generate failed: " << err << "\n";
         return 1;
     }
-    if (!writeVariant("mafia004.230_33", v33)) {
+    const auto t1 = std::chrono::steady_clock::now();
+    std::cout << "output=" << spec.output.string() << " variants=" << stats.variants << " threads=" << stats.threads
+              << " bytes_written=" << stats.bytesWritten << " bytes_reencrypted=" << stats.bytesEncrypted
+              << " elapsed_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << "\n";
+    if (!spec.notes.empty()) {
+        std::cout << "Plan note: " << (spec.output / spec.notes).string() << "\n";
+    }
+    return 0;
+}
+
+// Discards everything written to a stream while a benchmarked workflow runs.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int ch) override { return traits_type::not_eof(ch); }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class SilenceOutput {
+public:
+    SilenceOutput() : out_(std::cout.rdbuf(&null_)), err_(std::cerr.rdbuf(&null_)) {}
+    ~SilenceOutput() {
+        std::cout.rdbuf(out_);
+        std::cerr.rdbuf(err_);
+    }
+
+private:
+    NullBuffer null_;
+    std::streambuf* out_;
+    std::streambuf* err_;
+};
+
+// Runs the inspect, scan, vardiff, experiment and apply commands on a corpus with their output discarded.
+// The corpus is every GvaS file under `corpus` that ParseSave accepts; experiment uses the first one as
+// its base and writes 64 variants, apply writes to a copy. Both write below `workDir`.
+int CmdBench(const fs::path& corpus,
+             std::size_t reps,
+             unsigned threads,
+             const fs::path& workDir,
+             const fs::path& baselinePath,
+             const fs::path& writeBaselinePath,
+             double thresholdPct) {
+    std::vector<fs::path> files;
+    std::uint64_t bytes = 0;
+    std::size_t skipped = 0;
+    std::error_code ec;
+    save_index::CollectSaveFiles(corpus, &files);
+    files.erase(std::remove_if(files.begin(), files.end(),
+                               [&](const fs::path& f) {
+                                   const auto raw = mafia_save::ReadFileBytes(f);
+                                   mafia_save::SaveData save;
+                                   if (raw.empty() || !mafia_save::ParseSave(raw, &save)) {
+                                       ++skipped;
+                                       return true;
+                                   }
+                                   bytes += raw.size();
+                                   return false;
+                               }),
+                files.end());
+    if (files.empty()) {
+        std::cerr << "No parseable saves under " << corpus.string() << "\n";
         return 1;
     }
 
-    std::vector<std::uint8_t> raw31;
-    std::vector<std::uint8_t> raw32;
-    std::vector<std::uint8_t> raw33;
-    if (!mafia_save::BuildRaw(v31, &raw31) || !mafia_save::BuildRaw(v32, &raw32) || !mafia_save::BuildRaw(v33, &raw33)) {
-        std::cerr << "Internal error while rebuilding variants\n";
+    const fs::path specPath = workDir / "experiment.spec";
+    const fs::path scriptPath = workDir / "apply.edit";
+    fs::create_directories(workDir, ec);
+    {
+        std::ofstream spec(specPath, std::ios::binary | std::ios::trunc);
+        spec << "base = " << files.front().generic_string() << "\n"
+             << "output = " << (workDir / "experiment").generic_string() << "\n"
+             << "[variant]\n"
+             << "label = xor {off}\n"
+             << "xor file+0x200..0x23F = 0x01\n";
+        std::ofstream script(scriptPath, std::ios::binary | std::ios::trunc);
+        script << "cars.fuel = 60\n"
+               << "tommy.hp = @hpmax\n"
+               << "meta.hp_percent = 100\n";
+        if (!spec || !script) {
+            std::cerr << "Failed to write bench inputs to " << workDir.string() << "\n";
+            return 1;
+        }
+    }
+    constexpr std::size_t kVariants = 64;
+    const std::uint64_t baseSize = fs::file_size(files.front(), ec);
+    if (ec || baseSize <= 0x240) {
+        std::cerr << "Experiment base is too small for the bench spec: " << files.front().string() << "\n";
         return 1;
     }
 
-    const fs::path notePath = outDir / "RESULTS_SERIES_008_plan.txt";
-    std::vector<std::string> lines;
-    lines.push_back("Compact batch 008 (Tommy strict-field tests)");
-    lines.push_back("");
-    lines.push_back("Base file: " + basePath.string());
-    lines.push_back("actor_header_1 base offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << actorHeader1Abs; return oss.str(); }());
-    lines.push_back("");
-    lines.push_back("- mafia004.230_31: Tommy name -> Jommy");
-    lines.push_back("  Offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << offName; return oss.str(); }());
-    lines.push_back("  Hypothesis: even one-char mismatch should break actor matching like _27.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw31)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_32: Tommy type 2 -> 27");
-    lines.push_back("  Offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << offType; return oss.str(); }());
-    lines.push_back("  Hypothesis: type 27 may behave closer to human/player than type 4.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw32)));
-    lines.push_back("");
-    lines.push_back("- mafia004.230_33: Tommy model -> Tommy.i3d");
-    lines.push_back("  Offset: 0x" + [&]() { std::ostringstream oss; oss << std::hex << offModel; return oss.str(); }());
-    lines.push_back("  Hypothesis: valid non-empty model should avoid invisibility from _28.");
-    lines.push_back("  Byte diff vs base: " + std::to_string(CountDiffBytes(raw, raw33)));
-    lines.push_back("");
-    lines.push_back("What to report:");
-    lines.push_back("1) menu title/image/stats");
-    lines.push_back("2) mission behavior on start");
-    lines.push_back("3) player body visibility, controls, fail/restart behavior");
+    save_scan::ScanOptions scanOptions;
+    scanOptions.threads = threads;
+    save_edit::ApplyOptions applyOptions;
+    applyOptions.threads = threads;
+    applyOptions.write = true;
+    applyOptions.outDir = workDir / "apply";
 
-    std::string content;
-    for (const auto& line : lines) {
-        content += line;
-        content += "\n";
+    struct Workflow {
+        const char* name;
+        std::size_t files;
+        std::uint64_t bytes;
+        std::function<int()> run;
+    };
+    const std::vector<Workflow> workflows = {
+        {"inspect", files.size(), bytes,
+         [&] {
+             int rc = 0;
+             for (const auto& f : files) {
+                 rc |= CmdInspect(f);
+             }
+             return rc;
+         }},
+        {"scan", files.size() + skipped, bytes, [&] { return CmdScan(corpus, std::nullopt, false, scanOptions); }},
+        {"vardiff", files.size(), bytes, [&] { return CmdVarDiff(files, threads); }},
+        {"experiment", kVariants, kVariants * baseSize,
+         [&] { return CmdExperiment(specPath, fs::path(), fs::path(), threads, false); }},
+        {"apply", files.size(), bytes, [&] { return CmdApply(scriptPath, files, applyOptions); }},
+    };
+
+    std::vector<save_bench::Result> results;
+    std::string err;
+    for (const auto& w : workflows) {
+        save_bench::Result r;
+        const bool ok = save_bench::Measure(
+            w.name, w.files, w.bytes, reps,
+            [&] {
+                SilenceOutput quiet;
+                return w.run() == 0;
+            },
+            &r, &err);
+        if (!ok) {
+            std::cerr << "Bench failed: " << err << " (run it alone to see its output)\n";
+            return 1;
+        }
+        std::cout << "workflow=" << r.workflow << " files=" << r.files << " bytes=" << r.bytes << " reps=" << r.reps
+                  << std::fixed << std::setprecision(2) << " ms=" << r.seconds * 1000.0
+                  << " files_per_s=" << r.filesPerSec << " mb_per_s=" << r.mbPerSec << " peak_rss_kb=" << r.peakRssKb
+                  << std::setprecision(1) << " allocs_per_file=" << r.allocsPerFile << "\n";
+        std::cout << std::defaultfloat << std::setprecision(6);
+        results.push_back(std::move(r));
+    }
+    std::cout << "corpus=" << corpus.generic_string() << " files=" << files.size() << " skipped=" << skipped
+              << " bytes=" << bytes << "\n";
+
+    if (!writeBaselinePath.empty()) {
+        if (!save_bench::WriteBaseline(writeBaselinePath, results, &err)) {
+            std::cerr << "WriteBaseline failed: " << err << "\n";
+            return 1;
+        }
+        std::cout << "baseline_written=" << writeBaselinePath.generic_string() << "\n";
+    }
+    if (baselinePath.empty()) {
+        return 0;
     }
-    if (!mafia_save::WriteFileBytes(notePath, std::vector<std::uint8_t>(content.begin(), content.end()))) {
-        std::cerr << "Failed to write note file: " << notePath << "\n";
+    std::vector<save_bench::Result> baseline;
+    if (!save_bench::LoadBaseline(baselinePath, &baseline, &err)) {
+        std::cerr << "LoadBaseline failed: " << err << "\n";
         return 1;
     }
-
-    std::cout << "Generated: " << (outDir / "mafia004.230_31").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_32").string() << "\n";
-    std::cout << "Generated: " << (outDir / "mafia004.230_33").string() << "\n";
-    std::cout << "Plan note: " << notePath.string() << "\n";
-    return 0;
+    const auto cmp = save_bench::Compare(baseline, results, thresholdPct);
+    for (const auto& note : cmp.notes) {
+        std::cout << "note: " << note << "\n";
+    }
+    for (const auto& reg : cmp.regressions) {
+        std::cout << "regression workflow=" << reg.workflow << " metric=" << reg.metric << std::fixed
+                  << std::setprecision(2) << " baseline=" << reg.baseline << " current=" << reg.current
+                  << std::setprecision(1) << " change=" << std::showpos << reg.changePct << std::noshowpos << "%\n";
+        std::cout << std::defaultfloat << std::setprecision(6);
+    }
+    std::cout << "baseline=" << baselinePath.generic_string() << " threshold=" << thresholdPct
+              << "% regressions=" << cmp.regressions.size() << " result=" << (cmp.regressions.empty() ? "pass" : "fail")
+              << "\n";
+    return cmp.regressions.empty() ? 0 : 1;
 }
 
-}  // namespace
-
-int main(int argc, char** argv) {
+int RunCommand(int argc, char** argv) {
     if (argc < 2) {
         PrintUsage();
         return 1;
@@ -719,38 +1539,781 @@ int main(int argc, char** argv) {
         return CmdSetHp(argv[2], argv[3], *hpOpt);
     }
 
-    if (cmd == "batch005") {
-        if (argc != 4) {
+    if (cmd == "find") {
+        if (argc < 5) {
             PrintUsage();
             return 1;
         }
-        return CmdBatch005(argv[2], argv[3]);
+        double tolerance = 0.0;
+        std::size_t alignment = 1;
+        std::size_t limit = 1000;
+        for (int i = 5; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for option: " << opt << "\n";
+                return 1;
+            }
+            const std::string val = argv[++i];
+            if (opt == "--tol") {
+                const auto tolOpt = ParseF64(val);
+                if (!tolOpt.has_value()) {
+                    std::cerr << "Invalid tolerance: " << val << "\n";
+                    return 1;
+                }
+                tolerance = *tolOpt;
+            } else if (opt == "--align" || opt == "--limit") {
+                const auto numOpt = ParseU32(val);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid " << opt << " value: " << val << "\n";
+                    return 1;
+                }
+                (opt == "--align" ? alignment : limit) = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        save_search::ValueQuery query;
+        std::string err;
+        if (!save_search::ParseValueQuery(argv[3], argv[4], tolerance, &query, &err)) {
+            std::cerr << "Invalid search value: " << err << "\n";
+            return 1;
+        }
+        query.alignment = alignment;
+        return CmdFind(argv[2], query, limit);
     }
 
-    if (cmd == "batch006") {
-        if (argc != 4) {
+    if (cmd == "strings") {
+        if (argc != 3 && argc != 4) {
+            PrintUsage();
+            return 1;
+        }
+        std::size_t minLen = save_strings::kDefaultMinLen;
+        if (argc == 4) {
+            const auto lenOpt = ParseU32(argv[3]);
+            if (!lenOpt.has_value() || *lenOpt == 0) {
+                std::cerr << "Invalid min_len: " << argv[3] << "\n";
+                return 1;
+            }
+            minLen = *lenOpt;
+        }
+        return CmdStrings(argv[2], minLen);
+    }
+
+    if (cmd == "xref") {
+        if (argc != 4 && !(argc == 5 && std::string(argv[4]) == "--contains")) {
             PrintUsage();
             return 1;
         }
-        return CmdBatch006(argv[2], argv[3]);
+        return CmdXref(argv[2], argv[3], argc == 5);
     }
 
-    if (cmd == "batch007") {
-        if (argc != 4) {
+    if (cmd == "refs") {
+        if (argc != 3 && argc != 4) {
             PrintUsage();
             return 1;
         }
-        return CmdBatch007(argv[2], argv[3]);
+        return CmdRefs(argv[2], argc == 4 ? argv[3] : "");
     }
 
-    if (cmd == "batch008") {
+    if (cmd == "rename-actor") {
+        if (argc != 6) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdEditActor(argv[2], argv[3], argv[4], std::string(argv[5]));
+    }
+
+    if (cmd == "remove-actor") {
+        if (argc != 5) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdEditActor(argv[2], argv[3], argv[4], std::nullopt);
+    }
+
+    if (cmd == "timeline") {
+        if (argc < 4) {
+            PrintUsage();
+            return 1;
+        }
+        std::string fieldList = save_timeline::kDefaultFields;
+        save_timeline::HeaderFilter filter;
+        unsigned threads = 0;
+        for (int i = 4; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for option: " << opt << "\n";
+                return 1;
+            }
+            const std::string val = argv[++i];
+            if (opt == "--fields") {
+                fieldList = val;
+            } else if (opt == "--slot") {
+                if (!ParseU32Range(val, &filter.minSlot, &filter.maxSlot)) {
+                    std::cerr << "Invalid --slot range: " << val << "\n";
+                    return 1;
+                }
+            } else if (opt == "--date") {
+                if (!ParseU32Range(val, &filter.minDate, &filter.maxDate)) {
+                    std::cerr << "Invalid --date range: " << val << "\n";
+                    return 1;
+                }
+            } else if (opt == "--threads") {
+                const auto numOpt = ParseU32(val);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << val << "\n";
+                    return 1;
+                }
+                threads = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        std::vector<save_timeline::FieldSpec> fields;
+        std::string err;
+        if (!save_timeline::ParseFieldList(fieldList, &fields, &err)) {
+            std::cerr << "Invalid --fields: " << err << "\n";
+            return 1;
+        }
+        return CmdTimeline(argv[2], argv[3], fields, filter, threads);
+    }
+
+    if (cmd == "vardiff") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        std::vector<fs::path> inputs;
+        unsigned threads = 0;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--threads") {
+                const auto numOpt = i + 1 < argc ? ParseU32(argv[i + 1]) : std::nullopt;
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value\n";
+                    return 1;
+                }
+                threads = *numOpt;
+                ++i;
+            } else {
+                inputs.emplace_back(arg);
+            }
+        }
+        if (inputs.empty()) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdVarDiff(inputs, threads);
+    }
+
+    if (cmd == "export") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        std::vector<fs::path> inputs;
+        std::optional<fs::path> outPath;
+        save_json::Format format = save_json::Format::kJson;
+        unsigned threads = 0;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                inputs.emplace_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for option: " << arg << "\n";
+                return 1;
+            }
+            const std::string val = argv[++i];
+            if (arg == "--out") {
+                outPath = fs::path(val);
+            } else if (arg == "--format") {
+                if (val != "json" && val != "ndjson") {
+                    std::cerr << "Invalid --format value: " << val << "\n";
+                    return 1;
+                }
+                format = val == "json" ? save_json::Format::kJson : save_json::Format::kNdjson;
+            } else if (arg == "--threads") {
+                const auto numOpt = ParseU32(val);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << val << "\n";
+                    return 1;
+                }
+                threads = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            }
+        }
+        if (inputs.empty()) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdExport(inputs, outPath, format, threads);
+    }
+
+    if (cmd == "import") {
         if (argc != 4) {
             PrintUsage();
             return 1;
         }
-        return CmdBatch008(argv[2], argv[3]);
+        return CmdImport(argv[2], argv[3]);
+    }
+
+    if (cmd == "lint") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        std::vector<fs::path> inputs;
+        std::optional<fs::path> outPath;
+        save_lint::LintOptions options;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--out" && i + 1 < argc) {
+                outPath = fs::path(argv[++i]);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                    return 1;
+                }
+                options.threads = *numOpt;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            } else {
+                inputs.emplace_back(arg);
+            }
+        }
+        if (inputs.empty()) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdLint(inputs, outPath, options);
+    }
+
+    if (cmd == "scan") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        std::optional<fs::path> outPath;
+        std::optional<bool> csv;
+        save_scan::ScanOptions options;
+        for (int i = 3; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if (opt == "--header-only") {
+                options.headerOnly = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for option: " << opt << "\n";
+                return 1;
+            }
+            const std::string val = argv[++i];
+            if (opt == "--out") {
+                outPath = fs::path(val);
+            } else if (opt == "--format") {
+                if (val != "ndjson" && val != "csv") {
+                    std::cerr << "Invalid --format value: " << val << "\n";
+                    return 1;
+                }
+                csv = val == "csv";
+            } else if (opt == "--threads") {
+                const auto numOpt = ParseU32(val);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << val << "\n";
+                    return 1;
+                }
+                options.threads = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        if (!csv.has_value()) {
+            csv = outPath.has_value() && outPath->extension() == ".csv";
+        }
+        return CmdScan(argv[2], outPath, *csv, options);
+    }
+
+    if (cmd == "index") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        unsigned threads = 0;
+        bool rebuild = false;
+        bool list = false;
+        for (int i = 3; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if (opt == "--rebuild") {
+                rebuild = true;
+            } else if (opt == "--list") {
+                list = true;
+            } else if (opt == "--threads" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                    return 1;
+                }
+                threads = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        return CmdIndex(argv[2], threads, rebuild, list);
+    }
+
+    if (cmd == "archive") {
+        const std::string sub = argc >= 4 ? argv[2] : "";
+        if (sub == "add") {
+            std::vector<fs::path> inputs;
+            unsigned threads = 0;
+            for (int i = 4; i < argc; ++i) {
+                const std::string arg = argv[i];
+                if (arg == "--threads") {
+                    const auto numOpt = i + 1 < argc ? ParseU32(argv[i + 1]) : std::nullopt;
+                    if (!numOpt.has_value() || *numOpt == 0) {
+                        std::cerr << "Invalid --threads value\n";
+                        return 1;
+                    }
+                    threads = *numOpt;
+                    ++i;
+                } else {
+                    inputs.emplace_back(arg);
+                }
+            }
+            if (!inputs.empty()) {
+                return CmdArchiveAdd(argv[3], inputs, threads);
+            }
+        } else if (sub == "list" && argc == 4) {
+            return CmdArchiveList(argv[3]);
+        } else if (sub == "extract" && argc == 6) {
+            return CmdArchiveExtract(argv[3], argv[4], argv[5]);
+        }
+        PrintUsage();
+        return 1;
+    }
+
+    if (cmd == "find-saves") {
+        if (argc < 4) {
+            PrintUsage();
+            return 1;
+        }
+        std::string query;
+        bool refresh = true;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--no-refresh") {
+                refresh = false;
+            } else {
+                query += (query.empty() ? "" : " ") + arg;
+            }
+        }
+        return CmdFindSaves(argv[2], query, refresh);
+    }
+
+    if (cmd == "query") {
+        if (argc < 4) {
+            PrintUsage();
+            return 1;
+        }
+        std::string expression;
+        unsigned threads = 0;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--threads" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                    return 1;
+                }
+                threads = *numOpt;
+            } else {
+                expression += (expression.empty() ? "" : " ") + arg;
+            }
+        }
+        return CmdQuery(argv[2], expression, threads);
+    }
+
+    if (cmd == "similar" || cmd == "dedup-report") {
+        std::vector<fs::path> inputs;
+        fs::path queryPath;
+        std::size_t top = 10;
+        bool exhaustive = false;
+        double threshold = 0.9;
+        unsigned threads = 0;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--exhaustive") {
+                exhaustive = true;
+            } else if (arg == "--to" && i + 1 < argc) {
+                queryPath = argv[++i];
+            } else if (arg == "--threshold" && i + 1 < argc) {
+                char* end = nullptr;
+                threshold = std::strtod(argv[++i], &end);
+                if (end == argv[i] || *end != '\0' || threshold <= 0.0 || threshold > 1.0) {
+                    std::cerr << "Invalid --threshold value: " << argv[i] << "\n";
+                    return 1;
+                }
+            } else if ((arg == "--top" || arg == "--threads") && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid " << arg << " value: " << argv[i] << "\n";
+                    return 1;
+                }
+                if (arg == "--top") {
+                    top = *numOpt;
+                } else {
+                    threads = *numOpt;
+                }
+            } else {
+                inputs.emplace_back(arg);
+            }
+        }
+        if (inputs.empty() || (cmd == "similar" && queryPath.empty())) {
+            PrintUsage();
+            return 1;
+        }
+        return cmd == "similar" ? CmdSimilar(inputs, queryPath, top, exhaustive, threads)
+                                : CmdDedupReport(inputs, threshold, threads);
+    }
+
+    if (cmd == "watch") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        save_watch::WatchOptions options;
+        for (int i = 3; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if (opt == "--poll") {
+                options.forcePoll = true;
+            } else if (opt == "--no-sweep") {
+                options.initialSweep = false;
+            } else if (opt == "--backup-dir" && i + 1 < argc) {
+                options.backupDir = argv[++i];
+            } else if ((opt == "--settle-ms" || opt == "--poll-ms") && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid " << opt << " value: " << argv[i] << "\n";
+                    return 1;
+                }
+                (opt == "--settle-ms" ? options.settleMs : options.pollMs) = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        return CmdWatch(argv[2], options);
+    }
+
+    if (cmd == "apply") {
+        if (argc < 4) {
+            PrintUsage();
+            return 1;
+        }
+        save_edit::ApplyOptions options;
+        std::vector<fs::path> inputs;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--write") {
+                options.write = true;
+            } else if (arg == "--out" && i + 1 < argc) {
+                options.outDir = argv[++i];
+                options.write = true;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                    return 1;
+                }
+                options.threads = *numOpt;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            } else {
+                inputs.emplace_back(arg);
+            }
+        }
+        if (inputs.empty()) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdApply(argv[2], inputs, options);
+    }
+
+    if (cmd == "transplant") {
+        if (argc < 4) {
+            PrintUsage();
+            return 1;
+        }
+        save_transplant::Selection selection;
+        save_transplant::TransplantOptions options;
+        std::vector<fs::path> targets;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--actor" && i + 1 < argc) {
+                selection.names.emplace_back(argv[++i]);
+            } else if (arg == "--type" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value()) {
+                    std::cerr << "Invalid --type value: " << argv[i] << "\n";
+                    return 1;
+                }
+                selection.type = *numOpt;
+            } else if (arg == "--on-collision" && i + 1 < argc) {
+                if (!save_transplant::ParseCollision(argv[++i], &options.collision)) {
+                    std::cerr << "Invalid --on-collision value: " << argv[i] << "\n";
+                    return 1;
+                }
+            } else if (arg == "--write") {
+                options.write = true;
+            } else if (arg == "--out" && i + 1 < argc) {
+                options.outDir = argv[++i];
+                options.write = true;
+            } else if (arg == "--threads" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                    return 1;
+                }
+                options.threads = *numOpt;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "Unknown option: " << arg << "\n";
+                return 1;
+            } else {
+                targets.emplace_back(arg);
+            }
+        }
+        if (targets.empty() || (selection.names.empty() && !selection.type.has_value())) {
+            PrintUsage();
+            return 1;
+        }
+        return CmdTransplant(argv[2], selection, targets, options);
+    }
+
+    if (cmd == "serve") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        save_server::ServeOptions options;
+        for (int i = 3; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if ((opt == "--cache-mb" || opt == "--threads") && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid " << opt << " value: " << argv[i] << "\n";
+                    return 1;
+                }
+                if (opt == "--cache-mb") {
+                    options.cacheBytes = static_cast<std::size_t>(*numOpt) * 1024u * 1024u;
+                } else {
+                    options.scanThreads = *numOpt;
+                }
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        return CmdServe(argv[2], options);
+    }
+
+    if (cmd == "synth") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        save_synth::Spec spec;
+        std::size_t count = 1;
+        unsigned threads = 0;
+        for (int i = 3; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if ((opt == "--program" || opt == "--ai") && i + 1 < argc) {
+                std::vector<std::uint32_t> parts;
+                std::stringstream list(argv[++i]);
+                std::string item;
+                while (std::getline(list, item, ',')) {
+                    const auto numOpt = ParseU32(item);
+                    if (!numOpt.has_value()) {
+                        parts.clear();
+                        break;
+                    }
+                    parts.push_back(*numOpt);
+                }
+                if (parts.size() != (opt == "--program" ? 4u : 2u) || (opt == "--program" && parts[0] > 0xFFFFu)) {
+                    std::cerr << "Invalid " << opt << " value: " << argv[i] << "\n";
+                    return 1;
+                }
+                if (opt == "--program") {
+                    spec.programRegs = static_cast<std::uint16_t>(parts[0]);
+                    spec.programVars = parts[1];
+                    spec.programActors = parts[2];
+                    spec.programFrames = parts[3];
+                } else {
+                    spec.aiGroups = parts[0];
+                    spec.aiFollow = parts[1];
+                }
+                continue;
+            }
+            if ((opt == "--count" || opt == "--seed" || opt == "--actors" || opt == "--humans" || opt == "--car-size" ||
+                 opt == "--mission" || opt == "--size-mb" || opt == "--threads") &&
+                i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || ((opt == "--count" || opt == "--threads") && *numOpt == 0)) {
+                    std::cerr << "Invalid " << opt << " value: " << argv[i] << "\n";
+                    return 1;
+                }
+                if (opt == "--count") {
+                    count = *numOpt;
+                } else if (opt == "--seed") {
+                    spec.seed = *numOpt;
+                } else if (opt == "--actors") {
+                    spec.actors = *numOpt;
+                } else if (opt == "--humans") {
+                    spec.humanPercent = *numOpt;
+                } else if (opt == "--car-size") {
+                    spec.carPayloadSize = *numOpt;
+                } else if (opt == "--mission") {
+                    spec.mission = *numOpt;
+                } else if (opt == "--size-mb") {
+                    spec.targetBytes = static_cast<std::size_t>(*numOpt) * 1024u * 1024u;
+                } else {
+                    threads = *numOpt;
+                }
+                continue;
+            }
+            std::cerr << "Unknown option: " << opt << "\n";
+            return 1;
+        }
+        return CmdSynth(argv[2], spec, count, threads);
+    }
+
+    if (cmd == "experiment") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        fs::path base;
+        fs::path out;
+        unsigned threads = 0;
+        bool dryRun = false;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--dry-run") {
+                dryRun = true;
+            } else if (arg == "--base" && i + 1 < argc) {
+                base = argv[++i];
+            } else if (arg == "--out" && i + 1 < argc) {
+                out = argv[++i];
+            } else if (arg == "--threads" && i + 1 < argc) {
+                const auto numOpt = ParseU32(argv[++i]);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid --threads value: " << argv[i] << "\n";
+                    return 1;
+                }
+                threads = *numOpt;
+            } else {
+                std::cerr << "Unknown experiment option: " << arg << "\n";
+                return 1;
+            }
+        }
+        return CmdExperiment(argv[2], base, out, threads, dryRun);
+    }
+
+    if (cmd == "bench") {
+        if (argc < 3) {
+            PrintUsage();
+            return 1;
+        }
+        std::size_t reps = 5;
+        unsigned threads = 0;
+        fs::path workDir = fs::temp_directory_path() / "mafia_stream_tool_bench";
+        fs::path baseline;
+        fs::path writeBaseline;
+        double threshold = 20.0;
+        for (int i = 3; i < argc; ++i) {
+            const std::string opt = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for option: " << opt << "\n";
+                return 1;
+            }
+            const std::string val = argv[++i];
+            if (opt == "--reps" || opt == "--threads") {
+                const auto numOpt = ParseU32(val);
+                if (!numOpt.has_value() || *numOpt == 0) {
+                    std::cerr << "Invalid " << opt << " value: " << val << "\n";
+                    return 1;
+                }
+                if (opt == "--reps") {
+                    reps = *numOpt;
+                } else {
+                    threads = *numOpt;
+                }
+            } else if (opt == "--work") {
+                workDir = val;
+            } else if (opt == "--baseline") {
+                baseline = val;
+            } else if (opt == "--write-baseline") {
+                writeBaseline = val;
+            } else if (opt == "--threshold") {
+                const auto numOpt = ParseF64(val);
+                if (!numOpt.has_value() || *numOpt < 0.0) {
+                    std::cerr << "Invalid --threshold value: " << val << "\n";
+                    return 1;
+                }
+                threshold = *numOpt;
+            } else {
+                std::cerr << "Unknown option: " << opt << "\n";
+                return 1;
+            }
+        }
+        return CmdBench(argv[2], reps, threads, workDir, baseline, writeBaseline, threshold);
     }
 
     PrintUsage();
     return 1;
 }
+
+void PrintStats(std::ostream& out, const mafia_save::Stats& s, std::uint64_t heapAllocs, double wallMs) {
+    auto ms = [](std::uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    out << "stats files_read=" << s.filesRead << " bytes_read=" << s.bytesRead << " bytes_decrypted=" << s.bytesDecrypted
+        << " bytes_encrypted=" << s.bytesEncrypted << " segments=" << s.segmentsParsed << " actors=" << s.actorsParsed
+        << " buffers=" << s.allocations << " heap_allocs=" << heapAllocs
+        << " program_candidates=" << s.programCandidates << " layout_cache_hits=" << s.layoutCacheHits
+        << " layout_cache_misses=" << s.layoutCacheMisses << std::fixed << std::setprecision(3)
+        << " read_ms=" << ms(s.readNs) << " parse_ms=" << ms(s.parseNs) << " build_ms=" << ms(s.buildNs)
+        << " detect_ms=" << ms(s.detectNs) << " wall_ms=" << wallMs << "\n";
+    out << std::defaultfloat << std::setprecision(6);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // --stats is accepted by every command: it is taken out of the arguments, and the counters of the
+    // whole run go to stderr at the end so that data on stdout stays clean.
+    std::vector<char*> args(argv, argv + argc);
+    const auto stats = std::remove_if(args.begin() + (argc > 0 ? 1 : 0), args.end(),
+                                      [](const char* arg) { return std::strcmp(arg, "--stats") == 0; });
+    if (stats == args.end()) {
+        return RunCommand(argc, argv);
+    }
+    args.erase(stats, args.end());
+    const int count = static_cast<int>(args.size());
+    args.push_back(nullptr);
+
+    mafia_save::EnableStats(true);
+    const std::uint64_t allocs0 = save_bench::AllocationCount();
+    const auto t0 = std::chrono::steady_clock::now();
+    const int rc = RunCommand(count, args.data());
+    const auto wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    PrintStats(std::cerr, mafia_save::CollectStats(), save_bench::AllocationCount() - allocs0, wall);
+    return rc;
+}
@@ -1,4 +1,5 @@
 #include "gvas.hpp"
+#include "save_index.hpp"
 
 #include <algorithm>
 #include <cmath>
@@ -45,6 +46,31 @@ bool LoadSaveRecords(const fs::path& saveDir, std::vector<SaveRecord>* out) {
         return false;
     }
 
+    // With an index, header validity comes from the stored GvaS header and only valid saves are read.
+    save_index::Index index;
+    if (save_index::OpenIndex(saveDir, &index)) {
+        for (const auto& e : index.entries) {
+            gvas::SaveFileMeta meta;
+            if (!e.isSave || !e.path.parent_path().empty() || !gvas::ParseSaveFileMeta(saveDir / e.path, &meta)) {
+                continue;
+            }
+            SaveRecord rec;
+            rec.meta = meta;
+            gvas::Header header;
+            const std::vector<std::uint8_t> headerBytes(e.gvasHeader.begin(), e.gvasHeader.end());
+            if (e.size >= gvas::kHeaderSize && gvas::ReadHeader(headerBytes, &header)) {
+                std::string checkErr;
+                const std::uint16_t mission = gvas::DecodeMission(header);
+                if (gvas::ValidateMissionChecks(header, &checkErr) && meta.slot == static_cast<int>(mission)) {
+                    rec.bytes = gvas::ReadFileBytes(meta.path);
+                    rec.valid = true;
+                }
+            }
+            out->push_back(std::move(rec));
+        }
+        return true;
+    }
+
     for (const auto& entry : fs::directory_iterator(saveDir)) {
         if (!entry.is_regular_file()) {
             continue;
@@ -1,5 +1,7 @@
 #include "profile_sav.hpp"
 
+#include "mafia_save.hpp"
+
 #include <algorithm>
 #include <cstring>
 #include <sstream>
@@ -8,6 +10,10 @@ namespace profile_sav {
 
 namespace {
 
+using mafia_save::AddStat;
+using mafia_save::Stat;
+using mafia_save::StatTimer;
+
 struct CipherState {
     std::uint32_t key1 = 0x23101976u;
     std::uint32_t key2 = 0x10072002u;
@@ -109,6 +115,7 @@ void WriteU32LE(std::vector<std::uint8_t>* bytes, std::size_t offset, std::uint3
 }
 
 bool ParseProfileSave(const std::vector<std::uint8_t>& raw, ProfileSaveData* out, std::string* error) {
+    const StatTimer timer(Stat::kParseNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output profile save struct";
@@ -144,6 +151,9 @@ bool ParseProfileSave(const std::vector<std::uint8_t>& raw, ProfileSaveData* out
     if (!ReadEncryptedBlock(raw, &cursor, kBlock156Size, &state, &parsed.block156, error)) {
         return false;
     }
+    AddStat(Stat::kSegmentsParsed, 4);
+    AddStat(Stat::kBytesDecrypted, cursor - kFileHeaderSize);
+    AddStat(Stat::kAllocations, 4);
 
     if (ReadU32LERaw(parsed.fileHeader.data()) != kMagicForP || ReadU32LERaw(parsed.fileHeader.data() + 8) != kVersion1) {
         if (error != nullptr) {
@@ -177,7 +187,9 @@ bool BuildRaw(const ProfileSaveData& save, std::vector<std::uint8_t>* out, std::
         return false;
     }
 
+    const StatTimer timer(Stat::kBuildNs);
     std::vector<std::uint8_t> raw;
+    raw.reserve(kFileHeaderSize + kCoreSize + kBlock720Size + kBlock92Size + kBlock156Size);
     raw.insert(raw.end(), save.fileHeader.begin(), save.fileHeader.end());
 
     CipherState state;
@@ -191,12 +203,15 @@ bool BuildRaw(const ProfileSaveData& save, std::vector<std::uint8_t>* out, std::
     pushBlock(save.block720);
     pushBlock(save.block92);
     pushBlock(save.block156);
+    AddStat(Stat::kBytesEncrypted, raw.size() - kFileHeaderSize);
+    AddStat(Stat::kAllocations, 5);
 
     *out = std::move(raw);
     return true;
 }
 
 bool ParseMrProfileSave(const std::vector<std::uint8_t>& raw, MrProfileSaveData* out, std::string* error) {
+    const StatTimer timer(Stat::kParseNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output mr profile save struct";
@@ -229,6 +244,7 @@ bool ParseMrProfileSave(const std::vector<std::uint8_t>& raw, MrProfileSaveData*
 }
 
 bool BuildRaw(const MrProfileSaveData& save, std::vector<std::uint8_t>* out, std::string* error) {
+    const StatTimer timer(Stat::kBuildNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output byte vector";
@@ -250,6 +266,7 @@ bool BuildRaw(const MrProfileSaveData& save, std::vector<std::uint8_t>* out, std
 }
 
 bool ParseMrTimesSave(const std::vector<std::uint8_t>& raw, MrTimesSaveData* out, std::string* error) {
+    const StatTimer timer(Stat::kParseNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output mrtimes save struct";
@@ -283,6 +300,7 @@ bool ParseMrTimesSave(const std::vector<std::uint8_t>& raw, MrTimesSaveData* out
 }
 
 bool BuildRaw(const MrTimesSaveData& save, std::vector<std::uint8_t>* out, std::string* error) {
+    const StatTimer timer(Stat::kBuildNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output byte vector";
@@ -309,6 +327,7 @@ bool BuildRaw(const MrTimesSaveData& save, std::vector<std::uint8_t>* out, std::
 }
 
 bool ParseMrSeg0Save(const std::vector<std::uint8_t>& raw, MrSeg0SaveData* out, std::string* error) {
+    const StatTimer timer(Stat::kParseNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output mrseg0 save struct";
@@ -343,6 +362,7 @@ bool ParseMrSeg0Save(const std::vector<std::uint8_t>& raw, MrSeg0SaveData* out,
 }
 
 bool BuildRaw(const MrSeg0SaveData& save, std::vector<std::uint8_t>* out, std::string* error) {
+    const StatTimer timer(Stat::kBuildNs);
     if (out == nullptr) {
         if (error != nullptr) {
             *error = "null output byte vector";
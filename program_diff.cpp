@@ -0,0 +1,208 @@
+#include "program_diff.hpp"
+
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <utility>
+
+namespace program_diff {
+
+namespace {
+
+constexpr std::uint64_t kFnvOffset = 1469598103934665603ull;
+constexpr std::uint64_t kFnvPrime = 1099511628211ull;
+
+std::uint64_t HashMix(std::uint64_t h, const void* data, std::size_t size) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        h = (h ^ p[i]) * kFnvPrime;
+    }
+    return h;
+}
+
+std::uint64_t HashNames(std::uint64_t h, const std::vector<std::string>& names) {
+    const std::uint32_t count = static_cast<std::uint32_t>(names.size());
+    h = HashMix(h, &count, sizeof(count));
+    for (const auto& name : names) {
+        h = HashMix(h, name.data(), name.size());
+        h = HashMix(h, "", 1);
+    }
+    return h;
+}
+
+// Length-prefixed name: len counts the terminating NUL, 0 = no object.
+std::string ReadPrefixedName(const std::vector<std::uint8_t>& p, std::size_t off, std::size_t len) {
+    std::size_t n = 0;
+    while (n < len && off + n < p.size() && p[off + n] != 0u) {
+        ++n;
+    }
+    return std::string(reinterpret_cast<const char*>(p.data() + off), n);
+}
+
+enum class LoadStatus { kSkipped, kNoProgram, kFailed, kOk };
+
+LoadStatus LoadOne(const fs::path& path, ProgramSnapshot* out) {
+    const auto raw = mafia_save::ReadFileBytes(path);
+    if (raw.size() < 4 || std::memcmp(raw.data(), "GvaS", 4) != 0) {
+        return LoadStatus::kSkipped;
+    }
+    mafia_save::SaveData save;
+    if (!mafia_save::ParseSave(raw, &save)) {
+        return LoadStatus::kFailed;
+    }
+    if (!ExtractProgram(save, out)) {
+        return LoadStatus::kNoProgram;
+    }
+    out->path = path;
+    return LoadStatus::kOk;
+}
+
+bool SnapshotBefore(const ProgramSnapshot& a, const ProgramSnapshot& b) {
+    // packedDate/packedTime keep the most significant field in the high bits, so they order directly.
+    if (a.meta.packedDate != b.meta.packedDate) {
+        return a.meta.packedDate < b.meta.packedDate;
+    }
+    if (a.meta.packedTime != b.meta.packedTime) {
+        return a.meta.packedTime < b.meta.packedTime;
+    }
+    if (a.meta.slot != b.meta.slot) {
+        return a.meta.slot < b.meta.slot;
+    }
+    return a.path < b.path;
+}
+
+}  // namespace
+
+bool ExtractProgram(const mafia_save::SaveData& save, ProgramSnapshot* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output snapshot";
+        }
+        return false;
+    }
+    const auto where = save_layout::DetectProgramInSave(save);
+    if (!where.has_value()) {
+        if (error != nullptr) {
+            *error = "C_program block not found";
+        }
+        return false;
+    }
+    const auto& p = save.segments[where->segIdx].plain;
+    const auto& layout = where->layout;
+    save_layout::ProgramTables tables;
+    if (!save_layout::ReadProgramTables(p, layout, &tables)) {
+        if (error != nullptr) {
+            *error = "C_program actor/frame tables are truncated";
+        }
+        return false;
+    }
+
+    ProgramSnapshot snap;
+    snap.mission = mafia_save::ReadMissionName(save);
+    mafia_save::ReadMetaFields(save, &snap.meta);
+    snap.segment = save.segments[where->segIdx].name;
+    snap.baseOff = layout.baseOff;
+
+    snap.registers.resize(layout.regCount);
+    for (std::size_t i = 0; i < snap.registers.size(); ++i) {
+        const std::size_t off = layout.baseOff + save_layout::kProgramHeaderSize + 2u * i;
+        snap.registers[i] = static_cast<std::uint16_t>(p[off] | (p[off + 1] << 8));
+    }
+    snap.vars.resize(layout.varCount);
+    for (std::size_t i = 0; i < snap.vars.size(); ++i) {
+        snap.vars[i] = mafia_save::ReadU32LE(p, layout.varsOff + 4u * i);
+    }
+    snap.actors.reserve(tables.actors.size());
+    for (const auto& chunk : tables.actors) {
+        snap.actors.push_back(ReadPrefixedName(p, chunk.offset + 8, chunk.nameLen));
+    }
+    snap.frames.reserve(tables.frames.size());
+    for (const auto& frame : tables.frames) {
+        snap.frames.push_back(ReadPrefixedName(p, frame.offset + 2, frame.nameLen));
+    }
+
+    std::uint64_t h = kFnvOffset;
+    const std::uint32_t varCount = layout.varCount;
+    h = HashMix(h, &varCount, sizeof(varCount));
+    h = HashNames(h, snap.actors);
+    snap.signature = HashNames(h, snap.frames);
+
+    *out = std::move(snap);
+    return true;
+}
+
+bool LoadSnapshots(const std::vector<fs::path>& files, unsigned threads, LoadReport* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output report";
+        }
+        return false;
+    }
+
+    std::vector<ProgramSnapshot> snaps(files.size());
+    std::vector<LoadStatus> status(files.size(), LoadStatus::kSkipped);
+    work_pool::ParallelFor(files.size(), threads, [&](unsigned, std::size_t i) {
+        status[i] = LoadOne(files[i], &snaps[i]);
+    });
+
+    LoadReport report;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        switch (status[i]) {
+            case LoadStatus::kOk:
+                report.snapshots.push_back(std::move(snaps[i]));
+                ++report.scanned;
+                break;
+            case LoadStatus::kNoProgram:
+                ++report.noProgram;
+                ++report.scanned;
+                break;
+            case LoadStatus::kFailed:
+                ++report.failed;
+                break;
+            case LoadStatus::kSkipped:
+                break;
+        }
+    }
+    *out = std::move(report);
+    return true;
+}
+
+std::vector<ProgramGroup> BuildVarDiff(const std::vector<ProgramSnapshot>& snapshots) {
+    std::map<std::pair<std::string, std::uint64_t>, std::vector<std::size_t>> byKey;
+    for (std::size_t i = 0; i < snapshots.size(); ++i) {
+        byKey[{snapshots[i].mission, snapshots[i].signature}].push_back(i);
+    }
+
+    std::vector<ProgramGroup> groups;
+    groups.reserve(byKey.size());
+    for (auto& [key, members] : byKey) {
+        std::sort(members.begin(), members.end(),
+                  [&](std::size_t a, std::size_t b) { return SnapshotBefore(snapshots[a], snapshots[b]); });
+
+        ProgramGroup g;
+        g.mission = key.first;
+        g.signature = key.second;
+        g.members = std::move(members);
+        g.varCount = snapshots[g.members.front()].vars.size();
+        const std::size_t t = g.transitions();
+        g.changed.assign(g.varCount * t, 0u);
+        g.changeCount.assign(g.varCount, 0u);
+        for (std::size_t k = 0; k < t; ++k) {
+            const auto& a = snapshots[g.members[k]].vars;
+            const auto& b = snapshots[g.members[k + 1]].vars;
+            for (std::size_t v = 0; v < g.varCount; ++v) {
+                if (a[v] != b[v]) {
+                    g.changed[v * t + k] = 1u;
+                    ++g.changeCount[v];
+                }
+            }
+        }
+        groups.push_back(std::move(g));
+    }
+    return groups;
+}
+
+}  // namespace program_diff
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace program_diff {
+
+namespace fs = std::filesystem;
+
+// One C_program::SaveGameSave block lifted out of a save.
+struct ProgramSnapshot {
+    fs::path path;
+    std::string mission;  // info264 mission name
+    mafia_save::MetaFields meta;
+    std::string segment;
+    std::size_t baseOff = 0;
+    std::vector<std::uint16_t> registers;
+    std::vector<std::uint32_t> vars;  // m_fVariables as f32 bit patterns
+    std::vector<std::string> actors;
+    std::vector<std::string> frames;
+    std::uint64_t signature = 0;  // over variable count, actor names and frame names
+};
+
+bool ExtractProgram(const mafia_save::SaveData& save, ProgramSnapshot* out, std::string* error = nullptr);
+
+struct LoadReport {
+    std::vector<ProgramSnapshot> snapshots;  // input order
+    std::size_t scanned = 0;
+    std::size_t noProgram = 0;
+    std::size_t failed = 0;
+};
+
+// Files that are not "GvaS" saves are skipped silently.
+bool LoadSnapshots(const std::vector<fs::path>& files, unsigned threads, LoadReport* out, std::string* error = nullptr);
+
+// Saves of one mission whose programs share a signature, ordered by meta32 date, time, slot and path.
+struct ProgramGroup {
+    std::string mission;
+    std::uint64_t signature = 0;
+    std::vector<std::size_t> members;  // indices into the snapshot list
+    std::size_t varCount = 0;
+    // Change matrix, row-major by variable: changed[var * transitions + t] is 1 when the variable
+    // differs between members[t] and members[t + 1].
+    std::vector<std::uint8_t> changed;
+    std::vector<std::uint32_t> changeCount;  // per variable
+    std::size_t transitions() const { return members.empty() ? 0 : members.size() - 1; }
+};
+
+std::vector<ProgramGroup> BuildVarDiff(const std::vector<ProgramSnapshot>& snapshots);
+
+}  // namespace program_diff
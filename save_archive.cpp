@@ -0,0 +1,548 @@
+#include "save_archive.hpp"
+
+#include "lz_codec.hpp"
+#include "save_index.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace save_archive {
+
+namespace {
+
+constexpr char kMagic[4] = {'M', 'S', 'A', 'R'};
+constexpr std::size_t kBatchSize = 256;
+constexpr std::size_t kTrailerScanChunk = 1u << 20;
+
+#pragma pack(push, 1)
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t committedEnd;
+};
+
+struct Trailer {
+    std::uint64_t dirOffset;
+    std::uint64_t dirSize;
+    char magic[4];
+    std::uint32_t version;
+};
+
+struct BlobRecord {
+    std::uint64_t hash;
+    std::uint64_t offset;
+    std::uint32_t rawSize;
+    std::uint32_t storedSize;
+};
+
+// Followed by name bytes and u32 blob indices.
+struct SaveRecord {
+    std::uint64_t hash;
+    std::uint64_t rawSize;
+    std::int64_t mtime;
+    std::uint8_t fileHeader[mafia_save::kFileHeaderSize];
+    std::uint32_t segmentCount;
+    std::uint16_t nameLength;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FileHeader) == 16, "archive header layout");
+static_assert(sizeof(Trailer) == 24, "archive trailer layout");
+static_assert(sizeof(BlobRecord) == 24, "archive blob layout");
+static_assert(sizeof(SaveRecord) == 54, "archive save layout");
+
+using BlobKey = std::pair<std::uint64_t, std::uint32_t>;  // (hash, size)
+
+struct Prepared {
+    bool ok = false;
+    std::string error;
+    SaveEntry entry;
+    mafia_save::SaveData save;
+    std::vector<std::uint64_t> segmentHashes;
+};
+
+template <typename T>
+void Append(std::vector<char>* out, const T& value) {
+    const char* p = reinterpret_cast<const char*>(&value);
+    out->insert(out->end(), p, p + sizeof(T));
+}
+
+template <typename T>
+bool Take(const std::vector<char>& in, std::size_t* pos, T* value) {
+    if (in.size() - *pos < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(value, in.data() + *pos, sizeof(T));
+    *pos += sizeof(T);
+    return true;
+}
+
+std::vector<char> SerializeDirectory(const Archive& archive) {
+    std::vector<char> dir;
+    Append(&dir, static_cast<std::uint32_t>(archive.blobs.size()));
+    Append(&dir, static_cast<std::uint32_t>(archive.saves.size()));
+    for (const auto& b : archive.blobs) {
+        Append(&dir, BlobRecord{b.hash, b.offset, b.rawSize, b.storedSize});
+    }
+    for (const auto& s : archive.saves) {
+        SaveRecord rec{};
+        rec.hash = s.hash;
+        rec.rawSize = s.rawSize;
+        rec.mtime = s.mtime;
+        std::memcpy(rec.fileHeader, s.fileHeader.data(), s.fileHeader.size());
+        rec.segmentCount = static_cast<std::uint32_t>(s.blobs.size());
+        rec.nameLength = static_cast<std::uint16_t>(std::min<std::size_t>(s.name.size(), 0xFFFFu));
+        Append(&dir, rec);
+        dir.insert(dir.end(), s.name.begin(), s.name.begin() + rec.nameLength);
+        for (const auto idx : s.blobs) {
+            Append(&dir, idx);
+        }
+    }
+    return dir;
+}
+
+bool ParseDirectory(const std::vector<char>& dir, Archive* out) {
+    std::size_t pos = 0;
+    std::uint32_t blobCount = 0;
+    std::uint32_t saveCount = 0;
+    if (!Take(dir, &pos, &blobCount) || !Take(dir, &pos, &saveCount) ||
+        static_cast<std::uint64_t>(blobCount) * sizeof(BlobRecord) > dir.size() - pos) {
+        return false;
+    }
+    out->blobs.resize(blobCount);
+    for (auto& b : out->blobs) {
+        BlobRecord rec{};
+        Take(dir, &pos, &rec);
+        b = BlobEntry{rec.hash, rec.offset, rec.rawSize, rec.storedSize};
+    }
+    out->saves.resize(saveCount);
+    for (auto& s : out->saves) {
+        SaveRecord rec{};
+        if (!Take(dir, &pos, &rec) || dir.size() - pos < rec.nameLength) {
+            return false;
+        }
+        s.hash = rec.hash;
+        s.rawSize = rec.rawSize;
+        s.mtime = rec.mtime;
+        std::memcpy(s.fileHeader.data(), rec.fileHeader, s.fileHeader.size());
+        s.name.assign(dir.data() + pos, rec.nameLength);
+        pos += rec.nameLength;
+        if (static_cast<std::uint64_t>(rec.segmentCount) * 4u > dir.size() - pos) {
+            return false;
+        }
+        s.blobs.resize(rec.segmentCount);
+        for (auto& idx : s.blobs) {
+            Take(dir, &pos, &idx);
+            if (idx >= blobCount) {
+                return false;
+            }
+        }
+    }
+    return pos == dir.size();
+}
+
+// Forces what was written to `path` (through any handle) onto the disk.
+bool SyncFile(const fs::path& path) {
+#ifdef _WIN32
+    const HANDLE h = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    const bool ok = FlushFileBuffers(h) != 0;
+    CloseHandle(h);
+    return ok;
+#else
+    const int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+// The trailer, directory and blob bounds of the live state that ends at `end`; `what` says why not.
+bool LoadState(std::ifstream& in, std::uint64_t end, Archive* out, const char** what) {
+    Trailer trailer{};
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(end - sizeof(Trailer)));
+    in.read(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+    if (!in || std::memcmp(trailer.magic, kMagic, 4) != 0) {
+        *what = "not an archive";
+        return false;
+    }
+    if (trailer.version != kArchiveVersion) {
+        *what = "unsupported archive version";
+        return false;
+    }
+    if (trailer.dirOffset < sizeof(FileHeader) || trailer.dirOffset > end - sizeof(Trailer) ||
+        trailer.dirSize != end - sizeof(Trailer) - trailer.dirOffset) {
+        *what = "corrupt archive trailer";
+        return false;
+    }
+
+    std::vector<char> dir(static_cast<std::size_t>(trailer.dirSize));
+    in.seekg(static_cast<std::streamoff>(trailer.dirOffset));
+    in.read(dir.data(), static_cast<std::streamsize>(dir.size()));
+    Archive archive;
+    archive.dataEnd = trailer.dirOffset;
+    archive.fileEnd = end;
+    if (!in || !ParseDirectory(dir, &archive)) {
+        *what = "corrupt archive directory";
+        return false;
+    }
+    for (const auto& b : archive.blobs) {
+        if (b.offset < sizeof(FileHeader) || b.offset + b.storedSize > archive.dataEnd) {
+            *what = "blob outside archive data";
+            return false;
+        }
+    }
+    *out = std::move(archive);
+    return true;
+}
+
+// Every add appends past the live trailer and leaves it intact, so when the committed trailer is
+// unreadable the newest valid trailer ending at or below `limit` is the state before that add.
+bool LoadPreviousState(std::ifstream& in, std::uint64_t limit, Archive* out) {
+    const std::uint64_t lowest = sizeof(FileHeader) + sizeof(Trailer);
+    std::vector<char> buf;
+    const char* what = nullptr;
+    for (std::uint64_t hi = limit; hi >= lowest;) {
+        // Trailer ends in [from, hi]; the magic is 8 bytes before the end.
+        const std::uint64_t from = hi - std::min<std::uint64_t>(hi - lowest, kTrailerScanChunk);
+        buf.resize(static_cast<std::size_t>(hi - from + 4));
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(from - 8));
+        in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (!in) {
+            return false;
+        }
+        for (std::uint64_t end = hi + 1; end-- > from;) {
+            if (std::memcmp(buf.data() + (end - from), kMagic, 4) == 0 && LoadState(in, end, out, &what)) {
+                return true;
+            }
+        }
+        if (from == lowest) {
+            break;
+        }
+        hi = from - 1;
+    }
+    return false;
+}
+
+void Prepare(const AddInput& input, Prepared* out) {
+    const auto raw = mafia_save::ReadFileBytes(input.file);
+    if (raw.empty()) {
+        out->error = "cannot read file";
+        return;
+    }
+    if (!mafia_save::ParseSave(raw, &out->save, &out->error)) {
+        return;
+    }
+    std::error_code ec;
+    out->entry.name = input.name;
+    out->entry.hash = save_index::ContentHash(raw);
+    out->entry.rawSize = raw.size();
+    out->entry.mtime = static_cast<std::int64_t>(fs::last_write_time(input.file, ec).time_since_epoch().count());
+    out->entry.fileHeader = out->save.fileHeader;
+    out->segmentHashes.reserve(out->save.segments.size());
+    for (const auto& seg : out->save.segments) {
+        out->segmentHashes.push_back(save_index::ContentHash(seg.plain));
+    }
+    out->ok = true;
+}
+
+}  // namespace
+
+bool OpenArchive(const fs::path& path, Archive* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output archive";
+        }
+        return false;
+    }
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        *out = Archive{};
+        out->dataEnd = sizeof(FileHeader);
+        out->fileEnd = sizeof(FileHeader);
+        return true;
+    }
+    const std::uint64_t fileSize = fs::file_size(path, ec);
+    std::ifstream in(path, std::ios::binary);
+    FileHeader header{};
+    const auto fail = [&](const char* what) {
+        if (error != nullptr) {
+            *error = std::string(what) + ": " + path.string();
+        }
+        return false;
+    };
+    if (!in || ec || fileSize < sizeof(FileHeader) + sizeof(Trailer)) {
+        return fail("not an archive");
+    }
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, kMagic, 4) != 0) {
+        return fail("not an archive");
+    }
+    if (header.version != kArchiveVersion) {
+        return fail("unsupported archive version");
+    }
+    // Bytes past committedEnd are the remains of an add that did not finish.
+    const std::uint64_t end = header.committedEnd != 0 ? header.committedEnd : fileSize;
+    const char* what = "corrupt archive header";
+    Archive archive;
+    if (end >= sizeof(FileHeader) + sizeof(Trailer) && end <= fileSize && LoadState(in, end, &archive, &what)) {
+        *out = std::move(archive);
+        return true;
+    }
+    // The header commit can reach the disk without the trailer it points at (a drive that reorders
+    // writes, or a torn tail): fall back to the state before the last add.
+    if (LoadPreviousState(in, std::min(end - 1, fileSize), &archive)) {
+        archive.recovered = true;
+        *out = std::move(archive);
+        return true;
+    }
+    return fail(what);
+}
+
+bool AddSaves(const fs::path& path,
+              const std::vector<AddInput>& inputs,
+              unsigned threads,
+              AddStats* stats,
+              std::string* error) {
+    Archive archive;
+    if (!OpenArchive(path, &archive, error)) {
+        return false;
+    }
+
+    // A new archive is built next to the target and renamed into place; an existing one is only
+    // appended to past its live trailer, which stays valid until the header points past it.
+    std::error_code ec;
+    const bool exists = fs::exists(path, ec);
+    fs::path target = path;
+    if (!exists) {
+        target += ".tmp";
+    }
+    std::fstream out;
+    if (exists) {
+        out.open(target, std::ios::binary | std::ios::in | std::ios::out);
+    } else {
+        out.open(target, std::ios::binary | std::ios::out | std::ios::trunc);
+        FileHeader header{};
+        std::memcpy(header.magic, kMagic, 4);
+        header.version = kArchiveVersion;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    if (!out) {
+        if (error != nullptr) {
+            *error = "cannot open archive for writing: " + target.string();
+        }
+        return false;
+    }
+    std::uint64_t end = archive.fileEnd;
+    out.seekp(static_cast<std::streamoff>(end));
+
+    AddStats st;
+    std::map<BlobKey, std::uint32_t> known;
+    for (std::uint32_t i = 0; i < archive.blobs.size(); ++i) {
+        known.emplace(BlobKey{archive.blobs[i].hash, archive.blobs[i].rawSize}, i);
+    }
+    std::set<std::pair<std::string, std::uint64_t>> present;
+    for (const auto& s : archive.saves) {
+        present.emplace(s.name, s.hash);
+    }
+
+    // Batches bound the decrypted saves held in memory at once.
+    for (std::size_t begin = 0; begin < inputs.size(); begin += kBatchSize) {
+        const std::size_t count = std::min(kBatchSize, inputs.size() - begin);
+        std::vector<Prepared> prepared(count);
+        work_pool::ParallelFor(count, threads, [&](unsigned, std::size_t i) {
+            Prepare(inputs[begin + i], &prepared[i]);
+        });
+
+        // New blobs point at the segment plaintext they came from until they are compressed.
+        std::vector<const std::vector<std::uint8_t>*> pendingPlain;
+        const std::size_t firstNew = archive.blobs.size();
+        for (std::size_t i = 0; i < count; ++i) {
+            auto& p = prepared[i];
+            if (!p.ok) {
+                ++st.failed;
+                st.failures.push_back(inputs[begin + i].file.string() + ": " + p.error);
+                continue;
+            }
+            if (!present.emplace(p.entry.name, p.entry.hash).second) {
+                ++st.skipped;
+                continue;
+            }
+            p.entry.blobs.reserve(p.save.segments.size());
+            for (std::size_t s = 0; s < p.save.segments.size(); ++s) {
+                const auto& plain = p.save.segments[s].plain;
+                const BlobKey key{p.segmentHashes[s], static_cast<std::uint32_t>(plain.size())};
+                auto it = known.find(key);
+                if (it == known.end()) {
+                    it = known.emplace(key, static_cast<std::uint32_t>(archive.blobs.size())).first;
+                    BlobEntry blob;
+                    blob.hash = key.first;
+                    blob.rawSize = key.second;
+                    archive.blobs.push_back(blob);
+                    pendingPlain.push_back(&plain);
+                }
+                p.entry.blobs.push_back(it->second);
+            }
+            st.segments += p.save.segments.size();
+            st.rawBytes += p.entry.rawSize;
+            ++st.added;
+            archive.saves.push_back(std::move(p.entry));
+        }
+        st.newBlobs += pendingPlain.size();
+
+        std::vector<std::vector<std::uint8_t>> packed(pendingPlain.size());
+        work_pool::ParallelFor(pendingPlain.size(), threads, [&](unsigned, std::size_t i) {
+            const auto& plain = *pendingPlain[i];
+            packed[i] = lz_codec::Compress(plain.data(), plain.size());
+            if (packed[i].size() >= plain.size()) {
+                packed[i] = plain;
+            }
+        });
+        for (std::size_t i = 0; i < packed.size(); ++i) {
+            auto& blob = archive.blobs[firstNew + i];
+            blob.offset = end;
+            blob.storedSize = static_cast<std::uint32_t>(packed[i].size());
+            out.write(reinterpret_cast<const char*>(packed[i].data()), static_cast<std::streamsize>(packed[i].size()));
+            end += packed[i].size();
+            st.storedBytes += packed[i].size();
+        }
+    }
+
+    // A recovered archive is committed again even when nothing new was added.
+    if (st.added != 0 || !exists || archive.recovered) {
+        archive.dataEnd = end;
+        const auto dir = SerializeDirectory(archive);
+        Trailer trailer{};
+        trailer.dirOffset = archive.dataEnd;
+        trailer.dirSize = dir.size();
+        std::memcpy(trailer.magic, kMagic, 4);
+        trailer.version = kArchiveVersion;
+        out.write(dir.data(), static_cast<std::streamsize>(dir.size()));
+        out.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        out.flush();
+        archive.fileEnd = archive.dataEnd + dir.size() + sizeof(trailer);
+
+        // The commit: one header write switches readers to the new trailer, which has to be on the
+        // disk first; otherwise a power loss can leave the header pointing at bytes that never landed.
+        bool synced = out && SyncFile(target);
+        if (synced) {
+            FileHeader header{};
+            std::memcpy(header.magic, kMagic, 4);
+            header.version = kArchiveVersion;
+            header.committedEnd = archive.fileEnd;
+            out.seekp(0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+        out.close();
+        synced = synced && out && SyncFile(target);
+        if (!synced) {
+            if (!exists) {
+                fs::remove(target, ec);
+            }
+            if (error != nullptr) {
+                *error = "write failed: " + target.string();
+            }
+            return false;
+        }
+        // Drops what an earlier interrupted add left past the old trailer.
+        fs::resize_file(target, archive.fileEnd, ec);
+        if (!exists) {
+            fs::rename(target, path, ec);
+            if (ec) {
+                fs::remove(target, ec);
+                if (error != nullptr) {
+                    *error = "failed to create " + path.string();
+                }
+                return false;
+            }
+        }
+    }
+
+    if (stats != nullptr) {
+        *stats = std::move(st);
+    }
+    return true;
+}
+
+bool ReadBlob(std::istream& in, const BlobEntry& blob, std::vector<std::uint8_t>* plain, std::string* error) {
+    std::vector<std::uint8_t> stored(blob.storedSize);
+    in.seekg(static_cast<std::streamoff>(blob.offset));
+    in.read(reinterpret_cast<char*>(stored.data()), static_cast<std::streamsize>(stored.size()));
+    if (!in) {
+        if (error != nullptr) {
+            *error = "cannot read blob at offset " + std::to_string(blob.offset);
+        }
+        return false;
+    }
+    if (blob.storedSize == blob.rawSize) {
+        *plain = std::move(stored);
+        return true;
+    }
+    return lz_codec::Decompress(stored.data(), stored.size(), blob.rawSize, plain, error);
+}
+
+bool ExtractSave(const fs::path& path,
+                 const Archive& archive,
+                 std::size_t saveIndex,
+                 std::vector<std::uint8_t>* raw,
+                 std::string* error) {
+    if (raw == nullptr || saveIndex >= archive.saves.size()) {
+        if (error != nullptr) {
+            *error = "save index out of range";
+        }
+        return false;
+    }
+    const SaveEntry& entry = archive.saves[saveIndex];
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        if (error != nullptr) {
+            *error = "cannot open archive: " + path.string();
+        }
+        return false;
+    }
+
+    mafia_save::SaveData save;
+    save.fileHeader = entry.fileHeader;
+    save.segments.resize(entry.blobs.size());
+    for (std::size_t i = 0; i < entry.blobs.size(); ++i) {
+        if (!ReadBlob(in, archive.blobs[entry.blobs[i]], &save.segments[i].plain, error)) {
+            return false;
+        }
+    }
+    if (!mafia_save::BuildRaw(save, raw, error)) {
+        return false;
+    }
+    if (raw->size() != entry.rawSize || save_index::ContentHash(*raw) != entry.hash) {
+        if (error != nullptr) {
+            *error = "rebuilt save does not match the archived hash";
+        }
+        return false;
+    }
+    return true;
+}
+
+}  // namespace save_archive
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace save_archive {
+
+namespace fs = std::filesystem;
+
+constexpr std::uint32_t kArchiveVersion = 1;
+
+// One decrypted segment body, stored once per (hash, size) and LZ-compressed when that is smaller.
+struct BlobEntry {
+    std::uint64_t hash = 0;  // save_index::ContentHash of the plaintext
+    std::uint64_t offset = 0;
+    std::uint32_t rawSize = 0;
+    std::uint32_t storedSize = 0;  // == rawSize: stored uncompressed
+};
+
+// A save is its 24-byte file header plus the ordered list of segment blobs; BuildRaw re-encrypts them.
+struct SaveEntry {
+    std::string name;
+    std::uint64_t hash = 0;  // ContentHash of the original file, checked on extract
+    std::uint64_t rawSize = 0;
+    std::int64_t mtime = 0;
+    std::array<std::uint8_t, mafia_save::kFileHeaderSize> fileHeader{};
+    std::vector<std::uint32_t> blobs;
+};
+
+// File layout: "MSAR" u32 version u64 committedEnd | blob bodies | directory | trailer { u64 dirOffset,
+// u64 dirSize, "MSAR", u32 version }. The directory is BlobRecord[] followed by variable-size save records.
+// Adding saves appends bodies, a new directory and a new trailer after the live trailer, then points
+// committedEnd at the new trailer's end; a failed or interrupted add leaves the previous archive intact.
+// committedEnd 0 means the trailer ends the file.
+struct Archive {
+    std::vector<BlobEntry> blobs;
+    std::vector<SaveEntry> saves;
+    std::uint64_t dataEnd = 0;  // where the live directory starts
+    std::uint64_t fileEnd = 0;  // end of the live trailer; the next add appends here
+    bool recovered = false;     // the committed trailer was unreadable; this is the state before the last add
+};
+
+struct AddInput {
+    fs::path file;
+    std::string name;  // name stored in the archive (relative path)
+};
+
+struct AddStats {
+    std::size_t added = 0;
+    std::size_t skipped = 0;  // same name and content already archived
+    std::size_t failed = 0;
+    std::size_t segments = 0;
+    std::size_t newBlobs = 0;
+    std::uint64_t rawBytes = 0;     // size of the added saves
+    std::uint64_t storedBytes = 0;  // bytes of new blob bodies written
+    std::vector<std::string> failures;
+};
+
+// A missing file is an empty archive.
+bool OpenArchive(const fs::path& path, Archive* out, std::string* error = nullptr);
+bool AddSaves(const fs::path& path,
+              const std::vector<AddInput>& inputs,
+              unsigned threads,
+              AddStats* stats = nullptr,
+              std::string* error = nullptr);
+// Reads and decompresses one blob from an open archive stream.
+bool ReadBlob(std::istream& in, const BlobEntry& blob, std::vector<std::uint8_t>* plain, std::string* error = nullptr);
+bool ExtractSave(const fs::path& path,
+                 const Archive& archive,
+                 std::size_t saveIndex,
+                 std::vector<std::uint8_t>* raw,
+                 std::string* error = nullptr);
+
+}  // namespace save_archive
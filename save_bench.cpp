@@ -0,0 +1,397 @@
+#include "save_bench.hpp"
+
+#include "mafia_save.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <sstream>
+
+#ifdef _WIN32
+#include <thread>
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+// GetProcessMemoryInfo from kernel32 (K32*), so no -lpsapi is needed.
+#define PSAPI_VERSION 2
+#include <psapi.h>
+#elif !defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+// The counting operator new/delete below replace the global ones for the whole binary that links
+// this file (mafia_stream_tool, whose --stats and bench both report allocations). Build with
+// -DSAVE_BENCH_COUNT_ALLOCS=0 to keep the default allocator; allocation counts then read 0.
+#ifndef SAVE_BENCH_COUNT_ALLOCS
+#define SAVE_BENCH_COUNT_ALLOCS 1
+#endif
+
+#if SAVE_BENCH_COUNT_ALLOCS
+namespace {
+
+std::atomic<std::uint64_t> g_allocations{0};
+
+void* CountedAlloc(std::size_t size) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+    void* p = CountedAlloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace save_bench {
+
+namespace {
+
+constexpr const char* kCsvHeader = "workflow,files,bytes,reps,seconds,files_per_s,mb_per_s,peak_rss_kb,allocs_per_file";
+// RSS rises are a few pages once the warmup run has grown the heap, so growth below this is noise.
+constexpr std::uint64_t kRssSlackKb = 1024;
+
+bool SplitCsvLine(const std::string& line, std::vector<std::string>* fields) {
+    fields->clear();
+    std::istringstream in(line);
+    std::string field;
+    while (std::getline(in, field, ',')) {
+        fields->push_back(field);
+    }
+    if (!line.empty() && line.back() == ',') {
+        fields->emplace_back();
+    }
+    return fields->size() == 9;
+}
+
+bool ParseNumber(const std::string& s, double* out) {
+    char* end = nullptr;
+    *out = std::strtod(s.c_str(), &end);
+    return !s.empty() && end != nullptr && *end == '\0' && *out >= 0.0;
+}
+
+void AddRegression(Comparison* c, const Result& cur, const char* metric, double base, double now) {
+    c->regressions.push_back(Regression{cur.workflow, metric, base, now, (now - base) / base * 100.0});
+}
+
+#ifdef __linux__
+// "VmRSS:" or "VmHWM:" from /proc/self/status, in KiB.
+std::uint64_t ProcStatusKb(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    const std::size_t len = std::char_traits<char>::length(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, len, field) == 0) {
+            return std::strtoull(line.c_str() + len, nullptr, 10);
+        }
+    }
+    return 0;
+}
+#endif
+
+#ifdef _WIN32
+// PeakWorkingSetSize covers the whole process lifetime and cannot be lowered, so on Windows the peak
+// of one run is the highest WorkingSetSize seen by a thread polling it while the run is in progress.
+class WorkingSetSampler {
+public:
+    WorkingSetSampler()
+        : base_(CurrentRssKb() * 1024u),
+          thread_([this] {
+              while (!stop_.load(std::memory_order_relaxed)) {
+                  Sample();
+                  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+              }
+          }) {}
+
+    ~WorkingSetSampler() { StopKb(); }
+
+    // Highest working set above the one at construction.
+    std::uint64_t StopKb() {
+        if (thread_.joinable()) {
+            stop_.store(true, std::memory_order_relaxed);
+            thread_.join();
+            Sample();
+        }
+        return peak_ > base_ ? (peak_ - base_) / 1024u : 0u;
+    }
+
+private:
+    void Sample() {
+        PROCESS_MEMORY_COUNTERS pmc{};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+            peak_ = std::max<std::uint64_t>(peak_, pmc.WorkingSetSize);
+        }
+    }
+
+    std::atomic<bool> stop_{false};
+    std::uint64_t base_ = 0;
+    std::uint64_t peak_ = 0;  // written by the sampler thread until StopKb joins it
+    std::thread thread_;      // last: starts polling in the constructor
+};
+#endif
+
+}  // namespace
+
+std::uint64_t AllocationCount() {
+#if SAVE_BENCH_COUNT_ALLOCS
+    return g_allocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+std::uint64_t PeakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return static_cast<std::uint64_t>(pmc.PeakWorkingSetSize) / 1024u;
+    }
+    return 0;
+#elif defined(__linux__)
+    return ProcStatusKb("VmHWM:");
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<std::uint64_t>(usage.ru_maxrss) / 1024u;
+#else
+    return static_cast<std::uint64_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+std::uint64_t CurrentRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return static_cast<std::uint64_t>(pmc.WorkingSetSize) / 1024u;
+    }
+    return 0;
+#elif defined(__linux__)
+    return ProcStatusKb("VmRSS:");
+#else
+    return PeakRssKb();  // no portable current figure; the rise then counts only new process peaks
+#endif
+}
+
+void ResetPeakRss() {
+#ifdef __linux__
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+#endif
+}
+
+bool Measure(const std::string& workflow,
+             std::size_t files,
+             std::uint64_t bytes,
+             std::size_t reps,
+             const std::function<bool()>& run,
+             Result* out,
+             std::string* error) {
+    if (out == nullptr || reps == 0) {
+        if (error != nullptr) {
+            *error = out == nullptr ? "null output result" : "reps must be at least 1";
+        }
+        return false;
+    }
+    if (!run()) {
+        if (error != nullptr) {
+            *error = "workflow " + workflow + " failed";
+        }
+        return false;
+    }
+
+    Result r;
+    r.workflow = workflow;
+    r.files = files;
+    r.bytes = bytes;
+    r.reps = reps;
+    double best = 0.0;
+    std::uint64_t minAllocs = UINT64_MAX;
+    for (std::size_t i = 0; i < reps; ++i) {
+#ifdef _WIN32
+        WorkingSetSampler sampler;  // started outside the allocation count
+#else
+        ResetPeakRss();
+        const std::uint64_t baseKb = CurrentRssKb();
+#endif
+        const std::uint64_t a0 = AllocationCount();
+        const auto t0 = std::chrono::steady_clock::now();
+        const bool ok = run();
+        const auto t1 = std::chrono::steady_clock::now();
+        const std::uint64_t a1 = AllocationCount();
+#ifdef _WIN32
+        const std::uint64_t peakKb = sampler.StopKb();
+#else
+        const std::uint64_t highKb = PeakRssKb();
+        const std::uint64_t peakKb = highKb > baseKb ? highKb - baseKb : 0u;
+#endif
+        if (!ok) {
+            if (error != nullptr) {
+                *error = "workflow " + workflow + " failed";
+            }
+            return false;
+        }
+        const double seconds = std::chrono::duration<double>(t1 - t0).count();
+        best = i == 0 ? seconds : std::min(best, seconds);
+        minAllocs = std::min(minAllocs, a1 - a0);
+        r.peakRssKb = std::max(r.peakRssKb, peakKb);
+    }
+    r.seconds = best;
+    if (r.seconds > 0.0) {
+        r.filesPerSec = static_cast<double>(files) / r.seconds;
+        r.mbPerSec = static_cast<double>(bytes) / r.seconds / (1024.0 * 1024.0);
+    }
+    r.allocsPerFile = files == 0 ? 0.0 : static_cast<double>(minAllocs) / static_cast<double>(files);
+    *out = std::move(r);
+    return true;
+}
+
+bool LoadBaseline(const fs::path& path, std::vector<Result>* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output result vector";
+        }
+        return false;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        if (error != nullptr) {
+            *error = "failed to open " + path.string();
+        }
+        return false;
+    }
+    std::vector<Result> results;
+    std::vector<std::string> fields;
+    std::string line;
+    std::size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line == kCsvHeader) {
+            continue;
+        }
+        double v[8] = {};
+        bool ok = SplitCsvLine(line, &fields) && !fields[0].empty();
+        for (std::size_t i = 0; ok && i < 8; ++i) {
+            ok = ParseNumber(fields[i + 1], &v[i]);
+        }
+        if (!ok) {
+            if (error != nullptr) {
+                *error = path.string() + ":" + std::to_string(lineNo) + ": expected " + kCsvHeader;
+            }
+            return false;
+        }
+        Result r;
+        r.workflow = fields[0];
+        r.files = static_cast<std::size_t>(v[0]);
+        r.bytes = static_cast<std::uint64_t>(v[1]);
+        r.reps = static_cast<std::size_t>(v[2]);
+        r.seconds = v[3];
+        r.filesPerSec = v[4];
+        r.mbPerSec = v[5];
+        r.peakRssKb = static_cast<std::uint64_t>(v[6]);
+        r.allocsPerFile = v[7];
+        results.push_back(std::move(r));
+    }
+    *out = std::move(results);
+    return true;
+}
+
+bool WriteBaseline(const fs::path& path, const std::vector<Result>& results, std::string* error) {
+    std::ostringstream csv;
+    csv << kCsvHeader << "\n" << std::fixed;
+    for (const auto& r : results) {
+        csv << r.workflow << "," << r.files << "," << r.bytes << "," << r.reps << "," << std::setprecision(6)
+            << r.seconds << "," << std::setprecision(2) << r.filesPerSec << "," << r.mbPerSec << "," << r.peakRssKb
+            << "," << std::setprecision(1) << r.allocsPerFile << "\n";
+    }
+    const std::string text = csv.str();
+    return mafia_save::WriteFileBytesAtomic(path, std::vector<std::uint8_t>(text.begin(), text.end()), error);
+}
+
+Comparison Compare(const std::vector<Result>& baseline, const std::vector<Result>& current, double thresholdPct) {
+    Comparison c;
+    std::map<std::string, const Result*> byName;
+    for (const auto& b : baseline) {
+        byName[b.workflow] = &b;
+    }
+    const double low = 1.0 - thresholdPct / 100.0;
+    const double high = 1.0 + thresholdPct / 100.0;
+    for (const auto& cur : current) {
+        const auto it = byName.find(cur.workflow);
+        if (it == byName.end()) {
+            c.notes.push_back("workflow=" + cur.workflow + " has no baseline");
+            continue;
+        }
+        const Result& b = *it->second;
+        byName.erase(it);
+        if (b.files != cur.files || b.bytes != cur.bytes) {
+            c.notes.push_back("workflow=" + cur.workflow + " corpus differs from the baseline (files " +
+                              std::to_string(b.files) + " -> " + std::to_string(cur.files) + ", bytes " +
+                              std::to_string(b.bytes) + " -> " + std::to_string(cur.bytes) + ")");
+        }
+        if (b.filesPerSec > 0.0 && cur.filesPerSec < b.filesPerSec * low) {
+            AddRegression(&c, cur, "files_per_s", b.filesPerSec, cur.filesPerSec);
+        }
+        if (b.mbPerSec > 0.0 && cur.mbPerSec < b.mbPerSec * low) {
+            AddRegression(&c, cur, "mb_per_s", b.mbPerSec, cur.mbPerSec);
+        }
+        if (cur.peakRssKb > b.peakRssKb + kRssSlackKb &&
+            static_cast<double>(cur.peakRssKb) > static_cast<double>(b.peakRssKb) * high) {
+            AddRegression(&c, cur, "peak_rss_kb", static_cast<double>(b.peakRssKb), static_cast<double>(cur.peakRssKb));
+        }
+        if (b.allocsPerFile > 0.0 && cur.allocsPerFile > b.allocsPerFile * high) {
+            AddRegression(&c, cur, "allocs_per_file", b.allocsPerFile, cur.allocsPerFile);
+        }
+    }
+    for (const auto& left : byName) {
+        c.notes.push_back("workflow=" + left.first + " is in the baseline but was not run");
+    }
+    return c;
+}
+
+}  // namespace save_bench
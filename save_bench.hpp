@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace save_bench {
+
+namespace fs = std::filesystem;
+
+// End-to-end workflow measurements and the baseline gate. Linking save_bench.cpp replaces the global
+// operator new/delete of the whole binary with versions that count allocations (one relaxed atomic
+// add per call); -DSAVE_BENCH_COUNT_ALLOCS=0 turns that off and AllocationCount returns 0.
+std::uint64_t AllocationCount();
+
+// Peak and current resident set size of the process in KiB. ResetPeakRss lowers the peak to the
+// current RSS on Linux (/proc/self/clear_refs); elsewhere it is a no-op and the peak stays
+// process-wide, so Measure samples WorkingSetSize on a polling thread during each run on Windows (a
+// spike shorter than the poll interval can be missed).
+std::uint64_t PeakRssKb();
+std::uint64_t CurrentRssKb();
+void ResetPeakRss();
+
+struct Result {
+    std::string workflow;
+    std::size_t files = 0;
+    std::uint64_t bytes = 0;
+    std::size_t reps = 0;
+    double seconds = 0.0;  // fastest timed run; the least noisy figure to gate on
+    double filesPerSec = 0.0;
+    double mbPerSec = 0.0;
+    // Highest rise of RSS above its level at the start of a timed run. Heap the allocator kept from
+    // earlier workflows is part of that level, so one workflow's growth is not charged to the next.
+    std::uint64_t peakRssKb = 0;
+    double allocsPerFile = 0.0;   // lowest over the timed runs
+};
+
+// One untimed warmup run, then `reps` timed runs of `run`, which processes `files` files of `bytes`
+// bytes in total. Fails when any run fails.
+bool Measure(const std::string& workflow,
+             std::size_t files,
+             std::uint64_t bytes,
+             std::size_t reps,
+             const std::function<bool()>& run,
+             Result* out,
+             std::string* error = nullptr);
+
+// CSV with a header line: workflow,files,bytes,reps,seconds,files_per_s,mb_per_s,peak_rss_kb,allocs_per_file
+bool LoadBaseline(const fs::path& path, std::vector<Result>* out, std::string* error = nullptr);
+bool WriteBaseline(const fs::path& path, const std::vector<Result>& results, std::string* error = nullptr);
+
+struct Regression {
+    std::string workflow;
+    std::string metric;  // files_per_s, mb_per_s, peak_rss_kb, allocs_per_file
+    double baseline = 0.0;
+    double current = 0.0;
+    double changePct = 0.0;  // signed, relative to the baseline
+};
+
+struct Comparison {
+    std::vector<Regression> regressions;
+    std::vector<std::string> notes;  // workflows missing on either side, corpus size changes
+};
+
+// Throughput may drop and memory metrics may grow by at most `thresholdPct` percent of the baseline;
+// peak RSS also has to grow by more than 1 MiB to count.
+Comparison Compare(const std::vector<Result>& baseline, const std::vector<Result>& current, double thresholdPct);
+
+}  // namespace save_bench
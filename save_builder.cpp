@@ -0,0 +1,287 @@
+#include "save_builder.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace save_builder {
+
+namespace {
+
+constexpr std::size_t kHeaderNameSize = 64;
+constexpr std::size_t kHeaderModelOff = 64;
+constexpr std::size_t kHeaderTypeOff = 128;
+constexpr std::size_t kHeaderPayloadSizeOff = 132;
+constexpr std::size_t kHeaderIdxOff = 136;
+constexpr std::size_t kInfoNameSize = 32;
+constexpr std::size_t kInfoMainSizeOff = 32;
+constexpr std::size_t kInfoAiGroupsSizeOff = 240;
+constexpr std::size_t kInfoAiFollowSizeOff = 244;
+constexpr std::uint32_t kHeadMagic = 0x47766153u;  // "SavG"
+constexpr std::uint32_t kHeadVersion = 0x10u;
+constexpr std::uint32_t kHeadMissionBias = 5000u;
+
+bool CheckSize(const std::vector<std::uint8_t>& block, std::size_t size, const char* name, std::string* error) {
+    if (block.size() == size) {
+        return true;
+    }
+    if (error != nullptr) {
+        std::ostringstream oss;
+        oss << name << " must be " << size << " bytes, got " << block.size();
+        *error = oss.str();
+    }
+    return false;
+}
+
+bool CheckName(const std::string& name, std::size_t fieldSize, const char* what, std::string* error) {
+    if (name.size() < fieldSize && name.find('\0') == std::string::npos) {
+        return true;
+    }
+    if (error != nullptr) {
+        std::ostringstream oss;
+        oss << what << " '" << name << "' does not fit the " << fieldSize << "-byte field";
+        *error = oss.str();
+    }
+    return false;
+}
+
+bool CheckU32(std::size_t size, const char* what, std::string* error) {
+    if (size <= 0xFFFFFFFFu) {
+        return true;
+    }
+    if (error != nullptr) {
+        *error = std::string(what) + " is larger than a u32 size field";
+    }
+    return false;
+}
+
+void Place(const std::vector<std::uint8_t>& plain,
+           std::vector<std::uint8_t>* raw,
+           std::size_t* cursor,
+           mafia_save::CipherCheckpoint* state) {
+    std::copy(plain.begin(), plain.end(), raw->begin() + static_cast<std::ptrdiff_t>(*cursor));
+    mafia_save::EncryptRange(raw->data() + *cursor, plain.size(), state);
+    *cursor += plain.size();
+}
+
+}  // namespace
+
+SaveBuilder::SaveBuilder()
+    : head_(mafia_save::kBlockHeadSize, 0u), meta_(mafia_save::kBlockMetaSize, 0u), info_(mafia_save::kBlockInfoSize, 0u) {
+    const std::uint8_t header[mafia_save::kFileHeaderSize] = {'G', 'v', 'a', 'S', 0, 0, 0, 0, 1, 0, 0, 0};
+    std::copy(std::begin(header), std::end(header), fileHeader_.begin());
+    SetMission(0);
+}
+
+SaveBuilder SaveBuilder::FromSave(const mafia_save::SaveData& save) {
+    SaveBuilder b;
+    b.fileHeader_ = save.fileHeader;
+    auto block = [&](std::size_t idx, std::vector<std::uint8_t>* out) {
+        if (idx != mafia_save::kNoIndex && idx < save.segments.size()) {
+            *out = save.segments[idx].plain;
+        }
+    };
+    block(save.idxHead, &b.head_);
+    block(save.idxMeta, &b.meta_);
+    block(save.idxInfo, &b.info_);
+    block(save.idxGamePayload, &b.game_);
+    block(save.idxAiGroups, &b.aiGroups_);
+    block(save.idxAiFollow, &b.aiFollow_);
+    b.actors_.reserve(save.actorCount);
+    for (std::size_t i = 0; i + 1 < save.segments.size(); ++i) {
+        if (save.segments[i].name.rfind("actor_header_", 0) == 0 &&
+            save.segments[i + 1].name.rfind("actor_payload_", 0) == 0) {
+            b.actors_.push_back(Actor{save.segments[i].plain, save.segments[i + 1].plain});
+            ++i;
+        }
+    }
+    return b;
+}
+
+void SaveBuilder::SetFileHeader(const std::array<std::uint8_t, mafia_save::kFileHeaderSize>& header) {
+    fileHeader_ = header;
+}
+
+void SaveBuilder::SetMission(std::uint32_t mission) {
+    head_.assign(mafia_save::kBlockHeadSize, 0u);
+    mafia_save::WriteU32LE(&head_, 0, kHeadMagic);
+    mafia_save::WriteU32LE(&head_, 4, kHeadVersion);
+    mafia_save::WriteU32LE(&head_, 8, mission);
+    mafia_save::WriteU32LE(&head_, 20, kHeadMissionBias + mission);
+    mafia_save::WriteU32LE(&meta_, 0, mission);
+}
+
+bool SaveBuilder::SetHead(const std::vector<std::uint8_t>& head24, std::string* error) {
+    if (!CheckSize(head24, mafia_save::kBlockHeadSize, "head24", error)) {
+        return false;
+    }
+    head_ = head24;
+    return true;
+}
+
+bool SaveBuilder::SetMeta(const std::vector<std::uint8_t>& meta32, std::string* error) {
+    if (!CheckSize(meta32, mafia_save::kBlockMetaSize, "meta32", error)) {
+        return false;
+    }
+    meta_ = meta32;
+    return true;
+}
+
+bool SaveBuilder::SetInfo(const std::vector<std::uint8_t>& info264, std::string* error) {
+    if (!CheckSize(info264, mafia_save::kBlockInfoSize, "info264", error)) {
+        return false;
+    }
+    info_ = info264;
+    return true;
+}
+
+bool SaveBuilder::SetMissionName(const std::string& name, std::string* error) {
+    if (!CheckName(name, kInfoNameSize, "mission name", error)) {
+        return false;
+    }
+    std::fill(info_.begin(), info_.begin() + kInfoNameSize, 0u);
+    std::copy(name.begin(), name.end(), info_.begin());
+    return true;
+}
+
+void SaveBuilder::SetGamePayload(std::vector<std::uint8_t> payload) {
+    game_ = std::move(payload);
+}
+
+void SaveBuilder::SetAiGroups(std::vector<std::uint8_t> payload) {
+    aiGroups_ = std::move(payload);
+}
+
+void SaveBuilder::SetAiFollow(std::vector<std::uint8_t> payload) {
+    aiFollow_ = std::move(payload);
+}
+
+bool SaveBuilder::AddActor(const ActorSpec& actor, std::string* error) {
+    if (!CheckName(actor.name, kHeaderNameSize, "actor name", error) ||
+        !CheckName(actor.model, kHeaderNameSize, "actor model", error)) {
+        return false;
+    }
+    std::vector<std::uint8_t> header(mafia_save::kActorHeaderSize, 0u);
+    std::copy(actor.name.begin(), actor.name.end(), header.begin());
+    std::copy(actor.model.begin(), actor.model.end(), header.begin() + kHeaderModelOff);
+    mafia_save::WriteU32LE(&header, kHeaderTypeOff, actor.type);
+    mafia_save::WriteU32LE(&header, kHeaderIdxOff, actor.idx);
+    return AddRawActor(header, actor.payload, error);
+}
+
+bool SaveBuilder::AddRawActor(const std::vector<std::uint8_t>& header,
+                              std::vector<std::uint8_t> payload,
+                              std::string* error) {
+    if (!CheckSize(header, mafia_save::kActorHeaderSize, "actor header", error) ||
+        !CheckU32(payload.size(), "actor payload", error)) {
+        return false;
+    }
+    actors_.push_back(Actor{header, std::move(payload)});
+    return true;
+}
+
+void SaveBuilder::ReserveActors(std::size_t count) {
+    actors_.reserve(count);
+}
+
+void SaveBuilder::ClearActors() {
+    actors_.clear();
+}
+
+std::size_t SaveBuilder::RawSize() const {
+    std::size_t total = mafia_save::kFileHeaderSize + head_.size() + meta_.size() + info_.size() + game_.size() +
+                        aiGroups_.size() + aiFollow_.size();
+    for (const auto& a : actors_) {
+        total += a.header.size() + a.payload.size();
+    }
+    return total;
+}
+
+std::vector<std::uint8_t> SaveBuilder::InfoWithSizes() const {
+    std::vector<std::uint8_t> info = info_;
+    mafia_save::WriteU32LE(&info, kInfoMainSizeOff, static_cast<std::uint32_t>(game_.size()));
+    mafia_save::WriteU32LE(&info, kInfoAiGroupsSizeOff, static_cast<std::uint32_t>(aiGroups_.size()));
+    mafia_save::WriteU32LE(&info, kInfoAiFollowSizeOff, static_cast<std::uint32_t>(aiFollow_.size()));
+    return info;
+}
+
+bool SaveBuilder::Build(std::vector<std::uint8_t>* out, std::string* error) const {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output byte vector";
+        }
+        return false;
+    }
+    if (!CheckU32(game_.size(), "game payload", error) || !CheckU32(aiGroups_.size(), "ai_groups payload", error) ||
+        !CheckU32(aiFollow_.size(), "ai_follow payload", error)) {
+        return false;
+    }
+
+    std::vector<std::uint8_t> raw(RawSize());
+    std::copy(fileHeader_.begin(), fileHeader_.end(), raw.begin());
+    std::size_t cursor = mafia_save::kFileHeaderSize;
+    mafia_save::CipherCheckpoint state;
+    Place(head_, &raw, &cursor, &state);
+    Place(meta_, &raw, &cursor, &state);
+    Place(InfoWithSizes(), &raw, &cursor, &state);
+    Place(game_, &raw, &cursor, &state);
+    Place(aiGroups_, &raw, &cursor, &state);
+    Place(aiFollow_, &raw, &cursor, &state);
+    for (const auto& a : actors_) {
+        // The header is patched after the copy so the template stays untouched.
+        const std::size_t at = cursor;
+        std::copy(a.header.begin(), a.header.end(), raw.begin() + static_cast<std::ptrdiff_t>(at));
+        const auto size = static_cast<std::uint32_t>(a.payload.size());
+        for (std::size_t b = 0; b < 4; ++b) {
+            raw[at + kHeaderPayloadSizeOff + b] = static_cast<std::uint8_t>(size >> (8 * b));
+        }
+        mafia_save::EncryptRange(raw.data() + at, a.header.size(), &state);
+        cursor += a.header.size();
+        Place(a.payload, &raw, &cursor, &state);
+    }
+
+    *out = std::move(raw);
+    return true;
+}
+
+bool SaveBuilder::BuildSave(mafia_save::SaveData* out, std::string* error) const {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output save struct";
+        }
+        return false;
+    }
+    if (!CheckU32(game_.size(), "game payload", error) || !CheckU32(aiGroups_.size(), "ai_groups payload", error) ||
+        !CheckU32(aiFollow_.size(), "ai_follow payload", error)) {
+        return false;
+    }
+
+    mafia_save::SaveData save;
+    save.fileHeader = fileHeader_;
+    save.segments.reserve(6 + actors_.size() * 2);
+    auto add = [&](const char* name, std::vector<std::uint8_t> plain) {
+        save.segments.push_back(mafia_save::Segment{name, std::move(plain)});
+        return save.segments.size() - 1;
+    };
+    save.idxHead = add("head24", head_);
+    save.idxMeta = add("meta32", meta_);
+    save.idxInfo = add("info264", InfoWithSizes());
+    save.idxGamePayload = add("game_payload", game_);
+    if (!aiGroups_.empty()) {
+        save.idxAiGroups = add("ai_groups_payload", aiGroups_);
+    }
+    if (!aiFollow_.empty()) {
+        save.idxAiFollow = add("ai_follow_payload", aiFollow_);
+    }
+    for (std::size_t i = 0; i < actors_.size(); ++i) {
+        std::vector<std::uint8_t> header = actors_[i].header;
+        mafia_save::WriteU32LE(&header, kHeaderPayloadSizeOff, static_cast<std::uint32_t>(actors_[i].payload.size()));
+        save.segments.push_back(mafia_save::Segment{"actor_header_" + std::to_string(i), std::move(header)});
+        save.segments.push_back(mafia_save::Segment{"actor_payload_" + std::to_string(i), actors_[i].payload});
+    }
+    save.actorCount = actors_.size();
+    save.rawSize = RawSize();
+    *out = std::move(save);
+    return true;
+}
+
+}  // namespace save_builder
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace save_builder {
+
+struct ActorSpec {
+    std::string name;   // up to 63 bytes
+    std::string model;  // up to 63 bytes
+    std::uint32_t type = 0;
+    std::uint32_t idx = 0xFFFFFFFFu;
+    std::vector<std::uint8_t> payload;
+};
+
+// Assembles a save from blocks and actors. The size fields the loader reads (info264 +32, +240,
+// +244, actor header +132) are always computed from the parts, never taken from the templates, so
+// every build parses. An empty AI payload leaves its segment out, as in saves the game writes.
+class SaveBuilder {
+public:
+    // "GvaS" file header, head24 and meta32 for mission 0, zeroed info264, empty payloads.
+    SaveBuilder();
+    // Every block and actor of `save` as the template.
+    static SaveBuilder FromSave(const mafia_save::SaveData& save);
+
+    void SetFileHeader(const std::array<std::uint8_t, mafia_save::kFileHeaderSize>& header);
+    // head24 = "SavG", 0x10, mission, 0, 0, 5000 + mission; meta32 slot = mission.
+    void SetMission(std::uint32_t mission);
+    bool SetHead(const std::vector<std::uint8_t>& head24, std::string* error = nullptr);
+    bool SetMeta(const std::vector<std::uint8_t>& meta32, std::string* error = nullptr);
+    bool SetInfo(const std::vector<std::uint8_t>& info264, std::string* error = nullptr);
+    bool SetMissionName(const std::string& name, std::string* error = nullptr);
+    void SetGamePayload(std::vector<std::uint8_t> payload);
+    void SetAiGroups(std::vector<std::uint8_t> payload);
+    void SetAiFollow(std::vector<std::uint8_t> payload);
+
+    bool AddActor(const ActorSpec& actor, std::string* error = nullptr);
+    // A 140-byte header taken as is apart from its payload size field.
+    bool AddRawActor(const std::vector<std::uint8_t>& header, std::vector<std::uint8_t> payload, std::string* error = nullptr);
+    void ReserveActors(std::size_t count);
+    void ClearActors();
+    std::size_t ActorCount() const { return actors_.size(); }
+
+    std::size_t RawSize() const;
+    // Sizes the output once and encrypts every block in place right after copying it.
+    bool Build(std::vector<std::uint8_t>* out, std::string* error = nullptr) const;
+    bool BuildSave(mafia_save::SaveData* out, std::string* error = nullptr) const;
+
+private:
+    struct Actor {
+        std::vector<std::uint8_t> header;
+        std::vector<std::uint8_t> payload;
+    };
+    std::vector<std::uint8_t> InfoWithSizes() const;
+
+    std::array<std::uint8_t, mafia_save::kFileHeaderSize> fileHeader_{};
+    std::vector<std::uint8_t> head_;
+    std::vector<std::uint8_t> meta_;
+    std::vector<std::uint8_t> info_;
+    std::vector<std::uint8_t> game_;
+    std::vector<std::uint8_t> aiGroups_;
+    std::vector<std::uint8_t> aiFollow_;
+    std::vector<Actor> actors_;
+};
+
+}  // namespace save_builder
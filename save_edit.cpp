@@ -0,0 +1,618 @@
+#include "save_edit.hpp"
+
+#include "save_index.hpp"
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace save_edit {
+
+namespace {
+
+constexpr std::uint32_t kActorTypeCar = 4;
+
+std::string Trim(const std::string& s) {
+    std::size_t b = 0;
+    std::size_t e = s.size();
+    while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) {
+        ++b;
+    }
+    while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) {
+        --e;
+    }
+    return s.substr(b, e - b);
+}
+
+bool ParseUInt(const std::string& text, std::uint64_t* out) {
+    const std::string s = Trim(text);
+    if (s.empty() || s[0] == '-') {
+        return false;
+    }
+    const bool hex = s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+    char* end = nullptr;
+    const unsigned long long v = std::strtoull(s.c_str(), &end, hex ? 16 : 10);
+    if (end == nullptr || *end != '\0') {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// ---- properties --------------------------------------------------------------------------------------------
+
+enum class PropType : std::uint8_t { kU32, kF32, kStr64 };
+
+// Where an actor property lives once its layout is known.
+struct FieldRef {
+    std::size_t seg = mafia_save::kNoIndex;
+    std::size_t offset = 0;
+    PropType type = PropType::kU32;
+};
+
+struct HeaderProp {
+    const char* name;
+    std::size_t offset;
+    PropType type;
+};
+
+constexpr HeaderProp kHeaderProps[] = {
+    {"name", 0, PropType::kStr64},
+    {"model", 64, PropType::kStr64},
+    {"type", 128, PropType::kU32},
+    {"idx", 136, PropType::kU32},
+};
+
+constexpr const char* kPayloadProps[] = {"x", "y", "z", "hp", "hpmax", "fuel", "odometer"};
+
+// inv.mode -> 0; inv.sel.* -> 1..4; inv.slotN.* -> 9 + 4 (N - 1) ..; inv.coat.* -> 29..32 (dword indices).
+bool InventoryDword(const std::string& prop, std::size_t* dword) {
+    if (prop == "inv.mode") {
+        *dword = 0;
+        return true;
+    }
+    const std::size_t dot = prop.rfind('.');
+    if (prop.rfind("inv.", 0) != 0 || dot <= 4) {
+        return false;
+    }
+    const std::string group = prop.substr(4, dot - 4);
+    const std::string field = prop.substr(dot + 1);
+    static const char* const kFields[] = {"id", "loaded", "hidden", "unk"};
+    std::size_t k = 4;
+    for (std::size_t i = 0; i < 4; ++i) {
+        if (field == kFields[i]) {
+            k = i;
+        }
+    }
+    if (k == 4) {
+        return false;
+    }
+    std::uint64_t slot = 0;
+    if (group == "sel") {
+        *dword = 1 + k;
+    } else if (group == "coat") {
+        *dword = 29 + k;
+    } else if (group.rfind("slot", 0) == 0 && ParseUInt(group.substr(4), &slot) && slot >= 1 && slot <= 5) {
+        *dword = 9 + 4 * static_cast<std::size_t>(slot - 1) + k;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool PropTypeOf(const std::string& prop, PropType* type) {
+    for (const auto& h : kHeaderProps) {
+        if (prop == h.name) {
+            *type = h.type;
+            return true;
+        }
+    }
+    for (const char* p : kPayloadProps) {
+        if (prop == p) {
+            *type = PropType::kF32;
+            return true;
+        }
+    }
+    std::size_t dword = 0;
+    if (InventoryDword(prop, &dword)) {
+        *type = PropType::kU32;
+        return true;
+    }
+    return false;
+}
+
+// False when the payload layout of this actor has no such field.
+bool ResolveProp(const mafia_save::SaveData& save, std::size_t headerSeg, const std::string& prop, FieldRef* out) {
+    for (const auto& h : kHeaderProps) {
+        if (prop == h.name) {
+            *out = FieldRef{headerSeg, h.offset, h.type};
+            return true;
+        }
+    }
+    const std::size_t payloadSeg = headerSeg + 1;
+    const auto& p = save.segments[payloadSeg].plain;
+    const save_layout::CoordLayout l = save_layout::DetectCoordLayout(p);
+    std::size_t off = 0;
+    PropType type = PropType::kF32;
+    bool supported = false;
+    std::size_t dword = 0;
+    if (prop == "x" || prop == "y" || prop == "z") {
+        supported = l.coordsSupported;
+        off = prop == "x" ? l.xOff : prop == "y" ? l.yOff : l.zOff;
+    } else if (prop == "hp" || prop == "hpmax") {
+        supported = l.humanHealthSupported;
+        off = prop == "hp" ? l.humanHpCurrentOff : l.humanHpMaxOff;
+    } else if (prop == "fuel") {
+        supported = l.carStateSupported;
+        off = l.carFuelOff;
+    } else if (prop == "odometer") {
+        supported = l.carOdometerSupported;
+        off = l.carOdometerOff;
+    } else if (InventoryDword(prop, &dword)) {
+        supported = l.humanInventorySupported;
+        off = l.humanInventoryOff + dword * 4;
+        type = PropType::kU32;
+    }
+    if (!supported || off + 4 > p.size()) {
+        return false;
+    }
+    *out = FieldRef{payloadSeg, off, type};
+    return true;
+}
+
+double ReadNumber(const std::vector<std::uint8_t>& p, const FieldRef& f) {
+    const std::uint32_t bits = mafia_save::ReadU32LE(p, f.offset);
+    if (f.type == PropType::kU32) {
+        return static_cast<double>(bits);
+    }
+    float v = 0.0f;
+    std::memcpy(&v, &bits, sizeof(v));
+    return static_cast<double>(v);
+}
+
+// Writes `v` (clamped for u32) and reports whether any byte changed.
+bool WriteNumber(std::vector<std::uint8_t>* p, const FieldRef& f, double v) {
+    std::uint32_t bits = 0;
+    if (f.type == PropType::kU32) {
+        const double r = std::round(std::min(std::max(v, 0.0), 4294967295.0));
+        bits = static_cast<std::uint32_t>(r);
+    } else {
+        const float fv = static_cast<float>(v);
+        std::memcpy(&bits, &fv, sizeof(bits));
+    }
+    if (mafia_save::ReadU32LE(*p, f.offset) == bits) {
+        return false;
+    }
+    mafia_save::WriteU32LE(p, f.offset, bits);
+    return true;
+}
+
+bool WriteString(std::vector<std::uint8_t>* p, std::size_t offset, const std::string& s) {
+    std::uint8_t field[64] = {};
+    std::memcpy(field, s.data(), std::min<std::size_t>(s.size(), 63));
+    if (std::memcmp(p->data() + offset, field, sizeof(field)) == 0) {
+        return false;
+    }
+    std::memcpy(p->data() + offset, field, sizeof(field));
+    return true;
+}
+
+double Combine(Op op, double current, double value) {
+    return op == Op::kAdd ? current + value : op == Op::kSub ? current - value : value;
+}
+
+// ---- parsing -----------------------------------------------------------------------------------------------
+
+bool ParseSelector(const std::string& body, Selector* out, std::string* why) {
+    if (Trim(body) == "*") {
+        out->any = true;
+        return true;
+    }
+    std::stringstream ss(body);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const std::size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            *why = "selector terms are key=value";
+            return false;
+        }
+        const std::string key = Trim(item.substr(0, eq));
+        std::string value = Trim(item.substr(eq + 1));
+        if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value = value.substr(1, value.size() - 2);
+        }
+        std::uint64_t n = 0;
+        if (key == "name") {
+            out->name = value;
+        } else if (key == "model") {
+            out->model = mafia_save::Lower(value);
+        } else if (key == "type" && ParseUInt(value, &n) && n <= 0xFFFFFFFFu) {
+            out->type = static_cast<std::uint32_t>(n);
+        } else {
+            *why = "bad selector term '" + Trim(item) + "' (name=, type=, model=)";
+            return false;
+        }
+    }
+    if (out->name.empty() && out->model.empty() && !out->type.has_value()) {
+        *why = "empty selector (use actor[*] for every actor)";
+        return false;
+    }
+    return true;
+}
+
+bool ParseTarget(const std::string& lhs, Statement* st, std::string* why) {
+    if (lhs.rfind("meta.", 0) == 0) {
+        static const std::pair<const char*, std::size_t> kMeta[] = {
+            {"slot", 0}, {"time", 8}, {"date", 12}, {"hp_percent", 16}, {"mission_code", 28},
+        };
+        for (const auto& [name, off] : kMeta) {
+            if (lhs.compare(5, std::string::npos, name) == 0) {
+                st->scope = Scope::kMeta;
+                st->offset = off;
+                return true;
+            }
+        }
+        *why = "unknown meta field '" + lhs + "'";
+        return false;
+    }
+    if (lhs.rfind("garage(", 0) == 0 || lhs.rfind("garage2(", 0) == 0) {
+        const bool primary = lhs[6] == '(';
+        const std::size_t open = lhs.find('(');
+        std::uint64_t slot = 0;
+        if (lhs.back() != ')' || !ParseUInt(lhs.substr(open + 1, lhs.size() - open - 2), &slot) ||
+            slot >= save_layout::kGarageSlotCount) {
+            *why = "garage slot must be 0..24";
+            return false;
+        }
+        st->scope = Scope::kInfo;
+        st->offset = (primary ? save_layout::kGaragePrimaryOff : save_layout::kGarageSecondaryOff) +
+                     static_cast<std::size_t>(slot) * 4u;
+        return true;
+    }
+
+    st->scope = Scope::kActor;
+    std::size_t propStart = 0;
+    if (lhs.rfind("tommy.", 0) == 0) {
+        st->selector.name = "Tommy";
+        propStart = 6;
+    } else if (lhs.rfind("cars.", 0) == 0) {
+        st->selector.type = kActorTypeCar;
+        propStart = 5;
+    } else if (lhs.rfind("actor[", 0) == 0) {
+        const std::size_t close = lhs.find(']');
+        if (close == std::string::npos || close + 1 >= lhs.size() || lhs[close + 1] != '.') {
+            *why = "expected actor[...].<prop>";
+            return false;
+        }
+        if (!ParseSelector(lhs.substr(6, close - 6), &st->selector, why)) {
+            return false;
+        }
+        propStart = close + 2;
+    } else {
+        *why = "unknown target '" + lhs + "'";
+        return false;
+    }
+    st->prop = lhs.substr(propStart);
+    PropType type = PropType::kU32;
+    if (!PropTypeOf(st->prop, &type)) {
+        *why = "unknown actor property '" + st->prop + "'";
+        return false;
+    }
+    return true;
+}
+
+bool ParseStatement(const std::string& line, Statement* st, std::string* why) {
+    // The first '=' outside brackets and quotes; a preceding '+' or '-' makes it += / -=.
+    std::size_t eq = std::string::npos;
+    int depth = 0;
+    bool quoted = false;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        const char ch = line[i];
+        if (ch == '"') {
+            quoted = !quoted;
+        } else if (!quoted && (ch == '[' || ch == '(')) {
+            ++depth;
+        } else if (!quoted && (ch == ']' || ch == ')')) {
+            --depth;
+        } else if (!quoted && depth == 0 && ch == '=') {
+            eq = i;
+            break;
+        }
+    }
+    if (eq == std::string::npos || eq == 0) {
+        *why = "expected '<target> = <value>'";
+        return false;
+    }
+    std::size_t lhsEnd = eq;
+    if (line[eq - 1] == '+' || line[eq - 1] == '-') {
+        st->op = line[eq - 1] == '+' ? Op::kAdd : Op::kSub;
+        --lhsEnd;
+    }
+    if (!ParseTarget(Trim(line.substr(0, lhsEnd)), st, why)) {
+        return false;
+    }
+
+    const std::string rhs = Trim(line.substr(eq + 1));
+    PropType type = PropType::kU32;
+    if (st->scope == Scope::kActor) {
+        PropTypeOf(st->prop, &type);
+    }
+    if (type == PropType::kStr64) {
+        if (st->op != Op::kAssign || rhs.size() < 2 || rhs.front() != '"' || rhs.back() != '"' || rhs.size() - 2 > 63) {
+            *why = "'" + st->prop + "' takes = \"<up to 63 chars>\"";
+            return false;
+        }
+        st->str = rhs.substr(1, rhs.size() - 2);
+        st->isString = true;
+        return true;
+    }
+    if (!rhs.empty() && rhs[0] == '@') {
+        PropType refType = PropType::kU32;
+        if (st->scope != Scope::kActor || !PropTypeOf(rhs.substr(1), &refType) || refType == PropType::kStr64) {
+            *why = "@<prop> must name a numeric property of the same actor";
+            return false;
+        }
+        st->refProp = rhs.substr(1);
+        return true;
+    }
+    std::uint64_t n = 0;
+    if (rhs.size() > 2 && rhs[0] == '0' && (rhs[1] == 'x' || rhs[1] == 'X')) {
+        if (!ParseUInt(rhs, &n)) {
+            *why = "bad hex value '" + rhs + "'";
+            return false;
+        }
+        st->number = static_cast<double>(n);
+        return true;
+    }
+    char* end = nullptr;
+    st->number = std::strtod(rhs.c_str(), &end);
+    if (rhs.empty() || end == nullptr || *end != '\0') {
+        *why = "bad value '" + rhs + "'";
+        return false;
+    }
+    return true;
+}
+
+// ---- applying ----------------------------------------------------------------------------------------------
+
+bool Matches(const Selector& sel, const std::vector<std::uint8_t>& header) {
+    if (sel.any) {
+        return true;
+    }
+    if (sel.type.has_value() && mafia_save::ReadU32LE(header, 128) != *sel.type) {
+        return false;
+    }
+    if (!sel.name.empty() && mafia_save::ReadCStr(header, 0, 64) != sel.name) {
+        return false;
+    }
+    return sel.model.empty() || mafia_save::Lower(mafia_save::ReadCStr(header, 64, 64)) == sel.model;
+}
+
+void ApplyStatement(const Statement& st, mafia_save::SaveData* save, StatementResult* r) {
+    if (st.scope != Scope::kActor) {
+        const std::size_t seg = st.scope == Scope::kMeta ? save->idxMeta : save->idxInfo;
+        if (seg == mafia_save::kNoIndex || st.offset + 4 > save->segments[seg].plain.size()) {
+            return;
+        }
+        const FieldRef f{seg, st.offset, PropType::kU32};
+        auto& p = save->segments[seg].plain;
+        ++r->matched;
+        r->changed += WriteNumber(&p, f, Combine(st.op, ReadNumber(p, f), st.number)) ? 1u : 0u;
+        return;
+    }
+    for (std::size_t i = 0; i + 1 < save->segments.size(); ++i) {
+        const auto& h = save->segments[i];
+        if (h.name.rfind("actor_header_", 0) != 0 || h.plain.size() < mafia_save::kActorHeaderSize ||
+            !Matches(st.selector, h.plain)) {
+            continue;
+        }
+        ++r->matched;
+        FieldRef f;
+        if (!ResolveProp(*save, i, st.prop, &f)) {
+            ++r->skipped;
+            continue;
+        }
+        auto& p = save->segments[f.seg].plain;
+        if (st.isString) {
+            r->changed += WriteString(&p, f.offset, st.str) ? 1u : 0u;
+            continue;
+        }
+        double value = st.number;
+        if (!st.refProp.empty()) {
+            FieldRef ref;
+            if (!ResolveProp(*save, i, st.refProp, &ref)) {
+                ++r->skipped;
+                continue;
+            }
+            value = ReadNumber(save->segments[ref.seg].plain, ref);
+        }
+        r->changed += WriteNumber(&p, f, Combine(st.op, ReadNumber(p, f), value)) ? 1u : 0u;
+    }
+}
+
+struct InputFile {
+    fs::path path;
+    fs::path rel;  // name under ApplyOptions::outDir
+};
+
+void CollectInputs(const fs::path& input, std::vector<InputFile>* out) {
+    std::error_code ec;
+    if (!fs::is_directory(input, ec)) {
+        out->push_back(InputFile{input, input.filename()});
+        return;
+    }
+    std::vector<fs::path> found;
+    save_index::CollectSaveFiles(input, &found);
+    for (const auto& f : found) {
+        out->push_back(InputFile{f, f.lexically_relative(input)});
+    }
+}
+
+void ApplyToFile(const Script& script, const InputFile& in, const ApplyOptions& options, FileResult* r) {
+    r->path = in.path;
+    r->statements.assign(script.statements.size(), StatementResult{});
+    const auto raw = mafia_save::ReadFileBytes(in.path);
+    mafia_save::SaveData save;
+    std::string err;
+    if (raw.empty() || !mafia_save::ParseSave(raw, &save, &err)) {
+        r->status = FileResult::Status::kFailed;
+        r->error = raw.empty() ? "cannot read file" : err;
+        return;
+    }
+    std::vector<std::vector<std::uint8_t>> before;
+    before.reserve(save.segments.size());
+    for (const auto& seg : save.segments) {
+        before.push_back(seg.plain);
+    }
+    ApplyToSave(script, &save, &r->statements);
+    for (std::size_t i = 0; i < save.segments.size(); ++i) {
+        const auto& a = before[i];
+        const auto& b = save.segments[i].plain;
+        for (std::size_t k = 0; k < a.size(); ++k) {
+            r->bytesChanged += a[k] != b[k] ? 1u : 0u;
+        }
+    }
+    if (r->bytesChanged == 0) {
+        r->status = FileResult::Status::kUnchanged;
+        return;
+    }
+    r->status = FileResult::Status::kChanged;
+    if (!options.write) {
+        return;
+    }
+    std::vector<std::uint8_t> out;
+    if (!mafia_save::BuildRaw(save, &out, &err)) {
+        r->status = FileResult::Status::kFailed;
+        r->error = err;
+        return;
+    }
+    const fs::path target = options.outDir.empty() ? in.path : options.outDir / in.rel;
+    if (!mafia_save::WriteFileBytesAtomic(target, out, &r->error)) {
+        r->status = FileResult::Status::kFailed;
+        return;
+    }
+    r->written = target;
+}
+
+}  // namespace
+
+bool ParseScript(const std::string& text, Script* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output script";
+        }
+        return false;
+    }
+    Script script;
+    std::istringstream in(text);
+    std::string raw;
+    std::size_t lineNo = 0;
+    while (std::getline(in, raw)) {
+        ++lineNo;
+        const std::string line = Trim(raw);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        Statement st;
+        st.line = lineNo;
+        st.text = line;
+        std::string why;
+        if (!ParseStatement(line, &st, &why)) {
+            if (error != nullptr) {
+                *error = "line " + std::to_string(lineNo) + ": " + why;
+            }
+            return false;
+        }
+        script.statements.push_back(std::move(st));
+    }
+    if (script.statements.empty()) {
+        if (error != nullptr) {
+            *error = "script has no statements";
+        }
+        return false;
+    }
+    *out = std::move(script);
+    return true;
+}
+
+bool LoadScript(const fs::path& file, Script* out, std::string* error) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        if (error != nullptr) {
+            *error = "cannot open " + file.string();
+        }
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return ParseScript(text.str(), out, error);
+}
+
+void ApplyToSave(const Script& script, mafia_save::SaveData* save, std::vector<StatementResult>* results) {
+    if (save == nullptr) {
+        return;
+    }
+    std::vector<StatementResult> local(script.statements.size());
+    for (std::size_t i = 0; i < script.statements.size(); ++i) {
+        ApplyStatement(script.statements[i], save, &local[i]);
+    }
+    if (results != nullptr) {
+        *results = std::move(local);
+    }
+}
+
+bool Apply(const Script& script,
+           const std::vector<fs::path>& inputs,
+           const ApplyOptions& options,
+           std::vector<FileResult>* out,
+           std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output result list";
+        }
+        return false;
+    }
+    std::vector<InputFile> files;
+    for (const auto& input : inputs) {
+        CollectInputs(input, &files);
+    }
+    if (!options.outDir.empty()) {
+        std::vector<fs::path> names;
+        for (const auto& f : files) {
+            names.push_back(f.rel.lexically_normal());
+        }
+        std::sort(names.begin(), names.end());
+        if (std::adjacent_find(names.begin(), names.end()) != names.end()) {
+            if (error != nullptr) {
+                *error = "two inputs map to the same output name";
+            }
+            return false;
+        }
+    }
+    std::vector<FileResult> results(files.size());
+    work_pool::ParallelFor(files.size(), options.threads, [&](unsigned, std::size_t i) {
+        ApplyToFile(script, files[i], options, &results[i]);
+    });
+    *out = std::move(results);
+    return true;
+}
+
+const char* StatusName(FileResult::Status status) {
+    switch (status) {
+        case FileResult::Status::kUnchanged:
+            return "unchanged";
+        case FileResult::Status::kChanged:
+            return "changed";
+        case FileResult::Status::kFailed:
+            return "failed";
+    }
+    return "unknown";
+}
+
+}  // namespace save_edit
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace save_edit {
+
+namespace fs = std::filesystem;
+
+// Edit scripts: one assignment per line, '#' starts a comment line.
+//
+//   cars.fuel = 60                         every type 4 actor
+//   tommy.hp = @hpmax                      @<prop> reads the same actor before the edit
+//   actor[model=thunderbird00.i3d].odometer -= 100
+//   actor[type=2,name=Tommy].inv.slot1.loaded = 50
+//   meta.hp_percent = 100
+//   garage(3) = 0x2A
+//
+// Selectors: actor[name=..,type=..,model=..] (all given keys must match, model case-insensitive),
+// actor[*], tommy (name=Tommy), cars (type=4).
+// Actor properties:
+//   name, model (str64), type, idx (u32)                                 actor header
+//   x, y, z, hp, hpmax, fuel, odometer (f32)                             DetectCoordLayout offsets
+//   inv.mode, inv.sel|coat|slot1..slot5 .id|loaded|hidden|unk (u32)      FindHumanInventoryOffset
+// Save fields: meta.slot|time|date|hp_percent|mission_code, garage(n), garage2(n) (u32).
+// Operators: = += -= (u32 results clamp at 0 and 0xFFFFFFFF; strings only take =).
+enum class Op : std::uint8_t { kAssign, kAdd, kSub };
+
+enum class Scope : std::uint8_t { kMeta, kInfo, kActor };
+
+struct Selector {
+    bool any = false;
+    std::string name;
+    std::string model;  // lower-cased
+    std::optional<std::uint32_t> type;
+};
+
+struct Statement {
+    std::size_t line = 0;
+    std::string text;
+    Scope scope = Scope::kMeta;
+    std::size_t offset = 0;  // kMeta / kInfo: offset in meta32 / info264
+    Selector selector;
+    std::string prop;
+    Op op = Op::kAssign;
+    double number = 0.0;
+    std::string str;      // string literal
+    std::string refProp;  // @<prop>
+    bool isString = false;
+};
+
+struct Script {
+    std::vector<Statement> statements;
+};
+
+bool ParseScript(const std::string& text, Script* out, std::string* error = nullptr);
+bool LoadScript(const fs::path& file, Script* out, std::string* error = nullptr);
+
+struct StatementResult {
+    std::size_t matched = 0;  // fields the statement selected
+    std::size_t changed = 0;  // fields whose bytes changed
+    std::size_t skipped = 0;  // selected actors whose payload layout lacks the property
+};
+
+// Applies the script in order to a parsed save; statements see the edits of earlier ones.
+void ApplyToSave(const Script& script, mafia_save::SaveData* save, std::vector<StatementResult>* results);
+
+struct ApplyOptions {
+    unsigned threads = 0;  // 0 = hardware concurrency
+    bool write = false;    // false: dry run
+    fs::path outDir;       // empty: rewrite inputs in place (via .tmp + rename)
+};
+
+struct FileResult {
+    enum class Status : std::uint8_t { kUnchanged, kChanged, kFailed };
+    fs::path path;
+    fs::path written;  // empty in dry runs and for unchanged or failed files
+    Status status = Status::kUnchanged;
+    std::string error;
+    std::size_t bytesChanged = 0;  // plaintext bytes
+    std::vector<StatementResult> statements;
+};
+
+// Inputs are save files or directories (recursive, GvaS files only, .mafia_* entries skipped).
+// Results follow the sorted input file order.
+bool Apply(const Script& script,
+           const std::vector<fs::path>& inputs,
+           const ApplyOptions& options,
+           std::vector<FileResult>* out,
+           std::string* error = nullptr);
+
+const char* StatusName(FileResult::Status status);
+
+}  // namespace save_edit
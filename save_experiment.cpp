@@ -0,0 +1,832 @@
+#include "save_experiment.hpp"
+
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace save_experiment {
+
+namespace {
+
+constexpr std::size_t kMaxVariants = 1u << 20;
+
+std::string Trim(const std::string& s) {
+    std::size_t b = 0;
+    std::size_t e = s.size();
+    while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) {
+        ++b;
+    }
+    while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) {
+        --e;
+    }
+    return s.substr(b, e - b);
+}
+
+std::string Hex(std::uint64_t v, std::size_t digits = 0) {
+    std::ostringstream oss;
+    oss << "0x" << std::setw(static_cast<int>(digits)) << std::setfill('0') << std::hex << v;
+    return oss.str();
+}
+
+bool ParseUInt(const std::string& text, std::uint64_t* out) {
+    const std::string s = Trim(text);
+    if (s.empty() || s[0] == '-') {
+        return false;
+    }
+    const bool hex = s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+    char* end = nullptr;
+    const unsigned long long v = std::strtoull(s.c_str(), &end, hex ? 16 : 10);
+    if (end == nullptr || *end != '\0') {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// "a", "a..b" or "a..b/step", inclusive.
+bool ParseUIntRange(const std::string& text, std::vector<std::uint64_t>* out, bool* hex) {
+    const std::string s = Trim(text);
+    *hex = s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+    const std::size_t dots = s.find("..");
+    if (dots == std::string::npos) {
+        std::uint64_t v = 0;
+        if (!ParseUInt(s, &v)) {
+            return false;
+        }
+        out->push_back(v);
+        return true;
+    }
+    std::string hi = s.substr(dots + 2);
+    std::uint64_t step = 1;
+    const std::size_t slash = hi.find('/');
+    if (slash != std::string::npos) {
+        if (!ParseUInt(hi.substr(slash + 1), &step) || step == 0) {
+            return false;
+        }
+        hi = hi.substr(0, slash);
+    }
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+    if (!ParseUInt(s.substr(0, dots), &a) || !ParseUInt(hi, &b) || b < a || (b - a) / step >= kMaxVariants) {
+        return false;
+    }
+    for (std::uint64_t v = a;; v += step) {
+        out->push_back(v);
+        if (b - v < step) {
+            break;
+        }
+    }
+    return true;
+}
+
+// Splits on commas outside double quotes.
+std::vector<std::string> SplitList(const std::string& s) {
+    std::vector<std::string> items;
+    std::string cur;
+    bool quoted = false;
+    for (char ch : s) {
+        if (ch == '"') {
+            quoted = !quoted;
+        }
+        if (ch == ',' && !quoted) {
+            items.push_back(Trim(cur));
+            cur.clear();
+        } else {
+            cur += ch;
+        }
+    }
+    items.push_back(Trim(cur));
+    return items;
+}
+
+bool ParseType(const std::string& s, EditSpec* e) {
+    if (s == "u8" || s == "u32" || s == "f32") {
+        e->type = s == "u8" ? ValueType::kU8 : s == "u32" ? ValueType::kU32 : ValueType::kF32;
+        e->width = s == "u8" ? 1u : 4u;
+        return true;
+    }
+    std::uint64_t cap = 0;
+    if (s.rfind("str", 0) == 0 && ParseUInt(s.substr(3), &cap) && cap > 0 && cap <= 4096) {
+        e->type = ValueType::kStr;
+        e->width = static_cast<std::size_t>(cap);
+        return true;
+    }
+    return false;
+}
+
+// Named targets: actor(<name>).<prop>, meta.<field>, garage(n), garage2(n).
+struct NamedTarget {
+    enum class Kind : std::uint8_t { kMeta, kGarage, kGarage2, kActorHeader, kActorPayload };
+    Kind kind = Kind::kMeta;
+    std::string actor;
+    std::string prop;
+    std::size_t offset = 0;  // meta32 / info264 / actor header offset
+};
+
+bool ParseNamedTarget(const std::string& t, NamedTarget* out, ValueType* type, std::size_t* width) {
+    *type = ValueType::kU32;
+    *width = 4;
+    if (t.rfind("meta.", 0) == 0) {
+        static const std::pair<const char*, std::size_t> kMeta[] = {
+            {"slot", 0}, {"time", 8}, {"date", 12}, {"hp_percent", 16}, {"mission_code", 28},
+        };
+        for (const auto& [name, off] : kMeta) {
+            if (t.compare(5, std::string::npos, name) == 0) {
+                out->kind = NamedTarget::Kind::kMeta;
+                out->offset = off;
+                return true;
+            }
+        }
+        return false;
+    }
+    const std::size_t open = t.find('(');
+    const std::size_t close = t.rfind(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) {
+        return false;
+    }
+    const std::string fn = t.substr(0, open);
+    std::string arg = Trim(t.substr(open + 1, close - open - 1));
+    if (fn == "garage" || fn == "garage2") {
+        std::uint64_t slot = 0;
+        if (close + 1 != t.size() || !ParseUInt(arg, &slot) || slot >= save_layout::kGarageSlotCount) {
+            return false;
+        }
+        out->kind = fn == "garage" ? NamedTarget::Kind::kGarage : NamedTarget::Kind::kGarage2;
+        out->offset = (fn == "garage" ? save_layout::kGaragePrimaryOff : save_layout::kGarageSecondaryOff) +
+                      static_cast<std::size_t>(slot) * 4u;
+        return true;
+    }
+    if (fn != "actor" || close + 1 >= t.size() || t[close + 1] != '.') {
+        return false;
+    }
+    if (arg.size() >= 2 && arg.front() == '"' && arg.back() == '"') {
+        arg = arg.substr(1, arg.size() - 2);
+    }
+    out->actor = arg;
+    out->prop = t.substr(close + 2);
+    static const std::pair<const char*, std::size_t> kHeader[] = {
+        {"name", 0}, {"model", 64}, {"type", 128}, {"payload_size", 132}, {"idx", 136},
+    };
+    for (const auto& [name, off] : kHeader) {
+        if (out->prop == name) {
+            out->kind = NamedTarget::Kind::kActorHeader;
+            out->offset = off;
+            if (off < 128) {
+                *type = ValueType::kStr;
+                *width = 64;
+            }
+            return !arg.empty();
+        }
+    }
+    static const char* const kPayload[] = {"x", "y", "z", "hp", "hpmax", "fuel", "odometer"};
+    for (const char* name : kPayload) {
+        if (out->prop == name) {
+            out->kind = NamedTarget::Kind::kActorPayload;
+            *type = ValueType::kF32;
+            return !arg.empty();
+        }
+    }
+    return false;
+}
+
+bool ParseValues(const std::string& list, EditSpec* e, std::string* why) {
+    for (const std::string& item : SplitList(list)) {
+        if (item.empty()) {
+            *why = "empty value";
+            return false;
+        }
+        if (e->type == ValueType::kStr) {
+            if (item.size() < 2 || item.front() != '"' || item.back() != '"') {
+                *why = "string values are quoted";
+                return false;
+            }
+            const std::string s = item.substr(1, item.size() - 2);
+            if (s.size() + 1 > e->width) {
+                *why = "string '" + s + "' does not fit " + std::to_string(e->width) + " bytes";
+                return false;
+            }
+            EditValue v;
+            v.bytes.assign(e->width, 0u);
+            std::memcpy(v.bytes.data(), s.data(), s.size());
+            v.text = s;
+            e->values.push_back(std::move(v));
+            continue;
+        }
+        if (e->type == ValueType::kF32) {
+            char* end = nullptr;
+            const float f = std::strtof(item.c_str(), &end);
+            if (end == nullptr || *end != '\0') {
+                *why = "bad f32 value '" + item + "'";
+                return false;
+            }
+            std::uint32_t bits = 0;
+            std::memcpy(&bits, &f, sizeof(bits));
+            EditValue v;
+            v.bytes = {static_cast<std::uint8_t>(bits), static_cast<std::uint8_t>(bits >> 8),
+                       static_cast<std::uint8_t>(bits >> 16), static_cast<std::uint8_t>(bits >> 24)};
+            v.text = item;
+            e->values.push_back(std::move(v));
+            continue;
+        }
+        std::vector<std::uint64_t> nums;
+        bool hex = false;
+        if (!ParseUIntRange(item, &nums, &hex)) {
+            *why = "bad integer value or range '" + item + "'";
+            return false;
+        }
+        const std::uint64_t max = e->type == ValueType::kU8 ? 0xFFu : 0xFFFFFFFFu;
+        // Range values keep the digit count of the range start.
+        const std::size_t digits = hex && nums.size() > 1 ? Trim(item.substr(0, item.find(".."))).size() - 2 : 0;
+        for (const std::uint64_t n : nums) {
+            if (n > max) {
+                *why = "value " + std::to_string(n) + " does not fit the target";
+                return false;
+            }
+            EditValue v;
+            for (std::size_t i = 0; i < e->width; ++i) {
+                v.bytes.push_back(static_cast<std::uint8_t>(n >> (8 * i)));
+            }
+            v.text = nums.size() == 1 ? item : hex ? Hex(n, digits) : std::to_string(n);
+            e->values.push_back(std::move(v));
+        }
+    }
+    if (e->values.size() > kMaxVariants) {
+        *why = "too many values";
+        return false;
+    }
+    return true;
+}
+
+// "<target> = <values>" after the op word.
+bool ParseEditTarget(const std::string& text, EditSpec* e, std::string* why) {
+    const std::size_t plus = text.find('+');
+    if (plus == std::string::npos) {
+        e->target = text;
+        NamedTarget named;
+        if (!ParseNamedTarget(text, &named, &e->type, &e->width)) {
+            *why = "unknown target '" + text + "'";
+            return false;
+        }
+        return true;
+    }
+    e->target = Trim(text.substr(0, plus));
+    std::string rest = Trim(text.substr(plus + 1));
+    const std::size_t colon = rest.find(':');
+    if (colon != std::string::npos) {
+        if (!ParseType(Trim(rest.substr(colon + 1)), e)) {
+            *why = "unknown type '" + rest.substr(colon + 1) + "' (u8, u32, f32, strN)";
+            return false;
+        }
+        rest = Trim(rest.substr(0, colon));
+    }
+    bool hex = false;
+    if (e->target.empty() || !ParseUIntRange(rest, &e->offsets, &hex)) {
+        *why = "bad offset '" + rest + "'";
+        return false;
+    }
+    return true;
+}
+
+bool ParseEdit(const std::string& line, EditSpec* e, std::string* why) {
+    e->op = line.compare(0, 3, "xor") == 0 ? EditOp::kXor : EditOp::kSet;
+    const std::size_t eq = line.find('=');
+    if (eq == std::string::npos) {
+        *why = "expected '<op> <target> = <values>'";
+        return false;
+    }
+    if (!ParseEditTarget(Trim(line.substr(3, eq - 3)), e, why)) {
+        return false;
+    }
+    if (e->op == EditOp::kXor && (e->type == ValueType::kStr || e->type == ValueType::kF32)) {
+        *why = "xor needs an integer target";
+        return false;
+    }
+    return ParseValues(Trim(line.substr(eq + 1)), e, why);
+}
+
+// ---- resolving against the base save -----------------------------------------------------------------------
+
+class Resolver {
+public:
+    explicit Resolver(const mafia_save::SaveData& save) : save_(save) {
+        std::size_t abs = mafia_save::kFileHeaderSize;
+        for (const auto& seg : save.segments) {
+            starts_.push_back(abs);
+            abs += seg.plain.size();
+        }
+        end_ = abs;
+    }
+
+    // File offset of `e` at raw offset `offset` (ignored for named targets).
+    bool Resolve(const EditSpec& e, std::uint64_t offset, std::size_t* fileOffset, std::string* why) const {
+        if (!e.offsets.empty()) {
+            std::uint64_t base = 0;
+            std::size_t size = end_;
+            if (e.target != "file") {
+                const std::size_t idx = FindSegment(e.target);
+                if (idx == mafia_save::kNoIndex) {
+                    *why = "base save has no segment '" + e.target + "'";
+                    return false;
+                }
+                base = starts_[idx];
+                size = save_.segments[idx].plain.size();
+            }
+            if (offset + e.width > size) {
+                *why = e.target + "+" + Hex(offset) + " is out of range (size " + std::to_string(size) + ")";
+                return false;
+            }
+            *fileOffset = static_cast<std::size_t>(base + offset);
+            return true;
+        }
+
+        NamedTarget named;
+        ValueType type = ValueType::kU32;
+        std::size_t width = 0;
+        ParseNamedTarget(e.target, &named, &type, &width);
+        std::size_t seg = mafia_save::kNoIndex;
+        std::size_t off = named.offset;
+        switch (named.kind) {
+            case NamedTarget::Kind::kMeta:
+                seg = save_.idxMeta;
+                break;
+            case NamedTarget::Kind::kGarage:
+            case NamedTarget::Kind::kGarage2:
+                seg = save_.idxInfo;
+                break;
+            case NamedTarget::Kind::kActorHeader:
+            case NamedTarget::Kind::kActorPayload: {
+                seg = FindActorHeader(named.actor);
+                if (seg == mafia_save::kNoIndex) {
+                    *why = "base save has no actor '" + named.actor + "'";
+                    return false;
+                }
+                if (named.kind == NamedTarget::Kind::kActorHeader) {
+                    break;
+                }
+                ++seg;
+                const save_layout::CoordLayout l = save_layout::DetectCoordLayout(save_.segments[seg].plain);
+                const std::string& p = named.prop;
+                const bool supported = (p == "x" || p == "y" || p == "z") ? l.coordsSupported
+                                       : (p == "hp" || p == "hpmax")    ? l.humanHealthSupported
+                                       : p == "fuel"                    ? l.carStateSupported
+                                                                        : l.carOdometerSupported;
+                if (!supported) {
+                    *why = "actor '" + named.actor + "' payload layout has no " + p;
+                    return false;
+                }
+                off = p == "x" ? l.xOff : p == "y" ? l.yOff : p == "z" ? l.zOff : p == "hp" ? l.humanHpCurrentOff
+                      : p == "hpmax" ? l.humanHpMaxOff : p == "fuel" ? l.carFuelOff : l.carOdometerOff;
+                break;
+            }
+        }
+        if (seg == mafia_save::kNoIndex || off + width > save_.segments[seg].plain.size()) {
+            *why = "target '" + e.target + "' is not in the base save";
+            return false;
+        }
+        *fileOffset = starts_[seg] + off;
+        return true;
+    }
+
+private:
+    std::size_t FindSegment(const std::string& name) const {
+        for (std::size_t i = 0; i < save_.segments.size(); ++i) {
+            if (save_.segments[i].name == name) {
+                return i;
+            }
+        }
+        return mafia_save::kNoIndex;
+    }
+
+    std::size_t FindActorHeader(const std::string& name) const {
+        for (std::size_t i = 0; i + 1 < save_.segments.size(); ++i) {
+            const auto& h = save_.segments[i];
+            if (h.name.rfind("actor_header_", 0) == 0 && h.plain.size() >= mafia_save::kActorHeaderSize &&
+                mafia_save::ReadCStr(h.plain, 0, 64) == name) {
+                return i;
+            }
+        }
+        return mafia_save::kNoIndex;
+    }
+
+    const mafia_save::SaveData& save_;
+    std::vector<std::size_t> starts_;
+    std::size_t end_ = 0;
+};
+
+struct Choice {
+    std::size_t fileOffset = 0;
+    const EditValue* value = nullptr;
+};
+
+bool Render(const std::string& tmpl,
+            std::uint64_t n,
+            const std::string& baseName,
+            const std::vector<Choice>& choices,
+            const Resolver& resolver,
+            std::string* out,
+            std::string* why) {
+    std::string s;
+    std::size_t i = 0;
+    while (i < tmpl.size()) {
+        const std::size_t open = tmpl.find('{', i);
+        if (open == std::string::npos) {
+            s += tmpl.substr(i);
+            break;
+        }
+        const std::size_t close = tmpl.find('}', open);
+        if (close == std::string::npos) {
+            *why = "unclosed '{' in \"" + tmpl + "\"";
+            return false;
+        }
+        s += tmpl.substr(i, open - i);
+        const std::string key = tmpl.substr(open + 1, close - open - 1);
+        i = close + 1;
+        if (key == "n") {
+            s += std::to_string(n);
+            continue;
+        }
+        if (key == "base") {
+            s += baseName;
+            continue;
+        }
+        if (!key.empty() && key[0] == '@') {
+            EditSpec e;
+            std::string targetWhy;
+            std::size_t off = 0;
+            if (!ParseEditTarget(key.substr(1), &e, &targetWhy) ||
+                !resolver.Resolve(e, e.offsets.empty() ? 0 : e.offsets.front(), &off, &targetWhy)) {
+                *why = "{" + key + "}: " + targetWhy;
+                return false;
+            }
+            s += Hex(off);
+            continue;
+        }
+        const bool isOff = key.rfind("off", 0) == 0;
+        const bool isVal = key.rfind("val", 0) == 0;
+        std::uint64_t k = 1;
+        if ((!isOff && !isVal) || (key.size() > 3 && !ParseUInt(key.substr(3), &k)) || k == 0) {
+            *why = "unknown placeholder {" + key + "}";
+            return false;
+        }
+        if (k > choices.size()) {
+            *why = "{" + key + "} refers to a missing edit line";
+            return false;
+        }
+        s += isOff ? Hex(choices[k - 1].fileOffset) : choices[k - 1].value->text;
+    }
+    *out = std::move(s);
+    return true;
+}
+
+}  // namespace
+
+bool ParseSpec(const std::string& text, Spec* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output spec";
+        }
+        return false;
+    }
+    Spec spec;
+    std::istringstream in(text);
+    std::string raw;
+    std::size_t lineNo = 0;
+    std::string why;
+    bool ok = true;
+    while (ok && std::getline(in, raw)) {
+        ++lineNo;
+        const std::string line = Trim(raw);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line == "[variant]") {
+            spec.variants.emplace_back();
+            spec.variants.back().line = lineNo;
+            continue;
+        }
+        if (line.rfind("set ", 0) == 0 || line.rfind("xor ", 0) == 0) {
+            if (spec.variants.empty()) {
+                why = "edit outside a [variant] block";
+                ok = false;
+                break;
+            }
+            EditSpec e;
+            e.line = lineNo;
+            ok = ParseEdit(line, &e, &why);
+            spec.variants.back().edits.push_back(std::move(e));
+            continue;
+        }
+        const std::size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            why = "expected 'key = value', an edit or [variant]";
+            ok = false;
+            break;
+        }
+        const std::string key = Trim(line.substr(0, eq));
+        const std::string value = Trim(line.substr(eq + 1));
+        if (!spec.variants.empty()) {
+            VariantSpec& v = spec.variants.back();
+            if (key == "name") {
+                v.name = value;
+            } else if (key == "label") {
+                v.label = value;
+            } else if (key == "detail") {
+                v.details.push_back(value);
+            } else {
+                why = "unknown variant key '" + key + "'";
+                ok = false;
+            }
+        } else if (key == "base") {
+            spec.base = value;
+        } else if (key == "output") {
+            spec.output = value;
+        } else if (key == "name") {
+            spec.name = value;
+        } else if (key == "start") {
+            ok = ParseUInt(value, &spec.start);
+            why = "bad start number";
+        } else if (key == "notes") {
+            spec.notes = value;
+        } else if (key == "title") {
+            spec.title = value;
+        } else if (key == "intro") {
+            spec.intro.push_back(value);
+        } else if (key == "outro") {
+            spec.outro.push_back(value);
+        } else {
+            why = "unknown key '" + key + "'";
+            ok = false;
+        }
+    }
+    if (!ok) {
+        if (error != nullptr) {
+            *error = "line " + std::to_string(lineNo) + ": " + why;
+        }
+        return false;
+    }
+    if (spec.variants.empty()) {
+        if (error != nullptr) {
+            *error = "spec has no [variant] blocks";
+        }
+        return false;
+    }
+    *out = std::move(spec);
+    return true;
+}
+
+bool LoadSpec(const fs::path& file, Spec* out, std::string* error) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        if (error != nullptr) {
+            *error = "cannot open " + file.string();
+        }
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return ParseSpec(text.str(), out, error);
+}
+
+bool Expand(const Spec& spec, const mafia_save::SaveData& base, Plan* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output plan";
+        }
+        return false;
+    }
+    const Resolver resolver(base);
+    const std::string baseName = spec.base.filename().string();
+    Plan plan;
+    std::vector<Variant>& variants = plan.variants;
+    std::map<std::string, std::size_t> names;
+    std::string why;
+    const auto fail = [&](std::size_t line) {
+        if (error != nullptr) {
+            *error = (line != 0 ? "line " + std::to_string(line) + ": " : std::string()) + why;
+        }
+        return false;
+    };
+
+    const auto renderNote = [&](const std::string& text, std::vector<std::string>* lines) {
+        lines->emplace_back();
+        return Render(text, spec.start, baseName, {}, resolver, &lines->back(), &why);
+    };
+    if (!renderNote(spec.title, &plan.noteHead)) {
+        return fail(0);
+    }
+    plan.noteHead.push_back("");
+    plan.noteHead.push_back("Base file: " + spec.base.string());
+    for (const auto& line : spec.intro) {
+        if (!renderNote(line, &plan.noteHead)) {
+            return fail(0);
+        }
+    }
+    for (const auto& line : spec.outro) {
+        if (!renderNote(line, &plan.noteTail)) {
+            return fail(0);
+        }
+    }
+
+    for (const VariantSpec& vs : spec.variants) {
+        // One axis per edit line: every (offset, value) pair, resolved to file offsets once.
+        std::vector<std::vector<Choice>> axes;
+        std::size_t total = 1;
+        for (const EditSpec& e : vs.edits) {
+            std::vector<Choice> axis;
+            const std::vector<std::uint64_t> offsets = e.offsets.empty() ? std::vector<std::uint64_t>{0} : e.offsets;
+            for (const std::uint64_t off : offsets) {
+                std::size_t fileOffset = 0;
+                if (!resolver.Resolve(e, off, &fileOffset, &why)) {
+                    return fail(e.line);
+                }
+                for (const EditValue& v : e.values) {
+                    axis.push_back(Choice{fileOffset, &v});
+                }
+            }
+            total *= axis.size();
+            if (total > kMaxVariants) {
+                why = "block expands to more than " + std::to_string(kMaxVariants) + " variants";
+                return fail(e.line);
+            }
+            axes.push_back(std::move(axis));
+        }
+
+        std::vector<std::size_t> pos(axes.size(), 0);
+        std::vector<Choice> choices(axes.size());
+        for (std::size_t k = 0; k < total; ++k) {
+            for (std::size_t a = 0; a < axes.size(); ++a) {
+                choices[a] = axes[a][pos[a]];
+            }
+            Variant v;
+            const std::uint64_t n = spec.start + variants.size();
+            if (!Render(vs.name.empty() ? spec.name : vs.name, n, baseName, choices, resolver, &v.name, &why) ||
+                !Render(vs.label, n, baseName, choices, resolver, &v.label, &why)) {
+                return fail(vs.line);
+            }
+            for (const std::string& d : vs.details) {
+                v.details.emplace_back();
+                if (!Render(d, n, baseName, choices, resolver, &v.details.back(), &why)) {
+                    return fail(vs.line);
+                }
+            }
+            if (v.name.empty() || v.name.find_first_of("/\\") != std::string::npos || !names.emplace(v.name, k).second) {
+                why = "variant name '" + v.name + "' is empty, has a path separator or repeats";
+                return fail(vs.line);
+            }
+            for (std::size_t a = 0; a < axes.size(); ++a) {
+                v.patches.push_back(Patch{choices[a].fileOffset, vs.edits[a].op, choices[a].value->bytes});
+            }
+            variants.push_back(std::move(v));
+            // Last axis varies fastest.
+            for (std::size_t a = axes.size(); a-- > 0;) {
+                if (++pos[a] < axes[a].size()) {
+                    break;
+                }
+                pos[a] = 0;
+            }
+        }
+    }
+    *out = std::move(plan);
+    return true;
+}
+
+bool Generate(const Spec& spec,
+              const std::vector<std::uint8_t>& baseRaw,
+              const mafia_save::SaveData& base,
+              const Plan& plan,
+              unsigned threads,
+              GenerateStats* stats,
+              std::string* error) {
+    const std::vector<Variant>& variants = plan.variants;
+    std::error_code ec;
+    fs::create_directories(spec.output, ec);
+    if (!fs::is_directory(spec.output, ec)) {
+        if (error != nullptr) {
+            *error = "cannot create " + spec.output.string();
+        }
+        return false;
+    }
+
+    const std::vector<mafia_save::CipherCheckpoint> checkpoints = mafia_save::SegmentCheckpoints(base);
+    std::vector<std::size_t> starts;
+    std::size_t abs = mafia_save::kFileHeaderSize;
+    for (const auto& seg : base.segments) {
+        starts.push_back(abs);
+        abs += seg.plain.size();
+    }
+    if (abs > baseRaw.size()) {
+        if (error != nullptr) {
+            *error = "base bytes do not match the parsed save";
+        }
+        return false;
+    }
+
+    GenerateStats s;
+    s.variants = variants.size();
+    s.threads = work_pool::ResolveThreads(threads, variants.size());
+    s.diffBytes.assign(variants.size(), 0);
+    std::vector<std::uint64_t> encrypted(variants.size(), 0);
+    std::vector<std::string> errors(variants.size());
+
+    work_pool::ParallelFor(variants.size(), threads, [&](unsigned, std::size_t i) {
+        // Copy on write: only segments touched by a patch get a private plaintext.
+        std::map<std::size_t, std::vector<std::uint8_t>> edited;
+        std::vector<std::uint8_t> header(baseRaw.begin(), baseRaw.begin() + mafia_save::kFileHeaderSize);
+        for (const Patch& p : variants[i].patches) {
+            for (std::size_t b = 0; b < p.bytes.size(); ++b) {
+                const std::size_t off = p.fileOffset + b;
+                std::uint8_t* byte = nullptr;
+                if (off < mafia_save::kFileHeaderSize) {
+                    byte = &header[off];
+                } else {
+                    const std::size_t seg =
+                        static_cast<std::size_t>(std::upper_bound(starts.begin(), starts.end(), off) - starts.begin()) - 1;
+                    auto it = edited.find(seg);
+                    if (it == edited.end()) {
+                        it = edited.emplace(seg, base.segments[seg].plain).first;
+                    }
+                    byte = &it->second[off - starts[seg]];
+                }
+                *byte = p.op == EditOp::kXor ? static_cast<std::uint8_t>(*byte ^ p.bytes[b]) : p.bytes[b];
+            }
+        }
+
+        // The keystream depends on every earlier plaintext word, so everything from the first edited
+        // segment on is re-encrypted; the bytes before it are the base ciphertext.
+        const std::size_t first = edited.empty() ? base.segments.size() : edited.begin()->first;
+        std::vector<std::uint8_t> raw;
+        raw.reserve(baseRaw.size());
+        raw.insert(raw.end(), header.begin(), header.end());
+        const std::size_t copyEnd = first < starts.size() ? starts[first] : abs;
+        raw.insert(raw.end(), baseRaw.begin() + mafia_save::kFileHeaderSize, baseRaw.begin() + copyEnd);
+        if (first < base.segments.size()) {
+            mafia_save::CipherCheckpoint state = checkpoints[first];
+            for (std::size_t seg = first; seg < base.segments.size(); ++seg) {
+                const auto it = edited.find(seg);
+                std::vector<std::uint8_t> cipher = it != edited.end() ? it->second : base.segments[seg].plain;
+                mafia_save::EncryptWithCheckpoint(&cipher, &state);
+                raw.insert(raw.end(), cipher.begin(), cipher.end());
+                encrypted[i] += cipher.size();
+            }
+        }
+        raw.insert(raw.end(), baseRaw.begin() + abs, baseRaw.end());
+
+        std::size_t diff = 0;
+        for (std::size_t b = 0; b < raw.size(); ++b) {
+            diff += raw[b] != baseRaw[b] ? 1u : 0u;
+        }
+        s.diffBytes[i] = diff;
+        mafia_save::WriteFileBytesAtomic(spec.output / variants[i].name, raw, &errors[i]);
+    });
+
+    for (std::size_t i = 0; i < variants.size(); ++i) {
+        if (!errors[i].empty()) {
+            if (error != nullptr) {
+                *error = errors[i];
+            }
+            return false;
+        }
+        s.bytesWritten += baseRaw.size();
+        s.bytesEncrypted += encrypted[i];
+    }
+
+    if (!spec.notes.empty()) {
+        std::ostringstream note;
+        for (const auto& line : plan.noteHead) {
+            note << line << "\n";
+        }
+        note << "\n";
+        for (std::size_t i = 0; i < variants.size(); ++i) {
+            note << "- " << variants[i].name << ": " << variants[i].label << "\n";
+            for (const auto& line : variants[i].details) {
+                note << "  " << line << "\n";
+            }
+            note << "  Byte diff vs base: " << s.diffBytes[i] << "\n\n";
+        }
+        for (const auto& line : plan.noteTail) {
+            note << line << "\n";
+        }
+        const std::string text = note.str();
+        std::string err;
+        if (!mafia_save::WriteFileBytesAtomic(spec.output / spec.notes, std::vector<std::uint8_t>(text.begin(), text.end()), &err)) {
+            if (error != nullptr) {
+                *error = err;
+            }
+            return false;
+        }
+    }
+    if (stats != nullptr) {
+        *stats = std::move(s);
+    }
+    return true;
+}
+
+}  // namespace save_experiment
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace save_experiment {
+
+namespace fs = std::filesystem;
+
+// Spec files are line based; '#' starts a comment line. Global keys come first, then one [variant] block
+// per group of test files:
+//
+//   base   = savegame/mafia004.230        base save (overridable on the command line)
+//   output = out/batch007                 output directory (overridable)
+//   name   = {base}_{n}                   file name template; {n} counts up from `start`
+//   start  = 28
+//   notes  = RESULTS_SERIES_007_plan.txt  plan note written next to the variants (optional)
+//   title  = ... / intro = ... / outro = ...   note text; intro and outro may repeat
+//
+//   [variant]
+//   label  = actor_header_1 type 2 -> {val}
+//   detail = Offset: {off}                 (repeatable)
+//   set actor(Tommy).type = 4, 27
+//   xor file+0x400..0x4FF = 0x01
+//
+// Every edit line is an axis; a block expands to the product of its axes (offset ranges times values).
+// A block without edits is a control copy. Targets:
+//   file+<off>[:type]            absolute file offset (the 24-byte file header is not encrypted)
+//   <segment>+<off>[:type]       offset in a segment, e.g. actor_header_1+128:u32, meta32+16:u32
+//   meta.slot|time|date|hp_percent|mission_code, garage(n), garage2(n)                      u32
+//   actor(<name>).name|model (str64), .type|payload_size|idx (u32),
+//   actor(<name>).x|y|z|hp|hpmax|fuel|odometer (f32 at the DetectCoordLayout offset)
+// Raw targets default to u8; types are u8, u32, f32 and strN (NUL-padded to N bytes). Offsets may be
+// ranges "a..b" or "a..b/step"; values are comma lists of numbers, integer ranges and "strings".
+// Templates: {n} {base} {off} {val} ({offK} {valK} for the K-th edit line) and {@<target>} for the file
+// offset of any target in the base save.
+enum class EditOp : std::uint8_t { kSet, kXor };
+enum class ValueType : std::uint8_t { kU8, kU32, kF32, kStr };
+
+struct EditValue {
+    std::vector<std::uint8_t> bytes;  // little-endian, target width
+    std::string text;                 // for templates
+};
+
+struct EditSpec {
+    std::size_t line = 0;
+    EditOp op = EditOp::kSet;
+    std::string target;                  // without the offset range and type suffix
+    std::vector<std::uint64_t> offsets;  // raw targets only
+    ValueType type = ValueType::kU8;
+    std::size_t width = 1;
+    std::vector<EditValue> values;
+};
+
+struct VariantSpec {
+    std::size_t line = 0;
+    std::string name;  // overrides the global template
+    std::string label;
+    std::vector<std::string> details;
+    std::vector<EditSpec> edits;
+};
+
+struct Spec {
+    fs::path base;
+    fs::path output;
+    std::string name = "{base}_{n}";
+    std::uint64_t start = 0;
+    std::string notes;
+    std::string title;
+    std::vector<std::string> intro;
+    std::vector<std::string> outro;
+    std::vector<VariantSpec> variants;
+};
+
+bool ParseSpec(const std::string& text, Spec* out, std::string* error = nullptr);
+bool LoadSpec(const fs::path& file, Spec* out, std::string* error = nullptr);
+
+// One concrete edit at an absolute file offset.
+struct Patch {
+    std::size_t fileOffset = 0;
+    EditOp op = EditOp::kSet;
+    std::vector<std::uint8_t> bytes;
+};
+
+struct Variant {
+    std::string name;
+    std::string label;
+    std::vector<std::string> details;
+    std::vector<Patch> patches;
+};
+
+struct Plan {
+    std::vector<Variant> variants;
+    std::vector<std::string> noteHead;  // title, base file and intro, rendered
+    std::vector<std::string> noteTail;  // outro, rendered
+};
+
+// Resolves targets against the base save and expands every block's matrix, in spec order.
+bool Expand(const Spec& spec, const mafia_save::SaveData& base, Plan* out, std::string* error = nullptr);
+
+struct GenerateStats {
+    std::size_t variants = 0;
+    std::uint64_t bytesWritten = 0;
+    std::uint64_t bytesEncrypted = 0;  // re-encrypted from the first edited segment on; the rest is copied
+    std::vector<std::size_t> diffBytes;  // per variant, vs the base file
+    unsigned threads = 0;
+};
+
+// Writes every variant (and the plan note) to spec.output, each through a .tmp file and a rename.
+// Unedited segments are shared with the base and the base ciphertext is reused up to the first edit.
+bool Generate(const Spec& spec,
+              const std::vector<std::uint8_t>& baseRaw,
+              const mafia_save::SaveData& base,
+              const Plan& plan,
+              unsigned threads,
+              GenerateStats* stats = nullptr,
+              std::string* error = nullptr);
+
+}  // namespace save_experiment
@@ -0,0 +1,667 @@
+#include "save_index.hpp"
+
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace save_index {
+
+namespace {
+
+constexpr char kMagic[4] = {'M', 'S', 'I', 'X'};
+constexpr std::uint32_t kFlagSave = 1u;
+constexpr std::uint32_t kFlagParsed = 2u;
+
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t entryCount;
+    std::uint32_t segmentCount;
+    std::uint32_t actorCount;
+    std::uint32_t reserved;
+    std::uint64_t entriesOff;
+    std::uint64_t segmentsOff;
+    std::uint64_t actorsOff;
+    std::uint64_t stringsOff;
+    std::uint64_t stringsSize;
+};
+
+struct StrRef {
+    std::uint32_t off;
+    std::uint32_t len;
+};
+
+struct EntryRecord {
+    std::uint64_t size;
+    std::int64_t mtime;
+    std::uint64_t hash;
+    StrRef path;
+    std::uint32_t flags;
+    std::uint32_t reserved0;
+    std::uint8_t gvasHeader[kGvasHeaderSize];
+    std::uint32_t meta[8];
+    StrRef mission;
+    std::uint32_t gamePayloadSize;
+    std::uint32_t aiGroupsSize;
+    std::uint32_t aiFollowSize;
+    std::uint32_t reserved1;
+    std::uint32_t segFirst;
+    std::uint32_t segCount;
+    std::uint32_t actorFirst;
+    std::uint32_t actorCount;
+};
+
+struct SegmentRecord {
+    std::uint32_t fileOffset;
+    std::uint32_t size;
+    std::uint32_t key1;
+    std::uint32_t key2;
+    StrRef name;
+};
+
+struct ActorRecord {
+    StrRef name;
+    StrRef model;
+    std::uint32_t type;
+    std::uint32_t payloadSize;
+    std::uint32_t idx;
+    std::uint32_t headerSeg;
+};
+
+static_assert(sizeof(FileHeader) == 64, "index header layout");
+static_assert(sizeof(EntryRecord) == 168, "index entry layout");
+static_assert(sizeof(SegmentRecord) == 24, "index segment layout");
+static_assert(sizeof(ActorRecord) == 32, "index actor layout");
+
+}  // namespace
+
+// Read-only view of a whole file; falls back to an empty view on any failure.
+class MappedFile {
+public:
+    explicit MappedFile(const fs::path& path) {
+#ifdef _WIN32
+        // FILE_SHARE_DELETE lets WriteIndex rename a new index over this one while entries still map it.
+        file_ = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+            return;
+        }
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) {
+            return;
+        }
+        data_ = static_cast<const std::uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ != nullptr) {
+            size_ = static_cast<std::size_t>(size.QuadPart);
+        }
+#else
+        fd_ = open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return;
+        }
+        struct stat st {};
+        if (fstat(fd_, &st) != 0 || st.st_size <= 0) {
+            return;
+        }
+        void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (p == MAP_FAILED) {
+            return;
+        }
+        data_ = static_cast<const std::uint8_t*>(p);
+        size_ = static_cast<std::size_t>(st.st_size);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+#else
+        if (data_ != nullptr) {
+            munmap(const_cast<std::uint8_t*>(data_), size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::uint8_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const std::uint8_t* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+template <>
+SegmentInfo Rows<SegmentInfo>::Decode(std::size_t i) const {
+    SegmentRecord r;
+    std::memcpy(&r, records_ + i * sizeof(r), sizeof(r));
+    return SegmentInfo{std::string(strings_ + r.name.off, r.name.len), r.fileOffset, r.size, {r.key1, r.key2}};
+}
+
+template <>
+ActorInfo Rows<ActorInfo>::Decode(std::size_t i) const {
+    ActorRecord r;
+    std::memcpy(&r, records_ + i * sizeof(r), sizeof(r));
+    return ActorInfo{std::string(strings_ + r.name.off, r.name.len), std::string(strings_ + r.model.off, r.model.len),
+                     r.type, r.payloadSize, r.idx, r.headerSeg};
+}
+
+namespace {
+
+
+class StringTable {
+public:
+    StrRef Add(const std::string& s) {
+        StrRef ref{static_cast<std::uint32_t>(blob_.size()), static_cast<std::uint32_t>(s.size())};
+        blob_.insert(blob_.end(), s.begin(), s.end());
+        return ref;
+    }
+    const std::vector<char>& blob() const { return blob_; }
+
+private:
+    std::vector<char> blob_;
+};
+
+std::int64_t FileMtime(const fs::path& path, std::error_code& ec) {
+    return static_cast<std::int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+}
+
+std::uint64_t AlignUp8(std::uint64_t v) {
+    return (v + 7u) & ~static_cast<std::uint64_t>(7u);
+}
+
+void FillFromSave(const std::vector<std::uint8_t>& raw, Entry* e) {
+    std::copy(raw.begin(), raw.begin() + static_cast<std::ptrdiff_t>(std::min(raw.size(), kGvasHeaderSize)),
+              e->gvasHeader.begin());
+    mafia_save::SaveData save;
+    std::vector<mafia_save::CipherCheckpoint> checkpoints;
+    if (!mafia_save::ParseSaveWithCheckpoints(raw, &save, &checkpoints)) {
+        return;
+    }
+    e->parsed = true;
+    e->mission = mafia_save::ReadMissionName(save);
+    mafia_save::ReadMetaFields(save, &e->meta);
+    e->gamePayloadSize = mafia_save::ReadMainPayloadSize(save);
+    e->aiGroupsSize = mafia_save::ReadAiGroupsSize(save);
+    e->aiFollowSize = mafia_save::ReadAiFollowSize(save);
+
+    std::uint32_t cursor = static_cast<std::uint32_t>(mafia_save::kFileHeaderSize);
+    e->segments.reserve(save.segments.size());
+    for (std::size_t i = 0; i < save.segments.size(); ++i) {
+        const auto& seg = save.segments[i];
+        SegmentInfo info;
+        info.name = seg.name;
+        info.fileOffset = cursor;
+        info.size = static_cast<std::uint32_t>(seg.plain.size());
+        info.checkpoint = checkpoints[i];
+        cursor += info.size;
+        e->segments.push_back(std::move(info));
+
+        if (seg.name.rfind("actor_header_", 0) == 0 && seg.plain.size() >= mafia_save::kActorHeaderSize) {
+            ActorInfo actor;
+            actor.name = mafia_save::ReadCStr(seg.plain, 0, 64);
+            actor.model = mafia_save::ReadCStr(seg.plain, 64, 64);
+            actor.type = mafia_save::ReadU32LE(seg.plain, 128);
+            actor.payloadSize = mafia_save::ReadU32LE(seg.plain, 132);
+            actor.idx = mafia_save::ReadU32LE(seg.plain, 136);
+            actor.headerSeg = static_cast<std::uint32_t>(i);
+            e->actors.push_back(std::move(actor));
+        }
+    }
+}
+
+enum class Outcome { kUnchanged, kTouched, kParsed, kGone };
+
+Outcome RefreshOne(const fs::path& root, const fs::path& path, const Entry* old, Entry* out) {
+    std::error_code ec;
+    const std::uint64_t size = fs::file_size(path, ec);
+    if (ec) {
+        return Outcome::kGone;
+    }
+    const std::int64_t mtime = FileMtime(path, ec);
+    if (old != nullptr && old->size == size && old->mtime == mtime) {
+        *out = *old;
+        return Outcome::kUnchanged;
+    }
+
+    const auto raw = mafia_save::ReadFileBytes(path);
+    Entry e;
+    e.path = path.lexically_relative(root);
+    e.size = raw.size();
+    e.mtime = mtime;
+    e.isSave = raw.size() >= 4 && std::memcmp(raw.data(), "GvaS", 4) == 0;
+    if (e.isSave) {
+        e.hash = ContentHash(raw);
+        if (old != nullptr && old->isSave && old->hash == e.hash && old->size == e.size) {
+            *out = *old;
+            out->mtime = mtime;
+            return Outcome::kTouched;
+        }
+        FillFromSave(raw, &e);
+    }
+    *out = std::move(e);
+    return Outcome::kParsed;
+}
+
+void RebuildLookup(Index* index) {
+    index->byPath.clear();
+    index->byPath.reserve(index->entries.size());
+    for (std::size_t i = 0; i < index->entries.size(); ++i) {
+        index->byPath.emplace(index->entries[i].path.generic_string(), i);
+    }
+}
+
+bool TableFits(const MappedFile& map, std::uint64_t off, std::uint32_t count, std::size_t recordSize) {
+    const std::uint64_t bytes = static_cast<std::uint64_t>(count) * recordSize;
+    return off <= map.size() && bytes <= map.size() - off;
+}
+
+}  // namespace
+
+std::uint64_t ContentHash(const std::vector<std::uint8_t>& bytes) {
+    // FNV-1a over 8-byte words, finished with the length.
+    std::uint64_t h = 1469598103934665603ull;
+    std::size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        std::uint64_t w = 0;
+        std::memcpy(&w, bytes.data() + i, sizeof(w));
+        h = (h ^ w) * 1099511628211ull;
+    }
+    for (; i < bytes.size(); ++i) {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return (h ^ static_cast<std::uint64_t>(bytes.size())) * 1099511628211ull;
+}
+
+fs::path DefaultIndexPath(const fs::path& root) {
+    return root / kDefaultIndexName;
+}
+
+void CollectFiles(const fs::path& root, const std::function<bool(const fs::path&)>& accept, std::vector<fs::path>* out) {
+    std::vector<fs::path> found;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+         it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        if (it->path().filename().string().rfind(kToolEntryPrefix, 0) == 0) {
+            if (it->is_directory(ec)) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (it->is_regular_file(ec) && accept(it->path())) {
+            found.push_back(it->path());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    out->insert(out->end(), found.begin(), found.end());
+}
+
+void CollectSaveFiles(const fs::path& root, std::vector<fs::path>* out) {
+    CollectFiles(root, IsGvasFile, out);
+}
+
+bool IsGvasFile(const fs::path& path) {
+    const auto head = mafia_save::ReadFilePrefix(path, 4);
+    return head.size() == 4 && std::memcmp(head.data(), "GvaS", 4) == 0;
+}
+
+bool LoadIndex(const fs::path& file, Index* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output index";
+        }
+        return false;
+    }
+    const auto map = std::make_shared<const MappedFile>(file);
+    FileHeader header{};
+    if (map->data() == nullptr || map->size() < sizeof(header)) {
+        if (error != nullptr) {
+            *error = "index file is missing or too small";
+        }
+        return false;
+    }
+    std::memcpy(&header, map->data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kIndexVersion) {
+        if (error != nullptr) {
+            *error = "index magic/version mismatch";
+        }
+        return false;
+    }
+
+    if (!TableFits(*map, header.entriesOff, header.entryCount, sizeof(EntryRecord)) ||
+        !TableFits(*map, header.segmentsOff, header.segmentCount, sizeof(SegmentRecord)) ||
+        !TableFits(*map, header.actorsOff, header.actorCount, sizeof(ActorRecord)) || header.stringsOff > map->size() ||
+        header.stringsSize > map->size() - header.stringsOff) {
+        if (error != nullptr) {
+            *error = "index tables exceed file size";
+        }
+        return false;
+    }
+    const std::uint8_t* segments = map->data() + header.segmentsOff;
+    const std::uint8_t* actors = map->data() + header.actorsOff;
+    const char* strings = reinterpret_cast<const char*>(map->data() + header.stringsOff);
+    auto fits = [&](const StrRef& ref) { return static_cast<std::uint64_t>(ref.off) + ref.len <= header.stringsSize; };
+
+    // Rows are decoded from the mapping on access, so every string they reference is checked up front.
+    bool refsOk = true;
+    for (std::uint32_t i = 0; i < header.segmentCount && refsOk; ++i) {
+        SegmentRecord r;
+        std::memcpy(&r, segments + i * sizeof(r), sizeof(r));
+        refsOk = fits(r.name);
+    }
+    for (std::uint32_t i = 0; i < header.actorCount && refsOk; ++i) {
+        ActorRecord r;
+        std::memcpy(&r, actors + i * sizeof(r), sizeof(r));
+        refsOk = fits(r.name) && fits(r.model);
+    }
+
+    Index index;
+    index.entries.reserve(refsOk ? header.entryCount : 0u);
+    for (std::uint32_t i = 0; i < header.entryCount && refsOk; ++i) {
+        EntryRecord r;
+        std::memcpy(&r, map->data() + header.entriesOff + i * sizeof(r), sizeof(r));
+        if (static_cast<std::uint64_t>(r.segFirst) + r.segCount > header.segmentCount ||
+            static_cast<std::uint64_t>(r.actorFirst) + r.actorCount > header.actorCount || !fits(r.path) ||
+            !fits(r.mission)) {
+            refsOk = false;
+            break;
+        }
+        Entry e;
+        e.path = fs::u8path(std::string(strings + r.path.off, r.path.len));
+        e.size = r.size;
+        e.mtime = r.mtime;
+        e.hash = r.hash;
+        e.isSave = (r.flags & kFlagSave) != 0u;
+        e.parsed = (r.flags & kFlagParsed) != 0u;
+        std::memcpy(e.gvasHeader.data(), r.gvasHeader, kGvasHeaderSize);
+        e.meta = mafia_save::MetaFields{r.meta[0], r.meta[1], r.meta[2], r.meta[3],
+                                        r.meta[4], r.meta[5], r.meta[6], r.meta[7]};
+        e.mission.assign(strings + r.mission.off, r.mission.len);
+        e.gamePayloadSize = r.gamePayloadSize;
+        e.aiGroupsSize = r.aiGroupsSize;
+        e.aiFollowSize = r.aiFollowSize;
+        e.segments = Rows<SegmentInfo>(map, segments + r.segFirst * sizeof(SegmentRecord), r.segCount, strings);
+        e.actors = Rows<ActorInfo>(map, actors + r.actorFirst * sizeof(ActorRecord), r.actorCount, strings);
+        index.entries.push_back(std::move(e));
+    }
+    if (!refsOk) {
+        if (error != nullptr) {
+            *error = "index record references are out of range";
+        }
+        return false;
+    }
+    RebuildLookup(&index);
+    *out = std::move(index);
+    return true;
+}
+
+bool WriteIndex(const Index& index, const fs::path& file, std::string* error) {
+    StringTable strings;
+    std::vector<EntryRecord> entries;
+    std::vector<SegmentRecord> segments;
+    std::vector<ActorRecord> actors;
+    entries.reserve(index.entries.size());
+    for (const auto& e : index.entries) {
+        EntryRecord r{};
+        r.size = e.size;
+        r.mtime = e.mtime;
+        r.hash = e.hash;
+        r.path = strings.Add(e.path.generic_u8string());
+        r.flags = (e.isSave ? kFlagSave : 0u) | (e.parsed ? kFlagParsed : 0u);
+        std::memcpy(r.gvasHeader, e.gvasHeader.data(), kGvasHeaderSize);
+        const std::uint32_t meta[8] = {e.meta.slot,      e.meta.unknown1, e.meta.packedTime, e.meta.packedDate,
+                                       e.meta.hpPercent, e.meta.unknown5, e.meta.unknown6,   e.meta.missionCode};
+        std::memcpy(r.meta, meta, sizeof(meta));
+        r.mission = strings.Add(e.mission);
+        r.gamePayloadSize = e.gamePayloadSize;
+        r.aiGroupsSize = e.aiGroupsSize;
+        r.aiFollowSize = e.aiFollowSize;
+        r.segFirst = static_cast<std::uint32_t>(segments.size());
+        r.segCount = static_cast<std::uint32_t>(e.segments.size());
+        for (const auto& s : e.segments) {
+            segments.push_back(
+                SegmentRecord{s.fileOffset, s.size, s.checkpoint.key1, s.checkpoint.key2, strings.Add(s.name)});
+        }
+        r.actorFirst = static_cast<std::uint32_t>(actors.size());
+        r.actorCount = static_cast<std::uint32_t>(e.actors.size());
+        for (const auto& a : e.actors) {
+            actors.push_back(
+                ActorRecord{strings.Add(a.name), strings.Add(a.model), a.type, a.payloadSize, a.idx, a.headerSeg});
+        }
+        entries.push_back(r);
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kIndexVersion;
+    header.entryCount = static_cast<std::uint32_t>(entries.size());
+    header.segmentCount = static_cast<std::uint32_t>(segments.size());
+    header.actorCount = static_cast<std::uint32_t>(actors.size());
+    header.entriesOff = sizeof(FileHeader);
+    header.segmentsOff = AlignUp8(header.entriesOff + entries.size() * sizeof(EntryRecord));
+    header.actorsOff = AlignUp8(header.segmentsOff + segments.size() * sizeof(SegmentRecord));
+    header.stringsOff = AlignUp8(header.actorsOff + actors.size() * sizeof(ActorRecord));
+    header.stringsSize = strings.blob().size();
+
+    std::vector<std::uint8_t> bytes(static_cast<std::size_t>(header.stringsOff + header.stringsSize), 0u);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        std::memcpy(bytes.data() + header.entriesOff, entries.data(), entries.size() * sizeof(EntryRecord));
+    }
+    if (!segments.empty()) {
+        std::memcpy(bytes.data() + header.segmentsOff, segments.data(), segments.size() * sizeof(SegmentRecord));
+    }
+    if (!actors.empty()) {
+        std::memcpy(bytes.data() + header.actorsOff, actors.data(), actors.size() * sizeof(ActorRecord));
+    }
+    if (!strings.blob().empty()) {
+        std::memcpy(bytes.data() + header.stringsOff, strings.blob().data(), strings.blob().size());
+    }
+
+    // Write next to the target and rename, so a reader never maps a half-written index.
+    return mafia_save::WriteFileBytesAtomic(file, bytes, error);
+}
+
+bool RefreshIndex(const fs::path& root, Index* index, unsigned threads, RefreshStats* stats, std::string* error) {
+    if (index == nullptr) {
+        if (error != nullptr) {
+            *error = "null index";
+        }
+        return false;
+    }
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        if (error != nullptr) {
+            *error = "not a directory: " + root.string();
+        }
+        return false;
+    }
+
+    std::vector<fs::path> files;
+    CollectFiles(root, [](const fs::path&) { return true; }, &files);
+
+    std::vector<Entry> fresh(files.size());
+    std::vector<Outcome> outcome(files.size(), Outcome::kGone);
+    work_pool::ParallelFor(files.size(), threads, [&](unsigned, std::size_t i) {
+        const auto rel = files[i].lexically_relative(root);
+        const auto it = index->byPath.find(rel.generic_string());
+        const Entry* old = it != index->byPath.end() ? &index->entries[it->second] : nullptr;
+        outcome[i] = RefreshOne(root, files[i], old, &fresh[i]);
+    });
+
+    RefreshStats st;
+    Index next;
+    next.entries.reserve(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        switch (outcome[i]) {
+            case Outcome::kUnchanged:
+                ++st.unchanged;
+                break;
+            case Outcome::kTouched:
+                ++st.touched;
+                break;
+            case Outcome::kParsed:
+                ++st.parsed;
+                break;
+            case Outcome::kGone:
+                continue;
+        }
+        next.entries.push_back(std::move(fresh[i]));
+    }
+    st.files = next.entries.size();
+    std::size_t kept = 0;
+    for (const auto& e : next.entries) {
+        kept += index->byPath.count(e.path.generic_string());
+    }
+    st.removed = index->entries.size() - kept;
+    st.changed = st.touched != 0 || st.parsed != 0 || st.removed != 0;
+    RebuildLookup(&next);
+    *index = std::move(next);
+    if (stats != nullptr) {
+        *stats = st;
+    }
+    return true;
+}
+
+bool RefreshPaths(const fs::path& root,
+                  Index* index,
+                  const std::vector<fs::path>& relativePaths,
+                  RefreshStats* stats,
+                  std::string* error) {
+    if (index == nullptr) {
+        if (error != nullptr) {
+            *error = "null index";
+        }
+        return false;
+    }
+
+    RefreshStats st;
+    bool reorder = false;
+    std::vector<bool> drop(index->entries.size(), false);
+    for (const auto& rel : relativePaths) {
+        const std::string key = rel.generic_string();
+        const auto it = index->byPath.find(key);
+        const Entry* old = it != index->byPath.end() ? &index->entries[it->second] : nullptr;
+        Entry fresh;
+        std::error_code ec;
+        const Outcome outcome =
+            fs::is_regular_file(root / rel, ec) ? RefreshOne(root, root / rel, old, &fresh) : Outcome::kGone;
+        switch (outcome) {
+            case Outcome::kUnchanged:
+                ++st.unchanged;
+                continue;
+            case Outcome::kTouched:
+                ++st.touched;
+                break;
+            case Outcome::kParsed:
+                ++st.parsed;
+                break;
+            case Outcome::kGone:
+                if (old != nullptr && !drop[it->second]) {
+                    drop[it->second] = true;
+                    ++st.removed;
+                    reorder = true;
+                }
+                continue;
+        }
+        if (old != nullptr) {
+            index->entries[it->second] = std::move(fresh);
+        } else {
+            index->byPath.emplace(key, index->entries.size());
+            index->entries.push_back(std::move(fresh));
+            drop.push_back(false);
+            reorder = true;
+        }
+    }
+
+    if (reorder) {
+        std::vector<Entry> kept;
+        kept.reserve(index->entries.size());
+        for (std::size_t i = 0; i < index->entries.size(); ++i) {
+            if (!drop[i]) {
+                kept.push_back(std::move(index->entries[i]));
+            }
+        }
+        std::sort(kept.begin(), kept.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+        index->entries = std::move(kept);
+        RebuildLookup(index);
+    }
+    st.files = index->entries.size();
+    st.changed = st.touched != 0 || st.parsed != 0 || st.removed != 0;
+    if (stats != nullptr) {
+        *stats = st;
+    }
+    return true;
+}
+
+bool OpenIndex(const fs::path& root, Index* out, RefreshStats* stats, std::string* error) {
+    const fs::path file = DefaultIndexPath(root);
+    std::error_code ec;
+    if (out == nullptr || !fs::is_regular_file(file, ec)) {
+        return false;
+    }
+    Index index;
+    if (!LoadIndex(file, &index, error)) {
+        index = Index{};  // unreadable or older version: rebuild from scratch
+    }
+    RefreshStats st;
+    if (!RefreshIndex(root, &index, 0, &st, error)) {
+        return false;
+    }
+    if (st.changed && !WriteIndex(index, file, error)) {
+        return false;
+    }
+    if (stats != nullptr) {
+        *stats = st;
+    }
+    *out = std::move(index);
+    return true;
+}
+
+const Entry* FindEntry(const Index& index, const fs::path& relativePath) {
+    const auto it = index.byPath.find(relativePath.generic_string());
+    return it != index.byPath.end() ? &index.entries[it->second] : nullptr;
+}
+
+}  // namespace save_index
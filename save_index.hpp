@@ -0,0 +1,162 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace save_index {
+
+namespace fs = std::filesystem;
+
+constexpr const char* kDefaultIndexName = ".mafia_index";
+constexpr const char* kToolEntryPrefix = ".mafia_";  // index, its temp file, backup store: never indexed
+constexpr std::uint32_t kIndexVersion = 1;
+constexpr std::size_t kGvasHeaderSize = 56;
+
+struct SegmentInfo {
+    std::string name;
+    std::uint32_t fileOffset = 0;
+    std::uint32_t size = 0;
+    mafia_save::CipherCheckpoint checkpoint;  // key state before the segment's first cipher word
+};
+
+struct ActorInfo {
+    std::string name;
+    std::string model;
+    std::uint32_t type = 0;
+    std::uint32_t payloadSize = 0;
+    std::uint32_t idx = 0;
+    std::uint32_t headerSeg = 0;
+};
+
+class MappedFile;  // read-only view of an index file, shared by the entries LoadIndex served from it
+
+// Segment or actor table of an entry. Entries parsed by a refresh own their rows; entries loaded by
+// LoadIndex decode a row from the mapped index file on each access, so opening an index copies no
+// per-segment or per-actor records.
+template <typename Row>
+class Rows {
+public:
+    class const_iterator {
+    public:
+        const_iterator(const Rows* rows, std::size_t i) : rows_(rows), i_(i) {}
+        Row operator*() const { return (*rows_)[i_]; }
+        const_iterator& operator++() {
+            ++i_;
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const { return i_ != other.i_; }
+
+    private:
+        const Rows* rows_;
+        std::size_t i_;
+    };
+
+    Rows() = default;
+    Rows(std::shared_ptr<const MappedFile> file, const std::uint8_t* records, std::uint32_t count, const char* strings)
+        : file_(std::move(file)), records_(records), strings_(strings), count_(count) {}
+
+    std::size_t size() const { return file_ != nullptr ? count_ : owned_.size(); }
+    bool empty() const { return size() == 0; }
+    Row operator[](std::size_t i) const { return file_ != nullptr ? Decode(i) : owned_[i]; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    void reserve(std::size_t n) { owned_.reserve(n); }
+    void push_back(Row row) { owned_.push_back(std::move(row)); }
+
+private:
+    Row Decode(std::size_t i) const;
+
+    std::vector<Row> owned_;
+    std::shared_ptr<const MappedFile> file_;
+    const std::uint8_t* records_ = nullptr;
+    const char* strings_ = nullptr;
+    std::uint32_t count_ = 0;
+};
+
+template <>
+SegmentInfo Rows<SegmentInfo>::Decode(std::size_t i) const;
+template <>
+ActorInfo Rows<ActorInfo>::Decode(std::size_t i) const;
+
+struct Entry {
+    fs::path path;  // relative to the indexed root
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;  // fs::file_time_type ticks
+    std::uint64_t hash = 0;  // ContentHash of the whole file; 0 for non-saves
+    bool isSave = false;     // starts with "GvaS"
+    bool parsed = false;     // ParseSave succeeded
+    std::array<std::uint8_t, kGvasHeaderSize> gvasHeader{};
+    mafia_save::MetaFields meta;
+    std::string mission;
+    std::uint32_t gamePayloadSize = 0;
+    std::uint32_t aiGroupsSize = 0;
+    std::uint32_t aiFollowSize = 0;
+    Rows<SegmentInfo> segments;
+    Rows<ActorInfo> actors;
+};
+
+struct Index {
+    std::vector<Entry> entries;  // sorted by path
+    std::unordered_map<std::string, std::size_t> byPath;  // generic path -> entries index
+};
+
+struct RefreshStats {
+    std::size_t files = 0;
+    std::size_t unchanged = 0;  // size and mtime matched, file not opened
+    std::size_t touched = 0;    // size/mtime changed but the content hash matched
+    std::size_t parsed = 0;     // read and parsed again
+    std::size_t removed = 0;
+    bool changed = false;
+};
+
+std::uint64_t ContentHash(const std::vector<std::uint8_t>& bytes);
+fs::path DefaultIndexPath(const fs::path& root);
+
+// Appends the regular files under root that `accept` takes, sorted by path. Entries named
+// kToolEntryPrefix* are skipped together with everything below them.
+void CollectFiles(const fs::path& root, const std::function<bool(const fs::path&)>& accept, std::vector<fs::path>* out);
+// CollectFiles of the files that start with "GvaS".
+void CollectSaveFiles(const fs::path& root, std::vector<fs::path>* out);
+bool IsGvasFile(const fs::path& path);
+
+// On-disk layout (little-endian, every table 8-byte aligned so a mapped file can be read in place):
+//   FileHeader { "MSIX", u32 version, u32 entries, u32 segments, u32 actors, u32 0,
+//                u64 entriesOff, u64 segmentsOff, u64 actorsOff, u64 stringsOff, u64 stringsSize }
+//   EntryRecord[entries] (168 bytes), SegmentRecord[segments] (24 bytes), ActorRecord[actors] (32 bytes),
+//   string blob (paths, mission/segment/actor names; records hold offset + length).
+// LoadIndex keeps the file mapped for as long as any loaded entry refers to it.
+bool LoadIndex(const fs::path& file, Index* out, std::string* error = nullptr);
+bool WriteIndex(const Index& index, const fs::path& file, std::string* error = nullptr);
+
+// Brings `index` in line with the files under root: unchanged size + mtime keeps the entry without
+// opening the file, a matching content hash keeps it after one read, everything else is parsed.
+bool RefreshIndex(const fs::path& root,
+                  Index* index,
+                  unsigned threads,
+                  RefreshStats* stats = nullptr,
+                  std::string* error = nullptr);
+
+// Same as RefreshIndex for the given root-relative paths only; missing files drop their entries.
+bool RefreshPaths(const fs::path& root,
+                  Index* index,
+                  const std::vector<fs::path>& relativePaths,
+                  RefreshStats* stats = nullptr,
+                  std::string* error = nullptr);
+
+// Loads root/.mafia_index, refreshes it and writes it back when something changed.
+// Returns false (without error) when root has no index yet.
+bool OpenIndex(const fs::path& root, Index* out, RefreshStats* stats = nullptr, std::string* error = nullptr);
+
+const Entry* FindEntry(const Index& index, const fs::path& relativePath);
+
+}  // namespace save_index
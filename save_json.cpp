@@ -0,0 +1,1057 @@
+#include "save_json.hpp"
+
+#include "save_index.hpp"
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <utility>
+
+namespace save_json {
+
+namespace {
+
+constexpr std::size_t kExportBatch = 256;
+
+enum class FieldType : std::uint8_t { kU8, kU16, kU32, kF32, kStr };
+
+struct Field {
+    std::size_t off = 0;
+    std::size_t width = 0;
+    FieldType type = FieldType::kU32;
+    const char* name = "";
+    int index = -1;  // rendered as name[index]
+};
+
+constexpr char kBase64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// --- writer -----------------------------------------------------------------------------------
+
+void AppendUInt(std::string* out, std::uint64_t v) {
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out->append(buf, static_cast<std::size_t>(res.ptr - buf));
+}
+
+void AppendFloat(std::string* out, float v) {
+    char buf[32];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    out->append(buf, static_cast<std::size_t>(res.ptr - buf));
+}
+
+void AppendString(std::string* out, std::string_view s) {
+    static const char kHex[] = "0123456789abcdef";
+    out->push_back('"');
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20u && c != '"' && c != '\\') {
+            continue;
+        }
+        out->append(s.data() + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(static_cast<char>(c));
+        } else {
+            out->append("\\u00");
+            out->push_back(kHex[c >> 4]);
+            out->push_back(kHex[c & 0xFu]);
+        }
+    }
+    out->append(s.data() + run, s.size() - run);
+    out->push_back('"');
+}
+
+void AppendBase64(std::string* out, const std::uint8_t* data, std::size_t size) {
+    const std::size_t start = out->size();
+    out->resize(start + (size + 2) / 3 * 4);
+    char* dst = &(*out)[start];
+    std::size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        const std::uint32_t v = (static_cast<std::uint32_t>(data[i]) << 16) |
+                                (static_cast<std::uint32_t>(data[i + 1]) << 8) | data[i + 2];
+        *dst++ = kBase64Chars[(v >> 18) & 63u];
+        *dst++ = kBase64Chars[(v >> 12) & 63u];
+        *dst++ = kBase64Chars[(v >> 6) & 63u];
+        *dst++ = kBase64Chars[v & 63u];
+    }
+    if (i < size) {
+        std::uint32_t v = static_cast<std::uint32_t>(data[i]) << 16;
+        if (i + 1 < size) {
+            v |= static_cast<std::uint32_t>(data[i + 1]) << 8;
+        }
+        *dst++ = kBase64Chars[(v >> 18) & 63u];
+        *dst++ = kBase64Chars[(v >> 12) & 63u];
+        *dst++ = i + 1 < size ? kBase64Chars[(v >> 6) & 63u] : '=';
+        *dst++ = '=';
+    }
+}
+
+float LoadF32(const std::uint8_t* p) {
+    std::uint32_t bits = static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+                         (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    float v = 0.0f;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+std::uint32_t LoadUInt(const std::uint8_t* p, std::size_t width) {
+    std::uint32_t v = 0;
+    for (std::size_t i = width; i-- > 0;) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// strN: printable text, then NUL bytes only, so that the value alone reproduces the bytes.
+std::size_t TextLength(const std::uint8_t* p, std::size_t width, bool* clean) {
+    std::size_t len = 0;
+    while (len < width && p[len] != 0) {
+        if (p[len] < 0x20u || p[len] > 0x7Eu) {
+            *clean = false;
+            return 0;
+        }
+        ++len;
+    }
+    for (std::size_t i = len; i < width; ++i) {
+        if (p[i] != 0) {
+            *clean = false;
+            return 0;
+        }
+    }
+    *clean = true;
+    return len;
+}
+
+bool RoundTrips(const Field& f, const std::uint8_t* p) {
+    if (f.type == FieldType::kF32) {
+        return std::isfinite(LoadF32(p));
+    }
+    if (f.type == FieldType::kStr) {
+        bool clean = false;
+        TextLength(p, f.width, &clean);
+        return clean;
+    }
+    return true;
+}
+
+const char* TypeName(FieldType type) {
+    switch (type) {
+        case FieldType::kU8:
+            return "u8";
+        case FieldType::kU16:
+            return "u16";
+        case FieldType::kU32:
+            return "u32";
+        case FieldType::kF32:
+            return "f32";
+        case FieldType::kStr:
+            return "str";
+    }
+    return "?";
+}
+
+void Add(std::vector<Field>* fields, std::size_t off, FieldType type, const char* name, int index = -1) {
+    std::size_t width = 4;
+    if (type == FieldType::kU8) {
+        width = 1;
+    } else if (type == FieldType::kU16) {
+        width = 2;
+    }
+    fields->push_back(Field{off, width, type, name, index});
+}
+
+void AddStr(std::vector<Field>* fields, std::size_t off, std::size_t width, const char* name) {
+    fields->push_back(Field{off, width, FieldType::kStr, name, -1});
+}
+
+// Dword names of the 196-byte inventory blob, as save_edit spells them (nullptr: not known).
+const char* InventoryName(std::size_t dword) {
+    static const char* const kNames[] = {
+        "inv.mode",        "inv.sel.id",       "inv.sel.loaded",   "inv.sel.hidden",   "inv.sel.unk",
+        nullptr,           nullptr,            nullptr,            nullptr,            "inv.slot1.id",
+        "inv.slot1.loaded", "inv.slot1.hidden", "inv.slot1.unk",    "inv.slot2.id",     "inv.slot2.loaded",
+        "inv.slot2.hidden", "inv.slot2.unk",    "inv.slot3.id",     "inv.slot3.loaded", "inv.slot3.hidden",
+        "inv.slot3.unk",    "inv.slot4.id",     "inv.slot4.loaded", "inv.slot4.hidden", "inv.slot4.unk",
+        "inv.slot5.id",     "inv.slot5.loaded", "inv.slot5.hidden", "inv.slot5.unk",    "inv.coat.id",
+        "inv.coat.loaded",  "inv.coat.hidden",  "inv.coat.unk",
+    };
+    return dword < sizeof(kNames) / sizeof(kNames[0]) ? kNames[dword] : nullptr;
+}
+
+void PayloadFields(const std::vector<std::uint8_t>& p, std::vector<Field>* fields) {
+    const save_layout::CoordLayout l = save_layout::DetectCoordLayout(p);
+    if (l.baseSupported) {
+        Add(fields, l.stateOff, FieldType::kU8, "state");
+        Add(fields, l.idOff, FieldType::kU32, "id");
+        Add(fields, l.activeOff, FieldType::kU8, "active");
+        Add(fields, l.removeOff, FieldType::kU8, "remove");
+        Add(fields, l.frameOff, FieldType::kU8, "frame");
+    }
+    if (l.coordsSupported) {
+        Add(fields, l.xOff, FieldType::kF32, "x");
+        Add(fields, l.yOff, FieldType::kF32, "y");
+        Add(fields, l.zOff, FieldType::kF32, "z");
+    }
+    if (l.dirSupported) {
+        Add(fields, l.dirXOff, FieldType::kF32, "dir_x");
+        Add(fields, l.dirYOff, FieldType::kF32, "dir_y");
+        Add(fields, l.dirZOff, FieldType::kF32, "dir_z");
+    }
+    if (l.animSupported) {
+        Add(fields, l.animIdOff, FieldType::kU32, "anim_id");
+    }
+    if (l.quatSupported) {
+        Add(fields, l.quatWOff, FieldType::kF32, "quat_w");
+        Add(fields, l.quatXOff, FieldType::kF32, "quat_x");
+        Add(fields, l.quatYOff, FieldType::kF32, "quat_y");
+        Add(fields, l.quatZOff, FieldType::kF32, "quat_z");
+    }
+    if (l.carStateSupported) {
+        Add(fields, l.carFuelOff, FieldType::kF32, "fuel");
+        Add(fields, l.carFlowOff, FieldType::kF32, "flow");
+        Add(fields, l.carEngNormOff, FieldType::kF32, "eng_norm");
+        Add(fields, l.carEngCalcOff, FieldType::kF32, "eng_calc");
+    }
+    if (l.carDriveSupported) {
+        Add(fields, l.carSpeedLimitOff, FieldType::kF32, "speed_limit");
+        Add(fields, l.carLastGearOff, FieldType::kU32, "last_gear");
+        Add(fields, l.carGearOff, FieldType::kU32, "gear");
+    }
+    if (l.carEngineFlagsSupported) {
+        Add(fields, l.carGearboxFlagOff, FieldType::kU32, "gearbox_flag");
+        Add(fields, l.carDisableEngineOff, FieldType::kU8, "disable_engine");
+        Add(fields, l.carEngineOnOff, FieldType::kU8, "engine_on");
+        Add(fields, l.carIsEngineOnOff, FieldType::kU8, "is_engine_on");
+    }
+    if (l.carOdometerSupported) {
+        Add(fields, l.carOdometerOff, FieldType::kF32, "odometer");
+    }
+    if (l.humanStateSupported) {
+        Add(fields, l.humanSeatOff, FieldType::kU32, "seat");
+        Add(fields, l.humanCrouchOff, FieldType::kU8, "crouch");
+        Add(fields, l.humanAimOff, FieldType::kU8, "aim");
+        Add(fields, l.humanShootXOff, FieldType::kF32, "shoot_x");
+        Add(fields, l.humanShootYOff, FieldType::kF32, "shoot_y");
+        Add(fields, l.humanShootZOff, FieldType::kF32, "shoot_z");
+    }
+    if (l.humanHealthSupported) {
+        Add(fields, l.humanHpCurrentOff, FieldType::kF32, "hp");
+        Add(fields, l.humanHpMaxOff, FieldType::kF32, "hpmax");
+    }
+    if (l.humanInventorySupported) {
+        for (std::size_t d = 0; d < save_layout::kInventoryBlobSize / 4; ++d) {
+            if (const char* name = InventoryName(d)) {
+                Add(fields, l.humanInventoryOff + 4 * d, FieldType::kU32, name);
+            }
+        }
+    }
+}
+
+void GameHeaderFields(std::vector<Field>* fields) {
+    Add(fields, 0, FieldType::kU8, "marker");
+    Add(fields, 1, FieldType::kU32, "field_a");
+    Add(fields, 5, FieldType::kU32, "field_b");
+    Add(fields, 9, FieldType::kU32, "mission_id");
+    Add(fields, 13, FieldType::kU8, "timer_on");
+    Add(fields, 14, FieldType::kU32, "timer_interval");
+    Add(fields, 18, FieldType::kU32, "timer_a");
+    Add(fields, 22, FieldType::kU32, "timer_b");
+    Add(fields, 26, FieldType::kU32, "timer_c");
+    Add(fields, 42, FieldType::kU32, "script_entries");
+    Add(fields, 46, FieldType::kU32, "script_chunks");
+    Add(fields, 62, FieldType::kU8, "score_on");
+    Add(fields, 63, FieldType::kU32, "score_value");
+}
+
+void ProgramFields(const save_layout::ProgramLayout& prog, std::vector<Field>* fields) {
+    Add(fields, prog.baseOff, FieldType::kU8, "program.marker");
+    Add(fields, prog.baseOff + 17, FieldType::kU16, "program.reg_count");
+    Add(fields, prog.baseOff + 19, FieldType::kU32, "program.var_count");
+    Add(fields, prog.baseOff + 23, FieldType::kU32, "program.frame_count");
+    Add(fields, prog.baseOff + 27, FieldType::kU32, "program.actor_count");
+    for (std::uint32_t i = 0; i < prog.varCount; ++i) {
+        Add(fields, prog.varsOff + 4u * i, FieldType::kF32, "var", static_cast<int>(i));
+    }
+}
+
+// Known fields of one segment, in offset order, without overlaps, inside the segment.
+void SegmentFields(const mafia_save::SaveData& save,
+                   std::size_t idx,
+                   const std::optional<save_layout::ProgramLocation>& program,
+                   std::vector<Field>* fields) {
+    fields->clear();
+    const mafia_save::Segment& seg = save.segments[idx];
+    if (idx == save.idxMeta) {
+        static const char* const kMeta[] = {"slot", "unknown1", "packed_time", "packed_date",
+                                            "hp_percent", "unknown5", "unknown6", "mission_code"};
+        for (std::size_t i = 0; i < 8; ++i) {
+            Add(fields, 4 * i, FieldType::kU32, kMeta[i]);
+        }
+    } else if (idx == save.idxInfo) {
+        AddStr(fields, 0, 32, "mission_name");
+        Add(fields, 32, FieldType::kU32, "game_payload_size");
+        for (std::size_t i = 0; i < save_layout::kGarageSlotCount; ++i) {
+            Add(fields, save_layout::kGaragePrimaryOff + 4 * i, FieldType::kU32, "garage", static_cast<int>(i));
+        }
+        for (std::size_t i = 0; i < save_layout::kGarageSlotCount; ++i) {
+            Add(fields, save_layout::kGarageSecondaryOff + 4 * i, FieldType::kU32, "garage2", static_cast<int>(i));
+        }
+        Add(fields, 240, FieldType::kU32, "ai_groups_size");
+        Add(fields, 244, FieldType::kU32, "ai_follow_size");
+    } else if (seg.name.rfind("actor_header_", 0) == 0) {
+        AddStr(fields, 0, 64, "name");
+        AddStr(fields, 64, 64, "model");
+        Add(fields, 128, FieldType::kU32, "type");
+        Add(fields, 132, FieldType::kU32, "payload_size");
+        Add(fields, 136, FieldType::kU32, "idx");
+    } else if (seg.name.rfind("actor_payload_", 0) == 0) {
+        PayloadFields(seg.plain, fields);
+    }
+    if (idx == save.idxGamePayload && seg.plain.size() >= save_layout::kGameHeaderSize) {
+        GameHeaderFields(fields);
+    }
+    if (program.has_value() && program->segIdx == idx) {
+        ProgramFields(program->layout, fields);
+    }
+
+    std::stable_sort(fields->begin(), fields->end(), [](const Field& a, const Field& b) { return a.off < b.off; });
+    std::size_t end = 0;
+    std::size_t kept = 0;
+    for (const Field& f : *fields) {
+        if (f.off < end || f.off + f.width > seg.plain.size() || !RoundTrips(f, seg.plain.data() + f.off)) {
+            continue;
+        }
+        end = f.off + f.width;
+        (*fields)[kept++] = f;
+    }
+    fields->resize(kept);
+}
+
+void AppendGap(std::string* out, const std::vector<std::uint8_t>& p, std::size_t from, std::size_t to, bool* first) {
+    if (from >= to) {
+        return;
+    }
+    out->append(*first ? "{\"off\":" : ",{\"off\":");
+    *first = false;
+    AppendUInt(out, from);
+    out->append(",\"b64\":\"");
+    AppendBase64(out, p.data() + from, to - from);
+    out->append("\"}");
+}
+
+void AppendSegment(const mafia_save::SaveData& save,
+                   std::size_t idx,
+                   const std::vector<Field>& fields,
+                   std::string* out) {
+    const std::vector<std::uint8_t>& p = save.segments[idx].plain;
+    out->append("{\"segment\":");
+    AppendUInt(out, idx);
+    out->append(",\"name\":");
+    AppendString(out, save.segments[idx].name);
+    out->append(",\"size\":");
+    AppendUInt(out, p.size());
+    out->append(",\"fields\":[");
+    bool first = true;
+    std::size_t cur = 0;
+    for (const Field& f : fields) {
+        AppendGap(out, p, cur, f.off, &first);
+        out->append(first ? "{\"off\":" : ",{\"off\":");
+        first = false;
+        AppendUInt(out, f.off);
+        out->append(",\"name\":\"");
+        out->append(f.name);
+        if (f.index >= 0) {
+            out->push_back('[');
+            AppendUInt(out, static_cast<std::uint64_t>(f.index));
+            out->push_back(']');
+        }
+        out->append("\",\"");
+        out->append(TypeName(f.type));
+        const std::uint8_t* v = p.data() + f.off;
+        if (f.type == FieldType::kStr) {
+            AppendUInt(out, f.width);
+            out->append("\":");
+            bool clean = false;
+            const std::size_t len = TextLength(v, f.width, &clean);
+            AppendString(out, std::string_view(reinterpret_cast<const char*>(v), len));
+        } else if (f.type == FieldType::kF32) {
+            out->append("\":");
+            AppendFloat(out, LoadF32(v));
+        } else {
+            out->append("\":");
+            AppendUInt(out, LoadUInt(v, f.width));
+        }
+        out->push_back('}');
+        cur = f.off + f.width;
+    }
+    AppendGap(out, p, cur, p.size(), &first);
+    out->append("]}");
+}
+
+// --- reader -----------------------------------------------------------------------------------
+
+// Cursor over JSON text. Strings without escapes are returned as views into the input; only
+// escaped strings are decoded, into a scratch buffer per use (keys, values) that the next call reuses.
+class Reader {
+public:
+    Reader(std::string_view text, std::size_t pos) : text_(text), pos_(pos) {}
+
+    std::size_t pos() const { return pos_; }
+    const std::string& error() const { return error_; }
+
+    bool AtEnd() {
+        SkipWs();
+        return pos_ >= text_.size();
+    }
+
+    bool Peek(char c) {
+        SkipWs();
+        return pos_ < text_.size() && text_[pos_] == c;
+    }
+
+    bool Expect(char c) {
+        SkipWs();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return Fail(std::string("expected '") + c + "'");
+    }
+
+    bool Key(std::string_view* out) { return StringView(out, &keyScratch_) && Expect(':'); }
+    bool Value(std::string_view* out) { return StringView(out, &valueScratch_); }
+
+    bool UInt(std::uint64_t* out) {
+        SkipWs();
+        const char* begin = text_.data() + pos_;
+        const auto res = std::from_chars(begin, text_.data() + text_.size(), *out);
+        if (res.ec != std::errc() || (res.ptr < text_.data() + text_.size() && (*res.ptr == '.' || *res.ptr == 'e'))) {
+            return Fail("expected an unsigned integer");
+        }
+        pos_ += static_cast<std::size_t>(res.ptr - begin);
+        return true;
+    }
+
+    bool Float(float* out) {
+        SkipWs();
+        const char* begin = text_.data() + pos_;
+        const auto res = std::from_chars(begin, text_.data() + text_.size(), *out);
+        if (res.ec != std::errc()) {
+            return Fail("expected a number");
+        }
+        pos_ += static_cast<std::size_t>(res.ptr - begin);
+        return true;
+    }
+
+    // Object members: fn(key) must consume the value.
+    template <typename Fn>
+    bool Object(Fn&& fn) {
+        if (!Expect('{')) {
+            return false;
+        }
+        if (Peek('}')) {
+            ++pos_;
+            return true;
+        }
+        for (;;) {
+            std::string_view key;
+            if (!Key(&key) || !fn(key)) {
+                return false;
+            }
+            SkipWs();
+            if (pos_ < text_.size() && text_[pos_] == ',') {
+                ++pos_;
+                continue;
+            }
+            return Expect('}');
+        }
+    }
+
+    template <typename Fn>
+    bool Array(Fn&& fn) {
+        if (!Expect('[')) {
+            return false;
+        }
+        if (Peek(']')) {
+            ++pos_;
+            return true;
+        }
+        for (;;) {
+            if (!fn()) {
+                return false;
+            }
+            SkipWs();
+            if (pos_ < text_.size() && text_[pos_] == ',') {
+                ++pos_;
+                continue;
+            }
+            return Expect(']');
+        }
+    }
+
+    // Any value, for members this reader does not know.
+    bool Skip() {
+        SkipWs();
+        if (pos_ >= text_.size()) {
+            return Fail("unexpected end of input");
+        }
+        const char c = text_[pos_];
+        if (c == '{') {
+            return Object([this](std::string_view) { return Skip(); });
+        }
+        if (c == '[') {
+            return Array([this] { return Skip(); });
+        }
+        if (c == '"') {
+            std::string_view ignored;
+            return Value(&ignored);
+        }
+        const std::size_t start = pos_;
+        while (pos_ < text_.size() && std::strchr(",}] \t\r\n", text_[pos_]) == nullptr) {
+            ++pos_;
+        }
+        return pos_ > start || Fail("expected a value");
+    }
+
+    bool Fail(const std::string& message) {
+        if (error_.empty()) {
+            error_ = "offset " + std::to_string(pos_) + ": " + message;
+        }
+        return false;
+    }
+
+private:
+    void SkipWs() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' ||
+                                       text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    bool StringView(std::string_view* out, std::string* scratch) {
+        if (!Expect('"')) {
+            return false;
+        }
+        const std::size_t start = pos_;
+        while (pos_ < text_.size() && text_[pos_] != '"' && text_[pos_] != '\\') {
+            ++pos_;
+        }
+        if (pos_ >= text_.size()) {
+            return Fail("unterminated string");
+        }
+        if (text_[pos_] == '"') {
+            *out = text_.substr(start, pos_ - start);
+            ++pos_;
+            return true;
+        }
+        scratch->assign(text_.data() + start, pos_ - start);
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+            if (c != '\\') {
+                scratch->push_back(c);
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                break;
+            }
+            c = text_[pos_++];
+            switch (c) {
+                case 'n':
+                    scratch->push_back('\n');
+                    break;
+                case 't':
+                    scratch->push_back('\t');
+                    break;
+                case 'r':
+                    scratch->push_back('\r');
+                    break;
+                case 'b':
+                    scratch->push_back('\b');
+                    break;
+                case 'f':
+                    scratch->push_back('\f');
+                    break;
+                case 'u': {
+                    unsigned code = 0;
+                    if (pos_ + 4 > text_.size() ||
+                        std::from_chars(text_.data() + pos_, text_.data() + pos_ + 4, code, 16).ptr !=
+                            text_.data() + pos_ + 4) {
+                        return Fail("bad \\u escape");
+                    }
+                    pos_ += 4;
+                    if (code > 0xFFu) {
+                        return Fail("only \\u0000-\\u00ff escapes are supported");
+                    }
+                    scratch->push_back(static_cast<char>(code));
+                    break;
+                }
+                default:
+                    scratch->push_back(c);
+                    break;
+            }
+        }
+        if (pos_ >= text_.size()) {
+            return Fail("unterminated string");
+        }
+        ++pos_;
+        *out = *scratch;
+        return true;
+    }
+
+    std::string_view text_;
+    std::size_t pos_ = 0;
+    std::string error_;
+    std::string keyScratch_;
+    std::string valueScratch_;
+};
+
+std::int8_t Base64Value(char c) {
+    static const auto kTable = [] {
+        std::array<std::int8_t, 256> t{};
+        t.fill(-1);
+        for (int i = 0; i < 64; ++i) {
+            t[static_cast<unsigned char>(kBase64Chars[i])] = static_cast<std::int8_t>(i);
+        }
+        return t;
+    }();
+    return kTable[static_cast<unsigned char>(c)];
+}
+
+bool DecodeBase64(std::string_view in, std::vector<std::uint8_t>* out) {
+    if (in.size() % 4 != 0) {
+        return false;
+    }
+    std::size_t pad = 0;
+    if (!in.empty() && in.back() == '=') {
+        pad = in.size() >= 2 && in[in.size() - 2] == '=' ? 2 : 1;
+    }
+    const std::size_t start = out->size();
+    out->resize(start + in.size() / 4 * 3 - pad);
+    std::uint8_t* dst = out->data() + start;
+    for (std::size_t i = 0; i < in.size(); i += 4) {
+        const bool last = i + 4 == in.size();
+        std::uint32_t v = 0;
+        for (std::size_t k = 0; k < 4; ++k) {
+            const char c = in[i + k];
+            std::int8_t d = 0;
+            if (c == '=' && last && k >= 4 - pad) {
+                d = 0;
+            } else if ((d = Base64Value(c)) < 0) {
+                out->resize(start);
+                return false;
+            }
+            v = (v << 6) | static_cast<std::uint32_t>(d);
+        }
+        const std::size_t n = last ? 3 - pad : 3;
+        for (std::size_t k = 0; k < n; ++k) {
+            *dst++ = static_cast<std::uint8_t>(v >> (16 - 8 * k));
+        }
+    }
+    return true;
+}
+
+// One element of "fields": appends its bytes to *plain, which must be exactly `off` long so far.
+bool ReadField(Reader* r, std::vector<std::uint8_t>* plain) {
+    std::uint64_t off = 0;
+    bool haveOff = false;
+    std::string_view typeKey;
+    std::uint64_t num = 0;
+    float f32 = 0.0f;
+    std::string_view text;
+    std::size_t width = 0;
+    bool haveValue = false;
+    const bool ok = r->Object([&](std::string_view key) {
+        if (key == "off") {
+            haveOff = true;
+            return r->UInt(&off);
+        }
+        if (key == "name") {
+            return r->Skip();
+        }
+        if (haveValue) {
+            return r->Fail("field has more than one value");
+        }
+        haveValue = true;
+        if (key == "u8" || key == "u16" || key == "u32") {
+            typeKey = key == "u8" ? "u8" : (key == "u16" ? "u16" : "u32");
+            width = key == "u8" ? 1 : (key == "u16" ? 2 : 4);
+            if (!r->UInt(&num)) {
+                return false;
+            }
+            return (width == 4 ? num <= 0xFFFFFFFFull : num < (1ull << (8 * width))) || r->Fail("value out of range");
+        }
+        if (key == "f32") {
+            typeKey = "f32";
+            width = 4;
+            return r->Float(&f32);
+        }
+        if (key == "b64") {
+            typeKey = "b64";
+            return r->Value(&text);
+        }
+        if (key.size() > 3 && key.substr(0, 3) == "str") {
+            typeKey = "str";
+            const auto res = std::from_chars(key.data() + 3, key.data() + key.size(), width);
+            if (res.ec != std::errc() || res.ptr != key.data() + key.size() || width == 0) {
+                return r->Fail("bad string width");
+            }
+            return r->Value(&text);
+        }
+        return r->Fail("unknown field type");
+    });
+    if (!ok) {
+        return false;
+    }
+    if (!haveOff || !haveValue) {
+        return r->Fail("field needs \"off\" and a value");
+    }
+    if (off != plain->size()) {
+        return r->Fail("field at off " + std::to_string(off) + ", expected " + std::to_string(plain->size()));
+    }
+    if (typeKey == "b64") {
+        if (!DecodeBase64(text, plain)) {
+            return r->Fail("bad base64");
+        }
+        return true;
+    }
+    if (typeKey == "str") {
+        if (text.size() > width) {
+            return r->Fail("string longer than its field");
+        }
+        plain->insert(plain->end(), text.begin(), text.end());
+        plain->resize(plain->size() + (width - text.size()), 0);
+        return true;
+    }
+    std::uint32_t bits = static_cast<std::uint32_t>(num);
+    if (typeKey == "f32") {
+        std::memcpy(&bits, &f32, sizeof(bits));
+    }
+    for (std::size_t k = 0; k < width; ++k) {
+        plain->push_back(static_cast<std::uint8_t>(bits >> (8 * k)));
+    }
+    return true;
+}
+
+bool ReadSegment(Reader* r, mafia_save::Segment* seg) {
+    std::uint64_t size = 0;
+    bool haveSize = false;
+    bool haveFields = false;
+    const bool ok = r->Object([&](std::string_view key) {
+        if (key == "name") {
+            std::string_view name;
+            if (!r->Value(&name)) {
+                return false;
+            }
+            seg->name.assign(name.data(), name.size());
+            return true;
+        }
+        if (key == "size") {
+            haveSize = true;
+            return r->UInt(&size);
+        }
+        if (key == "fields") {
+            haveFields = true;
+            seg->plain.clear();
+            if (haveSize) {
+                seg->plain.reserve(static_cast<std::size_t>(size));
+            }
+            return r->Array([&] { return ReadField(r, &seg->plain); });
+        }
+        return r->Skip();
+    });
+    if (!ok) {
+        return false;
+    }
+    if (seg->name.empty() || !haveFields) {
+        return r->Fail("segment needs \"name\" and \"fields\"");
+    }
+    if (haveSize && size != seg->plain.size()) {
+        return r->Fail("segment " + seg->name + " has " + std::to_string(seg->plain.size()) + " bytes, size says " +
+                       std::to_string(size));
+    }
+    return true;
+}
+
+void IndexSegments(mafia_save::SaveData* save) {
+    save->actorCount = 0;
+    save->rawSize = mafia_save::kFileHeaderSize;
+    for (std::size_t i = 0; i < save->segments.size(); ++i) {
+        const std::string& name = save->segments[i].name;
+        save->rawSize += save->segments[i].plain.size();
+        if (name == "head24") {
+            save->idxHead = i;
+        } else if (name == "meta32") {
+            save->idxMeta = i;
+        } else if (name == "info264") {
+            save->idxInfo = i;
+        } else if (name == "game_payload") {
+            save->idxGamePayload = i;
+        } else if (name == "ai_groups_payload") {
+            save->idxAiGroups = i;
+        } else if (name == "ai_follow_payload") {
+            save->idxAiFollow = i;
+        } else if (name.rfind("actor_header_", 0) == 0) {
+            ++save->actorCount;
+        }
+    }
+}
+
+struct InputFile {
+    fs::path path;
+    std::string rel;  // "path" in the export
+};
+
+void CollectInputs(const fs::path& input, std::vector<InputFile>* out) {
+    std::error_code ec;
+    if (!fs::is_directory(input, ec)) {
+        out->push_back(InputFile{input, input.filename().generic_string()});
+        return;
+    }
+    std::vector<fs::path> found;
+    save_index::CollectSaveFiles(input, &found);
+    for (const auto& f : found) {
+        out->push_back(InputFile{f, f.lexically_relative(input).generic_string()});
+    }
+}
+
+bool SafeRelative(const std::string& path) {
+    const fs::path p(path);
+    if (path.empty() || p.is_absolute() || p.has_root_name()) {
+        return false;
+    }
+    for (const fs::path& part : p) {
+        if (part == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+void AppendSave(const mafia_save::SaveData& save, const std::string& path, Format format, std::string* out) {
+    out->append("{\"path\":");
+    AppendString(out, path);
+    out->append(",\"size\":");
+    AppendUInt(out, save.rawSize);
+    out->append(",\"file_header\":\"");
+    AppendBase64(out, save.fileHeader.data(), save.fileHeader.size());
+    out->push_back('"');
+    if (format == Format::kNdjson) {
+        out->append(",\"segment_count\":");
+        AppendUInt(out, save.segments.size());
+        out->append("}\n");
+    } else {
+        out->append(",\"segments\":[");
+    }
+
+    const auto program = save_layout::DetectProgramInSave(save);
+    std::vector<Field> fields;
+    for (std::size_t i = 0; i < save.segments.size(); ++i) {
+        SegmentFields(save, i, program, &fields);
+        if (format == Format::kJson && i > 0) {
+            out->push_back(',');
+        }
+        AppendSegment(save, i, fields, out);
+        if (format == Format::kNdjson) {
+            out->push_back('\n');
+        }
+    }
+    if (format == Format::kJson) {
+        out->append("]}\n");
+    }
+}
+
+bool ReadSave(std::string_view text, std::size_t* pos, ImportedSave* out, std::string* error) {
+    Reader r(text, *pos);
+    if (r.AtEnd()) {
+        if (error != nullptr) {
+            error->clear();
+        }
+        return false;
+    }
+    ImportedSave imported;
+    std::uint64_t size = 0;
+    bool haveSize = false;
+    bool haveHeader = false;
+    bool haveSegments = false;
+    std::uint64_t segmentCount = 0;
+    std::vector<std::uint8_t> header;
+    const bool ok = r.Object([&](std::string_view key) {
+        if (key == "path") {
+            std::string_view path;
+            if (!r.Value(&path)) {
+                return false;
+            }
+            imported.path.assign(path.data(), path.size());
+            return true;
+        }
+        if (key == "size") {
+            haveSize = true;
+            return r.UInt(&size);
+        }
+        if (key == "file_header") {
+            std::string_view b64;
+            haveHeader = true;
+            return r.Value(&b64) && (DecodeBase64(b64, &header) || r.Fail("bad base64"));
+        }
+        if (key == "segments") {
+            haveSegments = true;
+            return r.Array([&] {
+                imported.save.segments.emplace_back();
+                return ReadSegment(&r, &imported.save.segments.back());
+            });
+        }
+        if (key == "segment_count") {
+            return r.UInt(&segmentCount);
+        }
+        return r.Skip();
+    });
+    // NDJSON: the segments follow the save line.
+    for (std::uint64_t i = 0; ok && !haveSegments && i < segmentCount; ++i) {
+        imported.save.segments.emplace_back();
+        if (!ReadSegment(&r, &imported.save.segments.back())) {
+            break;
+        }
+    }
+    if (ok && r.error().empty()) {
+        if (!haveHeader || header.size() != mafia_save::kFileHeaderSize) {
+            r.Fail("save needs a " + std::to_string(mafia_save::kFileHeaderSize) + "-byte \"file_header\"");
+        } else if (imported.save.segments.empty()) {
+            r.Fail("save has no segments");
+        }
+    }
+    if (!r.error().empty()) {
+        if (error != nullptr) {
+            *error = r.error();
+        }
+        return false;
+    }
+    std::copy(header.begin(), header.end(), imported.save.fileHeader.begin());
+    IndexSegments(&imported.save);
+    if (haveSize && size != imported.save.rawSize) {
+        if (error != nullptr) {
+            *error = "save " + imported.path + " rebuilds to " + std::to_string(imported.save.rawSize) +
+                     " bytes, size says " + std::to_string(size);
+        }
+        return false;
+    }
+    *pos = r.pos();
+    *out = std::move(imported);
+    return true;
+}
+
+bool ExportFiles(const std::vector<fs::path>& inputs,
+                 Format format,
+                 unsigned threads,
+                 std::ostream& out,
+                 ExportStats* stats,
+                 std::string* error) {
+    std::vector<InputFile> files;
+    for (const fs::path& input : inputs) {
+        std::error_code ec;
+        if (!fs::exists(input, ec)) {
+            if (error != nullptr) {
+                *error = "not found: " + input.string();
+            }
+            return false;
+        }
+        CollectInputs(input, &files);
+    }
+
+    ExportStats local;
+    local.files = files.size();
+    local.threads = work_pool::ResolveThreads(threads, std::min(files.size(), kExportBatch));
+    std::vector<std::string> texts;
+    std::vector<std::string> errors;
+    std::vector<std::uint64_t> sizes;
+    for (std::size_t begin = 0; begin < files.size(); begin += kExportBatch) {
+        const std::size_t count = std::min(kExportBatch, files.size() - begin);
+        texts.assign(count, std::string());
+        errors.assign(count, std::string());
+        sizes.assign(count, 0);
+        work_pool::ParallelFor(count, local.threads, [&](unsigned, std::size_t i) {
+            const InputFile& in = files[begin + i];
+            const auto raw = mafia_save::ReadFileBytes(in.path);
+            sizes[i] = raw.size();
+            mafia_save::SaveData save;
+            std::string err;
+            if (raw.empty()) {
+                errors[i] = "failed to read";
+            } else if (!mafia_save::ParseSave(raw, &save, &err)) {
+                errors[i] = err;
+            } else {
+                texts[i].reserve(raw.size() * 2);
+                AppendSave(save, in.rel, format, &texts[i]);
+            }
+        });
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!errors[i].empty()) {
+                ++local.failed;
+                local.errors.push_back(files[begin + i].path.generic_string() + ": " + errors[i]);
+                continue;
+            }
+            local.bytesIn += sizes[i];
+            local.bytesOut += texts[i].size();
+            out.write(texts[i].data(), static_cast<std::streamsize>(texts[i].size()));
+        }
+    }
+    out.flush();
+    if (stats != nullptr) {
+        *stats = std::move(local);
+    }
+    if (!out) {
+        if (error != nullptr) {
+            *error = "failed to write the export";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ImportText(std::string_view text, const fs::path& out, ImportStats* stats, std::string* error) {
+    ImportStats local;
+    local.bytesIn = text.size();
+    std::error_code ec;
+    const bool outIsDir = fs::is_directory(out, ec);
+    std::size_t pos = 0;
+    std::string err;
+    ImportedSave imported;
+    while (ReadSave(text, &pos, &imported, &err)) {
+        const bool single = local.saves == 0 && !outIsDir && Reader(text, pos).AtEnd();
+        if (!single && !SafeRelative(imported.path)) {
+            if (error != nullptr) {
+                *error = "save path \"" + imported.path + "\" is not a relative path below the output directory";
+            }
+            return false;
+        }
+        std::vector<std::uint8_t> raw;
+        if (!mafia_save::BuildRaw(imported.save, &raw, &err)) {
+            break;
+        }
+        if (!mafia_save::WriteFileBytesAtomic(single ? out : out / fs::path(imported.path), raw, &err)) {
+            break;
+        }
+        ++local.saves;
+        local.bytesOut += raw.size();
+    }
+    if (!err.empty()) {
+        if (error != nullptr) {
+            *error = local.saves == 0 ? err : "save " + std::to_string(local.saves + 1) + ": " + err;
+        }
+        return false;
+    }
+    if (stats != nullptr) {
+        *stats = local;
+    }
+    return true;
+}
+
+}  // namespace save_json
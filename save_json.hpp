@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace save_json {
+
+namespace fs = std::filesystem;
+
+// Every segment is written as its plaintext cut into an ordered list that covers each byte once:
+// known fields {"off":O,"name":"hp","f32":400} with types u8, u16, u32, f32 and strN (printable
+// text NUL-padded to N bytes), and {"off":O,"b64":"..."} for everything else. A field whose bytes
+// do not round-trip through its type (NaN, text with junk after the NUL) is left in the b64 runs.
+//
+// Known fields: meta32 (all eight dwords), info264 (mission name, payload sizes, garage[n],
+// garage2[n]), the C_game header at the start of game_payload, the C_program header and var[n]
+// in the segment DetectProgramInSave picks, actor headers (name, model, type, payload_size, idx)
+// and the DetectCoordLayout fields of actor payloads, inventory included.
+//
+// kJson:   {"path":..,"size":..,"file_header":"<b64>","segments":[{segment},...]}  on one line
+// kNdjson: {"path":..,"size":..,"file_header":"<b64>","segment_count":N}  then N segment lines
+//          {"segment":i,"name":"meta32","size":32,"fields":[...]}
+enum class Format : std::uint8_t { kJson, kNdjson };
+
+void AppendSave(const mafia_save::SaveData& save, const std::string& path, Format format, std::string* out);
+
+struct ImportedSave {
+    std::string path;
+    mafia_save::SaveData save;  // segments, file header, segment indices, actorCount, rawSize
+};
+
+// Reads the save that starts at *pos (either format) and advances *pos past it. At the end of the
+// input it returns false with an empty error.
+bool ReadSave(std::string_view text, std::size_t* pos, ImportedSave* out, std::string* error = nullptr);
+
+struct ExportStats {
+    std::size_t files = 0;
+    std::size_t failed = 0;
+    std::uint64_t bytesIn = 0;
+    std::uint64_t bytesOut = 0;
+    unsigned threads = 0;
+    std::vector<std::string> errors;  // "<path>: <reason>"
+};
+
+// Inputs are save files or directories (recursive, GvaS files only, .mafia_* entries skipped); saves
+// are written in sorted path order, paths relative to their input directory. Formatting runs in
+// parallel, in batches, so memory stays bounded for large directories.
+bool ExportFiles(const std::vector<fs::path>& inputs,
+                 Format format,
+                 unsigned threads,
+                 std::ostream& out,
+                 ExportStats* stats = nullptr,
+                 std::string* error = nullptr);
+
+struct ImportStats {
+    std::size_t saves = 0;
+    std::uint64_t bytesIn = 0;
+    std::uint64_t bytesOut = 0;
+};
+
+// A stream with a single save is written to `out` unless `out` is an existing directory; otherwise
+// every save goes to out/<path> (paths must be relative and stay below `out`).
+bool ImportText(std::string_view text, const fs::path& out, ImportStats* stats = nullptr, std::string* error = nullptr);
+
+}  // namespace save_json
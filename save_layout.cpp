@@ -0,0 +1,527 @@
+#include "save_layout.hpp"
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAVE_LAYOUT_SSE2 1
+#include <emmintrin.h>
+#else
+#define SAVE_LAYOUT_SSE2 0
+#endif
+
+namespace save_layout {
+
+namespace {
+
+constexpr std::uint32_t kMaxRefNameLen = 1024u;
+// The layout cache is split into shards by hash so threads rarely wait on each other. Only segments
+// without an actor base record (game_payload, AI groups) are cached, at most three per save, so
+// 16 x 64 entries covers the saves a GUI session or a server keeps hot without growing in batch runs.
+constexpr std::size_t kLayoutCacheShards = 16;
+constexpr std::size_t kLayoutCacheShardCapacity = 64;
+
+// Bytes of the C_program header that the TryParseProgramLayoutAt count limits force to zero:
+// high byte of m_iVariableCount (<= 8192), m_iFrameCount and m_iActorCount (<= 2048).
+constexpr std::size_t kProgramZeroByteOffs[] = {22, 26, 30};
+
+std::uint16_t ReadU16LE(const std::vector<std::uint8_t>& data, std::size_t off) {
+    return static_cast<std::uint16_t>(data[off]) | (static_cast<std::uint16_t>(data[off + 1]) << 8);
+}
+
+bool PassesProgramPrefilter(const std::vector<std::uint8_t>& p, std::size_t off) {
+    if (p[off] != 2u) {
+        return false;
+    }
+    for (std::size_t z : kProgramZeroByteOffs) {
+        if (p[off + z] != 0u) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BetterProgramLayout(const ProgramLayout& cand, const std::optional<ProgramLayout>& best) {
+    return !best.has_value() || cand.varCount > best->varCount ||
+           (cand.varCount == best->varCount && cand.actorCount > best->actorCount);
+}
+
+// Fallback for segments without a known anchor: every offset is a candidate, but only offsets whose
+// marker and zero bytes match are handed to the full parse.
+std::optional<ProgramLayout> ScanProgramLayout(const std::vector<std::uint8_t>& p) {
+    std::optional<ProgramLayout> best;
+    std::uint64_t tried = 0;
+    auto tryAt = [&](std::size_t off) {
+        ++tried;
+        const auto cand = TryParseProgramLayoutAt(p, off);
+        if (cand.has_value() && BetterProgramLayout(*cand, best)) {
+            best = cand;
+        }
+    };
+
+    const std::size_t end = p.size() - kProgramHeaderSize + 1;
+    std::size_t off = 0;
+#if SAVE_LAYOUT_SSE2
+    const __m128i marker = _mm_set1_epi8(2);
+    const __m128i zero = _mm_setzero_si128();
+    const std::uint8_t* base = p.data();
+    for (; off + 16 <= end; off += 16) {
+        __m128i hit = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + off)), marker);
+        for (std::size_t z : kProgramZeroByteOffs) {
+            hit = _mm_and_si128(hit, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + off + z)), zero));
+        }
+        const std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(hit));
+        for (std::size_t lane = 0; mask != 0u && lane < 16; ++lane) {
+            if (((mask >> lane) & 1u) != 0u) {
+                tryAt(off + lane);
+            }
+        }
+    }
+#endif
+    for (; off < end; ++off) {
+        if (PassesProgramPrefilter(p, off)) {
+            tryAt(off);
+        }
+    }
+    mafia_save::AddStat(mafia_save::Stat::kProgramCandidates, tried);
+    return best;
+}
+
+// FNV-1a over 8-byte words; only used as a cache key together with the segment size.
+std::uint64_t HashBytes(const std::vector<std::uint8_t>& p) {
+    std::uint64_t h = 1469598103934665603ull;
+    std::size_t i = 0;
+    for (; i + 8 <= p.size(); i += 8) {
+        std::uint64_t w = 0;
+        std::memcpy(&w, p.data() + i, sizeof(w));
+        h = (h ^ w) * 1099511628211ull;
+    }
+    for (; i < p.size(); ++i) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+struct CachedLayout {
+    std::uint64_t key = 0;
+    std::size_t size = 0;
+    std::optional<ProgramLayout> layout;
+};
+
+// LRU: most recently used entry at the front of `order`.
+struct LayoutCacheShard {
+    std::mutex mutex;
+    std::list<CachedLayout> order;
+    std::unordered_map<std::uint64_t, std::list<CachedLayout>::iterator> index;
+};
+
+LayoutCacheShard g_layoutCache[kLayoutCacheShards];
+
+LayoutCacheShard& LayoutShard(std::uint64_t key) {
+    // The top bits: the map buckets already use the low ones.
+    return g_layoutCache[key >> 60];
+}
+
+bool FindCachedLayout(std::uint64_t key, std::size_t size, std::optional<ProgramLayout>* out) {
+    LayoutCacheShard& shard = LayoutShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end() || it->second->size != size) {
+        return false;
+    }
+    shard.order.splice(shard.order.begin(), shard.order, it->second);
+    *out = it->second->layout;
+    return true;
+}
+
+void StoreCachedLayout(std::uint64_t key, std::size_t size, const std::optional<ProgramLayout>& layout) {
+    LayoutCacheShard& shard = LayoutShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        *it->second = CachedLayout{key, size, layout};
+        shard.order.splice(shard.order.begin(), shard.order, it->second);
+        return;
+    }
+    shard.order.push_front(CachedLayout{key, size, layout});
+    shard.index[key] = shard.order.begin();
+    if (shard.order.size() > kLayoutCacheShardCapacity) {
+        shard.index.erase(shard.order.back().key);
+        shard.order.pop_back();
+    }
+}
+
+}  // namespace
+
+std::optional<std::size_t> ActorBaseRecordEnd(const std::vector<std::uint8_t>& p) {
+    if (p.size() < 13 || p[0] != 3u) {
+        return std::nullopt;
+    }
+    const std::uint32_t frames = mafia_save::ReadU32LE(p, 9);
+    std::size_t cur = 13;
+    for (std::uint32_t i = 0; i < frames; ++i) {
+        for (int s = 0; s < 3; ++s) {
+            if (cur + 2 > p.size()) {
+                return std::nullopt;
+            }
+            cur += 2u + ReadU16LE(p, cur);
+        }
+        cur += 40;
+        if (cur > p.size()) {
+            return std::nullopt;
+        }
+    }
+    return cur;
+}
+
+std::optional<ProgramLayout> TryParseProgramLayoutAt(const std::vector<std::uint8_t>& p, std::size_t base) {
+    if (base + kProgramHeaderSize > p.size() || p[base] != 2u) {
+        return std::nullopt;
+    }
+
+    ProgramLayout out;
+    out.baseOff = base;
+    out.regCount = ReadU16LE(p, base + 17);
+    out.varCount = mafia_save::ReadU32LE(p, base + 19);
+    out.frameCount = mafia_save::ReadU32LE(p, base + 23);
+    out.actorCount = mafia_save::ReadU32LE(p, base + 27);
+
+    if (out.regCount > 4096u || out.varCount > 8192u || out.frameCount > 2048u || out.actorCount > 2048u) {
+        return std::nullopt;
+    }
+
+    std::size_t cur = base + kProgramHeaderSize;
+    if (cur + (2u * static_cast<std::size_t>(out.regCount)) > p.size()) {
+        return std::nullopt;
+    }
+    cur += 2u * static_cast<std::size_t>(out.regCount);
+
+    out.varsOff = cur;
+    if (cur + (4u * static_cast<std::size_t>(out.varCount)) > p.size()) {
+        return std::nullopt;
+    }
+    cur += 4u * static_cast<std::size_t>(out.varCount);
+
+    for (std::uint32_t i = 0; i < out.actorCount; ++i) {
+        if (cur + 8 > p.size()) {
+            return std::nullopt;
+        }
+        const std::uint32_t nameLen = mafia_save::ReadU32LE(p, cur);
+        if (nameLen > kMaxRefNameLen) {
+            return std::nullopt;
+        }
+        cur += 8;
+        if (cur + static_cast<std::size_t>(nameLen) > p.size()) {
+            return std::nullopt;
+        }
+        cur += static_cast<std::size_t>(nameLen);
+    }
+
+    for (std::uint32_t i = 0; i < out.frameCount; ++i) {
+        if (cur + 2 > p.size()) {
+            return std::nullopt;
+        }
+        const std::uint16_t nameLen = ReadU16LE(p, cur);
+        cur += 2;
+        if (cur + static_cast<std::size_t>(nameLen) > p.size()) {
+            return std::nullopt;
+        }
+        cur += static_cast<std::size_t>(nameLen);
+    }
+
+    out.valid = true;
+    return out;
+}
+
+std::optional<ProgramLayout> DetectProgramLayout(const std::vector<std::uint8_t>& p) {
+    if (p.size() < kProgramHeaderSize) {
+        return std::nullopt;
+    }
+
+    const mafia_save::StatTimer timer(mafia_save::Stat::kDetectNs);
+    // Actor payloads: the owning actor writes its C_program right after the C_actor base record, so
+    // the byte there is either the program marker (2) or the subtype of a class without one. That check
+    // is cheap and every actor payload is different, so only the scanned segments go through the cache.
+    const auto anchor = ActorBaseRecordEnd(p);
+    if (anchor.has_value()) {
+        const int tag = (*anchor < p.size()) ? static_cast<int>(p[*anchor]) : -1;
+        std::optional<ProgramLayout> found;
+        if (tag == 2) {
+            mafia_save::AddStat(mafia_save::Stat::kProgramCandidates, 1);
+            found = TryParseProgramLayoutAt(p, *anchor);
+        }
+        if (!found.has_value() && tag != 6 && tag != 9) {
+            found = ScanProgramLayout(p);
+        }
+        return found;
+    }
+
+    const std::uint64_t key = HashBytes(p);
+    std::optional<ProgramLayout> cached;
+    if (FindCachedLayout(key, p.size(), &cached)) {
+        mafia_save::AddStat(mafia_save::Stat::kLayoutCacheHits, 1);
+        return cached;
+    }
+    mafia_save::AddStat(mafia_save::Stat::kLayoutCacheMisses, 1);
+
+    const auto found = ScanProgramLayout(p);
+    StoreCachedLayout(key, p.size(), found);
+    return found;
+}
+
+void ClearProgramLayoutCache() {
+    for (auto& shard : g_layoutCache) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.order.clear();
+        shard.index.clear();
+    }
+}
+
+bool IsProgramCandidateSegment(const mafia_save::SaveData& save, std::size_t segIdx) {
+    if (segIdx >= save.segments.size()) {
+        return false;
+    }
+    if (segIdx == save.idxGamePayload || segIdx == save.idxAiGroups || segIdx == save.idxAiFollow) {
+        return true;
+    }
+    const std::string& n = save.segments[segIdx].name;
+    return n.rfind("actor_payload_", 0) == 0 || n.rfind("actor_payload_clone", 0) == 0;
+}
+
+std::optional<ProgramLocation> DetectProgramInSave(const mafia_save::SaveData& save) {
+    std::optional<ProgramLocation> best;
+    for (std::size_t i = 0; i < save.segments.size(); ++i) {
+        if (!IsProgramCandidateSegment(save, i)) {
+            continue;
+        }
+        const auto prog = DetectProgramLayout(save.segments[i].plain);
+        if (!prog.has_value()) {
+            continue;
+        }
+
+        if (!best.has_value()) {
+            best = ProgramLocation{i, *prog};
+            continue;
+        }
+
+        const auto& b = best->layout;
+        const bool candHasVars = prog->varCount > 0u;
+        const bool bestHasVars = b.varCount > 0u;
+        if (candHasVars != bestHasVars) {
+            if (candHasVars) {
+                best = ProgramLocation{i, *prog};
+            }
+            continue;
+        }
+        if (prog->varCount != b.varCount) {
+            if (prog->varCount > b.varCount) {
+                best = ProgramLocation{i, *prog};
+            }
+            continue;
+        }
+        if (prog->actorCount != b.actorCount) {
+            if (prog->actorCount > b.actorCount) {
+                best = ProgramLocation{i, *prog};
+            }
+            continue;
+        }
+        if (prog->frameCount != b.frameCount) {
+            if (prog->frameCount > b.frameCount) {
+                best = ProgramLocation{i, *prog};
+            }
+            continue;
+        }
+        if (best->segIdx != save.idxGamePayload && i == save.idxGamePayload) {
+            best = ProgramLocation{i, *prog};
+        }
+    }
+    return best;
+}
+
+bool ReadProgramTables(const std::vector<std::uint8_t>& p, const ProgramLayout& layout, ProgramTables* out) {
+    if (out == nullptr || !layout.valid) {
+        return false;
+    }
+    ProgramTables tables;
+    std::size_t cur = layout.varsOff + 4u * static_cast<std::size_t>(layout.varCount);
+    tables.actors.reserve(layout.actorCount);
+    for (std::uint32_t i = 0; i < layout.actorCount; ++i) {
+        ActorRefChunk chunk;
+        if (!ReadActorRefChunk(p, cur, &chunk)) {
+            return false;
+        }
+        tables.actors.push_back(chunk);
+        cur += chunk.size();
+    }
+    tables.frames.reserve(layout.frameCount);
+    for (std::uint32_t i = 0; i < layout.frameCount; ++i) {
+        if (cur + 2 > p.size()) {
+            return false;
+        }
+        FrameRefChunk frame;
+        frame.offset = cur;
+        frame.nameLen = ReadU16LE(p, cur);
+        cur += 2;
+        if (cur + frame.nameLen > p.size()) {
+            return false;
+        }
+        cur += frame.nameLen;
+        tables.frames.push_back(frame);
+    }
+    tables.endOff = cur;
+    *out = std::move(tables);
+    return true;
+}
+
+bool ReadActorRefChunk(const std::vector<std::uint8_t>& p, std::size_t off, ActorRefChunk* out) {
+    if (out == nullptr || off + 8 > p.size()) {
+        return false;
+    }
+    const std::uint32_t nameLen = mafia_save::ReadU32LE(p, off);
+    if (nameLen > kMaxRefNameLen || off + 8 + static_cast<std::size_t>(nameLen) > p.size()) {
+        return false;
+    }
+    out->offset = off;
+    out->nameLen = nameLen;
+    out->actorType = mafia_save::ReadU32LE(p, off + 4);
+    return true;
+}
+
+bool IsHumanPayload(const std::vector<std::uint8_t>& p) {
+    return p.size() >= kHumanBlobOff + kHumanBlobSize && p[0] == 3u && p[kHumanBlobOff] == 6u;
+}
+
+bool ReadHumanUsedActorChunks(const std::vector<std::uint8_t>& p, ActorRefChunk* first, ActorRefChunk* second) {
+    ActorRefChunk* chunks[2] = {first, second};
+    std::size_t cursor = kHumanBlobOff + kHumanBlobSize;
+    for (ActorRefChunk* chunk : chunks) {
+        ActorRefChunk tmp;
+        if (!ReadActorRefChunk(p, cursor, &tmp)) {
+            return false;
+        }
+        if (chunk != nullptr) {
+            *chunk = tmp;
+        }
+        cursor += tmp.size();
+    }
+    return true;
+}
+
+bool FindHumanInventoryOffset(const std::vector<std::uint8_t>& p, std::size_t* outInvOff) {
+    if (outInvOff == nullptr) {
+        return false;
+    }
+    if (p.size() < kHumanBlobOff + kHumanBlobSize + 16 + kInventoryBlobSize) {
+        return false;
+    }
+    ActorRefChunk first;
+    ActorRefChunk second;
+    if (!ReadHumanUsedActorChunks(p, &first, &second)) {
+        return false;
+    }
+    const std::size_t cursor = second.offset + second.size();
+    if (cursor + kInventoryBlobSize > p.size()) {
+        return false;
+    }
+    *outInvOff = cursor;
+    return true;
+}
+
+CoordLayout DetectCoordLayout(const std::vector<std::uint8_t>& p) {
+    CoordLayout layout;
+    if (p.size() >= 13 && p[0] == 3u) {
+        layout.baseSupported = true;
+    }
+
+    if (p.size() >= 42 && p[0] == 3u && p[13] == 6u) {
+        layout.coordsSupported = true;
+        layout.dirSupported = true;
+        layout.animSupported = true;
+        layout.xOff = 14;
+        layout.yOff = 18;
+        layout.zOff = 22;
+        layout.dirXOff = 26;
+        layout.dirYOff = 30;
+        layout.dirZOff = 34;
+        layout.animIdOff = 38;
+        if (p.size() >= 66) {
+            layout.humanStateSupported = true;
+            layout.humanSeatOff = 46;
+            layout.humanCrouchOff = 50;
+            layout.humanAimOff = 51;
+            layout.humanShootXOff = 54;
+            layout.humanShootYOff = 58;
+            layout.humanShootZOff = 62;
+        }
+        if (p.size() >= (kHumanMaxHealthOff + 4)) {
+            layout.humanHealthSupported = true;
+            layout.humanHpCurrentOff = kHumanCurrentHealthOff;
+            layout.humanHpMaxOff = kHumanMaxHealthOff;
+        }
+        if (p.size() >= (kHumanPropsInitOff + 64)) {
+            layout.humanPropsSupported = true;
+            layout.humanPropsCurrentOff = kHumanPropsCurrentOff;
+            layout.humanPropsInitOff = kHumanPropsInitOff;
+        }
+        std::size_t invOff = 0;
+        if (FindHumanInventoryOffset(p, &invOff)) {
+            layout.humanInventorySupported = true;
+            layout.humanInventoryOff = invOff;
+        }
+        layout.hint = "Payload: marker=3, subtype=6 (human/player)";
+        return layout;
+    }
+
+    if (p.size() >= 18 && p[0] == 3u && p[13] == 9u) {
+        if (p.size() >= 49) {
+            layout.coordsSupported = true;
+            layout.quatSupported = true;
+            layout.xOff = 21;
+            layout.yOff = 25;
+            layout.zOff = 29;
+            layout.quatWOff = 33;
+            layout.quatXOff = 37;
+            layout.quatYOff = 41;
+            layout.quatZOff = 45;
+            if (p.size() > 308) {
+                layout.carStateSupported = true;
+                layout.carFuelOff = 304;
+                layout.carFlowOff = 211;
+                layout.carEngNormOff = 137;
+                layout.carEngCalcOff = 141;
+            }
+            if (p.size() >= 253) {
+                layout.carDriveSupported = true;
+                layout.carSpeedLimitOff = 215;
+                layout.carLastGearOff = 245;
+                layout.carGearOff = 249;
+            }
+            if (p.size() >= 304) {
+                layout.carEngineFlagsSupported = true;
+                layout.carGearboxFlagOff = 273;
+                layout.carDisableEngineOff = 277;
+                layout.carEngineOnOff = 298;
+                layout.carIsEngineOnOff = 303;
+            }
+            if (p.size() >= 349) {
+                layout.carOdometerSupported = true;
+                layout.carOdometerOff = 345;
+            }
+            layout.hint = "Payload: marker=3, subtype=9 (car mapped)";
+            return layout;
+        }
+        layout.hint = "Payload: marker=3, subtype=9 (car, partial mapping)";
+        return layout;
+    }
+
+    if (layout.baseSupported) {
+        layout.hint = "Payload: marker=3 (base fields available)";
+        return layout;
+    }
+    layout.hint = "Payload: unknown format";
+    return layout;
+}
+
+}  // namespace save_layout
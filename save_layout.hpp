@@ -0,0 +1,146 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace save_layout {
+
+// C_game::SaveGameSave fixed header at the start of game_payload.
+constexpr std::size_t kGameHeaderSize = 67;
+
+// C_human::SaveGameSave: 13-byte C_actor base, 382-byte human blob, two actor-ref chunks, inventory.
+constexpr std::size_t kHumanBlobOff = 13;
+constexpr std::size_t kHumanBlobSize = 382;
+constexpr std::size_t kHumanPropsCurrentOff = kHumanBlobOff + 229;
+constexpr std::size_t kHumanPropsInitOff = kHumanBlobOff + 293;
+constexpr std::size_t kHumanCurrentHealthOff = kHumanPropsCurrentOff + 4;
+constexpr std::size_t kHumanMaxHealthOff = kHumanPropsInitOff + 4;
+constexpr std::size_t kInventoryBlobSize = 196;
+
+// info264 garage: 25 primary dwords at +40, 25 secondary dwords at +140.
+constexpr std::size_t kGarageSlotCount = 25;
+constexpr std::size_t kGaragePrimaryOff = 40;
+constexpr std::size_t kGarageSecondaryOff = 140;
+
+// C_program::SaveGameSave fixed header (marker 2 .. m_bUnk2 + 1).
+constexpr std::size_t kProgramHeaderSize = 39;
+
+// Field offsets inside an actor payload, by payload subtype (6 = human, 9 = car).
+struct CoordLayout {
+    bool baseSupported = false;
+    bool coordsSupported = false;
+    bool dirSupported = false;
+    bool animSupported = false;
+    bool quatSupported = false;
+    bool carStateSupported = false;
+    bool carDriveSupported = false;
+    bool carEngineFlagsSupported = false;
+    bool carOdometerSupported = false;
+    bool humanStateSupported = false;
+    bool humanHealthSupported = false;
+    bool humanPropsSupported = false;
+    bool humanInventorySupported = false;
+    std::size_t stateOff = 1;
+    std::size_t idOff = 2;
+    std::size_t activeOff = 6;
+    std::size_t removeOff = 7;
+    std::size_t frameOff = 8;
+    std::size_t xOff = 0;
+    std::size_t yOff = 0;
+    std::size_t zOff = 0;
+    std::size_t dirXOff = 0;
+    std::size_t dirYOff = 0;
+    std::size_t dirZOff = 0;
+    std::size_t animIdOff = 0;
+    std::size_t quatWOff = 0;
+    std::size_t quatXOff = 0;
+    std::size_t quatYOff = 0;
+    std::size_t quatZOff = 0;
+    std::size_t carFuelOff = 0;
+    std::size_t carFlowOff = 0;
+    std::size_t carEngNormOff = 0;
+    std::size_t carEngCalcOff = 0;
+    std::size_t carSpeedLimitOff = 0;
+    std::size_t carLastGearOff = 0;
+    std::size_t carGearOff = 0;
+    std::size_t carGearboxFlagOff = 0;
+    std::size_t carDisableEngineOff = 0;
+    std::size_t carEngineOnOff = 0;
+    std::size_t carIsEngineOnOff = 0;
+    std::size_t carOdometerOff = 0;
+    std::size_t humanSeatOff = 0;
+    std::size_t humanCrouchOff = 0;
+    std::size_t humanAimOff = 0;
+    std::size_t humanShootXOff = 0;
+    std::size_t humanShootYOff = 0;
+    std::size_t humanShootZOff = 0;
+    std::size_t humanPropsCurrentOff = 0;
+    std::size_t humanPropsInitOff = 0;
+    std::size_t humanHpCurrentOff = 0;
+    std::size_t humanHpMaxOff = 0;
+    std::size_t humanInventoryOff = 0;
+    std::string hint;
+};
+
+struct ProgramLayout {
+    bool valid = false;
+    std::size_t baseOff = 0;
+    std::size_t varsOff = 0;
+    std::uint16_t regCount = 0;
+    std::uint32_t varCount = 0;
+    std::uint32_t frameCount = 0;
+    std::uint32_t actorCount = 0;
+};
+
+struct ProgramLocation {
+    std::size_t segIdx = mafia_save::kNoIndex;
+    ProgramLayout layout;
+};
+
+// C_actor::Actor_SaveGameSave record: u32 nameLen (incl. NUL, 0 = none), u32 actor type, name bytes.
+struct ActorRefChunk {
+    std::size_t offset = 0;
+    std::uint32_t nameLen = 0;
+    std::uint32_t actorType = 0;
+    std::size_t size() const { return 8u + static_cast<std::size_t>(nameLen); }
+};
+
+// u16 nameLen (incl. NUL, 0 = none) followed by the frame name.
+struct FrameRefChunk {
+    std::size_t offset = 0;
+    std::uint16_t nameLen = 0;
+};
+
+struct ProgramTables {
+    std::vector<ActorRefChunk> actors;
+    std::vector<FrameRefChunk> frames;
+    std::size_t endOff = 0;
+};
+
+std::optional<ProgramLayout> TryParseProgramLayoutAt(const std::vector<std::uint8_t>& p, std::size_t base);
+std::optional<ProgramLayout> DetectProgramLayout(const std::vector<std::uint8_t>& p);
+// DetectProgramLayout keeps results for segments without an actor base record (game_payload, AI
+// groups) in a sharded LRU keyed by segment hash and size (1024 entries); this forgets them
+// (cold-path measurements).
+void ClearProgramLayoutCache();
+bool IsProgramCandidateSegment(const mafia_save::SaveData& save, std::size_t segIdx);
+std::optional<ProgramLocation> DetectProgramInSave(const mafia_save::SaveData& save);
+bool ReadProgramTables(const std::vector<std::uint8_t>& p, const ProgramLayout& layout, ProgramTables* out);
+
+// End of the C_actor::SaveGameSave base record: 13 fixed bytes, then u32 count at +9 of car-frame
+// entries (3 x [u16 len, text], 12 + 12 + 16 bytes of transform). The payload subtype byte follows.
+std::optional<std::size_t> ActorBaseRecordEnd(const std::vector<std::uint8_t>& p);
+bool ReadActorRefChunk(const std::vector<std::uint8_t>& p, std::size_t off, ActorRefChunk* out);
+bool IsHumanPayload(const std::vector<std::uint8_t>& p);
+// Offsets of the m_pUsedActor / m_pUsedActor2 chunks that precede the human inventory.
+bool ReadHumanUsedActorChunks(const std::vector<std::uint8_t>& p, ActorRefChunk* first, ActorRefChunk* second);
+bool FindHumanInventoryOffset(const std::vector<std::uint8_t>& p, std::size_t* outInvOff);
+
+CoordLayout DetectCoordLayout(const std::vector<std::uint8_t>& payload);
+
+}  // namespace save_layout
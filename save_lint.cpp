@@ -0,0 +1,296 @@
+#include "save_lint.hpp"
+
+#include "gvas.hpp"
+#include "save_index.hpp"
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+namespace save_lint {
+
+namespace {
+
+constexpr std::uint32_t kActorTypeHuman = 2;
+constexpr std::uint32_t kActorTypeCar = 4;
+constexpr std::uint8_t kPayloadMarker = 3;
+constexpr std::uint8_t kSubtypeHuman = 6;
+constexpr std::uint8_t kSubtypeCar = 9;
+constexpr std::uint32_t kHeadMagic = 0x47766153u;  // "SavG"
+constexpr std::uint32_t kHeadVersion = 0x10u;
+constexpr std::uint32_t kHeadMissionBias = 5000u;
+
+class Collector {
+public:
+    explicit Collector(FileReport* report) : report_(report) {}
+
+    void Add(Severity severity, const char* code, std::string segment, std::size_t offset, std::string message) {
+        Finding f;
+        f.severity = severity;
+        f.code = code;
+        f.segment = std::move(segment);
+        f.offset = offset;
+        f.message = std::move(message);
+        ++(severity == Severity::kError ? report_->errors : report_->warnings);
+        report_->findings.push_back(std::move(f));
+    }
+    void Error(const char* code, std::string segment, std::size_t offset, std::string message) {
+        Add(Severity::kError, code, std::move(segment), offset, std::move(message));
+    }
+    void Warn(const char* code, std::string segment, std::size_t offset, std::string message) {
+        Add(Severity::kWarning, code, std::move(segment), offset, std::move(message));
+    }
+
+private:
+    FileReport* report_;
+};
+
+// "mafiaNNN.MMM" -> MMM; -1 for other names.
+int SlotFromName(const fs::path& name) {
+    const std::string s = mafia_save::Lower(name.filename().string());
+    const std::size_t dot = s.find('.');
+    if (s.rfind("mafia", 0) != 0 || dot == std::string::npos || dot == 5 || dot + 1 >= s.size() ||
+        s.size() - dot - 1 > 5) {
+        return -1;
+    }
+    int slot = 0;
+    for (std::size_t i = dot + 1; i < s.size(); ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(s[i]))) {
+            return -1;
+        }
+        slot = slot * 10 + (s[i] - '0');
+    }
+    return slot;
+}
+
+void LintHeader(const fs::path& name, const mafia_save::SaveData& save, std::uint16_t mission, Collector* c) {
+    const auto& head = save.segments[save.idxHead].plain;
+    if (mafia_save::ReadU32LE(head, 0) != kHeadMagic || mafia_save::ReadU32LE(head, 4) != kHeadVersion ||
+        mafia_save::ReadU32LE(head, 8) != mission || mafia_save::ReadU32LE(head, 12) != 0 ||
+        mafia_save::ReadU32LE(head, 16) != 0 || mafia_save::ReadU32LE(head, 20) != kHeadMissionBias + mission) {
+        c->Error("head24", "head24", 0,
+                 "expected SavG, 0x10, " + std::to_string(mission) + ", 0, 0, " +
+                     std::to_string(kHeadMissionBias + mission));
+    }
+    mafia_save::MetaFields meta;
+    if (!mafia_save::ReadMetaFields(save, &meta)) {
+        return;
+    }
+    if (meta.slot != mission) {
+        c->Error("slot-mismatch", "meta32", 0,
+                 "slot " + std::to_string(meta.slot) + ", GvaS header mission " + std::to_string(mission));
+    }
+    const int fileSlot = SlotFromName(name);
+    if (fileSlot >= 0 && static_cast<std::uint32_t>(fileSlot) != meta.slot) {
+        c->Warn("file-slot", "", 0,
+                "file name slot " + std::to_string(fileSlot) + ", meta32 slot " + std::to_string(meta.slot));
+    }
+    if (save.segments[save.idxGamePayload].plain.size() < save_layout::kGameHeaderSize) {
+        c->Error("game-header", "game_payload", 0,
+                 "game_payload is " + std::to_string(save.segments[save.idxGamePayload].plain.size()) +
+                     " bytes, the C_game header needs " + std::to_string(save_layout::kGameHeaderSize));
+    }
+}
+
+// C_human::SaveGameGetSize: C_actor base + 382 + two Actor_SaveGameGetSize chunks + G_Inventory (196).
+void LintPayload(const std::string& seg, std::uint32_t type, const std::vector<std::uint8_t>& p, Collector* c) {
+    if (p.empty()) {
+        return;
+    }
+    if (p[0] != kPayloadMarker) {
+        c->Error("payload-marker", seg, 0, "marker " + std::to_string(p[0]) + ", expected 3");
+        return;
+    }
+    const auto baseEnd = save_layout::ActorBaseRecordEnd(p);
+    if (!baseEnd.has_value()) {
+        c->Error("payload-base", seg, 9, "C_actor base record runs past the payload");
+        return;
+    }
+    if (type != kActorTypeHuman && type != kActorTypeCar) {
+        return;
+    }
+    const std::uint8_t want = type == kActorTypeHuman ? kSubtypeHuman : kSubtypeCar;
+    if (*baseEnd >= p.size() || p[*baseEnd] != want) {
+        c->Error("payload-subtype", seg, *baseEnd,
+                 "actor type " + std::to_string(type) + " needs payload subtype " + std::to_string(want) +
+                     (*baseEnd < p.size() ? ", found " + std::to_string(p[*baseEnd]) : ", payload ends"));
+        return;
+    }
+    if (type != kActorTypeHuman) {
+        return;
+    }
+    save_layout::ActorRefChunk first;
+    save_layout::ActorRefChunk second;
+    if (!save_layout::ReadHumanUsedActorChunks(p, &first, &second)) {
+        c->Error("payload-size", seg, save_layout::kHumanBlobOff + save_layout::kHumanBlobSize,
+                 "human payload ends inside the used-actor chunks");
+        return;
+    }
+    const std::size_t need = second.offset + second.size() + save_layout::kInventoryBlobSize;
+    if (p.size() < need) {
+        c->Error("payload-size", seg, 0,
+                 "human payload is " + std::to_string(p.size()) + " bytes, C_human::SaveGameGetSize needs " +
+                     std::to_string(need));
+    }
+}
+
+void LintActors(const mafia_save::SaveData& save, Collector* c) {
+    std::unordered_map<std::string, std::size_t> seen;
+    bool tommy = false;
+    for (std::size_t i = 0; i + 1 < save.segments.size(); ++i) {
+        const auto& hdr = save.segments[i];
+        if (hdr.name.rfind("actor_header_", 0) != 0) {
+            continue;
+        }
+        const std::string name = mafia_save::ReadCStr(hdr.plain, 0, 64);
+        const std::string model = mafia_save::ReadCStr(hdr.plain, 64, 64);
+        const std::uint32_t type = mafia_save::ReadU32LE(hdr.plain, 128);
+        if (name.empty()) {
+            c->Warn("actor-name-empty", hdr.name, 0, "SaveGameLoad matches actors by name; this one is skipped");
+        } else {
+            const auto [it, fresh] = seen.emplace(name, i);
+            if (!fresh) {
+                c->Error("actor-name-duplicate", hdr.name, 0,
+                         "\"" + name + "\" already used by " + save.segments[it->second].name);
+            }
+        }
+        if (name == "Tommy") {
+            tommy = true;
+            if (type != kActorTypeHuman) {
+                c->Error("tommy-type", hdr.name, 128, "Tommy has type " + std::to_string(type) + ", expected 2");
+            }
+            if (model.empty()) {
+                c->Error("tommy-model", hdr.name, 64, "Tommy has no model");
+            }
+        }
+        LintPayload(save.segments[i + 1].name, type, save.segments[i + 1].plain, c);
+    }
+    if (!tommy) {
+        c->Error("tommy-missing", "", 0, "no actor named Tommy");
+    }
+}
+
+bool IsCandidate(const fs::path& path) {
+    if (SlotFromName(path) >= 0) {
+        return true;
+    }
+    const auto head = mafia_save::ReadFilePrefix(path, 4);
+    return head.size() == 4 && std::memcmp(head.data(), "GvaS", 4) == 0;
+}
+
+struct InputFile {
+    fs::path path;
+    fs::path rel;
+};
+
+void CollectInputs(const fs::path& input, std::vector<InputFile>* out) {
+    std::error_code ec;
+    if (!fs::is_directory(input, ec)) {
+        out->push_back(InputFile{input, input.filename()});
+        return;
+    }
+    std::vector<fs::path> found;
+    save_index::CollectFiles(input, IsCandidate, &found);
+    for (const auto& f : found) {
+        out->push_back(InputFile{f, f.lexically_relative(input)});
+    }
+}
+
+}  // namespace
+
+const char* SeverityName(Severity severity) {
+    return severity == Severity::kError ? "error" : "warning";
+}
+
+void LintBytes(const fs::path& name, const std::vector<std::uint8_t>& raw, FileReport* out) {
+    out->size = raw.size();
+    Collector c(out);
+    if (raw.empty()) {
+        c.Error("read", "", 0, "empty or unreadable file");
+        return;
+    }
+    gvas::Header header;
+    std::string err;
+    if (!gvas::ReadHeader(raw, &header, &err)) {
+        c.Error("gvas-header", "", 0, err);
+        return;
+    }
+    const bool checksOk = gvas::ValidateMissionChecks(header, &err);
+    if (!checksOk) {
+        c.Error("mission-checks", "", 0x20, err);
+    }
+    mafia_save::SaveData save;
+    if (!mafia_save::ParseSave(raw, &save, &err)) {
+        c.Error("structure", "", 0, err);
+        return;
+    }
+    if (checksOk) {
+        LintHeader(name, save, gvas::DecodeMission(header), &c);
+    }
+    LintActors(save, &c);
+}
+
+bool Lint(const std::vector<fs::path>& inputs,
+          const LintOptions& options,
+          std::vector<FileReport>* out,
+          LintSummary* summary,
+          std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output reports";
+        }
+        return false;
+    }
+    std::vector<InputFile> files;
+    for (const fs::path& input : inputs) {
+        std::error_code ec;
+        if (!fs::exists(input, ec)) {
+            if (error != nullptr) {
+                *error = "not found: " + input.string();
+            }
+            return false;
+        }
+        CollectInputs(input, &files);
+    }
+
+    const unsigned threads = work_pool::ResolveThreads(options.threads, files.size());
+    std::vector<FileReport> reports(files.size());
+    work_pool::ParallelFor(files.size(), threads, [&](unsigned, std::size_t i) {
+        reports[i].path = files[i].rel;
+        LintBytes(files[i].path, mafia_save::ReadFileBytes(files[i].path), &reports[i]);
+    });
+
+    LintSummary s;
+    s.files = reports.size();
+    s.threads = threads;
+    for (const FileReport& r : reports) {
+        s.bytes += r.size;
+        if (r.errors > 0) {
+            ++s.withErrors;
+        } else if (r.warnings > 0) {
+            ++s.withWarnings;
+        } else {
+            ++s.clean;
+        }
+    }
+    *out = std::move(reports);
+    if (summary != nullptr) {
+        *summary = s;
+    }
+    return true;
+}
+
+void WriteNdjson(std::ostream& out, const FileReport& report) {
+    const std::string path = mafia_save::JsonEscape(report.path.generic_string());
+    for (const Finding& f : report.findings) {
+        out << "{\"path\":\"" << path << "\",\"severity\":\"" << SeverityName(f.severity) << "\",\"code\":\"" << f.code
+            << "\",\"segment\":\"" << f.segment << "\",\"offset\":" << f.offset << ",\"message\":\""
+            << mafia_save::JsonEscape(f.message) << "\"}\n";
+    }
+}
+
+}  // namespace save_lint
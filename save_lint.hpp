@@ -0,0 +1,75 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace save_lint {
+
+namespace fs = std::filesystem;
+
+enum class Severity : std::uint8_t { kWarning, kError };
+
+// One finding. Codes (error unless noted):
+//   read, gvas-header, mission-checks    file unreadable, GvaS header / gvas::ValidateMissionChecks
+//   structure                            ParseSave failure: info264 sizes vs segments, trailing bytes
+//   head24                               plaintext is not "SavG", 0x10, mission, 0, 0, 5000 + mission
+//   slot-mismatch                        meta32 slot differs from the d0 mission id
+//   file-slot (warning)                  mafiaNNN.MMM extension differs from the meta32 slot
+//   game-header                          game_payload shorter than the C_game header
+//   tommy-missing, tommy-type, tommy-model   REVERSE_NOTES 7-8: Tommy must exist, type 2, model set
+//   actor-name-empty (warning), actor-name-duplicate
+//   payload-marker, payload-base         C_actor base record (marker 3, car-frame list) does not parse
+//   payload-subtype                      type 2 without the human subtype 6, type 4 without car subtype 9
+//   payload-size                         human payload shorter than C_human::SaveGameGetSize
+struct Finding {
+    Severity severity = Severity::kError;
+    std::string code;
+    std::string segment;  // empty: whole file
+    std::size_t offset = 0;
+    std::string message;
+};
+
+struct FileReport {
+    fs::path path;  // relative to the input directory
+    std::uint64_t size = 0;
+    std::size_t errors = 0;
+    std::size_t warnings = 0;
+    std::vector<Finding> findings;
+};
+
+// Checks bytes already in memory; `name` is only used for the file-slot check.
+void LintBytes(const fs::path& name, const std::vector<std::uint8_t>& raw, FileReport* out);
+
+struct LintOptions {
+    unsigned threads = 0;  // 0 = hardware concurrency
+};
+
+struct LintSummary {
+    std::size_t files = 0;
+    std::size_t clean = 0;
+    std::size_t withErrors = 0;
+    std::size_t withWarnings = 0;  // warnings only
+    std::uint64_t bytes = 0;
+    unsigned threads = 0;
+};
+
+// Inputs are save files or directories (recursive, mafia*.??? names and GvaS files, .mafia_* entries
+// skipped). Reports follow the sorted input order.
+bool Lint(const std::vector<fs::path>& inputs,
+          const LintOptions& options,
+          std::vector<FileReport>* out,
+          LintSummary* summary = nullptr,
+          std::string* error = nullptr);
+
+const char* SeverityName(Severity severity);
+
+// {"path":..,"severity":..,"code":..,"segment":..,"offset":..,"message":..} per finding.
+void WriteNdjson(std::ostream& out, const FileReport& report);
+
+}  // namespace save_lint
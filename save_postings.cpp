@@ -0,0 +1,465 @@
+#include "save_postings.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <map>
+
+namespace save_postings {
+
+namespace {
+
+constexpr char kMagic[4] = {'M', 'S', 'P', 'X'};
+constexpr std::size_t kBloomBitsPerTerm = 10;
+constexpr std::uint32_t kBloomHashes = 7;
+
+#pragma pack(push, 1)
+struct FileHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t fingerprint;
+    std::uint32_t docCount;
+    std::uint32_t termCount;
+    std::uint32_t bloomWords;
+    std::uint32_t bloomHashes;
+    std::uint64_t postingsSize;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FileHeader) == 40, "postings header layout");
+
+std::uint64_t HashString(const std::string& s, std::uint64_t seed = 1469598103934665603ull) {
+    std::uint64_t h = seed;
+    for (unsigned char ch : s) {
+        h = (h ^ ch) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Double hashing: bit i = h1 + i * h2.
+void BloomBits(const std::string& term, std::size_t bitCount, std::uint32_t hashes, std::vector<std::size_t>* out) {
+    const std::uint64_t h = HashString(term);
+    const std::uint64_t h1 = h & 0xFFFFFFFFull;
+    const std::uint64_t h2 = (h >> 32) | 1u;
+    out->clear();
+    for (std::uint32_t i = 0; i < hashes; ++i) {
+        out->push_back(static_cast<std::size_t>((h1 + i * h2) % bitCount));
+    }
+}
+
+void PutVarint(std::vector<std::uint8_t>* out, std::uint32_t v) {
+    while (v >= 0x80u) {
+        out->push_back(static_cast<std::uint8_t>(v | 0x80u));
+        v >>= 7;
+    }
+    out->push_back(static_cast<std::uint8_t>(v));
+}
+
+template <typename T>
+void Append(std::vector<std::uint8_t>* out, const T* data, std::size_t count) {
+    const auto* p = reinterpret_cast<const std::uint8_t*>(data);
+    out->insert(out->end(), p, p + count * sizeof(T));
+}
+
+template <typename T>
+bool Take(const std::vector<std::uint8_t>& in, std::size_t* pos, T* data, std::size_t count) {
+    const std::size_t bytes = count * sizeof(T);
+    if (count != 0 && (in.size() - *pos) / sizeof(T) < count) {
+        return false;
+    }
+    if (bytes != 0) {
+        std::memcpy(data, in.data() + *pos, bytes);
+    }
+    *pos += bytes;
+    return true;
+}
+
+void AppendString(std::vector<std::uint8_t>* out, const std::string& s) {
+    const std::uint32_t len = static_cast<std::uint32_t>(s.size());
+    Append(out, &len, 1);
+    out->insert(out->end(), s.begin(), s.end());
+}
+
+bool TakeString(const std::vector<std::uint8_t>& in, std::size_t* pos, std::string* s) {
+    std::uint32_t len = 0;
+    if (!Take(in, pos, &len, 1) || in.size() - *pos < len) {
+        return false;
+    }
+    s->assign(reinterpret_cast<const char*>(in.data() + *pos), len);
+    *pos += len;
+    return true;
+}
+
+std::vector<std::uint32_t> Intersect(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+    std::vector<std::uint32_t> out;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+    return out;
+}
+
+std::vector<std::uint32_t> Union(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+    std::vector<std::uint32_t> out;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+    return out;
+}
+
+// Recursive descent: or := and ("OR" and)*, and := primary (["AND"] primary)*, primary := term | "(" or ")".
+class QueryParser {
+public:
+    QueryParser(const PostingIndex& postings, const std::string& text, QueryStats* stats)
+        : postings_(postings), stats_(stats) {
+        std::string cur;
+        const auto flush = [&]() {
+            if (!cur.empty()) {
+                tokens_.push_back(cur);
+                cur.clear();
+            }
+        };
+        for (char ch : text) {
+            if (ch == '(' || ch == ')') {
+                flush();
+                tokens_.emplace_back(1, ch);
+            } else if (std::isspace(static_cast<unsigned char>(ch))) {
+                flush();
+            } else {
+                cur += ch;
+            }
+        }
+        flush();
+    }
+
+    bool Parse(std::vector<std::uint32_t>* out, std::string* error) {
+        if (tokens_.empty()) {
+            error_ = "empty query";
+        } else {
+            *out = ParseOr();
+            if (error_.empty() && pos_ != tokens_.size()) {
+                error_ = "unexpected '" + tokens_[pos_] + "'";
+            }
+        }
+        if (!error_.empty()) {
+            if (error != nullptr) {
+                *error = error_;
+            }
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool IsKeyword(const char* word) const {
+        return pos_ < tokens_.size() && mafia_save::Lower(tokens_[pos_]) == word;
+    }
+
+    std::vector<std::uint32_t> ParseOr() {
+        auto acc = ParseAnd();
+        while (error_.empty() && IsKeyword("or")) {
+            ++pos_;
+            acc = Union(acc, ParseAnd());
+        }
+        return acc;
+    }
+
+    std::vector<std::uint32_t> ParseAnd() {
+        auto acc = ParsePrimary();
+        while (error_.empty() && pos_ < tokens_.size() && tokens_[pos_] != ")" && !IsKeyword("or")) {
+            if (IsKeyword("and")) {
+                ++pos_;
+            }
+            acc = Intersect(acc, ParsePrimary());
+        }
+        return acc;
+    }
+
+    std::vector<std::uint32_t> ParsePrimary() {
+        if (pos_ >= tokens_.size()) {
+            error_ = "query ends early";
+            return {};
+        }
+        const std::string tok = tokens_[pos_++];
+        if (tok == "(") {
+            auto inner = ParseOr();
+            if (error_.empty() && (pos_ >= tokens_.size() || tokens_[pos_] != ")")) {
+                error_ = "missing ')'";
+            }
+            ++pos_;
+            return inner;
+        }
+        if (tok == ")" || mafia_save::Lower(tok) == "and" || mafia_save::Lower(tok) == "or") {
+            error_ = "unexpected '" + tok + "'";
+            return {};
+        }
+        const std::string term = NormalizeTerm(tok);
+        if (stats_ != nullptr) {
+            ++stats_->terms;
+        }
+        if (!MayContain(postings_, term)) {
+            if (stats_ != nullptr) {
+                ++stats_->bloomRejects;
+            }
+            return {};
+        }
+        return Lookup(postings_, term);
+    }
+
+    const PostingIndex& postings_;
+    QueryStats* stats_;
+    std::vector<std::string> tokens_;
+    std::size_t pos_ = 0;
+    std::string error_;
+};
+
+}  // namespace
+
+std::uint64_t Fingerprint(const save_index::Index& index) {
+    std::uint64_t h = 1469598103934665603ull;
+    for (const auto& e : index.entries) {
+        if (!e.parsed) {
+            continue;
+        }
+        h = HashString(e.path.generic_string(), h);
+        h = (h ^ e.hash) * 1099511628211ull;
+    }
+    return h;
+}
+
+PostingIndex Build(const save_index::Index& index) {
+    std::map<std::string, std::vector<std::uint32_t>> lists;
+    PostingIndex out;
+    out.fingerprint = Fingerprint(index);
+    for (const auto& e : index.entries) {
+        if (!e.parsed) {
+            continue;
+        }
+        const auto doc = static_cast<std::uint32_t>(out.docs.size());
+        out.docs.push_back(e.path.generic_string());
+        for (const auto& a : e.actors) {
+            for (const auto& term : {"name:" + mafia_save::Lower(a.name), "model:" + mafia_save::Lower(a.model), "type:" + std::to_string(a.type)}) {
+                auto& list = lists[term];
+                if (list.empty() || list.back() != doc) {
+                    list.push_back(doc);
+                }
+            }
+        }
+    }
+
+    out.terms.reserve(lists.size());
+    out.postingOffsets.reserve(lists.size() + 1);
+    for (const auto& kv : lists) {
+        out.terms.push_back(kv.first);
+        out.postingOffsets.push_back(static_cast<std::uint32_t>(out.postings.size()));
+        std::uint32_t prev = 0;
+        for (const auto doc : kv.second) {
+            PutVarint(&out.postings, doc - prev);
+            prev = doc;
+        }
+    }
+    out.postingOffsets.push_back(static_cast<std::uint32_t>(out.postings.size()));
+
+    const std::size_t bits = std::max<std::size_t>(64, out.terms.size() * kBloomBitsPerTerm);
+    out.bloom.assign((bits + 63) / 64, 0);
+    out.bloomHashes = kBloomHashes;
+    std::vector<std::size_t> positions;
+    for (const auto& term : out.terms) {
+        BloomBits(term, out.bloom.size() * 64, out.bloomHashes, &positions);
+        for (const auto bit : positions) {
+            out.bloom[bit / 64] |= 1ull << (bit % 64);
+        }
+    }
+    return out;
+}
+
+fs::path DefaultPostingsPath(const fs::path& root) {
+    return root / kDefaultPostingsName;
+}
+
+bool LoadPostings(const fs::path& file, PostingIndex* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output postings";
+        }
+        return false;
+    }
+    const auto bytes = mafia_save::ReadFileBytes(file);
+    FileHeader header{};
+    std::size_t pos = 0;
+    if (!Take(bytes, &pos, &header, 1) || std::memcmp(header.magic, kMagic, 4) != 0 ||
+        header.version != kPostingsVersion) {
+        if (error != nullptr) {
+            *error = "not a postings file (or older version): " + file.string();
+        }
+        return false;
+    }
+
+    PostingIndex p;
+    p.fingerprint = header.fingerprint;
+    p.bloomHashes = header.bloomHashes;
+    bool ok = header.docCount <= bytes.size() && header.termCount <= bytes.size() &&
+              header.postingsSize <= bytes.size() && header.bloomWords <= bytes.size();
+    if (ok) {
+        p.docs.resize(header.docCount);
+        p.terms.resize(header.termCount);
+        p.postingOffsets.resize(static_cast<std::size_t>(header.termCount) + 1);
+        p.postings.resize(static_cast<std::size_t>(header.postingsSize));
+        p.bloom.resize(header.bloomWords);
+        for (auto& d : p.docs) {
+            ok = ok && TakeString(bytes, &pos, &d);
+        }
+        for (auto& t : p.terms) {
+            ok = ok && TakeString(bytes, &pos, &t);
+        }
+        ok = ok && Take(bytes, &pos, p.postingOffsets.data(), p.postingOffsets.size()) &&
+             Take(bytes, &pos, p.postings.data(), p.postings.size()) &&
+             Take(bytes, &pos, p.bloom.data(), p.bloom.size()) && pos == bytes.size() && !p.bloom.empty() &&
+             p.postingOffsets.front() == 0 && p.postingOffsets.back() == p.postings.size();
+        // Lookups binary-search the terms and slice postings between neighbouring offsets.
+        ok = ok && std::is_sorted(p.postingOffsets.begin(), p.postingOffsets.end()) &&
+             std::adjacent_find(p.terms.begin(), p.terms.end(), [](const std::string& a, const std::string& b) {
+                 return !(a < b);
+             }) == p.terms.end();
+    }
+    if (!ok) {
+        if (error != nullptr) {
+            *error = "corrupt postings file: " + file.string();
+        }
+        return false;
+    }
+    *out = std::move(p);
+    return true;
+}
+
+bool WritePostings(const PostingIndex& postings, const fs::path& file, std::string* error) {
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, 4);
+    header.version = kPostingsVersion;
+    header.fingerprint = postings.fingerprint;
+    header.docCount = static_cast<std::uint32_t>(postings.docs.size());
+    header.termCount = static_cast<std::uint32_t>(postings.terms.size());
+    header.bloomWords = static_cast<std::uint32_t>(postings.bloom.size());
+    header.bloomHashes = postings.bloomHashes;
+    header.postingsSize = postings.postings.size();
+
+    std::vector<std::uint8_t> bytes;
+    Append(&bytes, &header, 1);
+    for (const auto& d : postings.docs) {
+        AppendString(&bytes, d);
+    }
+    for (const auto& t : postings.terms) {
+        AppendString(&bytes, t);
+    }
+    Append(&bytes, postings.postingOffsets.data(), postings.postingOffsets.size());
+    Append(&bytes, postings.postings.data(), postings.postings.size());
+    Append(&bytes, postings.bloom.data(), postings.bloom.size());
+
+    return mafia_save::WriteFileBytesAtomic(file, bytes, error);
+}
+
+bool OpenPostings(const fs::path& root,
+                  const save_index::Index& index,
+                  PostingIndex* out,
+                  bool* rebuilt,
+                  std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output postings";
+        }
+        return false;
+    }
+    const fs::path file = DefaultPostingsPath(root);
+    const std::uint64_t fingerprint = Fingerprint(index);
+    std::error_code ec;
+    PostingIndex loaded;
+    if (fs::is_regular_file(file, ec) && LoadPostings(file, &loaded) && loaded.fingerprint == fingerprint) {
+        *out = std::move(loaded);
+        if (rebuilt != nullptr) {
+            *rebuilt = false;
+        }
+        return true;
+    }
+    PostingIndex fresh = Build(index);
+    if (!WritePostings(fresh, file, error)) {
+        return false;
+    }
+    *out = std::move(fresh);
+    if (rebuilt != nullptr) {
+        *rebuilt = true;
+    }
+    return true;
+}
+
+std::string NormalizeTerm(const std::string& text) {
+    const std::string lower = mafia_save::Lower(text);
+    for (const char* prefix : {"name:", "model:", "type:"}) {
+        if (lower.rfind(prefix, 0) == 0) {
+            return lower;
+        }
+    }
+    return "name:" + lower;
+}
+
+bool MayContain(const PostingIndex& postings, const std::string& term) {
+    if (postings.bloom.empty()) {
+        return false;
+    }
+    std::vector<std::size_t> positions;
+    BloomBits(term, postings.bloom.size() * 64, postings.bloomHashes, &positions);
+    for (const auto bit : positions) {
+        if ((postings.bloom[bit / 64] & (1ull << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::uint32_t> Lookup(const PostingIndex& postings, const std::string& term) {
+    std::vector<std::uint32_t> docs;
+    const auto it = std::lower_bound(postings.terms.begin(), postings.terms.end(), term);
+    if (it == postings.terms.end() || *it != term) {
+        return docs;
+    }
+    const std::size_t t = static_cast<std::size_t>(it - postings.terms.begin());
+    std::size_t pos = postings.postingOffsets[t];
+    const std::size_t end = postings.postingOffsets[t + 1];
+    std::uint32_t doc = 0;
+    while (pos < end) {
+        std::uint32_t delta = 0;
+        unsigned shift = 0;
+        while (pos < end) {
+            const std::uint8_t b = postings.postings[pos++];
+            delta |= static_cast<std::uint32_t>(b & 0x7Fu) << shift;
+            shift += 7;
+            if ((b & 0x80u) == 0 || shift > 28) {
+                break;
+            }
+        }
+        doc += delta;
+        docs.push_back(doc);
+    }
+    return docs;
+}
+
+bool Evaluate(const PostingIndex& postings,
+              const std::string& query,
+              std::vector<std::uint32_t>* docs,
+              QueryStats* stats,
+              std::string* error) {
+    if (docs == nullptr) {
+        if (error != nullptr) {
+            *error = "null output doc list";
+        }
+        return false;
+    }
+    QueryStats st;
+    QueryParser parser(postings, query, &st);
+    std::vector<std::uint32_t> result;
+    if (!parser.Parse(&result, error)) {
+        return false;
+    }
+    *docs = std::move(result);
+    if (stats != nullptr) {
+        *stats = st;
+    }
+    return true;
+}
+
+}  // namespace save_postings
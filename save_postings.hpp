@@ -0,0 +1,64 @@
+#pragma once
+
+#include "save_index.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace save_postings {
+
+namespace fs = std::filesystem;
+
+constexpr const char* kDefaultPostingsName = ".mafia_postings";
+constexpr std::uint32_t kPostingsVersion = 1;
+
+// Terms are "name:<actor name>", "model:<model>" and "type:<decimal type>", lower-cased.
+// Documents are the parsed saves of a save_index::Index, in index order.
+struct PostingIndex {
+    std::uint64_t fingerprint = 0;           // Fingerprint() of the index it was built from
+    std::vector<std::string> docs;           // save paths (generic, relative to the root)
+    std::vector<std::string> terms;          // sorted
+    std::vector<std::uint32_t> postingOffsets;  // terms.size() + 1 offsets into postings
+    std::vector<std::uint8_t> postings;      // per term: ascending doc ids, varint deltas
+    std::vector<std::uint64_t> bloom;        // bit set over all terms
+    std::uint32_t bloomHashes = 0;
+};
+
+// Changes whenever the set of parsed saves or any of their contents changes.
+std::uint64_t Fingerprint(const save_index::Index& index);
+PostingIndex Build(const save_index::Index& index);
+
+fs::path DefaultPostingsPath(const fs::path& root);
+bool LoadPostings(const fs::path& file, PostingIndex* out, std::string* error = nullptr);
+bool WritePostings(const PostingIndex& postings, const fs::path& file, std::string* error = nullptr);
+
+// Loads root/.mafia_postings when it was built from this index, otherwise rebuilds and writes it.
+bool OpenPostings(const fs::path& root,
+                  const save_index::Index& index,
+                  PostingIndex* out,
+                  bool* rebuilt = nullptr,
+                  std::string* error = nullptr);
+
+// "g_car_0" -> "name:g_car_0"; "Model:Tommy.i3d" -> "model:tommy.i3d".
+std::string NormalizeTerm(const std::string& text);
+// False is definite; true means "look it up".
+bool MayContain(const PostingIndex& postings, const std::string& term);
+// Ascending doc ids of a normalized term (empty when absent).
+std::vector<std::uint32_t> Lookup(const PostingIndex& postings, const std::string& term);
+
+struct QueryStats {
+    std::size_t terms = 0;
+    std::size_t bloomRejects = 0;  // terms answered by the Bloom filter alone
+};
+
+// Terms joined by AND / OR (AND binds tighter; adjacent terms are ANDed) with parentheses.
+bool Evaluate(const PostingIndex& postings,
+              const std::string& query,
+              std::vector<std::uint32_t>* docs,
+              QueryStats* stats = nullptr,
+              std::string* error = nullptr);
+
+}  // namespace save_postings
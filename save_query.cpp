@@ -0,0 +1,822 @@
+#include "save_query.hpp"
+
+#include "mafia_save.hpp"
+#include "save_index.hpp"
+#include "save_layout.hpp"
+#include "save_timeline.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <utility>
+
+namespace save_query {
+
+namespace {
+
+constexpr std::uint32_t kActorTypeCar = 4;
+
+enum class Type : std::uint8_t { kBool, kNum, kStr };
+
+// kUnknown: a field of a later stage; kMissing: the field does not exist in this save.
+struct Value {
+    enum class Kind : std::uint8_t { kUnknown, kMissing, kBool, kNum, kStr };
+    Kind kind = Kind::kMissing;
+    bool b = false;
+    double num = 0.0;
+    std::string str;
+
+    static Value Make(Kind kind) {
+        Value v;
+        v.kind = kind;
+        return v;
+    }
+    static Value Unknown() { return Make(Kind::kUnknown); }
+    static Value Missing() { return Make(Kind::kMissing); }
+    static Value Bool(bool b) {
+        Value v = Make(Kind::kBool);
+        v.b = b;
+        return v;
+    }
+    static Value Num(double num) {
+        Value v = Make(Kind::kNum);
+        v.num = num;
+        return v;
+    }
+    static Value Str(std::string str) {
+        Value v = Make(Kind::kStr);
+        v.str = std::move(str);
+        return v;
+    }
+};
+
+struct Context {
+    Stage stage = Stage::kFile;
+    std::string path;  // relative to the query root, '/' separated
+    std::uintmax_t fileSize = 0;
+    const mafia_save::SaveData* save = nullptr;  // header segments only before kFull
+    mafia_save::MetaFields meta;
+    std::string mission;
+    mutable bool programProbed = false;
+    mutable std::optional<save_layout::ProgramLocation> program;
+};
+
+}  // namespace
+
+struct Node {
+    Type type = Type::kBool;
+    Stage stage = Stage::kFile;
+    std::function<Value(const Context&)> eval;
+};
+
+namespace {
+
+using NodePtr = std::shared_ptr<const Node>;
+
+NodePtr MakeNode(Type type, Stage stage, std::function<Value(const Context&)> eval) {
+    auto n = std::make_shared<Node>();
+    n->type = type;
+    n->stage = stage;
+    n->eval = std::move(eval);
+    return n;
+}
+
+// Fields read at `stage` are unknown while the context is at an earlier stage.
+NodePtr MakeField(Type type, Stage stage, std::function<Value(const Context&)> read) {
+    return MakeNode(type, stage, [stage, read = std::move(read)](const Context& ctx) {
+        return ctx.stage < stage ? Value::Unknown() : read(ctx);
+    });
+}
+
+float ReadF32(const std::vector<std::uint8_t>& data, std::size_t off) {
+    const std::uint32_t bits = mafia_save::ReadU32LE(data, off);
+    float v = 0.0f;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+bool IsActorHeader(const mafia_save::Segment& seg) {
+    return seg.name.rfind("actor_header_", 0) == 0 && seg.plain.size() >= mafia_save::kActorHeaderSize;
+}
+
+// Segment index of the actor header named `name` (empty: first car); kNoIndex when absent.
+std::size_t FindActorHeader(const mafia_save::SaveData& save, const std::string& name) {
+    for (std::size_t i = 0; i + 1 < save.segments.size(); ++i) {
+        const auto& h = save.segments[i];
+        if (!IsActorHeader(h)) {
+            continue;
+        }
+        const bool match =
+            name.empty() ? mafia_save::ReadU32LE(h.plain, 128) == kActorTypeCar : mafia_save::ReadCStr(h.plain, 0, 64) == name;
+        if (match) {
+            return i;
+        }
+    }
+    return mafia_save::kNoIndex;
+}
+
+std::size_t CountActors(const mafia_save::SaveData& save, std::optional<std::uint32_t> type) {
+    std::size_t count = 0;
+    for (const auto& seg : save.segments) {
+        if (IsActorHeader(seg) && (!type.has_value() || mafia_save::ReadU32LE(seg.plain, 128) == *type)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::uint32_t TimeKey(std::uint32_t packedTime) {
+    return ((packedTime >> 16) & 0xFFu) * 10000u + ((packedTime >> 8) & 0xFFu) * 100u + (packedTime & 0xFFu);
+}
+
+// ---- lexer -------------------------------------------------------------------------------------------------
+
+enum class Tok : std::uint8_t { kEnd, kIdent, kNum, kStr, kOp };
+
+struct Token {
+    Tok kind = Tok::kEnd;
+    std::string text;
+    double num = 0.0;
+    std::size_t pos = 0;
+};
+
+bool Tokenize(const std::string& s, std::vector<Token>* out, std::string* error) {
+    static const char* const kOps[] = {"||", "&&", "==", "!=", "<=", ">=", "<", ">", "!", "(", ")", ",", "."};
+    std::size_t i = 0;
+    while (i < s.size()) {
+        const unsigned char ch = static_cast<unsigned char>(s[i]);
+        if (std::isspace(ch)) {
+            ++i;
+            continue;
+        }
+        Token t;
+        t.pos = i;
+        if (std::isalpha(ch) || ch == '_') {
+            std::size_t j = i;
+            while (j < s.size() && (std::isalnum(static_cast<unsigned char>(s[j])) || s[j] == '_')) {
+                ++j;
+            }
+            t.kind = Tok::kIdent;
+            t.text = s.substr(i, j - i);
+            i = j;
+        } else if (std::isdigit(ch) || (ch == '-' && i + 1 < s.size() && std::isdigit(static_cast<unsigned char>(s[i + 1])))) {
+            const char* begin = s.c_str() + i;
+            char* end = nullptr;
+            const bool hex = s.compare(i, 2, "0x") == 0 || s.compare(i, 2, "0X") == 0;
+            t.num = hex ? static_cast<double>(std::strtoull(begin, &end, 16)) : std::strtod(begin, &end);
+            t.kind = Tok::kNum;
+            i += static_cast<std::size_t>(end - begin);
+            if (i < s.size() && (std::isalpha(static_cast<unsigned char>(s[i])) || s[i] == '_')) {
+                if (error != nullptr) {
+                    *error = "bad number at offset " + std::to_string(t.pos);
+                }
+                return false;
+            }
+        } else if (ch == '"' || ch == '\'') {
+            std::size_t j = i + 1;
+            while (j < s.size() && s[j] != static_cast<char>(ch)) {
+                if (s[j] == '\\' && j + 1 < s.size()) {
+                    ++j;
+                }
+                t.text += s[j++];
+            }
+            if (j >= s.size()) {
+                if (error != nullptr) {
+                    *error = "unterminated string at offset " + std::to_string(t.pos);
+                }
+                return false;
+            }
+            t.kind = Tok::kStr;
+            i = j + 1;
+        } else {
+            for (const char* op : kOps) {
+                if (s.compare(i, std::strlen(op), op) == 0) {
+                    t.kind = Tok::kOp;
+                    t.text = op;
+                    break;
+                }
+            }
+            if (t.kind != Tok::kOp) {
+                if (error != nullptr) {
+                    *error = std::string("unexpected '") + s[i] + "' at offset " + std::to_string(i);
+                }
+                return false;
+            }
+            i += t.text.size();
+        }
+        out->push_back(std::move(t));
+    }
+    Token end;
+    end.pos = s.size();
+    out->push_back(end);
+    return true;
+}
+
+// ---- parser ------------------------------------------------------------------------------------------------
+
+// or := and ('||' and)* ; and := not ('&&' not)* ; not := '!' not | cmp ; cmp := primary (op primary)?
+class Parser {
+public:
+    explicit Parser(std::vector<Token> tokens) : toks_(std::move(tokens)) {}
+
+    NodePtr Parse(bool allowValue, std::string* error) {
+        NodePtr n = ParseOr();
+        if (n != nullptr && Peek().kind != Tok::kEnd) {
+            Fail("unexpected '" + Peek().text + "'");
+            n = nullptr;
+        }
+        if (n != nullptr && !allowValue && n->type != Type::kBool) {
+            Fail("query must be a condition, not a value");
+            n = nullptr;
+        }
+        if (n == nullptr && error != nullptr) {
+            *error = error_;
+        }
+        return n;
+    }
+
+private:
+    const Token& Peek() const { return toks_[pos_]; }
+    bool IsOp(const char* op) const { return Peek().kind == Tok::kOp && Peek().text == op; }
+    bool Accept(const char* op) {
+        if (IsOp(op)) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+    NodePtr Fail(const std::string& why) {
+        if (error_.empty()) {
+            error_ = why + " at offset " + std::to_string(Peek().pos);
+        }
+        return nullptr;
+    }
+    bool Expect(const char* op) {
+        if (Accept(op)) {
+            return true;
+        }
+        Fail(std::string("expected '") + op + "'");
+        return false;
+    }
+
+    NodePtr RequireBool(NodePtr n, const char* op) {
+        if (n != nullptr && n->type != Type::kBool) {
+            return Fail(std::string("operand of '") + op + "' must be a condition");
+        }
+        return n;
+    }
+
+    // The operand needing the earlier stage runs first, so `header && full` is often decided before
+    // the full parse and an unknown side never hides a definite one.
+    static NodePtr Logical(NodePtr a, NodePtr b, bool isAnd) {
+        if (b->stage < a->stage) {
+            std::swap(a, b);
+        }
+        const Stage stage = std::max(a->stage, b->stage);
+        return MakeNode(Type::kBool, stage, [a, b, isAnd](const Context& ctx) {
+            const Value va = a->eval(ctx);
+            if (va.kind == Value::Kind::kBool && va.b != isAnd) {
+                return va;
+            }
+            const Value vb = b->eval(ctx);
+            if (vb.kind == Value::Kind::kBool && vb.b != isAnd) {
+                return vb;
+            }
+            if (va.kind == Value::Kind::kUnknown || vb.kind == Value::Kind::kUnknown) {
+                return Value::Unknown();
+            }
+            return Value::Bool(isAnd);
+        });
+    }
+
+    NodePtr ParseOr() {
+        NodePtr n = ParseAnd();
+        if (IsOp("||")) {
+            n = RequireBool(n, "||");
+        }
+        while (n != nullptr && Accept("||")) {
+            NodePtr rhs = RequireBool(ParseAnd(), "||");
+            n = rhs != nullptr ? Logical(n, rhs, false) : nullptr;
+        }
+        return n;
+    }
+
+    NodePtr ParseAnd() {
+        NodePtr n = ParseNot();
+        if (IsOp("&&")) {
+            n = RequireBool(n, "&&");
+        }
+        while (n != nullptr && Accept("&&")) {
+            NodePtr rhs = RequireBool(ParseNot(), "&&");
+            n = rhs != nullptr ? Logical(n, rhs, true) : nullptr;
+        }
+        return n;
+    }
+
+    NodePtr ParseNot() {
+        if (!Accept("!")) {
+            return ParseCompare();
+        }
+        NodePtr inner = RequireBool(ParseNot(), "!");
+        if (inner == nullptr) {
+            return nullptr;
+        }
+        return MakeNode(Type::kBool, inner->stage, [inner](const Context& ctx) {
+            Value v = inner->eval(ctx);
+            return v.kind == Value::Kind::kBool ? Value::Bool(!v.b) : v;
+        });
+    }
+
+    NodePtr ParseCompare() {
+        NodePtr lhs = ParsePrimary();
+        if (lhs == nullptr) {
+            return nullptr;
+        }
+        static const char* const kCmp[] = {"==", "!=", "<=", ">=", "<", ">"};
+        const char* op = nullptr;
+        for (const char* c : kCmp) {
+            if (IsOp(c)) {
+                op = c;
+                break;
+            }
+        }
+        if (op == nullptr) {
+            return lhs;
+        }
+        ++pos_;
+        NodePtr rhs = ParsePrimary();
+        if (rhs == nullptr) {
+            return nullptr;
+        }
+        if (lhs->type != rhs->type) {
+            return Fail(std::string("'") + op + "' compares values of different types");
+        }
+        const std::string o = op;
+        const auto test = [o](int c) {
+            return o == "==" ? c == 0 : o == "!=" ? c != 0 : o == "<" ? c < 0 : o == "<=" ? c <= 0 : o == ">" ? c > 0 : c >= 0;
+        };
+        return MakeNode(Type::kBool, std::max(lhs->stage, rhs->stage), [lhs, rhs, test](const Context& ctx) {
+            const Value a = lhs->eval(ctx);
+            const Value b = rhs->eval(ctx);
+            if (a.kind == Value::Kind::kUnknown || b.kind == Value::Kind::kUnknown) {
+                return Value::Unknown();
+            }
+            if (a.kind != b.kind || a.kind == Value::Kind::kMissing) {
+                return Value::Bool(false);
+            }
+            int c = 0;
+            if (a.kind == Value::Kind::kStr) {
+                c = a.str.compare(b.str);
+            } else if (a.kind == Value::Kind::kNum) {
+                c = a.num < b.num ? -1 : a.num > b.num ? 1 : 0;
+            } else {
+                c = static_cast<int>(a.b) - static_cast<int>(b.b);
+            }
+            return Value::Bool(test(c));
+        });
+    }
+
+    bool ParseArgs(std::vector<Token>* args) {
+        if (!Expect("(")) {
+            return false;
+        }
+        if (Accept(")")) {
+            return true;
+        }
+        do {
+            if (Peek().kind != Tok::kNum && Peek().kind != Tok::kStr) {
+                Fail("function arguments must be literals");
+                return false;
+            }
+            args->push_back(toks_[pos_++]);
+        } while (Accept(","));
+        return Expect(")");
+    }
+
+    NodePtr ParsePrimary() {
+        const Token t = Peek();
+        if (Accept("(")) {
+            NodePtr n = ParseOr();
+            return n != nullptr && Expect(")") ? n : nullptr;
+        }
+        if (t.kind == Tok::kNum) {
+            ++pos_;
+            const double v = t.num;
+            return MakeNode(Type::kNum, Stage::kFile, [v](const Context&) { return Value::Num(v); });
+        }
+        if (t.kind == Tok::kStr) {
+            ++pos_;
+            const std::string v = t.text;
+            return MakeNode(Type::kStr, Stage::kFile, [v](const Context&) { return Value::Str(v); });
+        }
+        if (t.kind != Tok::kIdent) {
+            return Fail(t.kind == Tok::kEnd ? "unexpected end of query" : "unexpected '" + t.text + "'");
+        }
+        ++pos_;
+        if (t.text == "true" || t.text == "false") {
+            const bool v = t.text == "true";
+            return MakeNode(Type::kBool, Stage::kFile, [v](const Context&) { return Value::Bool(v); });
+        }
+        if (t.text == "tommy" || t.text == "car") {
+            return ParseActorProp(t.text == "tommy" ? "Tommy" : "");
+        }
+        if (IsOp("(")) {
+            return ParseCall(t.text);
+        }
+        return Field(t.text);
+    }
+
+    NodePtr ParseCall(const std::string& fn) {
+        if (fn == "contains") {
+            ++pos_;
+            NodePtr a = ParsePrimary();
+            if (a == nullptr || !Expect(",")) {
+                return nullptr;
+            }
+            NodePtr b = ParsePrimary();
+            if (b == nullptr || !Expect(")")) {
+                return nullptr;
+            }
+            if (a->type != Type::kStr || b->type != Type::kStr) {
+                return Fail("contains() takes two strings");
+            }
+            return MakeNode(Type::kBool, std::max(a->stage, b->stage), [a, b](const Context& ctx) {
+                const Value va = a->eval(ctx);
+                const Value vb = b->eval(ctx);
+                if (va.kind == Value::Kind::kUnknown || vb.kind == Value::Kind::kUnknown) {
+                    return Value::Unknown();
+                }
+                if (va.kind != Value::Kind::kStr || vb.kind != Value::Kind::kStr) {
+                    return Value::Bool(false);
+                }
+                return Value::Bool(mafia_save::Lower(va.str).find(mafia_save::Lower(vb.str)) != std::string::npos);
+            });
+        }
+
+        std::vector<Token> args;
+        if (!ParseArgs(&args)) {
+            return nullptr;
+        }
+        const auto oneArg = [&](Tok kind) { return args.size() == 1 && args[0].kind == kind; };
+        const auto index = [&]() { return static_cast<std::uint32_t>(std::max(0.0, args[0].num)); };
+
+        if (fn == "actor") {
+            if (!oneArg(Tok::kStr)) {
+                return Fail("actor() takes one string");
+            }
+            return ParseActorProp(args[0].text);
+        }
+        if (fn == "has_actor") {
+            if (!oneArg(Tok::kStr)) {
+                return Fail("has_actor() takes one string");
+            }
+            const std::string name = args[0].text;
+            return MakeField(Type::kBool, Stage::kFull, [name](const Context& ctx) {
+                return Value::Bool(FindActorHeader(*ctx.save, name) != mafia_save::kNoIndex);
+            });
+        }
+        if (fn == "count_type") {
+            if (!oneArg(Tok::kNum)) {
+                return Fail("count_type() takes one number");
+            }
+            const std::uint32_t type = index();
+            return MakeField(Type::kNum, Stage::kFull, [type](const Context& ctx) {
+                return Value::Num(static_cast<double>(CountActors(*ctx.save, type)));
+            });
+        }
+        if (fn == "var") {
+            if (!oneArg(Tok::kNum)) {
+                return Fail("var() takes one number");
+            }
+            const std::uint32_t var = index();
+            return MakeField(Type::kNum, Stage::kFull, [var](const Context& ctx) {
+                if (!ctx.programProbed) {
+                    ctx.program = save_layout::DetectProgramInSave(*ctx.save);
+                    ctx.programProbed = true;
+                }
+                if (!ctx.program.has_value() || var >= ctx.program->layout.varCount) {
+                    return Value::Missing();
+                }
+                return Value::Num(ReadF32(ctx.save->segments[ctx.program->segIdx].plain,
+                                          ctx.program->layout.varsOff + static_cast<std::size_t>(var) * 4u));
+            });
+        }
+        if (fn == "garage" || fn == "garage2") {
+            if (!oneArg(Tok::kNum) || args[0].num < 0 || args[0].num >= save_layout::kGarageSlotCount) {
+                return Fail(fn + "() takes a slot number below 25");
+            }
+            const std::size_t off = (fn == "garage" ? save_layout::kGaragePrimaryOff : save_layout::kGarageSecondaryOff) +
+                                    static_cast<std::size_t>(index()) * 4u;
+            return MakeField(Type::kNum, Stage::kHeader, [off](const Context& ctx) {
+                if (ctx.save->idxInfo == mafia_save::kNoIndex) {
+                    return Value::Missing();
+                }
+                const auto& info = ctx.save->segments[ctx.save->idxInfo].plain;
+                return off + 4 <= info.size() ? Value::Num(mafia_save::ReadU32LE(info, off)) : Value::Missing();
+            });
+        }
+        return Fail("unknown function '" + fn + "'");
+    }
+
+    // `.prop` after actor("name"), tommy or car (empty name: first car).
+    NodePtr ParseActorProp(const std::string& actor) {
+        if (!Expect(".")) {
+            return nullptr;
+        }
+        if (Peek().kind != Tok::kIdent) {
+            return Fail("expected an actor property");
+        }
+        const std::string prop = toks_[pos_++].text;
+
+        const auto header = [actor](const Context& ctx) { return FindActorHeader(*ctx.save, actor); };
+        const auto headerU32 = [header](std::size_t off) {
+            return MakeField(Type::kNum, Stage::kFull, [header, off](const Context& ctx) {
+                const std::size_t h = header(ctx);
+                return h == mafia_save::kNoIndex ? Value::Missing()
+                                                 : Value::Num(mafia_save::ReadU32LE(ctx.save->segments[h].plain, off));
+            });
+        };
+        if (prop == "type") {
+            return headerU32(128);
+        }
+        if (prop == "payload_size") {
+            return headerU32(132);
+        }
+        if (prop == "idx") {
+            return headerU32(136);
+        }
+        if (prop == "model") {
+            return MakeField(Type::kStr, Stage::kFull, [header](const Context& ctx) {
+                const std::size_t h = header(ctx);
+                return h == mafia_save::kNoIndex ? Value::Missing() : Value::Str(mafia_save::ReadCStr(ctx.save->segments[h].plain, 64, 64));
+            });
+        }
+
+        static const std::pair<const char*, std::size_t save_layout::CoordLayout::*> kOffsets[] = {
+            {"x", &save_layout::CoordLayout::xOff},
+            {"y", &save_layout::CoordLayout::yOff},
+            {"z", &save_layout::CoordLayout::zOff},
+            {"hp", &save_layout::CoordLayout::humanHpCurrentOff},
+            {"hpmax", &save_layout::CoordLayout::humanHpMaxOff},
+            {"fuel", &save_layout::CoordLayout::carFuelOff},
+            {"odometer", &save_layout::CoordLayout::carOdometerOff},
+        };
+        for (const auto& [name, member] : kOffsets) {
+            if (prop != name) {
+                continue;
+            }
+            const std::string p = prop;
+            return MakeField(Type::kNum, Stage::kFull, [header, member, p](const Context& ctx) {
+                const std::size_t h = header(ctx);
+                if (h == mafia_save::kNoIndex) {
+                    return Value::Missing();
+                }
+                const auto& payload = ctx.save->segments[h + 1].plain;
+                const save_layout::CoordLayout l = save_layout::DetectCoordLayout(payload);
+                const bool supported = (p == "x" || p == "y" || p == "z")   ? l.coordsSupported
+                                       : (p == "hp" || p == "hpmax")        ? l.humanHealthSupported
+                                       : p == "fuel"                        ? l.carStateSupported
+                                                                            : l.carOdometerSupported;
+                const std::size_t off = l.*member;
+                return supported && off + 4 <= payload.size() ? Value::Num(ReadF32(payload, off)) : Value::Missing();
+            });
+        }
+        return Fail("unknown actor property '" + prop + "'");
+    }
+
+    NodePtr Field(const std::string& name) {
+        using K = Value;
+        if (name == "path") {
+            return MakeField(Type::kStr, Stage::kFile, [](const Context& ctx) { return K::Str(ctx.path); });
+        }
+        if (name == "file_size") {
+            return MakeField(Type::kNum, Stage::kFile,
+                             [](const Context& ctx) { return K::Num(static_cast<double>(ctx.fileSize)); });
+        }
+        if (name == "mission_name") {
+            return MakeField(Type::kStr, Stage::kHeader, [](const Context& ctx) { return K::Str(ctx.mission); });
+        }
+
+        static const std::pair<const char*, std::uint32_t (*)(const Context&)> kHeaderFields[] = {
+            {"slot", [](const Context& c) { return c.meta.slot; }},
+            {"mission_code", [](const Context& c) { return c.meta.missionCode; }},
+            {"hp_percent", [](const Context& c) { return c.meta.hpPercent; }},
+            {"date", [](const Context& c) { return save_timeline::DateKey(c.meta.packedDate); }},
+            {"time", [](const Context& c) { return TimeKey(c.meta.packedTime); }},
+            {"game_payload_size", [](const Context& c) { return mafia_save::ReadMainPayloadSize(*c.save); }},
+            {"ai_groups_size", [](const Context& c) { return mafia_save::ReadAiGroupsSize(*c.save); }},
+            {"ai_follow_size", [](const Context& c) { return mafia_save::ReadAiFollowSize(*c.save); }},
+        };
+        for (const auto& [field, read] : kHeaderFields) {
+            if (name == field) {
+                const auto fn = read;
+                return MakeField(Type::kNum, Stage::kHeader, [fn](const Context& ctx) { return K::Num(fn(ctx)); });
+            }
+        }
+
+        if (name == "actor_count" || name == "car_count") {
+            const std::optional<std::uint32_t> type =
+                name == "car_count" ? std::optional<std::uint32_t>(kActorTypeCar) : std::nullopt;
+            return MakeField(Type::kNum, Stage::kFull, [type](const Context& ctx) {
+                return K::Num(static_cast<double>(CountActors(*ctx.save, type)));
+            });
+        }
+        return Fail("unknown field '" + name + "'");
+    }
+
+    std::vector<Token> toks_;
+    std::size_t pos_ = 0;
+    std::string error_;
+};
+
+enum class Outcome : std::uint8_t { kNoMatch, kMatch, kFailed };
+
+struct FileResult {
+    Outcome outcome = Outcome::kNoMatch;
+    Stage decidedAt = Stage::kFile;
+};
+
+FileResult EvaluateFile(const fs::path& root, const fs::path& path, const Query& query) {
+    FileResult r;
+    Context ctx;
+    ctx.path = path.lexically_relative(root).generic_string();
+    std::error_code ec;
+    ctx.fileSize = fs::file_size(path, ec);
+
+    const auto decide = [&](Stage stage) {
+        const Value v = query.root->eval(ctx);
+        if (v.kind == Value::Kind::kUnknown) {
+            return false;
+        }
+        r.outcome = v.kind == Value::Kind::kBool && v.b ? Outcome::kMatch : Outcome::kNoMatch;
+        r.decidedAt = stage;
+        return true;
+    };
+    if (decide(Stage::kFile)) {
+        return r;
+    }
+
+    mafia_save::SaveData header;
+    const auto prefix = mafia_save::ReadFilePrefix(path, mafia_save::kHeaderPrefixSize);
+    if (!mafia_save::ParseSaveHeader(prefix, &header) || !mafia_save::ReadMetaFields(header, &ctx.meta)) {
+        r.outcome = Outcome::kFailed;
+        return r;
+    }
+    ctx.mission = mafia_save::ReadMissionName(header);
+    ctx.save = &header;
+    ctx.stage = Stage::kHeader;
+    if (decide(Stage::kHeader)) {
+        return r;
+    }
+
+    mafia_save::SaveData save;
+    if (!mafia_save::ParseSave(mafia_save::ReadFileBytes(path), &save)) {
+        r.outcome = Outcome::kFailed;
+        r.decidedAt = Stage::kFull;
+        return r;
+    }
+    ctx.save = &save;
+    ctx.stage = Stage::kFull;
+    if (!decide(Stage::kFull)) {
+        r.outcome = Outcome::kFailed;  // cannot happen: nothing is unknown at the last stage
+        r.decidedAt = Stage::kFull;
+    }
+    return r;
+}
+
+bool CompileAs(const std::string& text, bool allowValue, Query* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output query";
+        }
+        return false;
+    }
+    std::vector<Token> tokens;
+    if (!Tokenize(text, &tokens, error)) {
+        return false;
+    }
+    Parser parser(std::move(tokens));
+    NodePtr root = parser.Parse(allowValue, error);
+    if (root == nullptr) {
+        return false;
+    }
+    out->text = text;
+    out->stage = root->stage;
+    out->root = std::move(root);
+    return true;
+}
+
+}  // namespace
+
+bool Compile(const std::string& text, Query* out, std::string* error) {
+    return CompileAs(text, false, out, error);
+}
+
+bool CompileValue(const std::string& text, Query* out, std::string* error) {
+    return CompileAs(text, true, out, error);
+}
+
+bool EvaluateSave(const Query& query,
+                  const mafia_save::SaveData& save,
+                  const fs::path& path,
+                  std::string* value,
+                  std::string* error) {
+    if (query.root == nullptr || value == nullptr) {
+        if (error != nullptr) {
+            *error = value == nullptr ? "null output value" : "query is not compiled";
+        }
+        return false;
+    }
+    Context ctx;
+    ctx.stage = Stage::kFull;
+    ctx.path = path.generic_string();
+    ctx.fileSize = save.rawSize;
+    ctx.save = &save;
+    ctx.mission = mafia_save::ReadMissionName(save);
+    if (!mafia_save::ReadMetaFields(save, &ctx.meta, error)) {
+        return false;
+    }
+    const Value v = query.root->eval(ctx);
+    std::ostringstream oss;
+    switch (v.kind) {
+        case Value::Kind::kBool:
+            oss << (v.b ? "true" : "false");
+            break;
+        case Value::Kind::kNum:
+            oss << std::setprecision(9) << v.num;
+            break;
+        case Value::Kind::kStr:
+            oss << v.str;
+            break;
+        case Value::Kind::kUnknown:
+        case Value::Kind::kMissing:
+            if (error != nullptr) {
+                *error = "field is absent in this save";
+            }
+            return false;
+    }
+    *value = oss.str();
+    return true;
+}
+
+bool Run(const fs::path& root,
+         const Query& query,
+         const QueryOptions& options,
+         std::vector<fs::path>* matches,
+         QueryStats* stats,
+         std::string* error) {
+    if (matches == nullptr || query.root == nullptr) {
+        if (error != nullptr) {
+            *error = matches == nullptr ? "null output match list" : "query is not compiled";
+        }
+        return false;
+    }
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        if (error != nullptr) {
+            *error = "not a directory: " + root.string();
+        }
+        return false;
+    }
+
+    std::vector<fs::path> files;
+    save_index::CollectSaveFiles(root, &files);
+    std::vector<FileResult> results(files.size());
+    work_pool::ParallelFor(files.size(), options.threads, [&](unsigned, std::size_t i) {
+        results[i] = EvaluateFile(root, files[i], query);
+    });
+
+    QueryStats s;
+    s.files = files.size();
+    s.threads = work_pool::ResolveThreads(options.threads, files.size());
+    matches->clear();
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        const FileResult& r = results[i];
+        if (r.outcome == Outcome::kFailed) {
+            ++s.failed;
+        } else if (r.decidedAt == Stage::kFile) {
+            ++s.decidedByFile;
+        } else if (r.decidedAt == Stage::kHeader) {
+            ++s.decidedByHeader;
+        }
+        if (r.decidedAt == Stage::kFull) {
+            ++s.fullParsed;
+        }
+        if (r.outcome == Outcome::kMatch) {
+            ++s.matched;
+            matches->push_back(files[i]);
+        }
+    }
+    if (stats != nullptr) {
+        *stats = s;
+    }
+    return true;
+}
+
+}  // namespace save_query
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace save_query {
+
+namespace fs = std::filesystem;
+
+// What a predicate needs before it can be decided.
+enum class Stage : std::uint8_t {
+    kFile,    // path, file_size: no decryption
+    kHeader,  // meta32 / info264 fields: ParseSaveHeader on the first kHeaderPrefixSize bytes
+    kFull,    // actors, program vars: whole file read and decrypted
+};
+
+struct Node;
+
+// Expression compiled to a closure tree. Operators: || && ! == != < <= > >= and parentheses;
+// literals are numbers (decimal, 0x hex, fractional), "strings" and true/false.
+//
+// File:   path (relative to the root), file_size
+// Header: mission_name, slot, mission_code, hp_percent, date (yyyymmdd), time (hhmmss),
+//         game_payload_size, ai_groups_size, ai_follow_size, garage(n), garage2(n)
+// Full:   actor_count, car_count, has_actor("name"), count_type(t), var(n),
+//         actor("name").<prop>, tommy.<prop>, car.<prop> (first type 4 actor) where <prop> is
+//         type, idx, model, payload_size, x, y, z, hp, hpmax, fuel, odometer
+// contains(a, b) is a case-insensitive substring test.
+//
+// A field absent from a save (unknown actor, layout without that offset) compares false.
+struct Query {
+    std::string text;
+    std::shared_ptr<const Node> root;
+    Stage stage = Stage::kFile;  // deepest stage any field needs
+};
+
+bool Compile(const std::string& text, Query* out, std::string* error = nullptr);
+// Like Compile, but the expression may be a plain value such as `tommy.hp` or `mission_name`.
+bool CompileValue(const std::string& text, Query* out, std::string* error = nullptr);
+// Evaluates on an already parsed save (path only feeds `path`); false when a field is absent.
+bool EvaluateSave(const Query& query,
+                  const mafia_save::SaveData& save,
+                  const fs::path& path,
+                  std::string* value,
+                  std::string* error = nullptr);
+
+struct QueryOptions {
+    unsigned threads = 0;  // 0 = hardware concurrency
+};
+
+struct QueryStats {
+    std::size_t files = 0;
+    std::size_t matched = 0;
+    std::size_t decidedByFile = 0;    // decided without reading the file
+    std::size_t decidedByHeader = 0;  // decided on the header prefix
+    std::size_t fullParsed = 0;
+    std::size_t failed = 0;
+    unsigned threads = 0;
+};
+
+// Evaluates the query on every GvaS save below root (tool-owned .mafia_* entries skipped). A predicate is
+// tried at each stage with the fields of deeper stages unknown; only saves still undecided are read further.
+bool Run(const fs::path& root,
+         const Query& query,
+         const QueryOptions& options,
+         std::vector<fs::path>* matches,
+         QueryStats* stats = nullptr,
+         std::string* error = nullptr);
+
+}  // namespace save_query
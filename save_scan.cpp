@@ -0,0 +1,296 @@
+#include "save_scan.hpp"
+
+#include "profile_sav.hpp"
+#include "save_index.hpp"
+#include "work_pool.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace save_scan {
+
+namespace {
+
+constexpr std::size_t kSniffBytes = 4;
+constexpr std::size_t kProfileSaveSize = profile_sav::kFileHeaderSize + profile_sav::kCoreSize +
+                                         profile_sav::kBlock720Size + profile_sav::kBlock92Size +
+                                         profile_sav::kBlock156Size;
+constexpr std::size_t kMrProfileSize = 136;
+
+bool IsMrProfileName(const std::string& name) {
+    return name.size() == 9 && name.compare(0, 2, "mr") == 0 && name.compare(5, 4, ".sav") == 0 &&
+           std::isdigit(static_cast<unsigned char>(name[2])) && std::isdigit(static_cast<unsigned char>(name[3])) &&
+           std::isdigit(static_cast<unsigned char>(name[4]));
+}
+
+void ScanMission(const std::vector<std::uint8_t>& bytes, bool headerOnly, ScanRecord* rec) {
+    mafia_save::SaveData save;
+    const bool ok = headerOnly ? mafia_save::ParseSaveHeader(bytes, &save, &rec->error)
+                               : mafia_save::ParseSave(bytes, &save, &rec->error);
+    if (!ok) {
+        return;
+    }
+    rec->mission = mafia_save::ReadMissionName(save);
+    mafia_save::ReadMetaFields(save, &rec->meta);
+    rec->gamePayloadSize = mafia_save::ReadMainPayloadSize(save);
+    rec->aiGroupsSize = mafia_save::ReadAiGroupsSize(save);
+    rec->aiFollowSize = mafia_save::ReadAiFollowSize(save);
+    rec->headerOnly = headerOnly;
+    if (!headerOnly) {
+        rec->actorCount = save.actorCount;
+        std::map<std::uint32_t, std::uint32_t> byType;
+        for (const auto& seg : save.segments) {
+            if (seg.name.rfind("actor_header_", 0) == 0 && seg.plain.size() >= mafia_save::kActorHeaderSize) {
+                ++byType[mafia_save::ReadU32LE(seg.plain, 128)];
+            }
+        }
+        rec->census.assign(byType.begin(), byType.end());
+    }
+    rec->ok = true;
+}
+
+void ScanProfileKind(const std::vector<std::uint8_t>& bytes, ScanRecord* rec) {
+    switch (rec->kind) {
+        case FileKind::kProfile: {
+            profile_sav::ProfileSaveData data;
+            rec->ok = profile_sav::ParseProfileSave(bytes, &data, &rec->error);
+            break;
+        }
+        case FileKind::kMrProfile: {
+            profile_sav::MrProfileSaveData data;
+            rec->ok = profile_sav::ParseMrProfileSave(bytes, &data, &rec->error);
+            rec->entries = data.words.size();
+            break;
+        }
+        case FileKind::kMrTimes: {
+            profile_sav::MrTimesSaveData data;
+            rec->ok = profile_sav::ParseMrTimesSave(bytes, &data, &rec->error);
+            rec->entries = data.records.size();
+            break;
+        }
+        case FileKind::kMrSeg0: {
+            profile_sav::MrSeg0SaveData data;
+            rec->ok = profile_sav::ParseMrSeg0Save(bytes, &data, &rec->error);
+            rec->entries = data.points.size();
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+std::string CsvEscape(const std::string& s) {
+    if (s.find_first_of(",\"\n") == std::string::npos) {
+        return s;
+    }
+    std::string out = "\"";
+    for (char ch : s) {
+        if (ch == '"') {
+            out += '"';
+        }
+        out += ch;
+    }
+    out += '"';
+    return out;
+}
+
+std::string FormatDate(std::uint32_t packed) {
+    std::ostringstream oss;
+    oss << std::setfill('0') << std::setw(4) << ((packed >> 16) & 0xFFFFu) << "-" << std::setw(2)
+        << ((packed >> 8) & 0xFFu) << "-" << std::setw(2) << (packed & 0xFFu);
+    return oss.str();
+}
+
+std::string FormatTime(std::uint32_t packed) {
+    std::ostringstream oss;
+    oss << std::setfill('0') << std::setw(2) << ((packed >> 16) & 0xFFu) << ":" << std::setw(2)
+        << ((packed >> 8) & 0xFFu) << ":" << std::setw(2) << (packed & 0xFFu);
+    return oss.str();
+}
+
+bool HasMissionFields(const ScanRecord& r) {
+    return r.ok && r.kind == FileKind::kMission;
+}
+
+}  // namespace
+
+const char* FileKindName(FileKind kind) {
+    switch (kind) {
+        case FileKind::kMission:
+            return "mission";
+        case FileKind::kProfile:
+            return "profile";
+        case FileKind::kMrProfile:
+            return "mr_profile";
+        case FileKind::kMrTimes:
+            return "mrtimes";
+        case FileKind::kMrSeg0:
+            return "mrseg0";
+        case FileKind::kUnknown:
+            break;
+    }
+    return "unknown";
+}
+
+FileKind SniffKind(const fs::path& path, const std::vector<std::uint8_t>& prefix, std::uintmax_t fileSize) {
+    if (prefix.size() >= 4 && std::memcmp(prefix.data(), "GvaS", 4) == 0) {
+        return FileKind::kMission;
+    }
+    const std::string name = mafia_save::Lower(path.filename().string());
+    if (name == "mrtimes.sav") {
+        return FileKind::kMrTimes;
+    }
+    if (name == "mrseg0.sav") {
+        return FileKind::kMrSeg0;
+    }
+    if (IsMrProfileName(name) || (fileSize == kMrProfileSize && path.extension() == ".sav")) {
+        return FileKind::kMrProfile;
+    }
+    if (fileSize == kProfileSaveSize) {
+        return FileKind::kProfile;
+    }
+    return FileKind::kUnknown;
+}
+
+bool ScanBytes(const fs::path& path, const std::vector<std::uint8_t>& bytes, bool headerOnly, ScanRecord* out) {
+    if (out == nullptr) {
+        return false;
+    }
+    ScanRecord rec;
+    rec.path = path;
+    rec.size = bytes.size();
+    rec.kind = SniffKind(path, bytes, rec.size);
+    if (rec.kind == FileKind::kMission) {
+        ScanMission(bytes, headerOnly, &rec);
+    } else if (rec.kind != FileKind::kUnknown) {
+        ScanProfileKind(bytes, &rec);
+    }
+    const bool ok = rec.ok;
+    *out = std::move(rec);
+    return ok;
+}
+
+bool ScanFile(const fs::path& path, bool headerOnly, ScanRecord* out) {
+    if (out == nullptr) {
+        return false;
+    }
+    ScanRecord rec;
+    rec.path = path;
+    std::error_code ec;
+    rec.size = fs::file_size(path, ec);
+    if (ec) {
+        rec.error = "cannot stat file";
+        *out = std::move(rec);
+        return false;
+    }
+
+    const auto head = mafia_save::ReadFilePrefix(path, kSniffBytes);
+    rec.kind = SniffKind(path, head, rec.size);
+    if (rec.kind == FileKind::kMission) {
+        const auto bytes = headerOnly ? mafia_save::ReadFilePrefix(path, mafia_save::kHeaderPrefixSize)
+                                      : mafia_save::ReadFileBytes(path);
+        ScanMission(bytes, headerOnly, &rec);
+    } else if (rec.kind != FileKind::kUnknown) {
+        ScanProfileKind(mafia_save::ReadFileBytes(path), &rec);
+    }
+    const bool ok = rec.ok;
+    *out = std::move(rec);
+    return ok;
+}
+
+bool ScanDirectory(const fs::path& root, const ScanOptions& options, ScanReport* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output scan report";
+        }
+        return false;
+    }
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        if (error != nullptr) {
+            *error = "not a directory: " + root.string();
+        }
+        return false;
+    }
+
+    std::vector<fs::path> files;
+    save_index::CollectFiles(root, [](const fs::path&) { return true; }, &files);
+
+    ScanReport report;
+    report.files = files.size();
+    report.threads = work_pool::ResolveThreads(options.threads, files.size());
+    report.records.resize(files.size());
+    work_pool::ParallelFor(files.size(), options.threads, [&](unsigned, std::size_t i) {
+        ScanFile(files[i], options.headerOnly, &report.records[i]);
+        report.records[i].path = files[i].lexically_relative(root);
+    });
+    for (const auto& rec : report.records) {
+        if (rec.ok) {
+            ++report.parsed;
+        } else if (rec.kind != FileKind::kUnknown) {
+            ++report.failed;
+        }
+    }
+    *out = std::move(report);
+    return true;
+}
+
+void WriteNdjsonRecord(std::ostream& out, const ScanRecord& r) {
+    out << "{\"path\":\"" << mafia_save::JsonEscape(r.path.generic_string()) << "\",\"kind\":\"" << FileKindName(r.kind)
+        << "\",\"size\":" << r.size << ",\"ok\":" << (r.ok ? "true" : "false");
+    if (!r.error.empty()) {
+        out << ",\"error\":\"" << mafia_save::JsonEscape(r.error) << "\"";
+    }
+    if (HasMissionFields(r)) {
+        out << ",\"mission\":\"" << mafia_save::JsonEscape(r.mission) << "\",\"slot\":" << r.meta.slot
+            << ",\"mission_code\":" << r.meta.missionCode << ",\"date\":\"" << FormatDate(r.meta.packedDate)
+            << "\",\"time\":\"" << FormatTime(r.meta.packedTime) << "\",\"hp_percent\":" << r.meta.hpPercent
+            << ",\"game_payload\":" << r.gamePayloadSize << ",\"ai_groups\":" << r.aiGroupsSize
+            << ",\"ai_follow\":" << r.aiFollowSize;
+        if (!r.headerOnly) {
+            out << ",\"actors\":" << r.actorCount << ",\"census\":{";
+            for (std::size_t i = 0; i < r.census.size(); ++i) {
+                out << (i == 0 ? "" : ",") << "\"" << r.census[i].first << "\":" << r.census[i].second;
+            }
+            out << "}";
+        }
+    } else if (r.ok && r.kind != FileKind::kProfile) {
+        out << ",\"entries\":" << r.entries;
+    }
+    out << "}\n";
+}
+
+void WriteCsvHeader(std::ostream& out) {
+    out << "path,kind,size,ok,mission,slot,mission_code,date,time,hp_percent,game_payload,ai_groups,ai_follow,"
+           "actors,census,entries,error\n";
+}
+
+void WriteCsvRecord(std::ostream& out, const ScanRecord& r) {
+    out << CsvEscape(r.path.generic_string()) << "," << FileKindName(r.kind) << "," << r.size << ","
+        << (r.ok ? 1 : 0) << ",";
+    if (HasMissionFields(r)) {
+        out << CsvEscape(r.mission) << "," << r.meta.slot << "," << r.meta.missionCode << ","
+            << FormatDate(r.meta.packedDate) << "," << FormatTime(r.meta.packedTime) << "," << r.meta.hpPercent << ","
+            << r.gamePayloadSize << "," << r.aiGroupsSize << "," << r.aiFollowSize << ",";
+        if (!r.headerOnly) {
+            out << r.actorCount << ",";
+            for (std::size_t i = 0; i < r.census.size(); ++i) {
+                out << (i == 0 ? "" : ";") << r.census[i].first << ":" << r.census[i].second;
+            }
+        } else {
+            out << ",";
+        }
+        out << ",";
+    } else {
+        out << ",,,,,,,,,,,";
+        if (r.ok && r.kind != FileKind::kProfile) {
+            out << r.entries;
+        }
+    }
+    out << "," << CsvEscape(r.error) << "\n";
+}
+
+}  // namespace save_scan
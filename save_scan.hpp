@@ -0,0 +1,75 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace save_scan {
+
+namespace fs = std::filesystem;
+
+enum class FileKind {
+    kUnknown,
+    kMission,    // GvaS mission save (mafiaNNN.MMM)
+    kProfile,    // profile .sav (forP core + fixed blocks)
+    kMrProfile,  // mrXXX.sav, 34 u32 words
+    kMrTimes,    // mrtimes.sav
+    kMrSeg0,     // mrseg0.sav
+};
+
+const char* FileKindName(FileKind kind);
+
+// Decides the kind from the first bytes, the file size and the file name.
+FileKind SniffKind(const fs::path& path, const std::vector<std::uint8_t>& prefix, std::uintmax_t fileSize);
+
+struct ScanOptions {
+    unsigned threads = 0;      // 0 = hardware concurrency
+    bool headerOnly = false;   // mission saves: decrypt head24/meta32/info264 only (no actor census)
+};
+
+struct ScanRecord {
+    fs::path path;   // relative to the scan root
+    FileKind kind = FileKind::kUnknown;
+    std::uintmax_t size = 0;
+    bool ok = false;
+    bool headerOnly = false;
+    std::string error;
+
+    // kMission
+    std::string mission;
+    mafia_save::MetaFields meta;
+    std::uint32_t gamePayloadSize = 0;
+    std::uint32_t aiGroupsSize = 0;
+    std::uint32_t aiFollowSize = 0;
+    std::size_t actorCount = 0;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> census;  // (actor type, count), ascending type
+
+    // kMrTimes records / kMrSeg0 points / kMrProfile words
+    std::size_t entries = 0;
+};
+
+struct ScanReport {
+    std::vector<ScanRecord> records;  // sorted by path, independent of thread timing
+    std::size_t files = 0;
+    std::size_t parsed = 0;
+    std::size_t failed = 0;
+    unsigned threads = 0;
+};
+
+// Fills `out` from bytes already in memory (mission saves need the whole file unless headerOnly).
+bool ScanBytes(const fs::path& path, const std::vector<std::uint8_t>& bytes, bool headerOnly, ScanRecord* out);
+bool ScanFile(const fs::path& path, bool headerOnly, ScanRecord* out);
+// Every file under root except the tool's own .mafia_* entries (index, postings, backups).
+bool ScanDirectory(const fs::path& root, const ScanOptions& options, ScanReport* out, std::string* error = nullptr);
+
+void WriteNdjsonRecord(std::ostream& out, const ScanRecord& record);
+void WriteCsvHeader(std::ostream& out);
+void WriteCsvRecord(std::ostream& out, const ScanRecord& record);
+
+}  // namespace save_scan
@@ -0,0 +1,505 @@
+#include "save_search.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAVE_SEARCH_SSE2 1
+#include <emmintrin.h>
+#else
+#define SAVE_SEARCH_SSE2 0
+#endif
+
+namespace save_search {
+
+namespace {
+
+constexpr std::size_t kBlock = 16;
+
+std::uint64_t ReadLE(const std::uint8_t* p, std::size_t width) {
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < width; ++i) {
+        v |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+float ReadF32(const std::uint8_t* p) {
+    const std::uint32_t bits = static_cast<std::uint32_t>(ReadLE(p, 4));
+    float out = 0.0f;
+    std::memcpy(&out, &bits, sizeof(out));
+    return out;
+}
+
+double ReadF64(const std::uint8_t* p) {
+    const std::uint64_t bits = ReadLE(p, 8);
+    double out = 0.0;
+    std::memcpy(&out, &bits, sizeof(out));
+    return out;
+}
+
+bool PatternMatchAt(const std::uint8_t* p, const ValueQuery& q) {
+    for (std::size_t k = 0; k < q.pattern.size(); ++k) {
+        if (q.mask[k] != 0u && p[k] != q.pattern[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MatchAt(const std::uint8_t* p, const ValueQuery& q) {
+    switch (q.kind) {
+    case ValueKind::kU8:
+    case ValueKind::kU16:
+    case ValueKind::kU32: {
+        const std::uint64_t v = ReadLE(p, ValueWidth(q));
+        return v >= q.minInt && v <= q.maxInt;
+    }
+    case ValueKind::kF32: {
+        const float v = ReadF32(p);
+        return v >= static_cast<float>(q.minFloat) && v <= static_cast<float>(q.maxFloat);
+    }
+    case ValueKind::kF64: {
+        const double v = ReadF64(p);
+        return v >= q.minFloat && v <= q.maxFloat;
+    }
+    case ValueKind::kBytes:
+        return PatternMatchAt(p, q);
+    }
+    return false;
+}
+
+std::uint32_t AlignmentBits(std::size_t alignment) {
+    std::uint32_t bits = 0;
+    for (std::size_t k = 0; k < kBlock; k += alignment) {
+        bits |= 1u << k;
+    }
+    return bits;
+}
+
+void EmitBits(std::uint32_t bits, std::size_t base, std::vector<std::size_t>* offsets) {
+    while (bits != 0u) {
+        std::size_t k = 0;
+        while (((bits >> k) & 1u) == 0u) {
+            ++k;
+        }
+        offsets->push_back(base + k);
+        bits &= bits - 1u;
+    }
+}
+
+#if SAVE_SEARCH_SSE2
+
+// Each helper returns a 16-bit mask whose bit k means "a value starting at p + k matches".
+// Values wider than one byte are tested with one unaligned load per byte phase.
+
+std::uint32_t BlockMaskU8(const std::uint8_t* p, __m128i lo, __m128i hi) {
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), bias);
+    const __m128i outside = _mm_or_si128(_mm_cmplt_epi8(v, lo), _mm_cmpgt_epi8(v, hi));
+    return static_cast<std::uint32_t>(~_mm_movemask_epi8(outside)) & 0xFFFFu;
+}
+
+std::uint32_t BlockMaskU16(const std::uint8_t* p, __m128i lo, __m128i hi) {
+    const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    std::uint32_t bits = 0;
+    for (std::size_t phase = 0; phase < 2; ++phase) {
+        const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + phase)), bias);
+        const __m128i outside = _mm_or_si128(_mm_cmplt_epi16(v, lo), _mm_cmpgt_epi16(v, hi));
+        const std::uint32_t lanes = static_cast<std::uint32_t>(~_mm_movemask_epi8(outside)) & 0x5555u;
+        bits |= lanes << phase;
+    }
+    return bits;
+}
+
+std::uint32_t BlockMaskU32(const std::uint8_t* p, __m128i lo, __m128i hi) {
+    const __m128i bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    std::uint32_t bits = 0;
+    for (std::size_t phase = 0; phase < 4; ++phase) {
+        const __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + phase)), bias);
+        const __m128i outside = _mm_or_si128(_mm_cmplt_epi32(v, lo), _mm_cmpgt_epi32(v, hi));
+        const std::uint32_t lanes = static_cast<std::uint32_t>(~_mm_movemask_ps(_mm_castsi128_ps(outside))) & 0xFu;
+        for (std::size_t lane = 0; lane < 4; ++lane) {
+            if (((lanes >> lane) & 1u) != 0u) {
+                bits |= 1u << (phase + lane * 4);
+            }
+        }
+    }
+    return bits;
+}
+
+std::uint32_t BlockMaskF32(const std::uint8_t* p, __m128 lo, __m128 hi) {
+    std::uint32_t bits = 0;
+    for (std::size_t phase = 0; phase < 4; ++phase) {
+        const __m128 v = _mm_loadu_ps(reinterpret_cast<const float*>(p + phase));
+        const __m128 inside = _mm_and_ps(_mm_cmpge_ps(v, lo), _mm_cmple_ps(v, hi));
+        const std::uint32_t lanes = static_cast<std::uint32_t>(_mm_movemask_ps(inside));
+        for (std::size_t lane = 0; lane < 4; ++lane) {
+            if (((lanes >> lane) & 1u) != 0u) {
+                bits |= 1u << (phase + lane * 4);
+            }
+        }
+    }
+    return bits;
+}
+
+std::uint32_t BlockMaskF64(const std::uint8_t* p, __m128d lo, __m128d hi) {
+    std::uint32_t bits = 0;
+    for (std::size_t phase = 0; phase < 8; ++phase) {
+        const __m128d v = _mm_loadu_pd(reinterpret_cast<const double*>(p + phase));
+        const __m128d inside = _mm_and_pd(_mm_cmpge_pd(v, lo), _mm_cmple_pd(v, hi));
+        const std::uint32_t lanes = static_cast<std::uint32_t>(_mm_movemask_pd(inside));
+        if ((lanes & 1u) != 0u) {
+            bits |= 1u << phase;
+        }
+        if ((lanes & 2u) != 0u) {
+            bits |= 1u << (phase + 8);
+        }
+    }
+    return bits;
+}
+
+std::uint32_t BlockMaskAnchors(const std::uint8_t* p, std::size_t first, __m128i firstByte, std::size_t last, __m128i lastByte) {
+    const __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + first)), firstByte);
+    const __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + last)), lastByte);
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(a, b)));
+}
+
+// Returns the offset where the scalar tail has to continue.
+std::size_t ScanBlocks(const std::uint8_t* data, std::size_t size, const ValueQuery& q, std::vector<std::size_t>* offsets) {
+    const std::size_t width = ValueWidth(q);
+    if (width == 0 || size < kBlock + width - 1) {
+        return 0;
+    }
+    const std::size_t limit = size - (kBlock + width - 1);
+    const std::uint32_t alignBits = AlignmentBits(q.alignment);
+    std::size_t i = 0;
+
+    switch (q.kind) {
+    case ValueKind::kU8: {
+        const __m128i lo = _mm_set1_epi8(static_cast<char>(static_cast<std::uint8_t>(q.minInt) ^ 0x80u));
+        const __m128i hi = _mm_set1_epi8(static_cast<char>(static_cast<std::uint8_t>(q.maxInt) ^ 0x80u));
+        for (; i <= limit; i += kBlock) {
+            EmitBits(BlockMaskU8(data + i, lo, hi) & alignBits, i, offsets);
+        }
+        break;
+    }
+    case ValueKind::kU16: {
+        const __m128i lo = _mm_set1_epi16(static_cast<short>(static_cast<std::uint16_t>(q.minInt) ^ 0x8000u));
+        const __m128i hi = _mm_set1_epi16(static_cast<short>(static_cast<std::uint16_t>(q.maxInt) ^ 0x8000u));
+        for (; i <= limit; i += kBlock) {
+            EmitBits(BlockMaskU16(data + i, lo, hi) & alignBits, i, offsets);
+        }
+        break;
+    }
+    case ValueKind::kU32: {
+        const __m128i lo = _mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(q.minInt) ^ 0x80000000u));
+        const __m128i hi = _mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(q.maxInt) ^ 0x80000000u));
+        for (; i <= limit; i += kBlock) {
+            EmitBits(BlockMaskU32(data + i, lo, hi) & alignBits, i, offsets);
+        }
+        break;
+    }
+    case ValueKind::kF32: {
+        const __m128 lo = _mm_set1_ps(static_cast<float>(q.minFloat));
+        const __m128 hi = _mm_set1_ps(static_cast<float>(q.maxFloat));
+        for (; i <= limit; i += kBlock) {
+            EmitBits(BlockMaskF32(data + i, lo, hi) & alignBits, i, offsets);
+        }
+        break;
+    }
+    case ValueKind::kF64: {
+        const __m128d lo = _mm_set1_pd(q.minFloat);
+        const __m128d hi = _mm_set1_pd(q.maxFloat);
+        for (; i <= limit; i += kBlock) {
+            EmitBits(BlockMaskF64(data + i, lo, hi) & alignBits, i, offsets);
+        }
+        break;
+    }
+    case ValueKind::kBytes: {
+        std::size_t first = q.pattern.size();
+        std::size_t last = 0;
+        for (std::size_t k = 0; k < q.pattern.size(); ++k) {
+            if (q.mask[k] != 0u) {
+                first = std::min(first, k);
+                last = k;
+            }
+        }
+        if (first == q.pattern.size()) {
+            return 0;
+        }
+        const __m128i firstByte = _mm_set1_epi8(static_cast<char>(q.pattern[first]));
+        const __m128i lastByte = _mm_set1_epi8(static_cast<char>(q.pattern[last]));
+        for (; i <= limit; i += kBlock) {
+            std::uint32_t bits = BlockMaskAnchors(data + i, first, firstByte, last, lastByte) & alignBits;
+            while (bits != 0u) {
+                std::size_t k = 0;
+                while (((bits >> k) & 1u) == 0u) {
+                    ++k;
+                }
+                if (PatternMatchAt(data + i + k, q)) {
+                    offsets->push_back(i + k);
+                }
+                bits &= bits - 1u;
+            }
+        }
+        break;
+    }
+    }
+    return i;
+}
+
+#endif
+
+bool ParseIntBound(const std::string& s, std::uint64_t maxValue, std::uint64_t* out) {
+    if (s.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    const unsigned long long v = std::strtoull(s.c_str(), &end, 0);
+    if (end == nullptr || *end != '\0' || s[0] == '-' || v > maxValue) {
+        return false;
+    }
+    *out = static_cast<std::uint64_t>(v);
+    return true;
+}
+
+bool ParseFloatBound(const std::string& s, double* out) {
+    if (s.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    const double v = std::strtod(s.c_str(), &end);
+    if (end == nullptr || *end != '\0' || !std::isfinite(v)) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+int HexNibble(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool ParseBytePattern(const std::string& text, ValueQuery* out) {
+    std::string compact;
+    for (char c : text) {
+        if (c != ' ' && c != '\t' && c != ',') {
+            compact.push_back(c);
+        }
+    }
+    if (compact.empty() || (compact.size() % 2) != 0) {
+        return false;
+    }
+    for (std::size_t i = 0; i < compact.size(); i += 2) {
+        if (compact[i] == '?' && compact[i + 1] == '?') {
+            out->pattern.push_back(0);
+            out->mask.push_back(0);
+            continue;
+        }
+        const int hi = HexNibble(compact[i]);
+        const int lo = HexNibble(compact[i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out->pattern.push_back(static_cast<std::uint8_t>((hi << 4) | lo));
+        out->mask.push_back(0xFFu);
+    }
+    return true;
+}
+
+void SetError(std::string* error, const std::string& message) {
+    if (error != nullptr) {
+        *error = message;
+    }
+}
+
+}  // namespace
+
+std::size_t ValueWidth(const ValueQuery& query) {
+    switch (query.kind) {
+    case ValueKind::kU8:
+        return 1;
+    case ValueKind::kU16:
+        return 2;
+    case ValueKind::kU32:
+    case ValueKind::kF32:
+        return 4;
+    case ValueKind::kF64:
+        return 8;
+    case ValueKind::kBytes:
+        return query.pattern.size();
+    }
+    return 0;
+}
+
+bool ParseValueQuery(const std::string& kind,
+                     const std::string& value,
+                     double tolerance,
+                     ValueQuery* out,
+                     std::string* error) {
+    if (out == nullptr) {
+        SetError(error, "null output query");
+        return false;
+    }
+    ValueQuery q;
+    if (kind == "bytes") {
+        q.kind = ValueKind::kBytes;
+        if (!ParseBytePattern(value, &q)) {
+            SetError(error, "byte pattern must be hex pairs with optional ?? wildcards");
+            return false;
+        }
+        *out = std::move(q);
+        return true;
+    }
+    if (kind == "ascii") {
+        q.kind = ValueKind::kBytes;
+        if (value.empty()) {
+            SetError(error, "ascii pattern is empty");
+            return false;
+        }
+        q.pattern.assign(value.begin(), value.end());
+        q.mask.assign(value.size(), 0xFFu);
+        *out = std::move(q);
+        return true;
+    }
+
+    std::string loText = value;
+    std::string hiText = value;
+    const std::size_t sep = value.find("..");
+    if (sep != std::string::npos) {
+        loText = value.substr(0, sep);
+        hiText = value.substr(sep + 2);
+    }
+
+    if (kind == "f32" || kind == "f64") {
+        q.kind = (kind == "f32") ? ValueKind::kF32 : ValueKind::kF64;
+        if (!ParseFloatBound(loText, &q.minFloat) || !ParseFloatBound(hiText, &q.maxFloat) || q.minFloat > q.maxFloat) {
+            SetError(error, "invalid float value or range: " + value);
+            return false;
+        }
+        if (tolerance < 0.0 || !std::isfinite(tolerance)) {
+            SetError(error, "tolerance must be a finite non-negative number");
+            return false;
+        }
+        q.minFloat -= tolerance;
+        q.maxFloat += tolerance;
+        *out = std::move(q);
+        return true;
+    }
+
+    std::uint64_t maxValue = 0;
+    if (kind == "u8") {
+        q.kind = ValueKind::kU8;
+        maxValue = 0xFFu;
+    } else if (kind == "u16") {
+        q.kind = ValueKind::kU16;
+        maxValue = 0xFFFFu;
+    } else if (kind == "u32") {
+        q.kind = ValueKind::kU32;
+        maxValue = 0xFFFFFFFFu;
+    } else {
+        SetError(error, "unknown value kind: " + kind);
+        return false;
+    }
+    if (!ParseIntBound(loText, maxValue, &q.minInt) || !ParseIntBound(hiText, maxValue, &q.maxInt) || q.minInt > q.maxInt) {
+        SetError(error, "invalid integer value or range: " + value);
+        return false;
+    }
+    *out = std::move(q);
+    return true;
+}
+
+void ScanBuffer(const std::uint8_t* data, std::size_t size, const ValueQuery& query, std::vector<std::size_t>* offsets) {
+    if (data == nullptr || offsets == nullptr) {
+        return;
+    }
+    const std::size_t width = ValueWidth(query);
+    if (width == 0 || size < width) {
+        return;
+    }
+    const std::size_t alignment = std::max<std::size_t>(1, query.alignment);
+    std::size_t i = 0;
+#if SAVE_SEARCH_SSE2
+    if ((kBlock % alignment) == 0) {
+        i = ScanBlocks(data, size, query, offsets);
+    }
+#endif
+    for (; i + width <= size; ++i) {
+        if ((i % alignment) == 0 && MatchAt(data + i, query)) {
+            offsets->push_back(i);
+        }
+    }
+}
+
+std::string ActorNameForSegment(const mafia_save::SaveData& save, std::size_t segIdx) {
+    if (segIdx >= save.segments.size()) {
+        return {};
+    }
+    std::size_t hdrIdx = segIdx;
+    if (save.segments[segIdx].name.rfind("actor_payload_", 0) == 0) {
+        if (segIdx == 0) {
+            return {};
+        }
+        hdrIdx = segIdx - 1;
+    }
+    const auto& hdr = save.segments[hdrIdx];
+    if (hdr.name.rfind("actor_header_", 0) != 0 || hdr.plain.size() < mafia_save::kActorHeaderSize) {
+        return {};
+    }
+    std::size_t len = 0;
+    while (len < 64 && hdr.plain[len] != 0) {
+        ++len;
+    }
+    return std::string(reinterpret_cast<const char*>(hdr.plain.data()), len);
+}
+
+bool FindValues(const mafia_save::SaveData& save, const ValueQuery& query, std::vector<Hit>* out, std::string* error) {
+    if (out == nullptr) {
+        SetError(error, "null output hit vector");
+        return false;
+    }
+    if (ValueWidth(query) == 0) {
+        SetError(error, "empty search value");
+        return false;
+    }
+    if (query.alignment == 0) {
+        SetError(error, "alignment must be at least 1");
+        return false;
+    }
+    out->clear();
+
+    std::vector<std::size_t> offsets;
+    std::size_t abs = mafia_save::kFileHeaderSize;
+    for (std::size_t segIdx = 0; segIdx < save.segments.size(); ++segIdx) {
+        const auto& seg = save.segments[segIdx];
+        offsets.clear();
+        ScanBuffer(seg.plain.data(), seg.plain.size(), query, &offsets);
+        if (!offsets.empty()) {
+            const std::string actorName = ActorNameForSegment(save, segIdx);
+            for (std::size_t off : offsets) {
+                Hit hit;
+                hit.segIdx = segIdx;
+                hit.offset = off;
+                hit.fileOffset = abs + off;
+                hit.actorName = actorName;
+                out->push_back(std::move(hit));
+            }
+        }
+        abs += seg.plain.size();
+    }
+    return true;
+}
+
+}  // namespace save_search
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace save_search {
+
+enum class ValueKind {
+    kU8,
+    kU16,
+    kU32,
+    kF32,
+    kF64,
+    kBytes,
+};
+
+// Inclusive value range (exact match when min == max) or a byte pattern.
+// For kBytes, mask[i] == 0 marks pattern[i] as a wildcard.
+struct ValueQuery {
+    ValueKind kind = ValueKind::kU32;
+    std::uint64_t minInt = 0;
+    std::uint64_t maxInt = 0;
+    double minFloat = 0.0;
+    double maxFloat = 0.0;
+    std::vector<std::uint8_t> pattern;
+    std::vector<std::uint8_t> mask;
+    std::size_t alignment = 1;
+};
+
+struct Hit {
+    std::size_t segIdx = mafia_save::kNoIndex;
+    std::size_t offset = 0;
+    std::size_t fileOffset = 0;
+    std::string actorName;
+};
+
+// kind: u8/u16/u32/f32/f64 with "<value>" or "<lo>..<hi>", bytes with hex pairs and "??" wildcards
+// ("4D 61 ?? 69"), ascii with a literal string.
+bool ParseValueQuery(const std::string& kind,
+                     const std::string& value,
+                     double tolerance,
+                     ValueQuery* out,
+                     std::string* error = nullptr);
+
+std::size_t ValueWidth(const ValueQuery& query);
+
+// Appends matching start offsets in ascending order.
+void ScanBuffer(const std::uint8_t* data, std::size_t size, const ValueQuery& query, std::vector<std::size_t>* offsets);
+
+std::string ActorNameForSegment(const mafia_save::SaveData& save, std::size_t segIdx);
+
+bool FindValues(const mafia_save::SaveData& save,
+                const ValueQuery& query,
+                std::vector<Hit>* out,
+                std::string* error = nullptr);
+
+}  // namespace save_search
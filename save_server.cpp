@@ -0,0 +1,629 @@
+#include "save_server.hpp"
+
+#include "save_edit.hpp"
+#include "save_query.hpp"
+#include "save_scan.hpp"
+#include "save_timeline.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SAVE_SERVER_UNIX 1
+#endif
+
+namespace save_server {
+
+namespace {
+
+constexpr std::size_t kMaxRequestBytes = 1u << 20;
+constexpr int kPollMs = 200;
+
+std::string CacheKey(const fs::path& path) {
+    std::error_code ec;
+    fs::path abs = fs::absolute(path, ec);
+    if (ec) {
+        abs = path;
+    }
+    return abs.lexically_normal().string();
+}
+
+// Rough resident size of a parsed save: segment plaintext plus per-segment bookkeeping.
+std::size_t EstimateCost(const mafia_save::SaveData& save) {
+    std::size_t cost = sizeof(mafia_save::SaveData);
+    for (const mafia_save::Segment& seg : save.segments) {
+        cost += sizeof(mafia_save::Segment) + seg.name.capacity() + seg.plain.capacity();
+    }
+    return cost;
+}
+
+// Splits on blanks; "..." groups an argument (\" and \\ escapes). ends[i] is the offset just past args[i].
+bool SplitArgs(const std::string& line,
+               std::vector<std::string>* out,
+               std::vector<std::size_t>* ends,
+               std::string* error) {
+    std::size_t i = 0;
+    while (i < line.size()) {
+        if (line[i] == ' ' || line[i] == '\t') {
+            ++i;
+            continue;
+        }
+        std::string arg;
+        if (line[i] == '"') {
+            ++i;
+            bool closed = false;
+            while (i < line.size()) {
+                const char c = line[i++];
+                if (c == '"') {
+                    closed = true;
+                    break;
+                }
+                if (c == '\\' && i < line.size() && (line[i] == '"' || line[i] == '\\')) {
+                    arg.push_back(line[i++]);
+                    continue;
+                }
+                arg.push_back(c);
+            }
+            if (!closed) {
+                *error = "unterminated quote";
+                return false;
+            }
+        } else {
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t') {
+                arg.push_back(line[i++]);
+            }
+        }
+        out->push_back(std::move(arg));
+        ends->push_back(i);
+    }
+    return true;
+}
+
+// The line after args[0..from), verbatim: expressions and scripts keep the quotes of their string literals.
+std::string RestOfLine(const std::string& line, const std::vector<std::size_t>& ends, std::size_t from) {
+    if (from == 0 || from > ends.size()) {
+        return std::string();
+    }
+    const std::size_t begin = line.find_first_not_of(" \t", ends[from - 1]);
+    return begin == std::string::npos ? std::string() : line.substr(begin);
+}
+
+std::string Error(const std::string& message) {
+    std::string line = "error " + message;
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    return line + "\n\n";
+}
+
+std::string Ok(const std::string& payload) {
+    return "ok\n" + payload + "\n";
+}
+
+const char* HitName(bool hit) {
+    return hit ? "hit" : "miss";
+}
+
+std::string CmdInspect(SaveCache* cache, const std::vector<std::string>& args) {
+    if (args.size() != 2) {
+        return Error("usage: inspect <save>");
+    }
+    bool hit = false;
+    std::string err;
+    const auto save = cache->Get(args[1], &hit, &err);
+    if (save == nullptr) {
+        return Error(err);
+    }
+    mafia_save::MetaFields meta;
+    if (!mafia_save::ReadMetaFields(*save, &meta, &err)) {
+        return Error(err);
+    }
+    std::ostringstream out;
+    out << "cache=" << HitName(hit) << "\n";
+    out << "size=" << save->rawSize << "\n";
+    out << "mission=" << mafia_save::ReadMissionName(*save) << "\n";
+    out << "slot=" << meta.slot << "\n";
+    out << "mission_code=" << meta.missionCode << "\n";
+    out << "hp_percent=" << meta.hpPercent << "\n";
+    out << "date=" << save_timeline::DateKey(meta.packedDate) << "\n";
+    out << "time=" << ((meta.packedTime >> 16) & 0xFFu) * 10000u + ((meta.packedTime >> 8) & 0xFFu) * 100u +
+                          (meta.packedTime & 0xFFu)
+        << "\n";
+    out << "actors=" << save->actorCount << "\n";
+    out << "segments=" << save->segments.size() << "\n";
+    for (const mafia_save::Segment& seg : save->segments) {
+        out << "segment " << seg.name << "=" << seg.plain.size() << "\n";
+    }
+    return Ok(out.str());
+}
+
+std::string CmdGet(SaveCache* cache, const std::vector<std::string>& args, const std::string& expression) {
+    if (args.size() < 3) {
+        return Error("usage: get <save> <expression>");
+    }
+    std::string err;
+    save_query::Query query;
+    if (!save_query::CompileValue(expression, &query, &err)) {
+        return Error(err);
+    }
+    bool hit = false;
+    const auto save = cache->Get(args[1], &hit, &err);
+    if (save == nullptr) {
+        return Error(err);
+    }
+    std::string value;
+    if (!save_query::EvaluateSave(query, *save, args[1], &value, &err)) {
+        return Error(err);
+    }
+    return Ok("cache=" + std::string(HitName(hit)) + "\nvalue=" + value + "\n");
+}
+
+std::string CmdPatch(SaveCache* cache, const std::vector<std::string>& args, const std::string& statements) {
+    if (args.size() < 4) {
+        return Error("usage: patch <save> <out> <statement>[; <statement>...]");
+    }
+    std::string text = statements;
+    std::replace(text.begin(), text.end(), ';', '\n');
+    std::string err;
+    save_edit::Script script;
+    if (!save_edit::ParseScript(text, &script, &err)) {
+        return Error(err);
+    }
+    bool hit = false;
+    const auto save = cache->Get(args[1], &hit, &err);
+    if (save == nullptr) {
+        return Error(err);
+    }
+    mafia_save::SaveData edited = *save;
+    std::vector<save_edit::StatementResult> results;
+    save_edit::ApplyToSave(script, &edited, &results);
+    std::vector<std::uint8_t> raw;
+    if (!mafia_save::BuildRaw(edited, &raw, &err)) {
+        return Error(err);
+    }
+    const fs::path out = args[2];
+    if (!mafia_save::WriteFileBytesAtomic(out, raw, &err)) {
+        return Error(err);
+    }
+    cache->Invalidate(out);
+
+    std::ostringstream payload;
+    payload << "cache=" << HitName(hit) << "\n";
+    std::size_t changed = 0;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        payload << "statement " << (i + 1) << " matched=" << results[i].matched << " changed=" << results[i].changed
+                << " skipped=" << results[i].skipped << "\n";
+        changed += results[i].changed;
+    }
+    payload << "changed=" << changed << "\n";
+    payload << "written=" << out.string() << "\n";
+    return Ok(payload.str());
+}
+
+std::string CmdBuild(SaveCache* cache, const std::vector<std::string>& args) {
+    if (args.size() != 3) {
+        return Error("usage: build <save> <out>");
+    }
+    bool hit = false;
+    std::string err;
+    const auto save = cache->Get(args[1], &hit, &err);
+    if (save == nullptr) {
+        return Error(err);
+    }
+    std::vector<std::uint8_t> raw;
+    if (!mafia_save::BuildRaw(*save, &raw, &err)) {
+        return Error(err);
+    }
+    const fs::path out = args[2];
+    if (!mafia_save::WriteFileBytesAtomic(out, raw, &err)) {
+        return Error(err);
+    }
+    cache->Invalidate(out);
+    return Ok("cache=" + std::string(HitName(hit)) + "\nbytes=" + std::to_string(raw.size()) + "\nwritten=" +
+              out.string() + "\n");
+}
+
+std::string CmdDiff(SaveCache* cache, const std::vector<std::string>& args) {
+    if (args.size() != 3) {
+        return Error("usage: diff <a> <b>");
+    }
+    bool hitA = false;
+    bool hitB = false;
+    std::string err;
+    const auto a = cache->Get(args[1], &hitA, &err);
+    if (a == nullptr) {
+        return Error(args[1] + ": " + err);
+    }
+    const auto b = cache->Get(args[2], &hitB, &err);
+    if (b == nullptr) {
+        return Error(args[2] + ": " + err);
+    }
+    std::ostringstream out;
+    std::size_t segments = 0;
+    std::size_t bytes = 0;
+    const std::size_t count = std::max(a->segments.size(), b->segments.size());
+    for (std::size_t i = 0; i < count; ++i) {
+        const mafia_save::Segment* sa = i < a->segments.size() ? &a->segments[i] : nullptr;
+        const mafia_save::Segment* sb = i < b->segments.size() ? &b->segments[i] : nullptr;
+        const std::size_t sizeA = sa != nullptr ? sa->plain.size() : 0;
+        const std::size_t sizeB = sb != nullptr ? sb->plain.size() : 0;
+        std::size_t diff = std::max(sizeA, sizeB) - std::min(sizeA, sizeB);
+        for (std::size_t k = 0; k < std::min(sizeA, sizeB); ++k) {
+            diff += sa->plain[k] != sb->plain[k] ? 1 : 0;
+        }
+        const bool renamed = sa != nullptr && sb != nullptr && sa->name != sb->name;
+        if (diff == 0 && !renamed) {
+            continue;
+        }
+        ++segments;
+        bytes += diff;
+        out << "segment " << (sa != nullptr ? sa->name : sb->name);
+        if (renamed) {
+            out << "/" << sb->name;
+        }
+        out << " size_a=" << sizeA << " size_b=" << sizeB << " diff=" << diff << "\n";
+    }
+    out << "differing_segments=" << segments << "\n";
+    out << "differing_bytes=" << bytes << "\n";
+    return Ok(out.str());
+}
+
+std::string CmdScan(const ServeOptions& options, const std::vector<std::string>& args) {
+    if (args.size() < 2 || args.size() > 3 || (args.size() == 3 && args[2] != "header-only")) {
+        return Error("usage: scan <dir> [header-only]");
+    }
+    save_scan::ScanOptions scan;
+    scan.threads = options.scanThreads;
+    scan.headerOnly = args.size() == 3;
+    save_scan::ScanReport report;
+    std::string err;
+    if (!save_scan::ScanDirectory(args[1], scan, &report, &err)) {
+        return Error(err);
+    }
+    std::ostringstream out;
+    for (const save_scan::ScanRecord& record : report.records) {
+        save_scan::WriteNdjsonRecord(out, record);
+    }
+    return Ok(out.str());
+}
+
+std::string CmdStats(SaveCache* cache) {
+    const CacheStats s = cache->Stats();
+    std::ostringstream out;
+    out << "hits=" << s.hits << "\n";
+    out << "misses=" << s.misses << "\n";
+    out << "invalidations=" << s.invalidations << "\n";
+    out << "evictions=" << s.evictions << "\n";
+    out << "entries=" << s.entries << "\n";
+    out << "bytes=" << s.bytes << "\n";
+    out << "capacity=" << s.capacity << "\n";
+    return Ok(out.str());
+}
+
+#ifdef SAVE_SERVER_UNIX
+
+bool SendAll(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+#ifdef MSG_NOSIGNAL
+        const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#else
+        const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, 0);
+#endif
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool Stopped(const ServeOptions& options, const std::atomic<bool>& shutdown) {
+    return shutdown.load() || (options.stop != nullptr && options.stop->load());
+}
+
+void ServeConnection(int fd, SaveCache* cache, const ServeOptions& options, std::atomic<bool>* shutdown) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    std::string buffer;
+    char chunk[4096];
+    while (!Stopped(options, *shutdown)) {
+        pollfd pfd{fd, POLLIN, 0};
+        const int ready = ::poll(&pfd, 1, kPollMs);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(n));
+
+        bool open = true;
+        std::size_t start = 0;
+        for (std::size_t nl = buffer.find('\n', start); nl != std::string::npos; nl = buffer.find('\n', start)) {
+            std::string line = buffer.substr(start, nl - start);
+            start = nl + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            bool stop = false;
+            if (!SendAll(fd, HandleRequest(cache, options, line, &stop))) {
+                open = false;
+                break;
+            }
+            if (stop) {
+                shutdown->store(true);
+                open = false;
+                break;
+            }
+        }
+        buffer.erase(0, start);
+        if (open && buffer.size() > kMaxRequestBytes) {
+            SendAll(fd, Error("request line too long"));
+            open = false;
+        }
+        if (!open) {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+#endif
+
+}  // namespace
+
+SaveCache::SaveCache(std::size_t capacityBytes) : capacity_(capacityBytes) {
+    stats_.capacity = capacityBytes;
+}
+
+std::shared_ptr<const mafia_save::SaveData> SaveCache::Get(const fs::path& path, bool* hit, std::string* error) {
+    if (hit != nullptr) {
+        *hit = false;
+    }
+    const std::string key = CacheKey(path);
+    std::error_code ec;
+    const std::uintmax_t size = fs::file_size(key, ec);
+    if (ec) {
+        if (error != nullptr) {
+            *error = "cannot stat " + path.string();
+        }
+        Invalidate(path);
+        return nullptr;
+    }
+    const fs::file_time_type mtime = fs::last_write_time(key, ec);
+    if (ec) {
+        if (error != nullptr) {
+            *error = "cannot stat " + path.string();
+        }
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (it->second.size == size && it->second.mtime == mtime) {
+                lru_.splice(lru_.begin(), lru_, it->second.lru);
+                ++stats_.hits;
+                if (hit != nullptr) {
+                    *hit = true;
+                }
+                return it->second.save;
+            }
+            DropLocked(it);
+            ++stats_.invalidations;
+        }
+        ++stats_.misses;
+    }
+
+    const std::vector<std::uint8_t> raw = mafia_save::ReadFileBytes(key);
+    if (raw.empty()) {
+        if (error != nullptr) {
+            *error = "failed to read " + path.string();
+        }
+        return nullptr;
+    }
+    auto save = std::make_shared<mafia_save::SaveData>();
+    if (!mafia_save::ParseSave(raw, save.get(), error)) {
+        return nullptr;
+    }
+    const std::size_t cost = EstimateCost(*save);
+    if (cost > capacity_) {
+        return save;  // served once, never cached
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        DropLocked(it);  // another request parsed the same file meanwhile
+    }
+    while (bytes_ + cost > capacity_ && !lru_.empty()) {
+        DropLocked(entries_.find(lru_.back()));
+        ++stats_.evictions;
+    }
+    lru_.push_front(key);
+    Entry& entry = entries_[key];
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.save = save;
+    entry.cost = cost;
+    entry.lru = lru_.begin();
+    bytes_ += cost;
+    return save;
+}
+
+void SaveCache::Invalidate(const fs::path& path) {
+    const std::string key = CacheKey(path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        DropLocked(it);
+        ++stats_.invalidations;
+    }
+}
+
+CacheStats SaveCache::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheStats s = stats_;
+    s.entries = entries_.size();
+    s.bytes = bytes_;
+    return s;
+}
+
+void SaveCache::DropLocked(std::unordered_map<std::string, Entry>::iterator it) {
+    bytes_ -= it->second.cost;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+std::string HandleRequest(SaveCache* cache, const ServeOptions& options, const std::string& line, bool* shutdown) {
+    std::vector<std::string> args;
+    std::vector<std::size_t> ends;
+    std::string err;
+    if (!SplitArgs(line, &args, &ends, &err)) {
+        return Error(err);
+    }
+    if (args.empty()) {
+        return Error("empty request");
+    }
+    const std::string& cmd = args[0];
+    if (cmd == "inspect") {
+        return CmdInspect(cache, args);
+    }
+    if (cmd == "get") {
+        return CmdGet(cache, args, RestOfLine(line, ends, 2));
+    }
+    if (cmd == "patch") {
+        return CmdPatch(cache, args, RestOfLine(line, ends, 3));
+    }
+    if (cmd == "build") {
+        return CmdBuild(cache, args);
+    }
+    if (cmd == "diff") {
+        return CmdDiff(cache, args);
+    }
+    if (cmd == "scan") {
+        return CmdScan(options, args);
+    }
+    if (cmd == "stats") {
+        return CmdStats(cache);
+    }
+    if (cmd == "shutdown") {
+        if (shutdown != nullptr) {
+            *shutdown = true;
+        }
+        return Ok("");
+    }
+    return Error("unknown command: " + cmd);
+}
+
+bool Serve(const fs::path& socketPath, const ServeOptions& options, std::string* error) {
+#ifdef SAVE_SERVER_UNIX
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    const std::string pathText = socketPath.string();
+    if (pathText.empty() || pathText.size() >= sizeof(addr.sun_path)) {
+        if (error != nullptr) {
+            *error = "socket path is empty or longer than " + std::to_string(sizeof(addr.sun_path) - 1) + " bytes";
+        }
+        return false;
+    }
+    std::memcpy(addr.sun_path, pathText.c_str(), pathText.size() + 1);
+
+    std::error_code ec;
+    if (fs::exists(fs::symlink_status(socketPath, ec))) {
+        if (!fs::is_socket(fs::symlink_status(socketPath, ec))) {
+            if (error != nullptr) {
+                *error = socketPath.string() + " exists and is not a socket";
+            }
+            return false;
+        }
+        fs::remove(socketPath, ec);
+    }
+
+    const int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        if (error != nullptr) {
+            *error = std::string("socket failed: ") + std::strerror(errno);
+        }
+        return false;
+    }
+    if (::bind(listenFd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, 64) != 0) {
+        if (error != nullptr) {
+            *error = "cannot listen on " + pathText + ": " + std::strerror(errno);
+        }
+        ::close(listenFd);
+        return false;
+    }
+
+    SaveCache cache(options.cacheBytes);
+    std::atomic<bool> shutdown{false};
+    struct Worker {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<Worker> workers;
+    auto reap = [&workers](bool all) {
+        for (auto it = workers.begin(); it != workers.end();) {
+            if (all || it->done->load()) {
+                it->thread.join();
+                it = workers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    while (!Stopped(options, shutdown)) {
+        pollfd pfd{listenFd, POLLIN, 0};
+        const int ready = ::poll(&pfd, 1, kPollMs);
+        reap(false);
+        if (ready <= 0) {
+            continue;
+        }
+        const int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        workers.push_back({std::thread([fd, &cache, &options, &shutdown, done] {
+                               ServeConnection(fd, &cache, options, &shutdown);
+                               done->store(true);
+                           }),
+                           done});
+    }
+    ::close(listenFd);
+    reap(true);
+    fs::remove(socketPath, ec);
+    return true;
+#else
+    (void)socketPath;
+    (void)options;
+    if (error != nullptr) {
+        *error = "serve needs Unix domain sockets, which this build does not support";
+    }
+    return false;
+#endif
+}
+
+}  // namespace save_server
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace save_server {
+
+namespace fs = std::filesystem;
+
+constexpr std::size_t kDefaultCacheBytes = 256u * 1024u * 1024u;
+
+struct CacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;         // not cached, or dropped because mtime or size changed
+    std::uint64_t invalidations = 0;  // stale entries replaced on access or dropped after a write
+    std::uint64_t evictions = 0;      // dropped to stay under the byte budget
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+    std::size_t capacity = 0;
+};
+
+// Parsed saves keyed by absolute path, least recently used first out once the estimated
+// footprint exceeds the budget. An entry is reused only while the file's mtime and size match.
+// Safe to share between threads; parsing happens outside the lock.
+class SaveCache {
+public:
+    explicit SaveCache(std::size_t capacityBytes);
+
+    std::shared_ptr<const mafia_save::SaveData> Get(const fs::path& path, bool* hit, std::string* error = nullptr);
+    void Invalidate(const fs::path& path);
+    CacheStats Stats() const;
+
+private:
+    struct Entry {
+        std::uintmax_t size = 0;
+        fs::file_time_type mtime;
+        std::shared_ptr<const mafia_save::SaveData> save;
+        std::size_t cost = 0;
+        std::list<std::string>::iterator lru;
+    };
+    void DropLocked(std::unordered_map<std::string, Entry>::iterator it);
+
+    const std::size_t capacity_;
+    mutable std::mutex mutex_;
+    std::list<std::string> lru_;  // front = most recently used
+    std::unordered_map<std::string, Entry> entries_;
+    std::size_t bytes_ = 0;
+    CacheStats stats_;
+};
+
+// Line protocol, one request per line; arguments are separated by spaces and may be "quoted"
+// (\" and \\ escape inside quotes). <expression> and <script> are the rest of the line as sent,
+// so quotes there belong to their string literals. A response is "ok" or "error <message>", then
+// payload lines, then an empty line.
+//
+//   inspect <save>                    header fields, segment sizes, actor count
+//   get <save> <expression>           value of a query expression (see save_query), e.g. tommy.hp
+//   patch <save> <out> <script>       edit script (see save_edit), statements separated by ';'
+//   build <save> <out>                re-encrypt the parsed save to <out>
+//   diff <a> <b>                      differing plaintext bytes per segment
+//   scan <dir> [header-only]          save_scan NDJSON records
+//   stats                             cache counters
+//   shutdown                          stop the server after this response
+//
+// Outputs are written through a .tmp file and a rename; the output path is dropped from the cache.
+struct ServeOptions {
+    std::size_t cacheBytes = kDefaultCacheBytes;
+    unsigned scanThreads = 0;  // 0 = hardware concurrency
+    const std::atomic<bool>* stop = nullptr;
+};
+
+// Answers one request line. Sets *shutdown for the shutdown command.
+std::string HandleRequest(SaveCache* cache, const ServeOptions& options, const std::string& line, bool* shutdown);
+
+// Listens on a Unix domain socket (a stale socket file is replaced) and serves every connection
+// on its own thread until *options.stop becomes true or a client sends shutdown.
+bool Serve(const fs::path& socketPath, const ServeOptions& options, std::string* error = nullptr);
+
+}  // namespace save_server
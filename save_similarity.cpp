@@ -0,0 +1,386 @@
+#include "save_similarity.hpp"
+
+#include "save_archive.hpp"
+#include "save_index.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace save_similarity {
+
+namespace {
+
+constexpr std::size_t kMinChunk = 8;
+constexpr std::size_t kMaxChunk = 128;
+constexpr std::uint32_t kChunkMask = 0x1Fu;  // ~32 bytes past the minimum: actor headers still split
+constexpr std::size_t kMaxBucketReps = 8;
+
+std::uint64_t Mix64(std::uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+struct Tables {
+    std::array<std::uint32_t, 256> gear{};
+    std::array<std::uint64_t, kSignatureSize> seeds{};
+    Tables() {
+        for (std::size_t i = 0; i < gear.size(); ++i) {
+            gear[i] = static_cast<std::uint32_t>(Mix64(0x6D61666961ull + i));
+        }
+        for (std::size_t i = 0; i < seeds.size(); ++i) {
+            seeds[i] = Mix64(0x5349474Eull * (i + 1));
+        }
+    }
+};
+
+const Tables& GetTables() {
+    static const Tables tables;
+    return tables;
+}
+
+void AddFeature(std::uint64_t feature, Signature* sig) {
+    const auto& seeds = GetTables().seeds;
+    for (std::size_t i = 0; i < kSignatureSize; ++i) {
+        const auto v = static_cast<std::uint32_t>(Mix64(feature ^ seeds[i]) >> 32);
+        if (v < (*sig)[i]) {
+            (*sig)[i] = v;
+        }
+    }
+}
+
+std::uint64_t ChunkFeature(SegmentKind kind, const std::uint8_t* data, std::size_t size) {
+    std::uint64_t h = 1469598103934665603ull ^ static_cast<std::uint64_t>(kind);
+    for (std::size_t i = 0; i < size; ++i) {
+        h = (h ^ data[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+bool IsArchive(const fs::path& path) {
+    const auto head = mafia_save::ReadFilePrefix(path, 4);
+    return head.size() == 4 && std::memcmp(head.data(), "MSAR", 4) == 0;
+}
+
+void LoadFiles(const std::vector<fs::path>& files, unsigned threads, Corpus* corpus) {
+    std::vector<Signature> sigs(files.size(), EmptySignature());
+    std::vector<char> ok(files.size(), 0);
+    std::vector<std::size_t> parts(files.size(), 0);
+    work_pool::ParallelFor(files.size(), threads, [&](unsigned, std::size_t i) {
+        mafia_save::SaveData save;
+        if (mafia_save::ParseSave(mafia_save::ReadFileBytes(files[i]), &save)) {
+            sigs[i] = SaveSignature(save);
+            parts[i] = save.segments.size();
+            ok[i] = 1;
+        }
+    });
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (!ok[i]) {
+            ++corpus->failed;
+            continue;
+        }
+        corpus->names.push_back(files[i].generic_string());
+        corpus->signatures.push_back(sigs[i]);
+        corpus->hashedParts += parts[i];
+    }
+}
+
+bool LoadArchive(const fs::path& path, unsigned threads, Corpus* corpus, std::string* error) {
+    save_archive::Archive archive;
+    if (!save_archive::OpenArchive(path, &archive, error)) {
+        return false;
+    }
+    const std::size_t saveCount = archive.saves.size();
+    const unsigned workers = work_pool::ResolveThreads(threads, std::max<std::size_t>(1, saveCount));
+    std::vector<std::ifstream> streams(workers);
+    for (auto& s : streams) {
+        s.open(path, std::ios::binary);
+    }
+
+    // Pass 1: segment kinds of every save (needs its info264 blob).
+    std::vector<std::vector<SegmentKind>> kinds(saveCount);
+    std::vector<char> ok(saveCount, 0);
+    work_pool::ParallelFor(saveCount, workers, [&](unsigned w, std::size_t i) {
+        const auto& entry = archive.saves[i];
+        std::vector<std::uint8_t> info;
+        if (entry.blobs.size() > 3 && save_archive::ReadBlob(streams[w], archive.blobs[entry.blobs[2]], &info)) {
+            kinds[i] = KindsFromInfo(info, entry.blobs.size());
+            ok[i] = 1;
+        }
+    });
+
+    // Pass 2: one partial signature per distinct (blob, kind).
+    std::vector<std::uint64_t> keys;
+    for (std::size_t i = 0; i < saveCount; ++i) {
+        for (std::size_t s = 0; ok[i] && s < kinds[i].size(); ++s) {
+            keys.push_back((static_cast<std::uint64_t>(archive.saves[i].blobs[s]) << 8) |
+                           static_cast<std::uint64_t>(kinds[i][s]));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::vector<Signature> partial(keys.size(), EmptySignature());
+    work_pool::ParallelFor(keys.size(), workers, [&](unsigned w, std::size_t k) {
+        std::vector<std::uint8_t> plain;
+        if (save_archive::ReadBlob(streams[w], archive.blobs[keys[k] >> 8], &plain)) {
+            partial[k] = SegmentSignature(static_cast<SegmentKind>(keys[k] & 0xFFu), plain);
+        }
+    });
+
+    // Pass 3: min-merge per save.
+    const std::string prefix = path.generic_string() + "#";
+    for (std::size_t i = 0; i < saveCount; ++i) {
+        if (!ok[i]) {
+            ++corpus->failed;
+            continue;
+        }
+        Signature sig = EmptySignature();
+        for (std::size_t s = 0; s < kinds[i].size(); ++s) {
+            const std::uint64_t key = (static_cast<std::uint64_t>(archive.saves[i].blobs[s]) << 8) |
+                                      static_cast<std::uint64_t>(kinds[i][s]);
+            MergeInto(&sig, partial[std::lower_bound(keys.begin(), keys.end(), key) - keys.begin()]);
+        }
+        corpus->names.push_back(prefix + std::to_string(i) + ":" + archive.saves[i].name);
+        corpus->signatures.push_back(sig);
+    }
+    corpus->hashedParts += keys.size();
+    return true;
+}
+
+std::uint64_t BandKey(const Signature& sig, std::size_t band) {
+    std::uint64_t h = Mix64(band + 1);
+    for (std::size_t r = 0; r < kRows; ++r) {
+        h = Mix64(h ^ sig[band * kRows + r]);
+    }
+    return h;
+}
+
+std::uint32_t Find(std::vector<std::uint32_t>* parent, std::uint32_t x) {
+    while ((*parent)[x] != x) {
+        (*parent)[x] = (*parent)[(*parent)[x]];
+        x = (*parent)[x];
+    }
+    return x;
+}
+
+}  // namespace
+
+SegmentKind KindOfSegment(const std::string& name) {
+    if (name == "head24") {
+        return SegmentKind::kHead;
+    }
+    if (name == "meta32") {
+        return SegmentKind::kMeta;
+    }
+    if (name == "info264") {
+        return SegmentKind::kInfo;
+    }
+    if (name == "game_payload") {
+        return SegmentKind::kGamePayload;
+    }
+    if (name == "ai_groups_payload") {
+        return SegmentKind::kAiGroups;
+    }
+    if (name == "ai_follow_payload") {
+        return SegmentKind::kAiFollow;
+    }
+    return name.rfind("actor_header_", 0) == 0 ? SegmentKind::kActorHeader : SegmentKind::kActorPayload;
+}
+
+std::vector<SegmentKind> KindsFromInfo(const std::vector<std::uint8_t>& info264, std::size_t segmentCount) {
+    mafia_save::SaveData info;
+    info.segments.push_back({"info264", info264});
+    info.idxInfo = 0;
+    std::vector<SegmentKind> kinds = {SegmentKind::kHead, SegmentKind::kMeta, SegmentKind::kInfo,
+                                      SegmentKind::kGamePayload};
+    if (mafia_save::ReadAiGroupsSize(info) > 0) {
+        kinds.push_back(SegmentKind::kAiGroups);
+    }
+    if (mafia_save::ReadAiFollowSize(info) > 0) {
+        kinds.push_back(SegmentKind::kAiFollow);
+    }
+    while (kinds.size() < segmentCount) {
+        const bool header = kinds.back() != SegmentKind::kActorHeader;
+        kinds.push_back(header ? SegmentKind::kActorHeader : SegmentKind::kActorPayload);
+    }
+    kinds.resize(segmentCount);
+    return kinds;
+}
+
+Signature EmptySignature() {
+    Signature sig;
+    sig.fill(0xFFFFFFFFu);
+    return sig;
+}
+
+void MergeInto(Signature* acc, const Signature& part) {
+    for (std::size_t i = 0; i < kSignatureSize; ++i) {
+        (*acc)[i] = std::min((*acc)[i], part[i]);
+    }
+}
+
+Signature SegmentSignature(SegmentKind kind, const std::vector<std::uint8_t>& plain) {
+    std::vector<std::uint8_t> normalized;
+    const std::vector<std::uint8_t>* data = &plain;
+    if (kind == SegmentKind::kMeta && plain.size() >= 16) {
+        normalized = plain;
+        std::fill(normalized.begin() + 8, normalized.begin() + 16, 0u);  // packedTime, packedDate
+        data = &normalized;
+    }
+
+    Signature sig = EmptySignature();
+    const auto& gear = GetTables().gear;
+    const std::uint8_t* p = data->data();
+    const std::size_t size = data->size();
+    std::size_t start = 0;
+    std::uint32_t rolling = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        rolling = (rolling << 1) + gear[p[i]];
+        const std::size_t len = i + 1 - start;
+        if ((len >= kMinChunk && (rolling & kChunkMask) == 0) || len == kMaxChunk) {
+            AddFeature(ChunkFeature(kind, p + start, len), &sig);
+            start = i + 1;
+            rolling = 0;
+        }
+    }
+    if (start < size || size == 0) {
+        AddFeature(ChunkFeature(kind, p + start, size - start), &sig);
+    }
+    return sig;
+}
+
+Signature SaveSignature(const mafia_save::SaveData& save) {
+    Signature sig = EmptySignature();
+    for (const auto& seg : save.segments) {
+        MergeInto(&sig, SegmentSignature(KindOfSegment(seg.name), seg.plain));
+    }
+    return sig;
+}
+
+double EstimateSimilarity(const Signature& a, const Signature& b) {
+    std::size_t same = 0;
+    for (std::size_t i = 0; i < kSignatureSize; ++i) {
+        same += a[i] == b[i] ? 1u : 0u;
+    }
+    return static_cast<double>(same) / static_cast<double>(kSignatureSize);
+}
+
+void LshIndex::Add(std::uint32_t id, const Signature& sig) {
+    for (std::size_t band = 0; band < kBands; ++band) {
+        buckets_[BandKey(sig, band)].push_back(id);
+    }
+}
+
+std::vector<std::uint32_t> LshIndex::Candidates(const Signature& sig) const {
+    std::vector<std::uint32_t> out;
+    for (std::size_t band = 0; band < kBands; ++band) {
+        const auto it = buckets_.find(BandKey(sig, band));
+        if (it != buckets_.end()) {
+            out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+bool LoadCorpus(const std::vector<fs::path>& inputs, unsigned threads, Corpus* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output corpus";
+        }
+        return false;
+    }
+    Corpus corpus;
+    std::vector<fs::path> files;
+    for (const auto& in : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(in, ec)) {
+            save_index::CollectSaveFiles(in, &files);
+        } else if (IsArchive(in)) {
+            LoadFiles(files, threads, &corpus);
+            files.clear();
+            if (!LoadArchive(in, threads, &corpus, error)) {
+                return false;
+            }
+        } else {
+            files.push_back(in);
+        }
+    }
+    LoadFiles(files, threads, &corpus);
+    for (std::uint32_t id = 0; id < corpus.signatures.size(); ++id) {
+        corpus.lsh.Add(id, corpus.signatures[id]);
+    }
+    *out = std::move(corpus);
+    return true;
+}
+
+std::vector<Neighbor> Nearest(const Corpus& corpus, const Signature& query, std::size_t top, bool exhaustive) {
+    std::vector<std::uint32_t> ids;
+    if (exhaustive) {
+        ids.resize(corpus.signatures.size());
+        std::iota(ids.begin(), ids.end(), 0u);
+    } else {
+        ids = corpus.lsh.Candidates(query);
+    }
+    std::vector<Neighbor> out;
+    out.reserve(ids.size());
+    for (const auto id : ids) {
+        out.push_back({id, EstimateSimilarity(query, corpus.signatures[id])});
+    }
+    const std::size_t keep = std::min(top, out.size());
+    std::partial_sort(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(keep), out.end(),
+                      [](const Neighbor& a, const Neighbor& b) {
+                          return a.similarity != b.similarity ? a.similarity > b.similarity : a.id < b.id;
+                      });
+    out.resize(keep);
+    return out;
+}
+
+std::vector<std::vector<std::uint32_t>> Clusters(const Corpus& corpus, double threshold) {
+    std::vector<std::uint32_t> parent(corpus.signatures.size());
+    std::iota(parent.begin(), parent.end(), 0u);
+
+    // Within a bucket, each member is compared with a few representatives only, keeping the
+    // work linear in bucket size even when thousands of near-identical autosaves share one.
+    corpus.lsh.ForEachBucket([&](const std::vector<std::uint32_t>& members) {
+        std::vector<std::uint32_t> reps;
+        for (const auto id : members) {
+            bool joined = false;
+            for (const auto rep : reps) {
+                if (EstimateSimilarity(corpus.signatures[id], corpus.signatures[rep]) >= threshold) {
+                    parent[Find(&parent, id)] = Find(&parent, rep);
+                    joined = true;
+                    break;
+                }
+            }
+            if (!joined && reps.size() < kMaxBucketReps) {
+                reps.push_back(id);
+            }
+        }
+    });
+
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> groups;
+    for (std::uint32_t id = 0; id < parent.size(); ++id) {
+        groups[Find(&parent, id)].push_back(id);
+    }
+    std::vector<std::vector<std::uint32_t>> out;
+    for (auto& kv : groups) {
+        if (kv.second.size() > 1) {
+            out.push_back(std::move(kv.second));
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+        return a.size() != b.size() ? a.size() > b.size() : a.front() < b.front();
+    });
+    return out;
+}
+
+}  // namespace save_similarity
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace save_similarity {
+
+namespace fs = std::filesystem;
+
+constexpr std::size_t kSignatureSize = 64;
+constexpr std::size_t kBands = 16;  // kBands * kRows == kSignatureSize; ~0.5 similarity collides half the time
+constexpr std::size_t kRows = 4;
+
+// MinHash over (segment kind, content-defined chunk) features. Min-merging the signatures of
+// parts gives the signature of their union, so segments shared by many saves are hashed once.
+using Signature = std::array<std::uint32_t, kSignatureSize>;
+
+enum class SegmentKind : std::uint8_t {
+    kHead,
+    kMeta,
+    kInfo,
+    kGamePayload,
+    kAiGroups,
+    kAiFollow,
+    kActorHeader,
+    kActorPayload,
+};
+
+SegmentKind KindOfSegment(const std::string& name);
+// Kinds of an archived save's segments in order, from its info264 plaintext (mirrors ParseSave).
+std::vector<SegmentKind> KindsFromInfo(const std::vector<std::uint8_t>& info264, std::size_t segmentCount);
+
+Signature EmptySignature();
+void MergeInto(Signature* acc, const Signature& part);
+// meta32 time/date words are zeroed first, so re-saving the same state does not change the signature.
+Signature SegmentSignature(SegmentKind kind, const std::vector<std::uint8_t>& plain);
+Signature SaveSignature(const mafia_save::SaveData& save);
+double EstimateSimilarity(const Signature& a, const Signature& b);
+
+class LshIndex {
+public:
+    void Add(std::uint32_t id, const Signature& sig);
+    // Ids sharing at least one band with sig, ascending, without duplicates.
+    std::vector<std::uint32_t> Candidates(const Signature& sig) const;
+    template <typename Fn>
+    void ForEachBucket(Fn&& fn) const {
+        for (const auto& kv : buckets_) {
+            fn(kv.second);
+        }
+    }
+
+private:
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> buckets_;  // (band, rows) hash -> ids
+};
+
+struct Corpus {
+    std::vector<std::string> names;  // file path or "<archive>#<id>:<name>"
+    std::vector<Signature> signatures;
+    LshIndex lsh;
+    std::size_t failed = 0;
+    std::size_t hashedParts = 0;  // distinct segment bodies (files) or (blob, kind) pairs (archives) hashed
+};
+
+// Inputs are save files, directories (recursive, GvaS files only) or .msar archives.
+bool LoadCorpus(const std::vector<fs::path>& inputs, unsigned threads, Corpus* out, std::string* error = nullptr);
+
+struct Neighbor {
+    std::uint32_t id = 0;
+    double similarity = 0.0;
+};
+
+// LSH candidates ranked by estimated similarity; exhaustive also scans non-candidates.
+std::vector<Neighbor> Nearest(const Corpus& corpus, const Signature& query, std::size_t top, bool exhaustive = false);
+
+// Saves connected by estimated similarity >= threshold within LSH buckets; clusters of two or more,
+// largest first, members ascending.
+std::vector<std::vector<std::uint32_t>> Clusters(const Corpus& corpus, double threshold);
+
+}  // namespace save_similarity
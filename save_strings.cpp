@@ -0,0 +1,203 @@
+#include "save_strings.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAVE_STRINGS_SSE2 1
+#include <emmintrin.h>
+#else
+#define SAVE_STRINGS_SSE2 0
+#endif
+
+namespace save_strings {
+
+namespace {
+
+constexpr std::uint64_t kFnvOffset = 0xCBF29CE484222325ull;
+constexpr std::uint64_t kFnvPrime = 0x100000001B3ull;
+
+bool IsPrintable(std::uint8_t b) {
+    return b >= 32u && b != 127u;
+}
+
+struct RunBuilder {
+    std::size_t minLen = 1;
+    std::size_t start = 0;
+    bool open = false;
+    std::vector<StringRun>* out = nullptr;
+
+    void Begin(std::size_t at) {
+        if (!open) {
+            start = at;
+            open = true;
+        }
+    }
+
+    void End(std::size_t at) {
+        if (open) {
+            if (at - start >= minLen) {
+                out->push_back(StringRun{start, at - start});
+            }
+            open = false;
+        }
+    }
+};
+
+std::size_t LowestBit(std::uint32_t bits) {
+    std::size_t k = 0;
+    while (((bits >> k) & 1u) == 0u) {
+        ++k;
+    }
+    return k;
+}
+
+#if SAVE_STRINGS_SSE2
+
+std::uint32_t PrintableMask(const std::uint8_t* p) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i geSpace = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(32)), v);
+    const __m128i isDel = _mm_cmpeq_epi8(v, _mm_set1_epi8(127));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_andnot_si128(isDel, geSpace)));
+}
+
+#endif
+
+}  // namespace
+
+void ExtractRuns(const std::uint8_t* data, std::size_t size, std::size_t minLen, std::vector<StringRun>* out) {
+    if (data == nullptr || out == nullptr) {
+        return;
+    }
+    RunBuilder rb;
+    rb.minLen = std::max<std::size_t>(1, minLen);
+    rb.out = out;
+
+    std::size_t i = 0;
+#if SAVE_STRINGS_SSE2
+    for (; i + 16 <= size; i += 16) {
+        const std::uint32_t printable = PrintableMask(data + i);
+        if (printable == 0xFFFFu) {
+            rb.Begin(i);
+            continue;
+        }
+        if (printable == 0u) {
+            rb.End(i);
+            continue;
+        }
+        // Walk alternating printable / non-printable stretches inside the block.
+        std::size_t k = 0;
+        while (k < 16) {
+            const std::uint32_t rest = printable >> k;
+            if ((rest & 1u) != 0u) {
+                rb.Begin(i + k);
+                const std::uint32_t stop = (~rest) & (0xFFFFu >> k);
+                k = (stop == 0u) ? 16 : k + LowestBit(stop);
+            } else {
+                rb.End(i + k);
+                k = (rest == 0u) ? 16 : k + LowestBit(rest);
+            }
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (IsPrintable(data[i])) {
+            rb.Begin(i);
+        } else {
+            rb.End(i);
+        }
+    }
+    rb.End(size);
+}
+
+std::uint64_t HashText(const std::uint8_t* data, std::size_t size) {
+    std::uint64_t h = kFnvOffset;
+    for (std::size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= kFnvPrime;
+    }
+    return h;
+}
+
+std::uint64_t HashText(const std::string& text) {
+    return HashText(reinterpret_cast<const std::uint8_t*>(text.data()), text.size());
+}
+
+bool BuildStringIndex(const mafia_save::SaveData& save, std::size_t minLen, StringIndex* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output string index";
+        }
+        return false;
+    }
+    StringIndex index;
+    index.minLen = std::max<std::size_t>(1, minLen);
+
+    std::vector<StringRun> runs;
+    for (std::size_t segIdx = 0; segIdx < save.segments.size(); ++segIdx) {
+        const auto& plain = save.segments[segIdx].plain;
+        runs.clear();
+        ExtractRuns(plain.data(), plain.size(), index.minLen, &runs);
+        for (const auto& run : runs) {
+            Occurrence occ;
+            occ.segIdx = segIdx;
+            occ.offset = run.offset;
+            occ.length = static_cast<std::uint32_t>(run.length);
+            occ.hash = HashText(plain.data() + run.offset, run.length);
+            index.byHash[occ.hash].push_back(index.occurrences.size());
+            index.occurrences.push_back(occ);
+        }
+    }
+    *out = std::move(index);
+    return true;
+}
+
+std::string OccurrenceText(const mafia_save::SaveData& save, const Occurrence& occ) {
+    if (occ.segIdx >= save.segments.size()) {
+        return {};
+    }
+    const auto& plain = save.segments[occ.segIdx].plain;
+    if (occ.offset + occ.length > plain.size()) {
+        return {};
+    }
+    return std::string(reinterpret_cast<const char*>(plain.data() + occ.offset), occ.length);
+}
+
+std::vector<Occurrence> FindReferences(const mafia_save::SaveData& save,
+                                       const StringIndex& index,
+                                       const std::string& text,
+                                       bool exact) {
+    std::vector<Occurrence> out;
+    if (text.empty()) {
+        return out;
+    }
+    if (exact) {
+        const auto it = index.byHash.find(HashText(text));
+        if (it == index.byHash.end()) {
+            return out;
+        }
+        for (std::size_t occIdx : it->second) {
+            const auto& occ = index.occurrences[occIdx];
+            const auto& plain = save.segments[occ.segIdx].plain;
+            if (occ.length == text.size() && std::memcmp(plain.data() + occ.offset, text.data(), text.size()) == 0) {
+                out.push_back(occ);
+            }
+        }
+        return out;
+    }
+
+    for (const auto& occ : index.occurrences) {
+        if (occ.length < text.size()) {
+            continue;
+        }
+        const auto& plain = save.segments[occ.segIdx].plain;
+        const char* begin = reinterpret_cast<const char*>(plain.data() + occ.offset);
+        const char* end = begin + occ.length;
+        if (std::search(begin, end, text.begin(), text.end()) != end) {
+            out.push_back(occ);
+        }
+    }
+    return out;
+}
+
+}  // namespace save_strings
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace save_strings {
+
+constexpr std::size_t kDefaultMinLen = 3;
+
+// Maximal run of printable ANSI bytes (>= 32, != 127), same class as the GUI text fields.
+struct StringRun {
+    std::size_t offset = 0;
+    std::size_t length = 0;
+};
+
+struct Occurrence {
+    std::size_t segIdx = mafia_save::kNoIndex;
+    std::size_t offset = 0;
+    std::uint32_t length = 0;
+    std::uint64_t hash = 0;
+};
+
+struct StringIndex {
+    std::size_t minLen = kDefaultMinLen;
+    std::vector<Occurrence> occurrences;
+    std::unordered_map<std::uint64_t, std::vector<std::size_t>> byHash;
+};
+
+void ExtractRuns(const std::uint8_t* data, std::size_t size, std::size_t minLen, std::vector<StringRun>* out);
+std::uint64_t HashText(const std::uint8_t* data, std::size_t size);
+std::uint64_t HashText(const std::string& text);
+
+bool BuildStringIndex(const mafia_save::SaveData& save,
+                      std::size_t minLen,
+                      StringIndex* out,
+                      std::string* error = nullptr);
+
+std::string OccurrenceText(const mafia_save::SaveData& save, const Occurrence& occ);
+
+// exact: whole runs equal to text (hash lookup). Otherwise runs containing text.
+std::vector<Occurrence> FindReferences(const mafia_save::SaveData& save,
+                                       const StringIndex& index,
+                                       const std::string& text,
+                                       bool exact = true);
+
+}  // namespace save_strings
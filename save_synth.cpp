@@ -0,0 +1,356 @@
+#include "save_synth.hpp"
+
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace save_synth {
+
+namespace {
+
+constexpr std::uint32_t kActorTypeHuman = 2;
+constexpr std::uint32_t kActorTypeCar = 4;
+constexpr std::uint8_t kPayloadMarker = 3;
+constexpr std::uint8_t kSubtypeHuman = 6;
+constexpr std::uint8_t kSubtypeCar = 9;
+constexpr std::uint8_t kGameMarker = 10;
+constexpr std::uint8_t kProgramMarker = 2;
+constexpr std::size_t kActorBaseSize = 13;
+constexpr std::size_t kHumanTailSize = 34;
+constexpr std::size_t kMinCarPayloadSize = 349;  // through the odometer
+constexpr std::size_t kAiNameSize = 32;
+constexpr std::size_t kMaxActors = 1u << 20;
+
+const char* const kCarModels[] = {"thunderbird00.i3d", "bolt_v8_00.i3d", "falconer00.i3d", "lassiter00.i3d"};
+const char* const kHumanModels[] = {"gangster01.i3d", "policeman01.i3d", "civil01.i3d", "waiter.i3d"};
+
+struct Rng {
+    std::uint64_t state;
+
+    std::uint64_t Next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    std::uint32_t Below(std::uint32_t n) { return n == 0 ? 0 : static_cast<std::uint32_t>(Next() % n); }
+    float Range(float lo, float hi) {
+        return lo + (hi - lo) * static_cast<float>(Next() >> 40) / static_cast<float>(1u << 24);
+    }
+};
+
+void PutU16(std::vector<std::uint8_t>* p, std::size_t off, std::uint16_t v) {
+    (*p)[off] = static_cast<std::uint8_t>(v & 0xFFu);
+    (*p)[off + 1] = static_cast<std::uint8_t>(v >> 8);
+}
+
+void PutF32(std::vector<std::uint8_t>* p, std::size_t off, float v) {
+    std::uint32_t bits = 0;
+    std::memcpy(&bits, &v, sizeof(bits));
+    mafia_save::WriteU32LE(p, off, bits);
+}
+
+void AppendU32(std::vector<std::uint8_t>* p, std::uint32_t v) {
+    p->resize(p->size() + 4);
+    mafia_save::WriteU32LE(p, p->size() - 4, v);
+}
+
+void AppendName(std::vector<std::uint8_t>* p, const std::string& name, std::size_t fieldSize) {
+    const std::size_t at = p->size();
+    p->resize(at + fieldSize, 0u);
+    std::copy(name.begin(), name.begin() + static_cast<std::ptrdiff_t>(std::min(name.size(), fieldSize - 1)),
+              p->begin() + static_cast<std::ptrdiff_t>(at));
+}
+
+// C_actor::Actor_SaveGameSave record: u32 nameLen (incl. NUL), u32 type, name.
+void AppendActorChunk(std::vector<std::uint8_t>* p, const std::string& name, std::uint32_t type) {
+    AppendU32(p, name.empty() ? 0u : static_cast<std::uint32_t>(name.size() + 1));
+    AppendU32(p, type);
+    if (!name.empty()) {
+        p->insert(p->end(), name.begin(), name.end());
+        p->push_back(0u);
+    }
+}
+
+// C_actor base record without car frames: marker, state, id, active, remove, frame, u32 frame count.
+std::vector<std::uint8_t> ActorBase(std::uint32_t id, std::uint8_t subtype) {
+    std::vector<std::uint8_t> p(kActorBaseSize + 1, 0u);
+    p[0] = kPayloadMarker;
+    mafia_save::WriteU32LE(&p, 2, 0x80000000u | id);
+    p[6] = 1u;
+    p[8] = 1u;
+    p[kActorBaseSize] = subtype;
+    return p;
+}
+
+std::vector<std::uint8_t> HumanPayload(std::uint32_t id, const std::string& usedCar, Rng* rng) {
+    std::vector<std::uint8_t> p = ActorBase(id, kSubtypeHuman);
+    p.resize(save_layout::kHumanBlobOff + save_layout::kHumanBlobSize, 0u);
+    PutF32(&p, 14, rng->Range(-1500.0f, 1500.0f));
+    PutF32(&p, 18, rng->Range(-5.0f, 40.0f));
+    PutF32(&p, 22, rng->Range(-1500.0f, 1500.0f));
+    const float heading = rng->Range(0.0f, 6.2831853f);
+    PutF32(&p, 26, std::sin(heading));
+    PutF32(&p, 34, std::cos(heading));
+    mafia_save::WriteU32LE(&p, 38, 1u);
+    PutF32(&p, save_layout::kHumanCurrentHealthOff, static_cast<float>(1 + rng->Below(400)));
+    PutF32(&p, save_layout::kHumanMaxHealthOff, 400.0f);
+    AppendActorChunk(&p, usedCar, usedCar.empty() ? 0u : kActorTypeCar);
+    AppendActorChunk(&p, "", 0u);
+    // G_Inventory: u32 mode, then 16-byte slots (id, loaded, hidden, unk): sel, coat, slot1..
+    const std::size_t inv = p.size();
+    p.resize(inv + save_layout::kInventoryBlobSize + kHumanTailSize, 0u);
+    mafia_save::WriteU32LE(&p, inv, 1u);
+    mafia_save::WriteU32LE(&p, inv + 36, 2u + rng->Below(12));
+    mafia_save::WriteU32LE(&p, inv + 40, rng->Below(100));
+    return p;
+}
+
+std::vector<std::uint8_t> CarPayload(std::uint32_t id, std::size_t size, Rng* rng) {
+    std::vector<std::uint8_t> p = ActorBase(id, kSubtypeCar);
+    p.resize(size, 0u);
+    PutF32(&p, 21, rng->Range(-1500.0f, 1500.0f));
+    PutF32(&p, 25, rng->Range(-5.0f, 40.0f));
+    PutF32(&p, 29, rng->Range(-1500.0f, 1500.0f));
+    const float half = rng->Range(0.0f, 3.1415927f);
+    PutF32(&p, 33, std::cos(half));
+    PutF32(&p, 41, std::sin(half));
+    PutF32(&p, 304, rng->Range(0.0f, 60.0f));
+    PutF32(&p, 345, rng->Range(0.0f, 20000.0f));
+    return p;
+}
+
+// C_program::SaveGameSave: 39-byte header, registers, vars, actor chunks, frame names.
+void AppendProgram(std::vector<std::uint8_t>* p,
+                   const Spec& spec,
+                   const std::vector<std::string>& names,
+                   const std::vector<std::uint32_t>& types,
+                   Rng* rng) {
+    const std::size_t base = p->size();
+    p->resize(base + save_layout::kProgramHeaderSize, 0u);
+    (*p)[base] = kProgramMarker;
+    mafia_save::WriteU32LE(p, base + 1, rng->Below(1000));
+    PutU16(p, base + 17, spec.programRegs);
+    mafia_save::WriteU32LE(p, base + 19, spec.programVars);
+    mafia_save::WriteU32LE(p, base + 23, spec.programFrames);
+    mafia_save::WriteU32LE(p, base + 27, spec.programActors);
+    for (std::uint16_t i = 0; i < spec.programRegs; ++i) {
+        p->push_back(static_cast<std::uint8_t>(rng->Below(256)));
+        p->push_back(0u);
+    }
+    for (std::uint32_t i = 0; i < spec.programVars; ++i) {
+        p->resize(p->size() + 4);
+        PutF32(p, p->size() - 4, static_cast<float>(rng->Below(200)));
+    }
+    for (std::uint32_t i = 0; i < spec.programActors; ++i) {
+        const std::size_t a = rng->Below(static_cast<std::uint32_t>(names.size()));
+        AppendActorChunk(p, names[a], types[a]);
+    }
+    for (std::uint32_t i = 0; i < spec.programFrames; ++i) {
+        const std::string frame = "frame_" + std::to_string(i);
+        p->push_back(static_cast<std::uint8_t>(frame.size() + 1));
+        p->push_back(0u);
+        p->insert(p->end(), frame.begin(), frame.end());
+        p->push_back(0u);
+    }
+}
+
+// ai_groups::Save: u32, u32 groups, per group {16 bytes, [u32 + name], [name], [name + u32]}, then [name].
+std::vector<std::uint8_t> AiGroups(std::uint32_t groups, const std::vector<std::string>& humans, Rng* rng) {
+    std::vector<std::uint8_t> p;
+    AppendU32(&p, 0u);
+    AppendU32(&p, groups);
+    auto pick = [&]() { return humans[rng->Below(static_cast<std::uint32_t>(humans.size()))]; };
+    for (std::uint32_t g = 0; g < groups; ++g) {
+        p.resize(p.size() + 16, 0u);
+        const std::uint32_t n = 1 + rng->Below(4);
+        AppendU32(&p, n);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            AppendU32(&p, i);
+            AppendName(&p, pick(), kAiNameSize);
+        }
+        AppendU32(&p, 1u);
+        AppendName(&p, pick(), kAiNameSize);
+        AppendU32(&p, 0u);
+    }
+    AppendU32(&p, 0u);
+    return p;
+}
+
+// ai_follow_manager::Save: u32, u32 count, per entry {[name], 12 bytes, 5 x u32, leader, target}.
+std::vector<std::uint8_t> AiFollow(std::uint32_t entries, const std::vector<std::string>& humans, Rng* rng) {
+    std::vector<std::uint8_t> p;
+    AppendU32(&p, 0u);
+    AppendU32(&p, entries);
+    for (std::uint32_t e = 0; e < entries; ++e) {
+        const std::uint32_t members = 1 + rng->Below(3);
+        AppendU32(&p, members);
+        for (std::uint32_t i = 0; i < members; ++i) {
+            AppendName(&p, humans[rng->Below(static_cast<std::uint32_t>(humans.size()))], kAiNameSize);
+        }
+        p.resize(p.size() + 12 + 5 * 4, 0u);
+        AppendName(&p, "Tommy", kAiNameSize);
+        AppendName(&p, "<NONE>", kAiNameSize);
+    }
+    return p;
+}
+
+}  // namespace
+
+bool BuildSynthetic(const Spec& spec, save_builder::SaveBuilder* out, SaveStats* stats, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output builder";
+        }
+        return false;
+    }
+    if (spec.actors == 0 || spec.actors > kMaxActors || spec.humanPercent > 100 ||
+        spec.carPayloadSize < kMinCarPayloadSize || spec.programVars > 8192u || spec.programActors > 2048u ||
+        spec.programFrames > 2048u || spec.programRegs > 4096u || spec.aiGroups > 4096u || spec.aiFollow > 4096u) {
+        if (error != nullptr) {
+            std::ostringstream oss;
+            oss << "spec out of range (actors 1.." << kMaxActors << ", human percent <= 100, car payload >= "
+                << kMinCarPayloadSize << ", program regs <= 4096, vars <= 8192, actors/frames <= 2048, AI <= 4096)";
+            *error = oss.str();
+        }
+        return false;
+    }
+
+    Rng rng{spec.seed};
+    save_builder::SaveBuilder b;
+    b.SetMission(spec.mission);
+    if (!b.SetMissionName(spec.missionName, error)) {
+        return false;
+    }
+
+    SaveStats s;
+    std::vector<std::string> names;
+    std::vector<std::uint32_t> types;
+    std::vector<std::string> humans;
+    std::vector<std::string> cars;
+    names.reserve(spec.actors);
+    types.reserve(spec.actors);
+    names.push_back("Tommy");
+    types.push_back(kActorTypeHuman);
+    for (std::size_t i = 1; i < spec.actors; ++i) {
+        const bool human = rng.Below(100) < spec.humanPercent;
+        names.push_back(human ? "npc_" + std::to_string(humans.size()) : "g_car_" + std::to_string(cars.size()));
+        types.push_back(human ? kActorTypeHuman : kActorTypeCar);
+        (human ? humans : cars).push_back(names.back());
+    }
+    humans.insert(humans.begin(), "Tommy");
+
+    b.ReserveActors(spec.actors);
+    std::uint32_t carSlot = 0;
+    for (std::size_t i = 0; i < spec.actors; ++i) {
+        save_builder::ActorSpec a;
+        a.name = names[i];
+        a.type = types[i];
+        if (types[i] == kActorTypeHuman) {
+            const bool inCar = !cars.empty() && i % 4 == 3;
+            a.model = i == 0 ? "TommyHAT.i3d" : kHumanModels[rng.Below(4)];
+            const std::string used = inCar ? cars[rng.Below(static_cast<std::uint32_t>(cars.size()))] : "";
+            a.payload = HumanPayload(static_cast<std::uint32_t>(i), used, &rng);
+            ++s.humans;
+        } else {
+            a.model = kCarModels[rng.Below(4)];
+            a.idx = carSlot++;
+            a.payload = CarPayload(static_cast<std::uint32_t>(i), spec.carPayloadSize, &rng);
+            ++s.cars;
+        }
+        if (!b.AddActor(a, error)) {
+            return false;
+        }
+    }
+
+    std::vector<std::uint8_t> game(save_layout::kGameHeaderSize, 0u);
+    game[0] = kGameMarker;
+    mafia_save::WriteU32LE(&game, 5, 1u);
+    mafia_save::WriteU32LE(&game, 9, spec.mission);
+    if (spec.programRegs != 0 || spec.programVars != 0 || spec.programActors != 0 || spec.programFrames != 0) {
+        s.programOffset = game.size();
+        AppendProgram(&game, spec, names, types, &rng);
+    }
+    if (spec.aiGroups != 0) {
+        b.SetAiGroups(AiGroups(spec.aiGroups, humans, &rng));
+    }
+    if (spec.aiFollow != 0) {
+        b.SetAiFollow(AiFollow(spec.aiFollow, humans, &rng));
+    }
+    const std::size_t size = b.RawSize() + game.size();
+    if (spec.targetBytes > size) {
+        const std::size_t at = game.size();
+        game.resize(at + (spec.targetBytes - size));
+        for (std::size_t i = at; i < game.size(); ++i) {
+            const auto v = static_cast<std::uint8_t>(rng.Next() >> 56);
+            game[i] = v == kProgramMarker ? 0u : v;
+        }
+    }
+    s.gamePayloadSize = game.size();
+    b.SetGamePayload(std::move(game));
+    s.rawSize = b.RawSize();
+    *out = std::move(b);
+    if (stats != nullptr) {
+        *stats = s;
+    }
+    return true;
+}
+
+bool GenerateRaw(const Spec& spec, std::vector<std::uint8_t>* out, SaveStats* stats, std::string* error) {
+    save_builder::SaveBuilder b;
+    return BuildSynthetic(spec, &b, stats, error) && b.Build(out, error);
+}
+
+bool GenerateFiles(const Spec& spec,
+                   std::size_t count,
+                   const fs::path& outDir,
+                   unsigned threads,
+                   GenerateStats* stats,
+                   std::string* error) {
+    std::error_code ec;
+    fs::create_directories(outDir, ec);
+    if (!fs::is_directory(outDir, ec)) {
+        if (error != nullptr) {
+            *error = "cannot create " + outDir.string();
+        }
+        return false;
+    }
+    std::vector<std::string> errors(count);
+    std::vector<std::uint64_t> sizes(count, 0);
+    GenerateStats s;
+    s.files = count;
+    s.threads = work_pool::ResolveThreads(threads, count);
+    work_pool::ParallelFor(count, threads, [&](unsigned, std::size_t i) {
+        Spec one = spec;
+        one.seed = spec.seed + i;
+        std::vector<std::uint8_t> raw;
+        if (!GenerateRaw(one, &raw, nullptr, &errors[i])) {
+            return;
+        }
+        std::ostringstream name;
+        name << "synth_" << std::setw(5) << std::setfill('0') << i << ".sav";
+        if (mafia_save::WriteFileBytesAtomic(outDir / name.str(), raw, &errors[i])) {
+            sizes[i] = raw.size();
+        }
+    });
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!errors[i].empty()) {
+            if (error != nullptr) {
+                *error = errors[i];
+            }
+            return false;
+        }
+        s.bytesWritten += sizes[i];
+    }
+    if (stats != nullptr) {
+        *stats = s;
+    }
+    return true;
+}
+
+}  // namespace save_synth
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "save_builder.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace save_synth {
+
+namespace fs = std::filesystem;
+
+// Synthetic saves for scaling tests. Everything is drawn from a splitmix64 stream seeded with `seed`,
+// so the same spec always gives the same bytes. Generated saves pass ParseSave and lint:
+//   head24/meta32 for `mission`, info264 mission name, a 67-byte C_game header (marker 10)
+//   actor 0 is Tommy (type 2, TommyHAT.i3d); the rest are humans ("npc_N", type 2, payload subtype 6:
+//   13-byte base, 382-byte blob, two used-actor chunks, 196-byte inventory, 34 trailing bytes; every
+//   fourth human uses a car) and cars ("g_car_N", type 4, subtype 9, `carPayloadSize` bytes, idx 0..)
+//   an optional C_program block in game_payload right after the C_game header: `programRegs` u16
+//   registers, `programVars` f32 vars, `programActors` actor chunks naming generated actors and
+//   `programFrames` frame names
+//   ai_groups_payload with `aiGroups` groups and ai_follow_payload with `aiFollow` entries (both name
+//   generated humans; 0 leaves the segment out)
+// With `targetBytes` set, game_payload is padded after the program until the save reaches that size.
+// The padding never contains the program marker byte, so the generated program stays the only one.
+struct Spec {
+    std::uint64_t seed = 1;
+    std::uint32_t mission = 1;
+    std::string missionName = "synthetic";
+    std::size_t actors = 64;  // Tommy included
+    std::uint32_t humanPercent = 50;  // share of humans among the other actors; the rest are cars
+    std::size_t carPayloadSize = 1193;
+    std::uint16_t programRegs = 0;
+    std::uint32_t programVars = 0;
+    std::uint32_t programActors = 0;
+    std::uint32_t programFrames = 0;
+    std::uint32_t aiGroups = 0;
+    std::uint32_t aiFollow = 0;
+    std::size_t targetBytes = 0;
+};
+
+struct SaveStats {
+    std::size_t humans = 0;  // Tommy included
+    std::size_t cars = 0;
+    std::size_t gamePayloadSize = 0;
+    std::size_t programOffset = 0;  // in game_payload; 0 without a program
+    std::size_t rawSize = 0;
+};
+
+bool BuildSynthetic(const Spec& spec, save_builder::SaveBuilder* out, SaveStats* stats = nullptr, std::string* error = nullptr);
+bool GenerateRaw(const Spec& spec, std::vector<std::uint8_t>* out, SaveStats* stats = nullptr, std::string* error = nullptr);
+
+struct GenerateStats {
+    std::size_t files = 0;
+    std::uint64_t bytesWritten = 0;
+    unsigned threads = 0;
+};
+
+// `count` files synth_00000.sav ... in `outDir`; file i uses seed + i. Written in parallel, each
+// through a .tmp file and a rename.
+bool GenerateFiles(const Spec& spec,
+                   std::size_t count,
+                   const fs::path& outDir,
+                   unsigned threads,
+                   GenerateStats* stats = nullptr,
+                   std::string* error = nullptr);
+
+}  // namespace save_synth
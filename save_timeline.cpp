@@ -0,0 +1,468 @@
+#include "save_timeline.hpp"
+
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+
+namespace save_timeline {
+
+namespace {
+
+constexpr std::uint32_t kActorTypeCar = 4;
+constexpr std::uint32_t kColumnarMagic = 0x4C54534Du;  // "MSTL"
+constexpr std::uint32_t kColumnarVersion = 1;
+
+bool ParseIndex(const std::string& s, std::uint32_t* out) {
+    if (s.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    const unsigned long v = std::strtoul(s.c_str(), &end, 10);
+    if (end == nullptr || *end != '\0' || v > 0xFFFFFFFFul) {
+        return false;
+    }
+    *out = static_cast<std::uint32_t>(v);
+    return true;
+}
+
+bool ParseActorProp(const std::string& s, ActorProp* out) {
+    static const std::pair<const char*, ActorProp> kProps[] = {
+        {"x", ActorProp::kX},         {"y", ActorProp::kY},       {"z", ActorProp::kZ},
+        {"hp", ActorProp::kHp},       {"hpmax", ActorProp::kHpMax}, {"fuel", ActorProp::kFuel},
+        {"odometer", ActorProp::kOdometer},
+    };
+    for (const auto& [name, prop] : kProps) {
+        if (s == name) {
+            *out = prop;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseField(const std::string& name, FieldSpec* out, std::string* error) {
+    FieldSpec f;
+    f.name = name;
+    const auto fail = [&](const std::string& why) {
+        if (error != nullptr) {
+            *error = "field '" + name + "': " + why;
+        }
+        return false;
+    };
+
+    if (name == "date" || name == "time" || name == "slot" || name == "mission_code" || name == "hp_percent") {
+        f.kind = name == "date"           ? FieldKind::kDate
+                 : name == "time"         ? FieldKind::kTime
+                 : name == "slot"         ? FieldKind::kSlot
+                 : name == "mission_code" ? FieldKind::kMissionCode
+                                          : FieldKind::kHpPercent;
+        *out = f;
+        return true;
+    }
+
+    const std::size_t colon = name.find(':');
+    if (colon != std::string::npos && name.compare(0, colon, "actor") != 0) {
+        const std::string prefix = name.substr(0, colon);
+        if (!ParseIndex(name.substr(colon + 1), &f.index)) {
+            return fail("expected a decimal index after ':'");
+        }
+        if (prefix == "var") {
+            f.kind = FieldKind::kProgramVar;
+            f.type = ColumnType::kF32;
+        } else if (prefix == "garage" || prefix == "garage2") {
+            if (f.index >= save_layout::kGarageSlotCount) {
+                return fail("garage slot must be < 25");
+            }
+            f.kind = prefix == "garage" ? FieldKind::kGaragePrimary : FieldKind::kGarageSecondary;
+        } else {
+            return fail("unknown prefix");
+        }
+        *out = f;
+        return true;
+    }
+
+    const std::size_t dot = name.rfind('.');
+    if (dot == std::string::npos || !ParseActorProp(name.substr(dot + 1), &f.prop)) {
+        return fail("unknown field (see --fields in usage)");
+    }
+    const std::string owner = name.substr(0, dot);
+    if (owner == "tommy") {
+        f.actor = "Tommy";
+    } else if (owner == "car") {
+        f.actor.clear();
+    } else if (owner.rfind("actor:", 0) == 0 && owner.size() > 6) {
+        f.actor = owner.substr(6);
+    } else {
+        return fail("actor fields are tommy.<prop>, car.<prop> or actor:<name>.<prop>");
+    }
+    f.kind = FieldKind::kActor;
+    f.type = ColumnType::kF32;
+    *out = f;
+    return true;
+}
+
+std::optional<std::size_t> FindActorPayload(const mafia_save::SaveData& save, const FieldSpec& f) {
+    for (std::size_t i = 0; i + 1 < save.segments.size(); ++i) {
+        const auto& h = save.segments[i];
+        if (h.name.rfind("actor_header_", 0) != 0 || h.plain.size() < mafia_save::kActorHeaderSize) {
+            continue;
+        }
+        const bool match = f.actor.empty() ? mafia_save::ReadU32LE(h.plain, 128) == kActorTypeCar
+                                           : mafia_save::ReadCStr(h.plain, 0, 64) == f.actor;
+        if (match) {
+            return i + 1;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::size_t> ActorPropOffset(const save_layout::CoordLayout& l, ActorProp prop) {
+    switch (prop) {
+        case ActorProp::kX:
+            return l.coordsSupported ? std::optional<std::size_t>(l.xOff) : std::nullopt;
+        case ActorProp::kY:
+            return l.coordsSupported ? std::optional<std::size_t>(l.yOff) : std::nullopt;
+        case ActorProp::kZ:
+            return l.coordsSupported ? std::optional<std::size_t>(l.zOff) : std::nullopt;
+        case ActorProp::kHp:
+            return l.humanHealthSupported ? std::optional<std::size_t>(l.humanHpCurrentOff) : std::nullopt;
+        case ActorProp::kHpMax:
+            return l.humanHealthSupported ? std::optional<std::size_t>(l.humanHpMaxOff) : std::nullopt;
+        case ActorProp::kFuel:
+            return l.carStateSupported ? std::optional<std::size_t>(l.carFuelOff) : std::nullopt;
+        case ActorProp::kOdometer:
+            return l.carOdometerSupported ? std::optional<std::size_t>(l.carOdometerOff) : std::nullopt;
+    }
+    return std::nullopt;
+}
+
+void ExtractRow(const mafia_save::SaveData& save, const std::vector<FieldSpec>& fields, Row* row) {
+    row->bits.assign(fields.size(), 0u);
+    row->valid.assign(fields.size(), 0u);
+
+    bool programProbed = false;
+    std::optional<save_layout::ProgramLocation> program;
+    const std::vector<std::uint8_t>* info =
+        save.idxInfo != mafia_save::kNoIndex ? &save.segments[save.idxInfo].plain : nullptr;
+
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        const FieldSpec& f = fields[i];
+        std::optional<std::uint32_t> v;
+        switch (f.kind) {
+            case FieldKind::kDate:
+                v = row->meta.packedDate;
+                break;
+            case FieldKind::kTime:
+                v = row->meta.packedTime;
+                break;
+            case FieldKind::kSlot:
+                v = row->meta.slot;
+                break;
+            case FieldKind::kMissionCode:
+                v = row->meta.missionCode;
+                break;
+            case FieldKind::kHpPercent:
+                v = row->meta.hpPercent;
+                break;
+            case FieldKind::kActor: {
+                const auto payloadIdx = FindActorPayload(save, f);
+                if (!payloadIdx.has_value()) {
+                    break;
+                }
+                const auto& p = save.segments[*payloadIdx].plain;
+                const auto off = ActorPropOffset(save_layout::DetectCoordLayout(p), f.prop);
+                if (off.has_value() && *off + 4 <= p.size()) {
+                    v = mafia_save::ReadU32LE(p, *off);
+                }
+                break;
+            }
+            case FieldKind::kProgramVar:
+                if (!programProbed) {
+                    program = save_layout::DetectProgramInSave(save);
+                    programProbed = true;
+                }
+                if (program.has_value() && f.index < program->layout.varCount) {
+                    v = mafia_save::ReadU32LE(save.segments[program->segIdx].plain,
+                                              program->layout.varsOff + static_cast<std::size_t>(f.index) * 4u);
+                }
+                break;
+            case FieldKind::kGaragePrimary:
+            case FieldKind::kGarageSecondary: {
+                const std::size_t base =
+                    f.kind == FieldKind::kGaragePrimary ? save_layout::kGaragePrimaryOff : save_layout::kGarageSecondaryOff;
+                const std::size_t off = base + static_cast<std::size_t>(f.index) * 4u;
+                if (info != nullptr && off + 4 <= info->size()) {
+                    v = mafia_save::ReadU32LE(*info, off);
+                }
+                break;
+            }
+        }
+        if (v.has_value()) {
+            row->bits[i] = *v;
+            row->valid[i] = 1u;
+        }
+    }
+}
+
+bool PassesFilter(const mafia_save::MetaFields& meta, const HeaderFilter& filter) {
+    const std::uint32_t date = DateKey(meta.packedDate);
+    return meta.slot >= filter.minSlot && meta.slot <= filter.maxSlot && date >= filter.minDate &&
+           date <= filter.maxDate;
+}
+
+enum class IngestStatus { kSkipped, kFiltered, kFailed, kOk };
+
+IngestStatus IngestFile(const fs::path& path, const std::vector<FieldSpec>& fields, const HeaderFilter& filter, Row* row) {
+    const auto prefix = mafia_save::ReadFilePrefix(path, mafia_save::kMetaPrefixSize);
+    if (prefix.size() < mafia_save::kMetaPrefixSize || std::memcmp(prefix.data(), "GvaS", 4) != 0) {
+        return IngestStatus::kSkipped;
+    }
+    if (!mafia_save::PeekMetaFields(prefix, &row->meta) || !PassesFilter(row->meta, filter)) {
+        return IngestStatus::kFiltered;
+    }
+
+    const auto raw = mafia_save::ReadFileBytes(path);
+    mafia_save::SaveData save;
+    if (!mafia_save::ParseSave(raw, &save)) {
+        return IngestStatus::kFailed;
+    }
+    row->path = path;
+    ExtractRow(save, fields, row);
+    return IngestStatus::kOk;
+}
+
+std::string FormatValue(const FieldSpec& f, std::uint32_t bits) {
+    std::ostringstream oss;
+    if (f.kind == FieldKind::kDate) {
+        oss << ((bits >> 16) & 0xFFFFu) << "-" << std::setw(2) << std::setfill('0') << ((bits >> 8) & 0xFFu) << "-"
+            << std::setw(2) << (bits & 0xFFu);
+    } else if (f.kind == FieldKind::kTime) {
+        oss << std::setfill('0') << std::setw(2) << ((bits >> 16) & 0xFFu) << ":" << std::setw(2) << ((bits >> 8) & 0xFFu)
+            << ":" << std::setw(2) << (bits & 0xFFu);
+    } else if (f.type == ColumnType::kF32) {
+        float v = 0.0f;
+        std::memcpy(&v, &bits, sizeof(v));
+        oss << std::setprecision(9) << v;
+    } else {
+        oss << bits;
+    }
+    return oss.str();
+}
+
+std::string CsvEscape(const std::string& s) {
+    if (s.find_first_of(",\"\n") == std::string::npos) {
+        return s;
+    }
+    std::string out = "\"";
+    for (char ch : s) {
+        if (ch == '"') {
+            out += '"';
+        }
+        out += ch;
+    }
+    out += '"';
+    return out;
+}
+
+void PutU32(std::vector<std::uint8_t>* out, std::uint32_t v) {
+    const std::size_t off = out->size();
+    out->resize(off + 4);
+    mafia_save::WriteU32LE(out, off, v);
+}
+
+void PutU16(std::vector<std::uint8_t>* out, std::uint16_t v) {
+    out->push_back(static_cast<std::uint8_t>(v & 0xFFu));
+    out->push_back(static_cast<std::uint8_t>(v >> 8));
+}
+
+void PutString(std::vector<std::uint8_t>* out, const std::string& s) {
+    const std::size_t len = std::min<std::size_t>(s.size(), 0xFFFFu);
+    PutU16(out, static_cast<std::uint16_t>(len));
+    out->insert(out->end(), s.begin(), s.begin() + static_cast<std::ptrdiff_t>(len));
+}
+
+}  // namespace
+
+bool ParseFieldList(const std::string& list, std::vector<FieldSpec>* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output field list";
+        }
+        return false;
+    }
+    std::vector<FieldSpec> fields;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        FieldSpec f;
+        if (!ParseField(item, &f, error)) {
+            return false;
+        }
+        fields.push_back(std::move(f));
+    }
+    if (fields.empty()) {
+        if (error != nullptr) {
+            *error = "field list is empty";
+        }
+        return false;
+    }
+    *out = std::move(fields);
+    return true;
+}
+
+std::uint32_t DateKey(std::uint32_t packedDate) {
+    const std::uint32_t day = packedDate & 0xFFu;
+    const std::uint32_t month = (packedDate >> 8) & 0xFFu;
+    const std::uint32_t year = (packedDate >> 16) & 0xFFFFu;
+    return year * 10000u + month * 100u + day;
+}
+
+bool BuildTimeline(const fs::path& directory,
+                   const std::vector<FieldSpec>& fields,
+                   const HeaderFilter& filter,
+                   unsigned threads,
+                   Timeline* out,
+                   std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output timeline";
+        }
+        return false;
+    }
+    std::error_code ec;
+    if (!fs::is_directory(directory, ec)) {
+        if (error != nullptr) {
+            *error = "not a directory: " + directory.string();
+        }
+        return false;
+    }
+
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.is_regular_file(ec)) {
+            files.push_back(entry.path());
+        }
+    }
+
+    std::vector<Row> rows(files.size());
+    std::vector<IngestStatus> status(files.size(), IngestStatus::kSkipped);
+    work_pool::ParallelFor(files.size(), threads, [&](unsigned, std::size_t i) {
+        status[i] = IngestFile(files[i], fields, filter, &rows[i]);
+    });
+
+    Timeline timeline;
+    timeline.fields = fields;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        switch (status[i]) {
+            case IngestStatus::kOk:
+                timeline.rows.push_back(std::move(rows[i]));
+                ++timeline.scanned;
+                break;
+            case IngestStatus::kFiltered:
+                ++timeline.filtered;
+                break;
+            case IngestStatus::kFailed:
+                ++timeline.failed;
+                break;
+            case IngestStatus::kSkipped:
+                break;
+        }
+    }
+    std::sort(timeline.rows.begin(), timeline.rows.end(), [](const Row& a, const Row& b) {
+        const std::uint32_t da = DateKey(a.meta.packedDate);
+        const std::uint32_t db = DateKey(b.meta.packedDate);
+        if (da != db) {
+            return da < db;
+        }
+        if (a.meta.packedTime != b.meta.packedTime) {
+            return a.meta.packedTime < b.meta.packedTime;
+        }
+        if (a.meta.slot != b.meta.slot) {
+            return a.meta.slot < b.meta.slot;
+        }
+        return a.path < b.path;
+    });
+    *out = std::move(timeline);
+    return true;
+}
+
+bool WriteCsv(const Timeline& timeline, const fs::path& path, std::string* error) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        if (error != nullptr) {
+            *error = "failed to open output file";
+        }
+        return false;
+    }
+    out << "file";
+    for (const auto& f : timeline.fields) {
+        out << "," << CsvEscape(f.name);
+    }
+    out << "\n";
+    for (const auto& row : timeline.rows) {
+        out << CsvEscape(row.path.filename().string());
+        for (std::size_t i = 0; i < timeline.fields.size(); ++i) {
+            out << ",";
+            if (row.valid[i] != 0u) {
+                out << FormatValue(timeline.fields[i], row.bits[i]);
+            }
+        }
+        out << "\n";
+    }
+    if (!out) {
+        if (error != nullptr) {
+            *error = "failed to write output file";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool WriteColumnar(const Timeline& timeline, const fs::path& path, std::string* error) {
+    const std::size_t rowCount = timeline.rows.size();
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(16 + rowCount * (32 + timeline.fields.size() * 4));
+    PutU32(&bytes, kColumnarMagic);
+    PutU32(&bytes, kColumnarVersion);
+    PutU32(&bytes, static_cast<std::uint32_t>(rowCount));
+    PutU32(&bytes, static_cast<std::uint32_t>(timeline.fields.size()));
+    for (const auto& f : timeline.fields) {
+        bytes.push_back(static_cast<std::uint8_t>(f.type));
+        bytes.push_back(0u);
+        PutString(&bytes, f.name);
+    }
+    for (const auto& row : timeline.rows) {
+        PutString(&bytes, row.path.filename().string());
+    }
+    for (std::size_t col = 0; col < timeline.fields.size(); ++col) {
+        for (const auto& row : timeline.rows) {
+            PutU32(&bytes, row.bits[col]);
+        }
+        std::vector<std::uint8_t> validity((rowCount + 7) / 8, 0u);
+        for (std::size_t r = 0; r < rowCount; ++r) {
+            if (timeline.rows[r].valid[col] != 0u) {
+                validity[r / 8] = static_cast<std::uint8_t>(validity[r / 8] | (1u << (r % 8)));
+            }
+        }
+        bytes.insert(bytes.end(), validity.begin(), validity.end());
+    }
+    if (!mafia_save::WriteFileBytes(path, bytes)) {
+        if (error != nullptr) {
+            *error = "failed to write output file";
+        }
+        return false;
+    }
+    return true;
+}
+
+}  // namespace save_timeline
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace save_timeline {
+
+namespace fs = std::filesystem;
+
+constexpr const char* kDefaultFields =
+    "date,time,slot,mission_code,hp_percent,tommy.x,tommy.y,tommy.z,tommy.hp,car.fuel,car.odometer";
+
+enum class FieldKind {
+    kDate,             // meta32 packedDate
+    kTime,             // meta32 packedTime
+    kSlot,             // meta32 slot
+    kMissionCode,      // meta32 missionCode
+    kHpPercent,        // meta32 hp
+    kActor,            // tommy.<prop>, car.<prop>, actor:<name>.<prop>
+    kProgramVar,       // var:<index>
+    kGaragePrimary,    // garage:<slot>
+    kGarageSecondary,  // garage2:<slot>
+};
+
+enum class ActorProp { kX, kY, kZ, kHp, kHpMax, kFuel, kOdometer };
+
+enum class ColumnType : std::uint8_t { kU32 = 0, kF32 = 1 };
+
+struct FieldSpec {
+    std::string name;
+    FieldKind kind = FieldKind::kDate;
+    ColumnType type = ColumnType::kU32;
+    std::string actor;      // actor name for kActor; empty = first car (type 4)
+    ActorProp prop = ActorProp::kX;
+    std::uint32_t index = 0;
+};
+
+// Header-only filter, evaluated on meta32 before the rest of the file is read.
+struct HeaderFilter {
+    std::uint32_t minSlot = 0;
+    std::uint32_t maxSlot = 0xFFFFFFFFu;
+    std::uint32_t minDate = 0;            // yyyymmdd
+    std::uint32_t maxDate = 0xFFFFFFFFu;  // yyyymmdd
+};
+
+struct Row {
+    fs::path path;
+    mafia_save::MetaFields meta;
+    std::vector<std::uint32_t> bits;   // u32 value or f32 bit pattern, per field
+    std::vector<std::uint8_t> valid;   // 0 when the field is absent in this save
+};
+
+struct Timeline {
+    std::vector<FieldSpec> fields;
+    std::vector<Row> rows;  // ordered by meta32 date, time, slot, path
+    std::size_t scanned = 0;
+    std::size_t filtered = 0;
+    std::size_t failed = 0;
+};
+
+bool ParseFieldList(const std::string& list, std::vector<FieldSpec>* out, std::string* error = nullptr);
+
+// yyyymmdd from meta32 packedDate (day | month << 8 | year << 16).
+std::uint32_t DateKey(std::uint32_t packedDate);
+
+bool BuildTimeline(const fs::path& directory,
+                   const std::vector<FieldSpec>& fields,
+                   const HeaderFilter& filter,
+                   unsigned threads,
+                   Timeline* out,
+                   std::string* error = nullptr);
+
+bool WriteCsv(const Timeline& timeline, const fs::path& path, std::string* error = nullptr);
+
+// "MSTL" columnar file, little-endian:
+//   u32 magic, u32 version (1), u32 rows, u32 columns
+//   per column: u8 type (0 = u32, 1 = f32), u8 0, u16 name length, name
+//   rows x (u16 length, path)
+//   per column: rows x u32 values, then ceil(rows / 8) validity bytes (bit i = row i)
+bool WriteColumnar(const Timeline& timeline, const fs::path& path, std::string* error = nullptr);
+
+}  // namespace save_timeline
@@ -0,0 +1,424 @@
+#include "save_transplant.hpp"
+
+#include "save_index.hpp"
+#include "save_layout.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+namespace save_transplant {
+
+namespace {
+
+constexpr std::size_t kHeaderNameSize = 64;
+constexpr std::size_t kHeaderTypeOff = 128;
+constexpr std::size_t kHeaderPayloadSizeOff = 132;
+constexpr std::size_t kHeaderIdxOff = 136;
+constexpr std::uint32_t kNoSlot = 0xFFFFFFFFu;
+
+bool IsActorHeader(const mafia_save::SaveData& save, std::size_t segIdx) {
+    return segIdx + 1 < save.segments.size() && save.segments[segIdx].name.rfind("actor_header_", 0) == 0 &&
+           save.segments[segIdx + 1].name.rfind("actor_payload_", 0) == 0 &&
+           save.segments[segIdx].plain.size() >= mafia_save::kActorHeaderSize;
+}
+
+bool ChunkName(const std::vector<std::uint8_t>& p, const save_layout::ActorRefChunk& chunk, std::string* out) {
+    if (chunk.nameLen < 2u || p[chunk.offset + 8 + chunk.nameLen - 1] != 0u) {
+        return false;
+    }
+    out->assign(reinterpret_cast<const char*>(p.data() + chunk.offset + 8), chunk.nameLen - 1);
+    return true;
+}
+
+// Rewrites the used-actor chunks of a human payload that name a renamed donor.
+void RenameUsedActors(std::vector<std::uint8_t>* payload, const std::map<std::string, std::string>& renames) {
+    save_layout::ActorRefChunk used[2];
+    if (!save_layout::IsHumanPayload(*payload) || !save_layout::ReadHumanUsedActorChunks(*payload, &used[0], &used[1])) {
+        return;
+    }
+    // Back to front so the first chunk's offset survives a resize of the second.
+    for (int i = 1; i >= 0; --i) {
+        std::string name;
+        if (!ChunkName(*payload, used[i], &name)) {
+            continue;
+        }
+        const auto it = renames.find(name);
+        if (it == renames.end()) {
+            continue;
+        }
+        std::vector<std::uint8_t> chunk(8 + it->second.size() + 1, 0u);
+        mafia_save::WriteU32LE(&chunk, 0, static_cast<std::uint32_t>(it->second.size() + 1));
+        mafia_save::WriteU32LE(&chunk, 4, used[i].actorType);
+        std::copy(it->second.begin(), it->second.end(), chunk.begin() + 8);
+        const auto at = payload->begin() + static_cast<std::ptrdiff_t>(used[i].offset);
+        payload->erase(at, at + static_cast<std::ptrdiff_t>(used[i].size()));
+        payload->insert(payload->begin() + static_cast<std::ptrdiff_t>(used[i].offset), chunk.begin(), chunk.end());
+    }
+}
+
+std::string UniqueName(const std::string& name, const std::set<std::string>& taken) {
+    for (std::size_t k = 2;; ++k) {
+        const std::string suffix = "_" + std::to_string(k);
+        const std::size_t keep = std::min(name.size(), kHeaderNameSize - 1 - suffix.size());
+        std::string candidate = name.substr(0, keep) + suffix;
+        if (taken.count(candidate) == 0) {
+            return candidate;
+        }
+    }
+}
+
+struct Placed {
+    std::vector<std::uint8_t> header;
+    std::vector<std::uint8_t> payload;
+};
+
+struct InputFile {
+    fs::path path;
+    fs::path rel;  // name under TransplantOptions::outDir
+};
+
+void CollectInputs(const fs::path& input, std::vector<InputFile>* out) {
+    std::error_code ec;
+    if (!fs::is_directory(input, ec)) {
+        out->push_back(InputFile{input, input.filename()});
+        return;
+    }
+    std::vector<fs::path> found;
+    save_index::CollectSaveFiles(input, &found);
+    for (const auto& f : found) {
+        out->push_back(InputFile{f, f.lexically_relative(input)});
+    }
+}
+
+void TransplantFile(const Source& source, const InputFile& in, const TransplantOptions& options, FileResult* r) {
+    r->path = in.path;
+    const auto raw = mafia_save::ReadFileBytes(in.path);
+    std::vector<std::uint8_t> out;
+    std::string err;
+    if (raw.empty() || !TransplantBytes(source, options.collision, raw, &out, r, &err)) {
+        r->status = FileResult::Status::kFailed;
+        r->error = raw.empty() ? "cannot read file" : err;
+        return;
+    }
+    if (r->status != FileResult::Status::kChanged || !options.write) {
+        return;
+    }
+    const fs::path target = options.outDir.empty() ? in.path : options.outDir / in.rel;
+    if (!mafia_save::WriteFileBytesAtomic(target, out, &r->error)) {
+        r->status = FileResult::Status::kFailed;
+        return;
+    }
+    r->written = target;
+}
+
+}  // namespace
+
+bool LoadSource(const fs::path& file, const Selection& selection, Source* out, std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output source";
+        }
+        return false;
+    }
+    const auto raw = mafia_save::ReadFileBytes(file);
+    mafia_save::SaveData save;
+    std::string err;
+    if (raw.empty() || !mafia_save::ParseSave(raw, &save, &err)) {
+        if (error != nullptr) {
+            *error = raw.empty() ? "cannot read " + file.string() : file.string() + ": " + err;
+        }
+        return false;
+    }
+
+    Source src;
+    src.path = file;
+    std::set<std::string> wanted(selection.names.begin(), selection.names.end());
+    std::set<std::string> seen;
+    for (std::size_t segIdx = 0; segIdx < save.segments.size(); ++segIdx) {
+        if (!IsActorHeader(save, segIdx)) {
+            continue;
+        }
+        const auto& h = save.segments[segIdx].plain;
+        Donor d;
+        d.name = mafia_save::ReadCStr(h, 0, kHeaderNameSize);
+        d.type = mafia_save::ReadU32LE(h, kHeaderTypeOff);
+        if (wanted.count(d.name) == 0 && !(selection.type.has_value() && *selection.type == d.type)) {
+            continue;
+        }
+        if (d.name.empty() || !seen.insert(d.name).second) {
+            if (error != nullptr) {
+                *error = d.name.empty() ? "selected actor has an empty name" : "source has two actors named '" + d.name + "'";
+            }
+            return false;
+        }
+        d.header = h;
+        d.payload = save.segments[segIdx + 1].plain;
+        save_layout::ActorRefChunk used[2];
+        if (save_layout::IsHumanPayload(d.payload) &&
+            save_layout::ReadHumanUsedActorChunks(d.payload, &used[0], &used[1])) {
+            for (const auto& chunk : used) {
+                std::string name;
+                if (ChunkName(d.payload, chunk, &name)) {
+                    d.usedActors.push_back(name);
+                }
+            }
+        }
+        src.donors.push_back(std::move(d));
+    }
+    for (const auto& name : wanted) {
+        if (seen.count(name) == 0) {
+            if (error != nullptr) {
+                *error = "source has no actor named '" + name + "'";
+            }
+            return false;
+        }
+    }
+    if (src.donors.empty()) {
+        if (error != nullptr) {
+            *error = "selection matches no source actor";
+        }
+        return false;
+    }
+    *out = std::move(src);
+    return true;
+}
+
+bool TransplantBytes(const Source& source,
+                     Collision collision,
+                     const std::vector<std::uint8_t>& raw,
+                     std::vector<std::uint8_t>* out,
+                     FileResult* result,
+                     std::string* error) {
+    if (out == nullptr || result == nullptr) {
+        if (error != nullptr) {
+            *error = "null output";
+        }
+        return false;
+    }
+    out->clear();
+    mafia_save::SaveData save;
+    std::vector<mafia_save::CipherCheckpoint> checkpoints;
+    if (!mafia_save::ParseSaveWithCheckpoints(raw, &save, &checkpoints, error)) {
+        return false;
+    }
+
+    std::unordered_map<std::string, std::size_t> headerByName;
+    std::set<std::string> taken;
+    std::uint32_t nextSlot = 0;
+    for (std::size_t segIdx = 0; segIdx < save.segments.size(); ++segIdx) {
+        if (!IsActorHeader(save, segIdx)) {
+            continue;
+        }
+        const auto& h = save.segments[segIdx].plain;
+        const std::string name = mafia_save::ReadCStr(h, 0, kHeaderNameSize);
+        headerByName.emplace(name, segIdx);
+        taken.insert(name);
+        const std::uint32_t slot = mafia_save::ReadU32LE(h, kHeaderIdxOff);
+        if (slot != kNoSlot && slot >= nextSlot) {
+            nextSlot = slot + 1;
+        }
+    }
+    for (const auto& d : source.donors) {
+        taken.insert(d.name);
+    }
+
+    // Decide every donor's fate first so renames are known before payloads are copied.
+    enum class Fate : std::uint8_t { kReplace, kAppend, kSkip };
+    std::vector<Fate> fates(source.donors.size(), Fate::kAppend);
+    std::map<std::string, std::string> renames;
+    for (std::size_t i = 0; i < source.donors.size(); ++i) {
+        const Donor& d = source.donors[i];
+        if (headerByName.count(d.name) == 0) {
+            continue;
+        }
+        if (collision == Collision::kReplace) {
+            fates[i] = Fate::kReplace;
+        } else if (collision == Collision::kSkip) {
+            fates[i] = Fate::kSkip;
+            ++result->skipped;
+            result->notes.push_back("skipped '" + d.name + "': name taken");
+        } else {
+            const std::string fresh = UniqueName(d.name, taken);
+            taken.insert(fresh);
+            renames.emplace(d.name, fresh);
+            ++result->renamed;
+            result->notes.push_back("renamed '" + d.name + "' -> '" + fresh + "'");
+        }
+    }
+
+    std::map<std::size_t, Placed> replaced;  // target header segment -> donor segments
+    std::vector<Placed> appended;
+    std::set<std::string> present;
+    for (const auto& entry : headerByName) {
+        present.insert(entry.first);
+    }
+    for (std::size_t i = 0; i < source.donors.size(); ++i) {
+        if (fates[i] == Fate::kSkip) {
+            continue;
+        }
+        const Donor& d = source.donors[i];
+        Placed p{d.header, d.payload};
+        const auto renamed = renames.find(d.name);
+        if (renamed != renames.end()) {
+            std::fill(p.header.begin(), p.header.begin() + kHeaderNameSize, 0u);
+            std::copy(renamed->second.begin(), renamed->second.end(), p.header.begin());
+        }
+        RenameUsedActors(&p.payload, renames);
+        mafia_save::WriteU32LE(&p.header, kHeaderPayloadSizeOff, static_cast<std::uint32_t>(p.payload.size()));
+        present.insert(renamed != renames.end() ? renamed->second : d.name);
+
+        if (fates[i] == Fate::kReplace) {
+            const std::size_t segIdx = headerByName[d.name];
+            const auto& old = save.segments[segIdx].plain;
+            mafia_save::WriteU32LE(&p.header, kHeaderIdxOff, mafia_save::ReadU32LE(old, kHeaderIdxOff));
+            const std::uint32_t oldType = mafia_save::ReadU32LE(old, kHeaderTypeOff);
+            if (oldType != d.type) {
+                std::ostringstream oss;
+                oss << "'" << d.name << "' changes type " << oldType << " -> " << d.type;
+                result->notes.push_back(oss.str());
+            }
+            if (p.header == old && p.payload == save.segments[segIdx + 1].plain) {
+                continue;
+            }
+            ++result->replaced;
+            replaced.emplace(segIdx, std::move(p));
+        } else {
+            if (mafia_save::ReadU32LE(p.header, kHeaderIdxOff) != kNoSlot) {
+                mafia_save::WriteU32LE(&p.header, kHeaderIdxOff, nextSlot++);
+            }
+            ++result->added;
+            appended.push_back(std::move(p));
+        }
+    }
+    for (std::size_t i = 0; i < source.donors.size(); ++i) {
+        if (fates[i] == Fate::kSkip) {
+            continue;
+        }
+        for (const auto& used : source.donors[i].usedActors) {
+            const auto renamed = renames.find(used);
+            if (present.count(renamed != renames.end() ? renamed->second : used) == 0) {
+                result->notes.push_back("'" + source.donors[i].name + "' uses '" + used + "', which the target lacks");
+            }
+        }
+    }
+    if (replaced.empty() && appended.empty()) {
+        result->status = FileResult::Status::kUnchanged;
+        return true;
+    }
+
+    // Plaintext feedback: every key after the first replaced segment changes, so the ciphertext is
+    // reused up to there and re-encrypted from the checkpoint ParseSaveWithCheckpoints recorded.
+    const std::size_t first = replaced.empty() ? save.segments.size() : replaced.begin()->first;
+    std::size_t copyEnd = mafia_save::kFileHeaderSize;
+    for (std::size_t seg = 0; seg < first; ++seg) {
+        copyEnd += save.segments[seg].plain.size();
+    }
+    std::size_t total = copyEnd;
+    for (std::size_t seg = first; seg < save.segments.size(); ++seg) {
+        total += save.segments[seg].plain.size();
+    }
+    for (const auto& entry : replaced) {
+        total += entry.second.header.size() + entry.second.payload.size();
+        total -= save.segments[entry.first].plain.size() + save.segments[entry.first + 1].plain.size();
+    }
+    for (const auto& p : appended) {
+        total += p.header.size() + p.payload.size();
+    }
+
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(total);
+    bytes.insert(bytes.end(), raw.begin(), raw.begin() + static_cast<std::ptrdiff_t>(copyEnd));
+    mafia_save::CipherCheckpoint state = checkpoints[first];
+    std::vector<std::uint8_t> cipher;
+    auto emit = [&](const std::vector<std::uint8_t>& plain) {
+        cipher = plain;
+        mafia_save::EncryptWithCheckpoint(&cipher, &state);
+        bytes.insert(bytes.end(), cipher.begin(), cipher.end());
+        result->bytesEncrypted += plain.size();
+    };
+    for (std::size_t seg = first; seg < save.segments.size(); ++seg) {
+        const auto it = replaced.find(seg);
+        if (it == replaced.end()) {
+            emit(save.segments[seg].plain);
+            continue;
+        }
+        emit(it->second.header);
+        emit(it->second.payload);
+        ++seg;
+    }
+    for (const auto& p : appended) {
+        emit(p.header);
+        emit(p.payload);
+    }
+    result->bytesCopied = copyEnd;
+    result->status = FileResult::Status::kChanged;
+    *out = std::move(bytes);
+    return true;
+}
+
+bool Transplant(const Source& source,
+                const std::vector<fs::path>& targets,
+                const TransplantOptions& options,
+                std::vector<FileResult>* out,
+                std::string* error) {
+    if (out == nullptr) {
+        if (error != nullptr) {
+            *error = "null output result list";
+        }
+        return false;
+    }
+    std::vector<InputFile> files;
+    for (const auto& target : targets) {
+        CollectInputs(target, &files);
+    }
+    std::error_code ec;
+    files.erase(std::remove_if(files.begin(),
+                               files.end(),
+                               [&](const InputFile& f) { return fs::equivalent(f.path, source.path, ec); }),
+                files.end());
+    if (!options.outDir.empty()) {
+        std::vector<fs::path> names;
+        for (const auto& f : files) {
+            names.push_back(f.rel.lexically_normal());
+        }
+        std::sort(names.begin(), names.end());
+        if (std::adjacent_find(names.begin(), names.end()) != names.end()) {
+            if (error != nullptr) {
+                *error = "two targets map to the same output name";
+            }
+            return false;
+        }
+    }
+    std::vector<FileResult> results(files.size());
+    work_pool::ParallelFor(files.size(), options.threads, [&](unsigned, std::size_t i) {
+        TransplantFile(source, files[i], options, &results[i]);
+    });
+    *out = std::move(results);
+    return true;
+}
+
+const char* StatusName(FileResult::Status status) {
+    switch (status) {
+        case FileResult::Status::kUnchanged:
+            return "unchanged";
+        case FileResult::Status::kChanged:
+            return "changed";
+        case FileResult::Status::kFailed:
+            return "failed";
+    }
+    return "unknown";
+}
+
+bool ParseCollision(const std::string& text, Collision* out) {
+    if (text == "replace" || text == "rename" || text == "skip") {
+        *out = text == "replace" ? Collision::kReplace : text == "rename" ? Collision::kRename : Collision::kSkip;
+        return true;
+    }
+    return false;
+}
+
+}  // namespace save_transplant
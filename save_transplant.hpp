@@ -0,0 +1,87 @@
+#pragma once
+
+#include "mafia_save.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace save_transplant {
+
+namespace fs = std::filesystem;
+
+// Actors to take from the source save: every listed header name plus, when set, every actor of `type`.
+struct Selection {
+    std::vector<std::string> names;
+    std::optional<std::uint32_t> type;
+};
+
+struct Donor {
+    std::string name;
+    std::uint32_t type = 0;
+    std::vector<std::uint8_t> header;   // kActorHeaderSize bytes
+    std::vector<std::uint8_t> payload;
+    std::vector<std::string> usedActors;  // m_pUsedActor / m_pUsedActor2 names of human payloads
+};
+
+struct Source {
+    fs::path path;
+    std::vector<Donor> donors;  // source save order
+};
+
+bool LoadSource(const fs::path& file, const Selection& selection, Source* out, std::string* error = nullptr);
+
+// What happens to a donor whose name is already taken in the target:
+//   kReplace  the target actor's header and payload are swapped for the donor's, its idx is kept
+//   kRename   the donor is appended as <name>_2, _3, ...; used-actor refs between donors follow it
+//   kSkip     the target actor is left alone
+enum class Collision : std::uint8_t { kReplace, kRename, kSkip };
+
+struct FileResult {
+    enum class Status : std::uint8_t { kUnchanged, kChanged, kFailed };
+    fs::path path;
+    fs::path written;  // empty in dry runs and for unchanged or failed files
+    Status status = Status::kUnchanged;
+    std::string error;
+    std::size_t replaced = 0;
+    std::size_t added = 0;  // renamed donors included
+    std::size_t renamed = 0;
+    std::size_t skipped = 0;
+    std::uint64_t bytesCopied = 0;     // ciphertext reused from the target
+    std::uint64_t bytesEncrypted = 0;  // plaintext run through the cipher on the way out
+    std::vector<std::string> notes;    // renames, type changes, used-actor names the target lacks
+};
+
+// Transplants the donors into one target. The target is decrypted once; its ciphertext is reused up to
+// the first replaced actor (up to the end when donors are only appended) and the rest is encrypted from
+// the recorded key state. Appended donors get the next free idx unless theirs is 0xFFFFFFFF. Program,
+// AI and used-actor references of the target are not touched. `out` is left empty when nothing changes.
+bool TransplantBytes(const Source& source,
+                     Collision collision,
+                     const std::vector<std::uint8_t>& raw,
+                     std::vector<std::uint8_t>* out,
+                     FileResult* result,
+                     std::string* error = nullptr);
+
+struct TransplantOptions {
+    Collision collision = Collision::kReplace;
+    unsigned threads = 0;  // 0 = hardware concurrency
+    bool write = false;    // false: dry run
+    fs::path outDir;       // empty: rewrite targets in place (via .tmp + rename)
+};
+
+// Targets are save files or directories (recursive, GvaS files only, .mafia_* entries skipped); the
+// source file itself is skipped. Results follow the sorted target file order.
+bool Transplant(const Source& source,
+                const std::vector<fs::path>& targets,
+                const TransplantOptions& options,
+                std::vector<FileResult>* out,
+                std::string* error = nullptr);
+
+const char* StatusName(FileResult::Status status);
+bool ParseCollision(const std::string& text, Collision* out);
+
+}  // namespace save_transplant
@@ -0,0 +1,515 @@
+#include "save_watch.hpp"
+
+#include "mafia_save.hpp"
+#include "save_index.hpp"
+#include "save_scan.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define SAVE_WATCH_INOTIFY 1
+#endif
+
+namespace save_watch {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct FileState {
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+};
+
+struct Pending {
+    FileState state;
+    Clock::time_point lastChange;
+    Clock::time_point firstPartial;
+    bool partial = false;
+    bool reported = false;
+};
+
+bool StatFile(const fs::path& path, FileState* out) {
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) {
+        return false;
+    }
+    out->size = fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    out->mtime = static_cast<std::int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+    return !ec;
+}
+
+std::string HashHex(std::uint64_t hash) {
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return oss.str();
+}
+
+// "000012-0123456789abcdef.230" -> version 12, hash 0x0123456789abcdef.
+bool ParseBackupName(const std::string& name, std::uint32_t* version, std::uint64_t* hash) {
+    if (name.size() < 23 || name[6] != '-') {
+        return false;
+    }
+    std::uint32_t v = 0;
+    for (std::size_t i = 0; i < 6; ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(name[i]))) {
+            return false;
+        }
+        v = v * 10u + static_cast<std::uint32_t>(name[i] - '0');
+    }
+    std::uint64_t h = 0;
+    for (std::size_t i = 7; i < 23; ++i) {
+        const int ch = std::tolower(static_cast<unsigned char>(name[i]));
+        if (!std::isxdigit(ch)) {
+            return false;
+        }
+        h = (h << 4) | static_cast<std::uint64_t>(std::isdigit(ch) ? ch - '0' : ch - 'a' + 10);
+    }
+    *version = v;
+    *hash = h;
+    return true;
+}
+
+class Watcher {
+public:
+    Watcher(fs::path root, const WatchOptions& options)
+        : root_(std::move(root)),
+          options_(options),
+          store_(options.backupDir.empty() ? root_ / kDefaultBackupDirName : options.backupDir) {}
+
+    bool Start(std::string* error) {
+        const fs::path file = save_index::DefaultIndexPath(root_);
+        std::error_code ec;
+        if (fs::is_regular_file(file, ec) && !save_index::LoadIndex(file, &index_)) {
+            index_ = save_index::Index{};
+        }
+        save_index::RefreshStats st;
+        if (!save_index::RefreshIndex(root_, &index_, 0, &st, error)) {
+            return false;
+        }
+        if ((st.changed || !fs::is_regular_file(file, ec)) && !save_index::WriteIndex(index_, file, error)) {
+            return false;
+        }
+
+        Walk(fs::path(), nullptr, [&](const fs::path& name, const FileState& state) {
+            known_[name.generic_string()] = state;
+            if (options_.initialSweep) {
+                Settle(name, state);
+            }
+        });
+        return true;
+    }
+
+    // Directories and watched files below root_ / `from` (root-relative, `from` itself excluded), the
+    // same tree RefreshIndex covers: tool entries and the backup store are skipped.
+    void Walk(const fs::path& from,
+              const std::function<void(const fs::path&)>& onDir,
+              const std::function<void(const fs::path&, const FileState&)>& onFile) const {
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(root_ / from, fs::directory_options::skip_permission_denied, ec);
+             it != fs::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (ec) {
+                break;
+            }
+            const fs::path name = it->path().lexically_relative(root_);
+            if (it->is_directory(ec)) {
+                if (Skipped(it->path())) {
+                    it.disable_recursion_pending();
+                } else if (onDir) {
+                    onDir(name);
+                }
+                continue;
+            }
+            FileState state;
+            if (onFile && IsWatchedName(name) && StatFile(it->path(), &state)) {
+                onFile(name, state);
+            }
+        }
+    }
+
+    bool Skipped(const fs::path& dir) const {
+        std::error_code ec;
+        return dir.filename().string().rfind(save_index::kToolEntryPrefix, 0) == 0 ||
+               fs::equivalent(dir, store_.root(), ec);
+    }
+
+    // A change for `name` was noticed (event or poll); restart its quiet period.
+    void Touch(const fs::path& name) {
+        const fs::path full = root_ / name;
+        FileState state;
+        if (!StatFile(full, &state)) {
+            pending_.erase(name.string());
+            if (known_.erase(name.string()) != 0) {
+                Removed(name);
+            }
+            return;
+        }
+        auto& p = pending_[name.string()];
+        p.state = state;
+        p.lastChange = Clock::now();
+        p.partial = false;
+    }
+
+    void Poll() {
+        std::unordered_map<std::string, FileState> seen;
+        Walk(fs::path(), nullptr, [&](const fs::path& name, const FileState& state) {
+            seen.emplace(name.generic_string(), state);
+        });
+        for (const auto& kv : seen) {
+            const auto it = known_.find(kv.first);
+            if (it == known_.end() || it->second.size != kv.second.size || it->second.mtime != kv.second.mtime) {
+                known_[kv.first] = kv.second;
+                Touch(kv.first);
+            }
+        }
+        std::vector<std::string> gone;
+        for (const auto& kv : known_) {
+            if (seen.count(kv.first) == 0) {
+                gone.push_back(kv.first);
+            }
+        }
+        for (const auto& name : gone) {
+            Touch(name);
+        }
+    }
+
+    // Handles files whose quiet period is over. Returns ms until the next one is due (or -1).
+    int Flush() {
+        const auto now = Clock::now();
+        int nextMs = -1;
+        std::vector<std::string> due;
+        for (auto& kv : pending_) {
+            auto& p = kv.second;
+            const auto quiet = std::chrono::duration_cast<std::chrono::milliseconds>(now - p.lastChange).count();
+            const long long wait = static_cast<long long>(options_.settleMs) - quiet;
+            if (wait <= 0) {
+                due.push_back(kv.first);
+            } else if (nextMs < 0 || wait < nextMs) {
+                nextMs = static_cast<int>(wait);
+            }
+        }
+        for (const auto& name : due) {
+            FileState state;
+            if (!StatFile(root_ / name, &state)) {
+                Touch(name);
+                continue;
+            }
+            auto& p = pending_[name];
+            if (state.size != p.state.size || state.mtime != p.state.mtime) {
+                Touch(name);  // still being written
+                nextMs = nextMs < 0 ? static_cast<int>(options_.settleMs) : nextMs;
+                continue;
+            }
+            if (Settle(name, state)) {
+                pending_.erase(name);
+            } else {
+                nextMs = nextMs < 0 ? static_cast<int>(options_.settleMs) : nextMs;
+            }
+        }
+        return nextMs;
+    }
+
+private:
+    void Emit(const WatchEvent& event) const {
+        if (options_.onEvent) {
+            options_.onEvent(event);
+        }
+    }
+
+    void UpdateIndex(const fs::path& name) {
+        save_index::RefreshStats st;
+        if (save_index::RefreshPaths(root_, &index_, {name}, &st) && st.changed) {
+            save_index::WriteIndex(index_, save_index::DefaultIndexPath(root_));
+        }
+    }
+
+    void Removed(const fs::path& name) {
+        UpdateIndex(name);
+        WatchEvent ev;
+        ev.kind = WatchEvent::Kind::kRemoved;
+        ev.path = name;
+        Emit(ev);
+    }
+
+    // Reads a quiet file; backs it up when complete. Returns false while it is still partial.
+    bool Settle(const fs::path& name, const FileState& state) {
+        const auto bytes = mafia_save::ReadFileBytes(root_ / name);
+        std::string reason;
+        if (bytes.size() != state.size || !IsCompleteSave(name, bytes, &reason)) {
+            auto& p = pending_[name.string()];
+            const auto now = Clock::now();
+            if (!p.partial) {
+                p.partial = true;
+                p.reported = false;
+                p.firstPartial = now;
+            }
+            p.lastChange = now;
+            p.state = state;
+            const auto stuck = std::chrono::duration_cast<std::chrono::milliseconds>(now - p.firstPartial).count();
+            if (!p.reported && stuck >= static_cast<long long>(options_.giveUpMs)) {
+                p.reported = true;
+                WatchEvent ev;
+                ev.kind = WatchEvent::Kind::kPartial;
+                ev.path = name;
+                ev.size = bytes.size();
+                ev.detail = reason.empty() ? "size changed while reading" : reason;
+                Emit(ev);
+                pending_.erase(name.string());  // wait for the next write
+                return true;
+            }
+            return false;
+        }
+
+        known_[name.string()] = state;
+        UpdateIndex(name);
+        WatchEvent ev;
+        ev.path = name;
+        ev.size = bytes.size();
+        ev.hash = save_index::ContentHash(bytes);
+        if (const auto* entry = save_index::FindEntry(index_, name)) {
+            ev.detail = entry->mission;
+        }
+        bool duplicate = false;
+        std::string err;
+        if (!store_.Store(name, bytes, ev.hash, &ev.version, &duplicate, &err)) {
+            ev.kind = WatchEvent::Kind::kPartial;
+            ev.detail = "backup failed: " + err;
+        } else {
+            ev.kind = duplicate ? WatchEvent::Kind::kDuplicate : WatchEvent::Kind::kBackup;
+        }
+        Emit(ev);
+        return true;
+    }
+
+    fs::path root_;
+    const WatchOptions& options_;
+    BackupStore store_;
+    save_index::Index index_;
+    std::unordered_map<std::string, FileState> known_;
+    std::unordered_map<std::string, Pending> pending_;
+};
+
+bool Stopped(const WatchOptions& options) {
+    return options.stop != nullptr && options.stop->load();
+}
+
+void RunPolling(Watcher* watcher, const WatchOptions& options) {
+    auto nextPoll = Clock::now();
+    while (!Stopped(options)) {
+        const auto now = Clock::now();
+        if (now >= nextPoll) {
+            watcher->Poll();
+            nextPoll = now + std::chrono::milliseconds(options.pollMs);
+        }
+        const int dueMs = watcher->Flush();
+        auto wake = nextPoll;
+        if (dueMs >= 0) {
+            wake = std::min(wake, Clock::now() + std::chrono::milliseconds(dueMs));
+        }
+        std::this_thread::sleep_until(std::min(wake, Clock::now() + std::chrono::milliseconds(200)));
+    }
+}
+
+#ifdef SAVE_WATCH_INOTIFY
+bool RunInotify(const fs::path& root, Watcher* watcher, const WatchOptions& options) {
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const std::uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+    // One watch per directory of the tree, by watch descriptor -> root-relative directory.
+    std::unordered_map<int, fs::path> dirs;
+    const auto addWatch = [&](const fs::path& dir) {
+        const int wd = inotify_add_watch(fd, (root / dir).string().c_str(), mask);
+        if (wd >= 0) {
+            dirs[wd] = dir;
+        }
+    };
+    const auto addTree = [&](const fs::path& dir) {
+        addWatch(dir);
+        watcher->Walk(dir, addWatch, nullptr);
+    };
+    const int rootWd = inotify_add_watch(fd, root.string().c_str(), mask);
+    if (rootWd < 0) {
+        close(fd);
+        return false;
+    }
+    dirs[rootWd] = fs::path();
+    watcher->Walk(fs::path(), addWatch, nullptr);
+
+    alignas(inotify_event) char buf[16 * 1024];
+    while (!Stopped(options)) {
+        const int dueMs = watcher->Flush();
+        // Wake at least every 200 ms so the stop flag is honoured.
+        pollfd pfd{fd, POLLIN, 0};
+        const int rc = poll(&pfd, 1, dueMs < 0 ? 200 : std::min(dueMs, 200));
+        if (rc <= 0 || (pfd.revents & POLLIN) == 0) {
+            continue;
+        }
+        for (;;) {
+            const ssize_t len = read(fd, buf, sizeof(buf));
+            if (len <= 0) {
+                break;
+            }
+            for (ssize_t off = 0; off < len;) {
+                const auto* ev = reinterpret_cast<const inotify_event*>(buf + off);
+                off += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+                if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+                    watcher->Poll();  // events were dropped: compare the directory against what we know
+                    continue;
+                }
+                if ((ev->mask & IN_IGNORED) != 0) {
+                    dirs.erase(ev->wd);
+                    continue;
+                }
+                const auto dir = dirs.find(ev->wd);
+                if (ev->len == 0 || dir == dirs.end()) {
+                    continue;
+                }
+                const fs::path name = dir->second / ev->name;
+                if ((ev->mask & IN_ISDIR) != 0) {
+                    // A directory left or entered the tree: move the watches, then let a poll drop or pick
+                    // up the saves inside it (files in a new directory may predate its watch).
+                    if ((ev->mask & (IN_MOVED_FROM | IN_DELETE)) != 0) {
+                        for (auto it = dirs.begin(); it != dirs.end();) {
+                            const fs::path rel = it->second.lexically_relative(name);
+                            if (!rel.empty() && *rel.begin() != "..") {
+                                inotify_rm_watch(fd, it->first);
+                                it = dirs.erase(it);
+                            } else {
+                                ++it;
+                            }
+                        }
+                    } else if (!watcher->Skipped(root / name)) {
+                        addTree(name);
+                    }
+                    watcher->Poll();
+                    continue;
+                }
+                if (IsWatchedName(name)) {
+                    watcher->Touch(name);
+                }
+            }
+        }
+    }
+    close(fd);
+    return true;
+}
+#endif
+
+}  // namespace
+
+bool IsWatchedName(const fs::path& path) {
+    const std::string name = mafia_save::Lower(path.filename().string());
+    if (name.size() >= 4 && name.compare(name.size() - 4, 4, ".sav") == 0) {
+        return true;
+    }
+    return name.rfind("mafia", 0) == 0 && name.size() >= 9 && name[name.size() - 4] == '.' &&
+           name.find('.') == name.size() - 4;
+}
+
+bool IsCompleteSave(const fs::path& path, const std::vector<std::uint8_t>& bytes, std::string* reason) {
+    // One full parse decides it: ParseSave reads every info264-sized payload and the actor chain up to
+    // the last byte, so a save cut short fails with the segment that runs past the end.
+    save_scan::ScanRecord rec;
+    if (save_scan::ScanBytes(path, bytes, false, &rec)) {
+        return true;
+    }
+    if (reason != nullptr) {
+        *reason = rec.kind == save_scan::FileKind::kUnknown ? "unknown file kind" : rec.error;
+    }
+    return false;
+}
+
+BackupStore::BackupStore(fs::path root) : root_(std::move(root)) {}
+
+BackupStore::Latest BackupStore::LatestFor(const std::string& name) {
+    const auto it = latest_.find(name);
+    if (it != latest_.end()) {
+        return it->second;
+    }
+    Latest latest;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(root_ / name, ec)) {
+        std::uint32_t version = 0;
+        std::uint64_t hash = 0;
+        if (ParseBackupName(entry.path().filename().string(), &version, &hash) && version >= latest.version) {
+            latest.version = version;
+            latest.hash = hash;
+        }
+    }
+    latest_[name] = latest;
+    return latest;
+}
+
+bool BackupStore::Store(const fs::path& name,
+                        const std::vector<std::uint8_t>& bytes,
+                        std::uint64_t hash,
+                        std::uint32_t* version,
+                        bool* duplicate,
+                        std::string* error) {
+    const std::string key = name.generic_string();
+    const Latest latest = LatestFor(key);
+    if (latest.version != 0 && latest.hash == hash) {
+        *version = latest.version;
+        *duplicate = true;
+        return true;
+    }
+
+    std::ostringstream file;
+    file << std::setw(6) << std::setfill('0') << (latest.version + 1) << "-" << HashHex(hash)
+         << name.extension().string();
+    if (!mafia_save::WriteFileBytesAtomic(root_ / key / file.str(), bytes, error)) {
+        return false;
+    }
+    latest_[key] = Latest{latest.version + 1, hash};
+    *version = latest.version + 1;
+    *duplicate = false;
+    return true;
+}
+
+const char* BackendName(bool forcePoll) {
+#ifdef SAVE_WATCH_INOTIFY
+    return forcePoll ? "poll" : "inotify";
+#else
+    (void)forcePoll;
+    return "poll";
+#endif
+}
+
+bool Watch(const fs::path& root, const WatchOptions& options, std::string* error) {
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        if (error != nullptr) {
+            *error = "not a directory: " + root.string();
+        }
+        return false;
+    }
+    Watcher watcher(root, options);
+    if (!watcher.Start(error)) {
+        return false;
+    }
+#ifdef SAVE_WATCH_INOTIFY
+    if (!options.forcePoll && RunInotify(root, &watcher, options)) {
+        return true;
+    }
+#endif
+    RunPolling(&watcher, options);
+    return true;
+}
+
+}  // namespace save_watch
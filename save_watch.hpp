@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace save_watch {
+
+namespace fs = std::filesystem;
+
+constexpr const char* kDefaultBackupDirName = ".mafia_backups";
+
+// mafia*.??? mission saves and *.sav profile files (case-insensitive, file name only).
+bool IsWatchedName(const fs::path& path);
+
+// A mission save is complete once it parses and its info264 payload sizes plus the actor
+// chain end exactly at the file length; other files only need to parse as their kind.
+bool IsCompleteSave(const fs::path& path, const std::vector<std::uint8_t>& bytes, std::string* reason = nullptr);
+
+// Versioned copies under <backupRoot>/<name>/<NNNNNN>-<hash>.<ext>, where `name` is the path relative
+// to the watched root; a version is only added when the content hash differs from the newest stored one.
+class BackupStore {
+public:
+    explicit BackupStore(fs::path root);
+
+    const fs::path& root() const { return root_; }
+    bool Store(const fs::path& name,
+               const std::vector<std::uint8_t>& bytes,
+               std::uint64_t hash,
+               std::uint32_t* version,
+               bool* duplicate,
+               std::string* error = nullptr);
+
+private:
+    struct Latest {
+        std::uint32_t version = 0;
+        std::uint64_t hash = 0;
+    };
+    Latest LatestFor(const std::string& name);
+
+    fs::path root_;
+    std::map<std::string, Latest> latest_;  // relative path -> newest stored version
+};
+
+struct WatchEvent {
+    enum class Kind { kBackup, kDuplicate, kPartial, kRemoved };
+    Kind kind = Kind::kBackup;
+    fs::path path;  // relative to the watched root
+    std::uint64_t size = 0;
+    std::uint64_t hash = 0;
+    std::uint32_t version = 0;
+    std::string detail;  // mission name, or why the file is still considered partial
+};
+
+struct WatchOptions {
+    fs::path backupDir;            // empty: <root>/.mafia_backups
+    unsigned settleMs = 300;       // quiet time after the last change before a file is read
+    unsigned pollMs = 1000;        // directory poll interval when inotify is not available
+    unsigned giveUpMs = 30000;     // report a file that stays inconsistent this long, then wait for a new write
+    bool forcePoll = false;
+    bool initialSweep = true;      // back up current versions not yet in the store on start
+    const std::atomic<bool>* stop = nullptr;
+    std::function<void(const WatchEvent&)> onEvent;
+};
+
+const char* BackendName(bool forcePoll);
+
+// Watches the whole tree below `root` (tool entries and the backup store excluded), the same files
+// <root>/.mafia_index covers, and keeps that index up to date. Blocks until *options.stop becomes true.
+bool Watch(const fs::path& root, const WatchOptions& options, std::string* error = nullptr);
+
+}  // namespace save_watch
@@ -0,0 +1,116 @@
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace work_pool {
+
+namespace {
+
+struct Slice {
+    std::mutex mutex;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+bool PopOwn(Slice* slice, std::size_t* index) {
+    std::lock_guard<std::mutex> lock(slice->mutex);
+    if (slice->begin >= slice->end) {
+        return false;
+    }
+    *index = slice->begin++;
+    return true;
+}
+
+// Moves the upper half of the fullest other slice into slices[self].
+bool Steal(std::vector<std::unique_ptr<Slice>>& slices, unsigned self) {
+    std::size_t bestLeft = 0;
+    unsigned victim = self;
+    for (unsigned i = 0; i < slices.size(); ++i) {
+        if (i == self) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(slices[i]->mutex);
+        const std::size_t left = slices[i]->end - slices[i]->begin;
+        if (left > bestLeft) {
+            bestLeft = left;
+            victim = i;
+        }
+    }
+    if (victim == self) {
+        return false;
+    }
+
+    std::size_t from = 0;
+    std::size_t to = 0;
+    {
+        std::lock_guard<std::mutex> lock(slices[victim]->mutex);
+        const std::size_t left = slices[victim]->end - slices[victim]->begin;
+        if (left == 0) {
+            return true;  // drained meanwhile; rescan
+        }
+        to = slices[victim]->end;
+        from = to - (left + 1) / 2;
+        slices[victim]->end = from;
+    }
+    std::lock_guard<std::mutex> lock(slices[self]->mutex);
+    slices[self]->begin = from;
+    slices[self]->end = to;
+    return true;
+}
+
+}  // namespace
+
+unsigned ResolveThreads(unsigned requested, std::size_t items) {
+    const unsigned wanted = requested != 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(wanted, items)));
+}
+
+void ParallelFor(std::size_t count, unsigned threads, const std::function<void(unsigned, std::size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    const unsigned workers = ResolveThreads(threads, count);
+    if (workers == 1) {
+        for (std::size_t i = 0; i < count; ++i) {
+            fn(0, i);
+        }
+        return;
+    }
+
+    std::vector<std::unique_ptr<Slice>> slices;
+    slices.reserve(workers);
+    for (unsigned w = 0; w < workers; ++w) {
+        auto slice = std::make_unique<Slice>();
+        slice->begin = count * w / workers;
+        slice->end = count * (w + 1) / workers;
+        slices.push_back(std::move(slice));
+    }
+
+    auto run = [&](unsigned self) {
+        std::size_t index = 0;
+        for (;;) {
+            while (PopOwn(slices[self].get(), &index)) {
+                fn(self, index);
+            }
+            if (!Steal(slices, self)) {
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; ++w) {
+        pool.emplace_back(run, w);
+    }
+    run(0);
+    for (auto& th : pool) {
+        th.join();
+    }
+}
+
+}  // namespace work_pool
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace work_pool {
+
+// 0 = hardware concurrency, never more workers than items.
+unsigned ResolveThreads(unsigned requested, std::size_t items);
+
+// Calls fn(worker, index) once for every index in [0, count). Each worker starts on its own
+// contiguous slice and, when that runs dry, steals the upper half of the largest remaining slice,
+// so a few slow items (large saves, cold disk reads) do not leave the other workers idle.
+// fn must only write to per-index or per-worker state.
+void ParallelFor(std::size_t count, unsigned threads, const std::function<void(unsigned, std::size_t)>& fn);
+
+}  // namespace work_pool